@@ -0,0 +1,359 @@
+/**
+****************************************************************************************
+*
+* @file bdaddr.c
+*
+* @brief BD addresses taken in order from the range of the station.
+*
+* The address for the next DUT is taken while the current plan still runs
+* its tests (bdaddr_prefetch), so that the write to the state file is not on
+* the way of the OTP write.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <io.h>
+#include <windows.h>
+#include <process.h>
+
+#include "bdaddr.h"
+#include "config.h"
+
+typedef struct {
+	bool      has_next;
+	uint64_t  next;
+	int       spare_count;
+	uint64_t  spares[BDADDR_MAX_SPARES];
+} bdaddr_state_t;
+
+static bool bdaddr_prefetching;
+static HANDLE bdaddr_prefetch_done;
+static int bdaddr_prefetch_status;
+static uint64_t bdaddr_prefetch_value;
+
+static bool bdaddr_parse(const char *text, uint64_t *value)
+{
+	unsigned int b[6];
+	int kk;
+
+	if (text == NULL || strlen(text) != 17
+	    || sscanf(text, "%02X:%02X:%02X:%02X:%02X:%02X", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+		return false;
+
+	for (*value = 0, kk = 0; kk < 6; kk++)
+		*value = (*value << 8) | (b[kk] & 0xFF);
+
+	return true;
+}
+
+static void bdaddr_format(uint64_t v, char *text)
+{
+	sprintf(text, "%02X:%02X:%02X:%02X:%02X:%02X",
+		(unsigned int) (v >> 40) & 0xFF, (unsigned int) (v >> 32) & 0xFF, (unsigned int) (v >> 24) & 0xFF,
+		(unsigned int) (v >> 16) & 0xFF, (unsigned int) (v >> 8) & 0xFF, (unsigned int) v & 0xFF);
+}
+
+static bool bdaddr_state_path(char *path)
+{
+	const char *name = config_get(BDADDR_CONFIG_STATE, NULL);
+
+	if (name == NULL)
+		return config_exe_path(BDADDR_DEFAULT_FILE_NAME, path, MAX_PATH);
+
+	strncpy(path, name, MAX_PATH - 1);
+	path[MAX_PATH - 1] = 0;
+	return true;
+}
+
+// a missing state file is a new range; a line that is not understood is an error
+static bool bdaddr_read_state(const char *path, bdaddr_state_t *state)
+{
+	char line[128], key[16], text[32];
+	uint64_t value;
+	FILE *fp;
+	bool ok = true;
+
+	memset(state, 0, sizeof(bdaddr_state_t));
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return true;
+
+	while (ok && fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0)
+			continue;
+
+		if (sscanf(line, " %15[a-z] = %31s", key, text) != 2 || !bdaddr_parse(text, &value))
+			ok = false;
+		else if (strcmp(key, "next") == 0)
+		{
+			state->next = value;
+			state->has_next = true;
+		}
+		else if (strcmp(key, "spare") == 0 && state->spare_count < BDADDR_MAX_SPARES)
+			state->spares[state->spare_count++] = value;
+		else
+			ok = false;
+	}
+
+	fclose(fp);
+
+	return ok;
+}
+
+static bool bdaddr_write_state(const char *path, const bdaddr_state_t *state)
+{
+	char tmp[MAX_PATH + 4];
+	char text[18];
+	FILE *fp;
+	bool ok;
+	int kk;
+
+	sprintf(tmp, "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (fp == NULL)
+		return false;
+
+	fprintf(fp, "# prodtest BD address range state, see bdaddr.h\n");
+	bdaddr_format(state->next, text);
+	fprintf(fp, "next = %s\n", text);
+	for (kk = 0; kk < state->spare_count; kk++)
+	{
+		bdaddr_format(state->spares[kk], text);
+		fprintf(fp, "spare = %s\n", text);
+	}
+
+	// on disk before it replaces the old state
+	ok = fflush(fp) == 0 && _commit(_fileno(fp)) == 0;
+	if (fclose(fp) != 0 || !ok)
+		return false;
+
+	return MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+static HANDLE bdaddr_lock(void)
+{
+	HANDLE mutex = CreateMutex(NULL, FALSE, BDADDR_MUTEX_NAME);
+
+	if (mutex == NULL)
+		return NULL;
+
+	if (WaitForSingleObject(mutex, BDADDR_LOCK_MILLIS) == WAIT_TIMEOUT)
+	{
+		CloseHandle(mutex);
+		return NULL;
+	}
+
+	return mutex;
+}
+
+static void bdaddr_unlock(HANDLE mutex)
+{
+	ReleaseMutex(mutex);
+	CloseHandle(mutex);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Take an address of the range: a spare one, else the high-water mark, which
+ *        is moved on. The state is on disk when this returns.
+ *
+ * @return BDADDR_...
+ ****************************************************************************************
+*/
+static int bdaddr_take(uint64_t *value)
+{
+	char path[MAX_PATH];
+	bdaddr_state_t state;
+	uint64_t first, last;
+	HANDLE mutex;
+	int status = BDADDR_OK;
+	int kk;
+
+	if (!bdaddr_parse(config_get(BDADDR_CONFIG_FIRST, NULL), &first)
+	    || !bdaddr_parse(config_get(BDADDR_CONFIG_LAST, NULL), &last)
+	    || first > last)
+		return BDADDR_NO_RANGE;
+
+	if (!bdaddr_state_path(path))
+		return BDADDR_STATE_ERROR;
+
+	mutex = bdaddr_lock();
+	if (mutex == NULL)
+		return BDADDR_STATE_ERROR;
+
+	if (!bdaddr_read_state(path, &state))
+	{
+		status = BDADDR_STATE_ERROR;
+		goto exit_take;
+	}
+
+	// a range moved on to new addresses starts at its first one
+	if (!state.has_next || state.next < first)
+	{
+		state.next = first;
+		state.has_next = true;
+	}
+
+	for (kk = 0; kk < state.spare_count; kk++)
+		if (state.spares[kk] >= first && state.spares[kk] <= last)
+			break;
+
+	if (kk < state.spare_count)
+	{
+		*value = state.spares[kk];
+		state.spares[kk] = state.spares[--state.spare_count];
+	}
+	else if (state.next > last)
+	{
+		status = BDADDR_EXHAUSTED;
+		goto exit_take;
+	}
+	else
+		*value = state.next++;
+
+	if (!bdaddr_write_state(path, &state))
+		status = BDADDR_STATE_ERROR;
+
+exit_take:
+	bdaddr_unlock(mutex);
+
+	return status;
+}
+
+static void bdaddr_prefetcher(PVOID unused)
+{
+	bdaddr_prefetch_status = bdaddr_take(&bdaddr_prefetch_value);
+	SetEvent(bdaddr_prefetch_done);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Start taking the next address in the background; bdaddr_next() waits for it.
+ ****************************************************************************************
+*/
+void bdaddr_prefetch(void)
+{
+	if (bdaddr_prefetching)
+		return;
+
+	if (bdaddr_prefetch_done == NULL)
+	{
+		bdaddr_prefetch_done = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if (bdaddr_prefetch_done == NULL)
+			return;
+	}
+
+	ResetEvent(bdaddr_prefetch_done);
+	bdaddr_prefetching = true;
+
+	_beginthread(bdaddr_prefetcher, 10000, NULL);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Take the address for the DUT.
+ *
+ * @param[out] bd_addr  The address, least significant byte first as in the HCI commands.
+ *
+ * @return BDADDR_...
+ ****************************************************************************************
+*/
+int bdaddr_next(uint8_t bd_addr[6])
+{
+	uint64_t value = 0;
+	int status;
+	int kk;
+
+	if (bdaddr_prefetching)
+	{
+		WaitForSingleObject(bdaddr_prefetch_done, INFINITE);
+		bdaddr_prefetching = false;
+		status = bdaddr_prefetch_status;
+		value = bdaddr_prefetch_value;
+	}
+	else
+		status = bdaddr_take(&value);
+
+	if (status != BDADDR_OK)
+		return status;
+
+	for (kk = 0; kk < 6; kk++)
+		bd_addr[kk] = (uint8_t) (value >> (8 * kk));
+
+	return BDADDR_OK;
+}
+
+static void bdaddr_give_back(uint64_t value)
+{
+	char path[MAX_PATH];
+	bdaddr_state_t state;
+	HANDLE mutex;
+	int kk;
+
+	if (!bdaddr_state_path(path))
+		return;
+
+	mutex = bdaddr_lock();
+	if (mutex == NULL)
+		return;
+
+	if (bdaddr_read_state(path, &state) && state.has_next && state.spare_count < BDADDR_MAX_SPARES)
+	{
+		for (kk = 0; kk < state.spare_count; kk++)
+			if (state.spares[kk] == value)
+				break;
+
+		if (kk == state.spare_count && value < state.next)
+		{
+			state.spares[state.spare_count++] = value;
+			bdaddr_write_state(path, &state);
+		}
+	}
+
+	bdaddr_unlock(mutex);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Hand an address back to the range, for an address that surely was not written.
+ ****************************************************************************************
+*/
+void bdaddr_release(const uint8_t bd_addr[6])
+{
+	uint64_t value = 0;
+	int kk;
+
+	for (kk = 5; kk >= 0; kk--)
+		value = (value << 8) | bd_addr[kk];
+
+	bdaddr_give_back(value);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Hand back an address taken in the background but not used, e.g. when a plan
+ *        failed before its OTP write.
+ ****************************************************************************************
+*/
+void bdaddr_close(void)
+{
+	if (!bdaddr_prefetching)
+		return;
+
+	WaitForSingleObject(bdaddr_prefetch_done, INFINITE);
+	bdaddr_prefetching = false;
+
+	if (bdaddr_prefetch_status == BDADDR_OK)
+		bdaddr_give_back(bdaddr_prefetch_value);
+}
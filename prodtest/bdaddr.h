@@ -0,0 +1,63 @@
+/**
+****************************************************************************************
+*
+* @file bdaddr.h
+*
+* @brief BD addresses taken in order from the range of the station (otp wr_bdaddr auto).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _BDADDR_H_
+#define _BDADDR_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+
+/*
+ * The range is set in the configuration, e.g. for the OUI 80:EA:CA:
+ *
+ *   bdaddr.first = 80:EA:CA:00:00:00
+ *   bdaddr.last  = 80:EA:CA:00:FF:FF
+ *
+ * The state file holds the high-water mark, the next address never handed out,
+ * and the addresses handed back because they surely did not reach a DUT:
+ *
+ *   next  = 80:EA:CA:00:01:2C
+ *   spare = 80:EA:CA:00:01:27
+ *
+ * An address is taken by writing the state without it, through a temporary
+ * file that replaces the old one, before the address is sent to the DUT. A
+ * crash at any point loses at most an address; it never gives one twice.
+ */
+#define BDADDR_CONFIG_FIRST     "bdaddr.first"
+#define BDADDR_CONFIG_LAST      "bdaddr.last"
+#define BDADDR_CONFIG_STATE     "bdaddr.state"
+
+/* next to prodtest.exe when bdaddr.state is not set */
+#define BDADDR_DEFAULT_FILE_NAME  "prodtest.bda"
+#define BDADDR_MUTEX_NAME         "prodtest_bdaddr_state"
+#define BDADDR_LOCK_MILLIS        5000
+
+#define BDADDR_MAX_SPARES         64
+
+/* bdaddr_next() */
+#define BDADDR_OK          0
+#define BDADDR_NO_RANGE    1    // bdaddr.first / bdaddr.last missing or invalid
+#define BDADDR_EXHAUSTED   2    // no address left in the range
+#define BDADDR_STATE_ERROR 3    // the state file cannot be read, written or locked
+
+void bdaddr_prefetch(void);
+int  bdaddr_next(uint8_t bd_addr[6]);
+void bdaddr_release(const uint8_t bd_addr[6]);
+void bdaddr_close(void);
+
+#endif /* _BDADDR_H_ */
@@ -0,0 +1,169 @@
+/**
+****************************************************************************************
+*
+* @file framer_bench.c
+*
+* @brief Throughput microbenchmark of the UART framing parser.
+*
+* Standalone program, not part of the prodtest project. Build with e.g.
+*
+*   cl /O2 framer_bench.c ..\hci_framer.c ..\hci_scan.c
+*   gcc -O2 -o framer_bench framer_bench.c ../hci_framer.c ../hci_scan.c
+*
+* and run without arguments. Every stream is pushed in 512 byte chunks, like the
+* reception thread does, once per scan implementation the CPU supports.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../hci_framer.h"
+#include "../hci_scan.h"
+
+#define STREAM_SIZE   (4 * 1024 * 1024)
+#define CHUNK_SIZE    512
+#define MIN_SECONDS   0.5
+
+static uint32_t rnd_state = 12345;
+
+static uint32_t rnd(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 16;
+}
+
+// a Command Complete event with a 3..60 byte payload
+static unsigned int put_event(uint8_t *p)
+{
+	unsigned int len = 3 + rnd() % 58;
+	unsigned int kk;
+
+	p[0] = 0x04;
+	p[1] = 0x0E;
+	p[2] = (uint8_t) len;
+	for (kk = 0; kk < len; kk++)
+		p[3 + kk] = (uint8_t) rnd();
+
+	return 3 + len;
+}
+
+// boot ROM / console chatter: printable ASCII with an event every 4 KB
+static void make_garbage(uint8_t *buf, unsigned int size)
+{
+	unsigned int pos = 0;
+
+	while (pos + 64 < size)
+	{
+		if (pos % 4096 < 64)
+			pos += put_event(&buf[pos]);
+		else
+			buf[pos++] = (uint8_t) (0x20 + rnd() % 0x5F);
+	}
+	while (pos < size)
+		buf[pos++] = ' ';
+}
+
+// line noise: uniformly random bytes
+static void make_noise(uint8_t *buf, unsigned int size)
+{
+	unsigned int pos;
+
+	for (pos = 0; pos < size; pos++)
+		buf[pos] = (uint8_t) rnd();
+}
+
+// back-to-back events
+static void make_events(uint8_t *buf, unsigned int size)
+{
+	unsigned int pos = 0;
+
+	while (pos + 64 < size)
+		pos += put_event(&buf[pos]);
+	while (pos < size)
+		buf[pos++] = ' ';
+}
+
+static double run(const uint8_t *buf, unsigned int size, uint32_t *frames)
+{
+	static hci_framer_t f;
+	hci_frame_t frame;
+	const uint8_t *data;
+	unsigned int pos, chunk, len, used;
+	unsigned long rounds = 0;
+	clock_t start = clock();
+	double seconds;
+
+	hci_framer_init(&f, HCI_FRAMER_INTER_BYTE_TIMEOUT_MILLIS);
+
+	do
+	{
+		for (pos = 0; pos < size; pos += chunk)
+		{
+			chunk = size - pos < CHUNK_SIZE ? size - pos : CHUNK_SIZE;
+			data = &buf[pos];
+			len = chunk;
+			for (;;)
+			{
+				used = hci_framer_push(&f, data, len, 0);
+				data += used;
+				len -= used;
+				if (!hci_framer_pull(&f, &frame))
+					break;
+			}
+		}
+		rounds++;
+		seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+	} while (seconds < MIN_SECONDS);
+
+	*frames = (f.stats.frames_hci + f.stats.frames_fe) / rounds;
+
+	return (double) size * rounds / (1024.0 * 1024.0) / seconds;
+}
+
+int main(void)
+{
+	static const struct {
+		const char *name;
+		void (*make)(uint8_t *, unsigned int);
+	} streams[] = {
+		{ "garbage", make_garbage },
+		{ "noise",   make_noise   },
+		{ "events",  make_events  },
+	};
+	int impls[] = { HCI_SCAN_SCALAR, HCI_SCAN_SSE2, HCI_SCAN_AVX2 };
+	uint8_t *buf = (uint8_t *) malloc(STREAM_SIZE);
+	uint32_t frames;
+	int ss, ii, impl;
+
+	printf("%-8s %-7s %10s %9s\n", "stream", "scan", "MB/s", "frames");
+
+	for (ss = 0; ss < 3; ss++)
+	{
+		streams[ss].make(buf, STREAM_SIZE);
+
+		for (ii = 0; ii < 3; ii++)
+		{
+			impl = hci_scan_select(impls[ii]);
+			if (impl != impls[ii])
+				continue; // not supported by this CPU
+
+			printf("%-8s %-7s %10.1f", streams[ss].name, hci_scan_name(impl), run(buf, STREAM_SIZE, &frames));
+			printf(" %9u\n", frames);
+		}
+	}
+
+	free(buf);
+
+	return 0;
+}
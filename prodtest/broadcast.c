@@ -0,0 +1,115 @@
+/**
+****************************************************************************************
+*
+* @file broadcast.c
+*
+* @brief One HCI command sent to all DUTs of -p at the same moment.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <process.h>
+#include <windows.h>
+
+#include "broadcast.h"
+#include "commands.h"
+#include "latency.h"
+
+static LARGE_INTEGER broadcast_freq;
+
+static double broadcast_us(const LARGE_INTEGER *release)
+{
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+
+	return (double) (now.QuadPart - release->QuadPart) * 1000000.0 / (double) broadcast_freq.QuadPart;
+}
+
+static void broadcast_proc(PVOID arg)
+{
+	broadcast_slot_t *slot = (broadcast_slot_t *) arg;
+	uint8_t evt[RX_ALL_MAX_EVT_SIZE];
+
+	// the wake-up at the release is what the ports differ in
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+	SetEvent(slot->armed);
+	WaitForSingleObject(slot->go, INFINITE);
+
+	rx_all_link_write(&slot->link, slot->packet, slot->size);
+	slot->written_us = broadcast_us(slot->release);
+
+	if (!rx_all_link_wait(&slot->link, 0x0E, slot->opcode, evt,
+			latency_timeout(LATENCY_KEY(slot->opcode, 0), RX_TIMEOUT_MILLIS)))
+		slot->status = SC_RX_TIMEOUT;
+	else
+		slot->replied_us = broadcast_us(slot->release);
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+	SetEvent(slot->done);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Send the encoded command of each slot at the same moment, and wait until all
+ *        have their Command Complete or have timed out.
+ *
+ *  @param[in,out] slots  One per DUT; link, com, packet, size and opcode must be set.
+ *  @param[in]     count  Number of slots.
+ ****************************************************************************************
+*/
+void broadcast_run(broadcast_slot_t *slots, int count)
+{
+	HANDLE armed[UART_MAX_PORTS];
+	HANDLE done[UART_MAX_PORTS];
+	HANDLE go = CreateEvent(NULL, TRUE, FALSE, NULL);
+	LARGE_INTEGER release;
+	int kk;
+
+	QueryPerformanceFrequency(&broadcast_freq);
+
+	for (kk = 0; kk < count; kk++)
+	{
+		slots[kk].status = 0;
+		slots[kk].written_us = 0;
+		slots[kk].replied_us = 0;
+		slots[kk].go = go;
+		slots[kk].release = &release;
+		slots[kk].armed = armed[kk] = CreateEvent(NULL, TRUE, FALSE, NULL);
+		slots[kk].done = done[kk] = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		// a slot without its thread is armed and done as it is
+		if (_beginthread(broadcast_proc, 10000, &slots[kk]) == (uintptr_t) -1)
+		{
+			slots[kk].status = SC_OUT_OF_MEMORY;
+			SetEvent(slots[kk].armed);
+			SetEvent(slots[kk].done);
+		}
+	}
+
+	WaitForMultipleObjects(count, armed, TRUE, INFINITE);
+
+	// give the armed threads a moment to block at the barrier
+	Sleep(1);
+
+	QueryPerformanceCounter(&release);
+	SetEvent(go);
+
+	WaitForMultipleObjects(count, done, TRUE, INFINITE);
+
+	CloseHandle(go);
+	for (kk = 0; kk < count; kk++)
+	{
+		CloseHandle(armed[kk]);
+		CloseHandle(done[kk]);
+	}
+}
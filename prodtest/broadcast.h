@@ -0,0 +1,53 @@
+/**
+****************************************************************************************
+*
+* @file broadcast.h
+*
+* @brief One HCI command sent to all DUTs of -p at the same moment (broadcast).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _BROADCAST_H_
+#define _BROADCAST_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "stdbool.h"
+#include "rx_all.h"
+
+/*
+ * The command is encoded for every port beforehand; one thread per port, at
+ * time critical priority, waits at a barrier and writes it as soon as the
+ * barrier is released. The time from the release until each write has
+ * completed, and until each Command Complete is in, is measured with the
+ * performance counter; their spread over the ports is the start skew.
+ */
+
+/* one DUT */
+typedef struct {
+	rx_all_link_t link;
+	int      com;                          // COM port number, for the report
+	uint8_t  packet[RX_ALL_MAX_CMD_SIZE];  // the command, encoded
+	unsigned int size;
+	uint16_t opcode;
+	int      status;                       // SC_...
+	double   written_us;                   // from the release until the write has completed
+	double   replied_us;                   // from the release until the Command Complete was in
+	HANDLE   armed;                        // set when waiting at the barrier
+	HANDLE   done;
+	HANDLE   go;                           // the barrier, shared by all slots
+	const LARGE_INTEGER *release;          // performance counter at the release
+} broadcast_slot_t;
+
+void broadcast_run(broadcast_slot_t *slots, int count);
+
+#endif /* _BROADCAST_H_ */
@@ -0,0 +1,448 @@
+/**
+****************************************************************************************
+*
+* @file bulk.c
+*
+* @brief Windowed bulk transfer of OTP / RAM / flash contents over FE messages.
+*
+* The data is cut in blocks of up to BULK_MAX_BLOCK_SIZE bytes, each carried by
+* one BULK_DATA message with a sequence number and a CRC-16. The sender keeps up
+* to a window of blocks in flight; the receiver acknowledges cumulatively every
+* half window and asks for everything from the first missing block again (go
+* back N) when a block is lost or corrupted, or when nothing arrives in time.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "bulk.h"
+#include "fe_msg.h"
+
+#define BULK_GET16(p) ((uint16_t) ((p)[0] | ((p)[1] << 8)))
+
+/*
+ ****************************************************************************************
+ * @brief CRC-16/CCITT (polynomial 0x1021), bitwise; blocks are short enough.
+ *
+ *  @param[in] crc   Initial value, 0xFFFF for a new block.
+ *  @param[in] data  Bytes.
+ *  @param[in] len   Number of bytes.
+ *
+ * @return the updated crc.
+ ****************************************************************************************
+*/
+uint16_t bulk_crc16(uint16_t crc, const uint8_t *data, unsigned int len)
+{
+	unsigned int kk;
+	int bit;
+
+	for (kk = 0; kk < len; kk++)
+	{
+		crc ^= (uint16_t) data[kk] << 8;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+	}
+
+	return crc;
+}
+
+static uint16_t bulk_msg_crc(uint16_t type, const uint8_t *param, uint16_t len)
+{
+	uint8_t t[2];
+
+	t[0] = type & 0xFF;
+	t[1] = type >> 8;
+
+	return bulk_crc16(bulk_crc16(0xFFFF, t, 2), param, len);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Append the crc to a message.
+ *
+ *  @param[in]     type   Message type.
+ *  @param[in,out] param  len parameter bytes, followed by room for BULK_CRC_SIZE more.
+ *  @param[in]     len    Number of parameter bytes.
+ ****************************************************************************************
+*/
+void bulk_msg_seal(uint16_t type, uint8_t *param, uint16_t len)
+{
+	uint16_t crc = bulk_msg_crc(type, param, len);
+
+	param[len] = crc & 0xFF;
+	param[len + 1] = crc >> 8;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Check the crc of a received message.
+ *
+ *  @param[in] type   Message type.
+ *  @param[in] param  Parameters.
+ *  @param[in] len    Number of parameter bytes, crc included.
+ *
+ * @return true if the crc matches.
+ ****************************************************************************************
+*/
+bool bulk_msg_valid(uint16_t type, const uint8_t *param, uint16_t len)
+{
+	if (len < BULK_CRC_SIZE)
+		return false;
+
+	return bulk_msg_crc(type, param, len - BULK_CRC_SIZE) == BULK_GET16(&param[len - BULK_CRC_SIZE]);
+}
+
+static void bulk_send_start(uint8_t op, uint8_t target, uint32_t address, uint32_t size)
+{
+	uint8_t p[BULK_START_REQ_LEN + BULK_CRC_SIZE];
+
+	p[0] = op;
+	p[1] = target;
+	p[2] = address       & 0xFF; // LSB first
+	p[3] = address >> 8  & 0xFF;
+	p[4] = address >> 16 & 0xFF;
+	p[5] = address >> 24 & 0xFF;
+	p[6] = size       & 0xFF;
+	p[7] = size >> 8  & 0xFF;
+	p[8] = size >> 16 & 0xFF;
+	p[9] = size >> 24 & 0xFF;
+	p[10] = BULK_DEFAULT_BLOCK_SIZE & 0xFF;
+	p[11] = BULK_DEFAULT_BLOCK_SIZE >> 8;
+	p[12] = BULK_DEFAULT_WINDOW;
+	bulk_msg_seal(BULK_START_REQ, p, BULK_START_REQ_LEN);
+
+	fe_send(BULK_START_REQ, BULK_DUT_TASK, BULK_HOST_TASK, sizeof(p), p);
+}
+
+static void bulk_send_ack(uint16_t next_seq, uint8_t status)
+{
+	uint8_t p[BULK_ACK_LEN + BULK_CRC_SIZE];
+
+	p[0] = next_seq & 0xFF;
+	p[1] = next_seq >> 8;
+	p[2] = status;
+	bulk_msg_seal(BULK_ACK, p, BULK_ACK_LEN);
+
+	fe_send(BULK_ACK, BULK_DUT_TASK, BULK_HOST_TASK, sizeof(p), p);
+}
+
+static void bulk_send_data(uint16_t seq, const uint8_t *data, uint16_t len)
+{
+	uint8_t p[MAX_PACKET_LENGTH];
+
+	p[0] = seq & 0xFF;
+	p[1] = seq >> 8;
+	memcpy(&p[2], data, len);
+	bulk_msg_seal(BULK_DATA, p, 2 + len);
+
+	fe_send(BULK_DATA, BULK_DUT_TASK, BULK_HOST_TASK, len + BULK_DATA_OVERHEAD, p);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Open the channel and agree on block size and window with the DUT.
+ *
+ * @return BULK_NO_ERROR, or the error to return to the caller.
+ ****************************************************************************************
+*/
+static int bulk_start(fe_channel_t *ch, uint8_t op, uint8_t target, uint32_t address, uint32_t size,
+                      bulk_stats_t *stats, uint32_t *block_count)
+{
+	fe_msg_t *msg;
+	int retries;
+
+	if (size == 0 || (size + BULK_DEFAULT_BLOCK_SIZE - 1) / BULK_DEFAULT_BLOCK_SIZE > BULK_MAX_BLOCKS)
+		return BULK_ERR_ARGUMENT;
+
+	for (retries = 0; retries < 3; retries++)
+	{
+		bulk_send_start(op, target, address, size);
+
+		while ((msg = fe_recv_wait(ch, BULK_START_TIMEOUT_MILLIS)) != NULL)
+		{
+			if (msg->type == BULK_START_RSP
+				&& msg->length == BULK_START_RSP_LEN + BULK_CRC_SIZE
+				&& bulk_msg_valid(msg->type, msg->param, msg->length))
+				break;
+			free(msg); // left over from an earlier transfer
+		}
+
+		if (msg != NULL)
+			break;
+
+		stats->timeouts++;
+	}
+
+	if (msg == NULL)
+		return BULK_ERR_TIMEOUT;
+
+	stats->dut_status = msg->param[0];
+	stats->block_size = BULK_GET16(&msg->param[1]);
+	stats->window = msg->param[3];
+	free(msg);
+
+	if (stats->dut_status != BULK_ACK_OK)
+		return BULK_ERR_REJECTED;
+
+	// never trust the DUT to stay within what we proposed
+	if (stats->block_size == 0 || stats->block_size > BULK_DEFAULT_BLOCK_SIZE)
+		stats->block_size = BULK_DEFAULT_BLOCK_SIZE;
+	if (stats->window == 0 || stats->window > BULK_DEFAULT_WINDOW)
+		stats->window = BULK_DEFAULT_WINDOW;
+
+	// a smaller block size than proposed may not fit the 16 bit sequence numbers
+	*block_count = (size + stats->block_size - 1) / stats->block_size;
+	if (*block_count > BULK_MAX_BLOCKS)
+		return BULK_ERR_ARGUMENT;
+
+	return BULK_NO_ERROR;
+}
+
+static uint16_t bulk_block_len(uint32_t seq, uint32_t size, uint16_t block_size)
+{
+	uint32_t offset = seq * block_size;
+
+	return (uint16_t) (size - offset < block_size ? size - offset : block_size);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read a memory range of the DUT.
+ *
+ *  @param[in]  target   BULK_TARGET_xxx.
+ *  @param[in]  address  Start address in the target.
+ *  @param[out] buf      Receives size bytes.
+ *  @param[in]  size     Number of bytes.
+ *  @param[out] stats    Transfer statistics.
+ *
+ * @return BULK_NO_ERROR or BULK_ERR_xxx.
+ ****************************************************************************************
+*/
+int bulk_read(uint8_t target, uint32_t address, uint8_t *buf, uint32_t size, bulk_stats_t *stats)
+{
+	fe_channel_t *ch;
+	fe_msg_t *msg = NULL;
+	uint32_t block_count = 0;
+	uint32_t expected = 0;
+	uint32_t since_ack = 0;
+	uint32_t seq;
+	uint16_t len;
+	bool valid;
+	bool resend_requested = false;
+	uint32_t resend_mark = 0;
+	int retries = 0;
+	int rc;
+	DWORD start = GetTickCount();
+
+	memset(stats, 0, sizeof(bulk_stats_t));
+
+	ch = fe_subscribe(FE_MSG_ANY, BULK_DUT_TASK);
+	if (ch == NULL)
+		return BULK_ERR_CHANNEL;
+
+	rc = bulk_start(ch, BULK_OP_READ, target, address, size, stats, &block_count);
+	if (rc != BULK_NO_ERROR)
+		goto exit_bulk;
+
+	while (expected < block_count)
+	{
+		msg = fe_recv_wait(ch, BULK_BLOCK_TIMEOUT_MILLIS);
+		if (msg == NULL)
+		{
+			stats->timeouts++;
+			if (++retries > BULK_MAX_RETRIES)
+			{
+				rc = BULK_ERR_TIMEOUT;
+				goto exit_bulk;
+			}
+			bulk_send_ack((uint16_t) expected, BULK_ACK_RESEND);
+			stats->retransmits++;
+			continue;
+		}
+
+		valid = bulk_msg_valid(msg->type, msg->param, msg->length);
+
+		if (valid
+			&& msg->type == BULK_ACK
+			&& msg->length == BULK_ACK_LEN + BULK_CRC_SIZE
+			&& msg->param[2] >= BULK_ACK_BAD_TARGET)
+		{
+			stats->dut_status = msg->param[2];
+			rc = BULK_ERR_REJECTED;
+			goto exit_bulk;
+		}
+
+		if (valid && msg->type != BULK_DATA)
+		{
+			free(msg);
+			msg = NULL;
+			continue;
+		}
+
+		seq = BULK_MAX_BLOCKS;
+		if (valid && msg->length >= BULK_DATA_OVERHEAD)
+		{
+			seq = BULK_GET16(msg->param);
+			if (seq >= block_count || msg->length != bulk_block_len(seq, size, stats->block_size) + BULK_DATA_OVERHEAD)
+				seq = BULK_MAX_BLOCKS;
+		}
+
+		if (seq == BULK_MAX_BLOCKS)
+		{
+			// a corrupted block counts as lost: the next one shows the gap
+			stats->crc_errors++;
+		}
+		else if (seq == expected)
+		{
+			len = msg->length - BULK_DATA_OVERHEAD;
+			memcpy(&buf[expected * stats->block_size], &msg->param[2], len);
+			expected++;
+			stats->blocks++;
+			stats->bytes += len;
+			retries = 0;
+			resend_requested = false;
+
+			if (++since_ack >= (uint32_t) (stats->window + 1) / 2 || expected == block_count)
+			{
+				bulk_send_ack((uint16_t) expected, BULK_ACK_OK);
+				since_ack = 0;
+			}
+		}
+		else if (seq > expected && (!resend_requested || seq <= resend_mark))
+		{
+			// a gap. The blocks still in flight behind it carry higher seqs and are
+			// dropped silently; a seq at or below the one that triggered the last
+			// request can only come from the resent round, which then has a gap too
+			bulk_send_ack((uint16_t) expected, BULK_ACK_RESEND);
+			stats->retransmits++;
+			resend_requested = true;
+			resend_mark = seq;
+		}
+
+		free(msg);
+		msg = NULL;
+	}
+
+exit_bulk:
+	if (msg)
+		free(msg);
+
+	fe_unsubscribe(ch);
+
+	stats->millis = GetTickCount() - start;
+
+	return rc;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Write a memory range of the DUT.
+ *
+ *  Returns after the DUT has acknowledged the last block, i.e. after it has
+ *  programmed all of them.
+ *
+ *  @param[in]  target   BULK_TARGET_xxx.
+ *  @param[in]  address  Start address in the target.
+ *  @param[in]  buf      size bytes to write.
+ *  @param[in]  size     Number of bytes.
+ *  @param[out] stats    Transfer statistics.
+ *
+ * @return BULK_NO_ERROR or BULK_ERR_xxx.
+ ****************************************************************************************
+*/
+int bulk_write(uint8_t target, uint32_t address, const uint8_t *buf, uint32_t size, bulk_stats_t *stats)
+{
+	fe_channel_t *ch;
+	fe_msg_t *msg;
+	uint32_t block_count = 0;
+	uint32_t base = 0;        // first block not acknowledged yet
+	uint32_t next = 0;        // next block to send
+	uint32_t acked;
+	int retries = 0;
+	int rc;
+	DWORD start = GetTickCount();
+
+	memset(stats, 0, sizeof(bulk_stats_t));
+
+	ch = fe_subscribe(FE_MSG_ANY, BULK_DUT_TASK);
+	if (ch == NULL)
+		return BULK_ERR_CHANNEL;
+
+	rc = bulk_start(ch, BULK_OP_WRITE, target, address, size, stats, &block_count);
+	if (rc != BULK_NO_ERROR)
+		goto exit_bulk;
+
+	while (base < block_count)
+	{
+		for (; next < block_count && next < base + stats->window; next++)
+		{
+			bulk_send_data((uint16_t) next, &buf[next * stats->block_size],
+			               bulk_block_len(next, size, stats->block_size));
+		}
+
+		msg = fe_recv_wait(ch, BULK_BLOCK_TIMEOUT_MILLIS);
+		if (msg == NULL)
+		{
+			stats->timeouts++;
+			if (++retries > BULK_MAX_RETRIES)
+			{
+				rc = BULK_ERR_TIMEOUT;
+				goto exit_bulk;
+			}
+			// go back to the first unacknowledged block
+			stats->retransmits += next - base;
+			next = base;
+			continue;
+		}
+
+		if (msg->type == BULK_ACK
+			&& msg->length == BULK_ACK_LEN + BULK_CRC_SIZE
+			&& bulk_msg_valid(msg->type, msg->param, msg->length))
+		{
+			acked = BULK_GET16(msg->param);
+
+			if (msg->param[2] >= BULK_ACK_BAD_TARGET)
+			{
+				stats->dut_status = msg->param[2];
+				free(msg);
+				rc = BULK_ERR_REJECTED;
+				goto exit_bulk;
+			}
+
+			if (acked > base && acked <= block_count)
+			{
+				stats->blocks += acked - base;
+				base = acked;
+				retries = 0;
+			}
+
+			if (msg->param[2] == BULK_ACK_RESEND && acked == base && next > base)
+			{
+				stats->retransmits += next - base;
+				stats->crc_errors++;
+				next = base;
+			}
+		}
+
+		free(msg);
+	}
+
+	stats->bytes = size;
+
+exit_bulk:
+	fe_unsubscribe(ch);
+
+	stats->millis = GetTickCount() - start;
+
+	return rc;
+}
@@ -0,0 +1,102 @@
+/**
+****************************************************************************************
+*
+* @file bulk.h
+*
+* @brief Windowed bulk transfer of OTP / RAM / flash contents over FE messages.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _BULK_H_
+#define _BULK_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+#include "hci_framer.h"
+
+/* task ids of both ends, the message ids follow the KE_FIRST_MSG(task) scheme */
+#define BULK_HOST_TASK 0x3E
+#define BULK_DUT_TASK  0x3F
+
+#define BULK_MSG_BASE  (BULK_DUT_TASK << 10)
+
+#define BULK_START_REQ (BULK_MSG_BASE + 0) // op, target, address(4), size(4), block size(2), window
+#define BULK_START_RSP (BULK_MSG_BASE + 1) // status, block size(2), window
+#define BULK_DATA      (BULK_MSG_BASE + 2) // seq(2), data
+#define BULK_ACK       (BULK_MSG_BASE + 3) // next expected seq(2), ack status
+
+/* every message ends with a CRC-16 over its type and parameters, so that a
+   corrupted message is dropped rather than taken for another one */
+#define BULK_CRC_SIZE 2
+
+/* parameter lengths, crc not included */
+#define BULK_START_REQ_LEN 13
+#define BULK_START_RSP_LEN 4
+#define BULK_ACK_LEN       3
+#define BULK_DATA_OVERHEAD (2 + BULK_CRC_SIZE)
+
+/* operations */
+#define BULK_OP_READ  0
+#define BULK_OP_WRITE 1
+
+/* memories */
+#define BULK_TARGET_OTP   0
+#define BULK_TARGET_RAM   1
+#define BULK_TARGET_FLASH 2
+
+/* ack status: below 0x80 the transfer goes on, from 0x80 it is aborted */
+#define BULK_ACK_OK                0x00
+#define BULK_ACK_RESEND            0x01 // go back to the acknowledged seq
+#define BULK_ACK_BAD_TARGET        0x80
+#define BULK_ACK_BAD_RANGE         0x81
+#define BULK_ACK_WRITE_FAILED      0x82
+#define BULK_ACK_BUSY              0x83
+
+/* defaults proposed by the host, the DUT may lower them in BULK_START_RSP */
+#define BULK_DEFAULT_BLOCK_SIZE 256
+#define BULK_DEFAULT_WINDOW     8
+
+#define BULK_MAX_BLOCK_SIZE (MAX_PACKET_LENGTH - BULK_DATA_OVERHEAD)
+#define BULK_MAX_BLOCKS     0xFFFF
+
+/* no progress for this long makes the receiver ask for a resend */
+#define BULK_BLOCK_TIMEOUT_MILLIS 500
+#define BULK_START_TIMEOUT_MILLIS 1000
+#define BULK_MAX_RETRIES          10
+
+/* bulk_read() / bulk_write() results */
+#define BULK_NO_ERROR     0
+#define BULK_ERR_TIMEOUT  1 // no progress after BULK_MAX_RETRIES
+#define BULK_ERR_REJECTED 2 // the DUT aborted, see bulk_stats_t.dut_status
+#define BULK_ERR_CHANNEL  3 // no FE channel available
+#define BULK_ERR_ARGUMENT 4 // size is 0 or needs more than BULK_MAX_BLOCKS blocks of the agreed size
+
+typedef struct {
+	uint32_t bytes;
+	uint32_t blocks;
+	uint32_t retransmits;     // blocks sent again (write) / resend requests (read)
+	uint32_t crc_errors;      // blocks dropped for a bad crc or length
+	uint32_t timeouts;
+	uint8_t  dut_status;      // ack status of an aborted transfer
+	uint16_t block_size;      // as agreed with the DUT
+	uint8_t  window;
+	uint32_t millis;
+} bulk_stats_t;
+
+uint16_t bulk_crc16(uint16_t crc, const uint8_t *data, unsigned int len);
+void bulk_msg_seal(uint16_t type, uint8_t *param, uint16_t len);
+bool bulk_msg_valid(uint16_t type, const uint8_t *param, uint16_t len);
+
+int bulk_read(uint8_t target, uint32_t address, uint8_t *buf, uint32_t size, bulk_stats_t *stats);
+int bulk_write(uint8_t target, uint32_t address, const uint8_t *buf, uint32_t size, bulk_stats_t *stats);
+
+#endif /* _BULK_H_ */
@@ -0,0 +1,241 @@
+/**
+****************************************************************************************
+*
+* @file capture.c
+*
+* @brief Capture of the UART traffic into a btsnoop file (Wireshark, Frontline).
+*
+* The capture is an evt_buf tap: it takes a reference to every frame and hands
+* it to a writer thread, so the reception thread never waits for the disk.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+#include <process.h>
+
+#include "capture.h"
+#include "evt_buf.h"
+
+/* microseconds from 0 AD to 1970 (btsnoop) and 1601 to 1970 (FILETIME) */
+#define BTSNOOP_EPOCH_DELTA_US   0x00dcddb30f2f8000ULL
+#define FILETIME_EPOCH_DELTA_US  11644473600000000ULL
+
+/* btsnoop record flags */
+#define BTSNOOP_FLAG_RECEIVED    0x01
+#define BTSNOOP_FLAG_CMD_EVT     0x02
+
+static FILE *capture_file;
+
+static CRITICAL_SECTION capture_lock;
+static HANDLE capture_has_data;   // auto reset
+static HANDLE capture_done;       // set when the writer thread exits
+static volatile BOOL capture_stop;
+static bool capture_active = false;
+static bool capture_lock_initialized = false; // kept: a late tap call may still take it
+
+static evt_buf_t *capture_queue[CAPTURE_QUEUE_SIZE];
+static unsigned int capture_head, capture_tail;
+static uint32_t capture_drops;
+
+// time base: the QPC stamp of a buffer is converted to wall clock time
+static LONGLONG capture_qpc_base;
+static LONGLONG capture_qpc_freq;
+static unsigned long long capture_us_base; // btsnoop time at capture_qpc_base
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t) (v >> 24);
+	p[1] = (uint8_t) (v >> 16);
+	p[2] = (uint8_t) (v >> 8);
+	p[3] = (uint8_t) v;
+}
+
+static void put_be64(uint8_t *p, unsigned long long v)
+{
+	put_be32(p, (uint32_t) (v >> 32));
+	put_be32(p + 4, (uint32_t) v);
+}
+
+static void capture_write(evt_buf_t *buf, uint32_t drops)
+{
+	uint8_t rec[25];
+	LONGLONG ticks = buf->stamp - capture_qpc_base;
+	unsigned long long us;
+	uint32_t flags = 0;
+
+	us = capture_us_base + (unsigned long long) (ticks / capture_qpc_freq) * 1000000
+	   + (unsigned long long) (ticks % capture_qpc_freq) * 1000000 / capture_qpc_freq;
+
+	if (buf->direction == EVT_BUF_RX)
+		flags |= BTSNOOP_FLAG_RECEIVED;
+	if (buf->payload_type == 0x01 || buf->payload_type == 0x04)
+		flags |= BTSNOOP_FLAG_CMD_EVT;
+
+	put_be32(&rec[0], buf->length + 1);  // original length
+	put_be32(&rec[4], buf->length + 1);  // included length
+	put_be32(&rec[8], flags);
+	put_be32(&rec[12], drops);
+	put_be64(&rec[16], us);
+	rec[24] = buf->payload_type;         // H4 packet indicator
+
+	fwrite(rec, 1, sizeof(rec), capture_file);
+	fwrite(buf->data, 1, buf->length, capture_file);
+}
+
+static void capture_writer(PVOID unused)
+{
+	evt_buf_t *buf;
+	uint32_t drops;
+
+	for (;;)
+	{
+		EnterCriticalSection(&capture_lock);
+		buf = NULL;
+		if (capture_tail != capture_head)
+		{
+			buf = capture_queue[capture_tail];
+			capture_tail = (capture_tail + 1) % CAPTURE_QUEUE_SIZE;
+		}
+		drops = capture_drops;
+		LeaveCriticalSection(&capture_lock);
+
+		if (buf != NULL)
+		{
+			capture_write(buf, drops);
+			evt_buf_release(buf);
+			continue;
+		}
+
+		if (capture_stop)
+			break;
+
+		WaitForSingleObject(capture_has_data, INFINITE);
+	}
+
+	SetEvent(capture_done);
+}
+
+static void capture_tap(evt_buf_t *buf, void *ctx)
+{
+	unsigned int next;
+
+	EnterCriticalSection(&capture_lock);
+
+	next = (capture_head + 1) % CAPTURE_QUEUE_SIZE;
+	if (!capture_active || capture_stop)
+	{
+		// closed after the publisher took its list of taps
+	}
+	else if (next == capture_tail)
+	{
+		capture_drops++;
+	}
+	else
+	{
+		evt_buf_ref(buf);
+		capture_queue[capture_head] = buf;
+		capture_head = next;
+	}
+
+	LeaveCriticalSection(&capture_lock);
+
+	SetEvent(capture_has_data);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Start capturing all frames sent to and received from the DUT.
+ *
+ *  @param[in] path  btsnoop file to create.
+ *
+ * @return true on success.
+ ****************************************************************************************
+*/
+bool capture_open(const char *path)
+{
+	uint8_t hdr[16];
+	LARGE_INTEGER qpc, freq;
+	FILETIME ft;
+
+	if (capture_active)
+		return false;
+
+	capture_file = fopen(path, "wb");
+	if (capture_file == NULL)
+		return false;
+
+	memcpy(hdr, "btsnoop\0", 8);
+	put_be32(&hdr[8], 1);
+	put_be32(&hdr[12], CAPTURE_BTSNOOP_DATALINK_H4);
+	fwrite(hdr, 1, sizeof(hdr), capture_file);
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&qpc);
+	GetSystemTimeAsFileTime(&ft);
+	capture_qpc_freq = freq.QuadPart;
+	capture_qpc_base = qpc.QuadPart;
+	capture_us_base = ((((unsigned long long) ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10
+	                - FILETIME_EPOCH_DELTA_US + BTSNOOP_EPOCH_DELTA_US;
+
+	if (!capture_lock_initialized)
+	{
+		InitializeCriticalSection(&capture_lock);
+		capture_lock_initialized = true;
+	}
+	capture_has_data = CreateEvent(NULL, FALSE, FALSE, NULL);
+	capture_done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	capture_head = capture_tail = 0;
+	capture_drops = 0;
+	capture_stop = FALSE;
+	capture_active = true;
+
+	_beginthread(capture_writer, 10000, NULL);
+
+	if (!evt_tap_add(capture_tap, NULL))
+	{
+		capture_close();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Stop capturing, write what is queued and close the file.
+ ****************************************************************************************
+*/
+void capture_close(void)
+{
+	if (!capture_active)
+		return;
+
+	evt_tap_remove(capture_tap, NULL);
+
+	EnterCriticalSection(&capture_lock);
+	capture_stop = TRUE;
+	LeaveCriticalSection(&capture_lock);
+
+	SetEvent(capture_has_data);
+	WaitForSingleObject(capture_done, INFINITE);
+
+	if (capture_drops)
+		fprintf(stderr, "capture: %u frames dropped\n", (unsigned int) capture_drops);
+
+	fclose(capture_file);
+	capture_file = NULL;
+
+	CloseHandle(capture_has_data);
+	CloseHandle(capture_done);
+	capture_active = false;
+}
@@ -0,0 +1,32 @@
+/**
+****************************************************************************************
+*
+* @file capture.h
+*
+* @brief Capture of the UART traffic into a btsnoop file (Wireshark, Frontline).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include "stdbool.h"
+
+/* frames waiting for the writer thread; further frames are counted as dropped */
+#define CAPTURE_QUEUE_SIZE 256
+
+/* btsnoop datalink type of an H4 (UART) capture */
+#define CAPTURE_BTSNOOP_DATALINK_H4 1002
+
+bool capture_open(const char *path);
+void capture_close(void);
+
+#endif /* _CAPTURE_H_ */
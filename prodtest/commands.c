@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <windows.h>
 
@@ -25,8 +26,25 @@
 #include "queue.h"
 #include "host_hci.h"
 #include "commands.h"
+#include "bulk.h"
+#include "fw_load.h"
+#include "linectl.h"
+#include "latency.h"
+#include "config.h"
+#include "result.h"
+#include "plan.h"
+#include "journal.h"
+#include "pool.h"
+#include "bdaddr.h"
+#include "history.h"
+#include "rx_all.h"
+#include "per.h"
+#include "broadcast.h"
+#include "tx_rotate.h"
 
 extern int g_com_port_number;
+extern int g_com_port_list[];
+extern int g_com_port_count;
 //#define HCI_CUSTOM_ACTION_CMD_OPCODE                (0x40D0)
 long parse_number(int *return_status, const char * str)
 {
@@ -35,6 +53,7 @@ long parse_number(int *return_status, const char * str)
 	
 	*return_status = 0;
 
+	errno = 0; // strtol() only sets it on overflow
 	result = strtol(str, &endptr, 10);
 	
 	if (endptr[0])
@@ -134,6 +153,16 @@ static uint32_t parsse_hex_SN(int *error_code, const char *str,char *buffer)
 	return 0;
 }
 
+// text a custom action (0x40D0) returns after its status, up to the first zero
+static void parse_custom_action_text(const uint8_t *data, int length, char *text)
+{
+	int kk;
+
+	for (kk = 0; kk < length && kk < PROVISION_FIELD_SIZE - 1 && data[kk] != 0; kk++)
+		text[kk] = (data[kk] >= 0x20 && data[kk] < 0x7F) ? data[kk] : '?';
+	text[kk] = 0;
+}
+
 static int parse_frequency(int *return_status, const char * str)
 {
 	long result;
@@ -141,6 +170,7 @@ static int parse_frequency(int *return_status, const char * str)
 	
 	*return_status = 0;
 
+	errno = 0; // strtol() only sets it on overflow
 	result = strtol(str, &endptr, 10);
 	
 	if (endptr[0])
@@ -165,6 +195,7 @@ static int parse_data_length(int *return_status, const char * str)
 	
 	*return_status = 0;
 
+	errno = 0; // strtol() only sets it on overflow
 	result = strtol(str, &endptr, 10);
 	
 	if (endptr[0])
@@ -187,6 +218,7 @@ static int parse_payload_type(int *return_status, const char * str)
 	
 	*return_status = 0;
 
+	errno = 0; // strtol() only sets it on overflow
 	result = strtol(str, &endptr, 10);
 
 	if (endptr[0])
@@ -239,6 +271,25 @@ static int parse_bd_addr(uint8_t bd_addr[6], const char *str)
     return 0;
 }
 
+// what a write status tells of a value taken from a pool; sent: the write command
+// went out to the DUT
+static int pool_outcome(int status, bool sent)
+{
+    // a value used before is taken out of the pool as well
+    if (status == SC_DUPLICATE_VALUE)
+        return POOL_WRITTEN;
+
+    // refused before the send: argument, COM port
+    if (!sent)
+        return POOL_NOT_WRITTEN;
+
+    if (status == SC_NO_ERROR)
+        return POOL_WRITTEN;
+
+    // whatever went wrong after the send, the DUT may hold the value
+    return POOL_MAYBE_WRITTEN;
+}
+
 // GPIO's
 enum
 {
@@ -455,7 +506,7 @@ int starttest_tx_param_len_3_handler(int argc, char **argv)
 	hci_tx_test(/*uint8_t*/ frequency, /*uint8_t*/  data_length, /*uint8_t*/ payload_type);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
 
 	if (evt == NULL)
 	{
@@ -488,7 +539,7 @@ int starttest_tx_param_len_3_handler(int argc, char **argv)
 	
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	
@@ -512,6 +563,7 @@ int starttest_tx_param_len_5_handler(int argc, char **argv)
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
 	hci_evt_t *evt2 = NULL;
+	unsigned int timeout, air_millis;
 
 
 	//check number of arguments
@@ -566,7 +618,7 @@ int starttest_tx_param_len_5_handler(int argc, char **argv)
 	hci_dialog_tx_test(/*uint8_t*/ frequency, /*uint8_t*/  data_length, /*uint8_t*/ payload_type, number_of_packets);
 
 	// receive command status event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
 
 	if (evt == NULL)
 	{
@@ -586,8 +638,13 @@ int starttest_tx_param_len_5_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// receive command completion event
-	evt2 = hci_recv_event_wait(60000); // wait for 60 seconds
+	// receive command completion event: at least twice the air time of the
+	// packets, one every ceil((L + 249) / 625) * 625 us with L = (10 + length) * 8 us
+	timeout = latency_timeout(LATENCY_KEY(0x4040, 0), 60000);
+	air_millis = (unsigned int) (((unsigned long) number_of_packets * ((((10 + data_length) * 8 + 249) + 624) / 625) * 625) / 1000);
+	if (timeout < 2 * air_millis + 1000)
+		timeout = 2 * air_millis + 1000;
+	evt2 = hci_recv_event_wait(timeout);
 
 	if (evt2 == NULL)
 	{
@@ -611,9 +668,9 @@ int starttest_tx_param_len_5_handler(int argc, char **argv)
 	
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 	if(evt2)
-		free(evt2);
+		hci_free_event(evt2);
 
 	printf("status = %d\n", return_status);
 	
@@ -672,7 +729,7 @@ int starttest_rx_default_handler(int argc, char **argv)
 	hci_rx_test(/*uint8_t*/ frequency);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
 
 	if (evt == NULL)
 	{
@@ -705,7 +762,7 @@ int starttest_rx_default_handler(int argc, char **argv)
 	
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	
@@ -760,7 +817,7 @@ int starttest_rx_readback_values_handler(int argc, char **argv)
 	hci_dialog_rx_readback_test(/*uint8_t*/ frequency);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
 
 	if (evt == NULL)
 	{
@@ -785,7 +842,7 @@ int starttest_rx_readback_values_handler(int argc, char **argv)
 	
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	
@@ -838,7 +895,7 @@ int stoptest_rx_readback_values_handler(int argc, char **argv)
 	hci_dialog_rx_readback_test_end();
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
 
 	if (evt == NULL)
 	{
@@ -869,7 +926,7 @@ int stoptest_rx_readback_values_handler(int argc, char **argv)
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 
 	printf("status = %d\n", return_status);
@@ -877,44 +934,103 @@ exit_command_handler:
 	printf("nb_packets_with_syncerror       = %d\n", nb_packets_with_syncerror);
 	printf("nb_packets_received_with_crcerr = %d\n", nb_packets_received_with_crcerr);
 	printf("rssi                            = %.2f\n", dBm);
+	result_put_int("nb_packets_received_correctly", nb_packets_received_correctly);
+	result_put_int("nb_packets_with_syncerror", nb_packets_with_syncerror);
+	result_put_int("nb_packets_received_with_crcerr", nb_packets_received_with_crcerr);
+	result_put_double("rssi", dBm);
 	
 	return return_status;
 };
 
 /*
  ****************************************************************************************
- * @brief Command handler for "End Test Mode Command(default)"
+ * @brief Counts of the RX test so far (0x40E0); unlike stop_pkt_rx_stats the test goes
+ *        on. No resync when the reply is lost: HCI Reset, or a reset of the DUT, would
+ *        end the test.
  *
- *  @param[in] argc		Command line argument count.
- *  @param[in] argv		Command line arguments.
+ *  @param[out] counts  Received correctly, sync errors, CRC errors, raw RSSI.
  *
- * @return error code on failure / 0 on success.
+ * @return SC_...
  ****************************************************************************************
 */
-int stoptest_handler(int argc, char **argv)
+static int peek_rx_stats(uint16_t counts[4])
 {
-	int return_status = 0;
-	hci_evt_t *evt = NULL;
+	hci_evt_t *evt;
+	int kk;
 
-	// HCI event return parameters:
-	uint8_t Num_HCI_Command_Packets;
-	uint16_t opcode;
-	uint8_t status; // see: BT spec 4.0 vol 2- part D - error codes
-	uint16_t number_of_packets = 0;
+	hci_dialog_rx_readback_peek();
+
+	// neither sent again nor followed by a reset: either would end the test
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
+	if (evt == NULL)
+		return SC_RX_TIMEOUT;
+
+	if ( !( evt->event == 0x0E
+		&& evt->length == 11
+		&& evt->parameters[1] == (HCI_PEEK_PROD_RX_STATS_CMD_OPCODE & 0xFF)
+		&& evt->parameters[2] == (HCI_PEEK_PROD_RX_STATS_CMD_OPCODE >> 8))
+	)
+	{
+		hci_free_event(evt);
+		return SC_UNEXPECTED_EVENT;
+	}
+
+	for (kk = 0; kk < 4; kk++)
+		counts[kk] = evt->parameters[3 + 2 * kk] + 256 * evt->parameters[4 + 2 * kk];
+
+	hci_free_event(evt);
+
+	return 0;
+}
+
+// peek_pkt_rx_stats, and monitor_pkt_rx_stats <interval ms> <samples> [<packets>]
+static int rx_readback_values_sample(int argc, char **argv, bool monitor)
+{
+	long interval = 0, samples = 1, packets = 0;
+	uint16_t counts[4] = { 0, 0, 0, 0 };
+	uint16_t previous = 0;
+	DWORD start, next, now;
+	long sample;
+	int return_status = 0;
 
 	// check number of args
-	if (argc != 1)
+	if ( !(monitor ? (argc == 3 || argc == 4) : argc == 1) )
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
+	if (monitor)
+	{
+		interval = parse_number(&return_status, argv[1]);
+		if (return_status != 0 || interval <= 0)
+		{
+			return_status = SC_INVALID_TIMEOUT_ARG;
+			goto exit_command_handler;
+		}
+		samples = parse_number(&return_status, argv[2]);
+		if (return_status != 0 || samples <= 0)
+		{
+			return_status = SC_INVALID_NUMBER_OF_PACKETS_ARG;
+			goto exit_command_handler;
+		}
+		if (argc == 4)
+		{
+			packets = parse_number(&return_status, argv[3]);
+			if (return_status != 0 || packets <= 0 || packets > 65535)
+			{
+				return_status = SC_INVALID_NUMBER_OF_PACKETS_ARG;
+				goto exit_command_handler;
+			}
+		}
+	}
+
 	//
 	// execute ..
 	//
 
 	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
+	if (!InitUART(g_com_port_number, 115200))
 		InitTasks();
 	else
 	{
@@ -922,61 +1038,52 @@ int stoptest_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// send HCI command
-	hci_test_end();
-
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
-
-	if (evt == NULL)
+	// samples at a fixed rate: a slow reply delays one sample, not the ones after it
+	start = GetTickCount();
+	next = start;
+	for (sample = 1; ; sample++)
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
-		goto exit_command_handler;
-	}
-	
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+		return_status = peek_rx_stats(counts);
+		if (return_status != 0)
+			break;
 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 6
-		&& evt->parameters[1] == 0x1F
-		&& evt->parameters[2] == 0x20)
-	)
-	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
-		goto exit_command_handler;
-	}
+		now = GetTickCount();
+		if (monitor)
+		{
+			fprintf(stderr, "%6u ms: received %5u (+%u), syncerror %5u, crcerr %5u, rssi %.2f\n",
+				(unsigned int) (now - start), counts[0], (unsigned int) (uint16_t) (counts[0] - previous),
+				counts[1], counts[2], (0.474f * counts[3]) - 112.4f);
+			previous = counts[0];
+		}
 
-	// parse event parameters
-	Num_HCI_Command_Packets = evt->parameters[0];
-	opcode = evt->parameters[1] + 256 * evt->parameters[2];
-	status = evt->parameters[3];
-	number_of_packets = evt->parameters[4] + 256 * evt->parameters[5];
+		if (sample >= samples || (packets > 0 && counts[0] >= packets))
+			break;
 
-	// check command completion event status
-	if (status != 0 )
-	{
-		return_status = SC_HCI_STANDARD_ERROR_CODE_BASE + status;
+		next += interval;
+		if ((LONG) (next - now) > 0)
+			Sleep(next - now);
+		else
+			next = now;
 	}
-	
-exit_command_handler:
-	if(evt)
-		free(evt);
-
 
+exit_command_handler:
 	printf("status = %d\n", return_status);
-	printf("number_of_packets = %d\n", number_of_packets);
-	
+	printf("nb_packets_received_correctly   = %d\n", counts[0]);
+	printf("nb_packets_with_syncerror       = %d\n", counts[1]);
+	printf("nb_packets_received_with_crcerr = %d\n", counts[2]);
+	printf("rssi                            = %.2f\n", (0.474f * counts[3]) - 112.4f);
+	result_put_int("nb_packets_received_correctly", counts[0]);
+	result_put_int("nb_packets_with_syncerror", counts[1]);
+	result_put_int("nb_packets_received_with_crcerr", counts[2]);
+	result_put_double("rssi", (0.474f * counts[3]) - 112.4f);
+
 	return return_status;
-};
+}
 
 /*
  ****************************************************************************************
- * @brief Command handler for "Unmodulated RX/TX"
- *
- * command line:
- *   prodtest  starttest_unmodulated  OFF
- *   prodtest  starttest_unmodulated  TX 2404
- *   prodtest  starttest_unmodulated  RX 2404
+ * @brief Command handler for "Peek Prod testmode RX with ReadBack values": the counts
+ *        so far, as stop_pkt_rx_stats returns them, while the test goes on.
  *
  *  @param[in] argc		Command line argument count.
  *  @param[in] argv		Command line arguments.
@@ -984,144 +1091,303 @@ exit_command_handler:
  * @return error code on failure / 0 on success.
  ****************************************************************************************
 */
-int starttest_unmodulated_handler(int argc, char **argv)
+int peek_rx_readback_values_handler(int argc, char **argv)
+{
+	return rx_readback_values_sample(argc, argv, false);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for "Monitor Prod testmode RX with ReadBack values": a sample
+ *        of the counts every interval, until the number of samples is taken or the
+ *        number of packets is received correctly. The return values are those of
+ *        the last sample.
+ *
+ *  argv[1]  interval in ms
+ *  argv[2]  max. number of samples
+ *  argv[3]  (optional) packets received correctly that end the monitoring
+ ****************************************************************************************
+*/
+int monitor_rx_readback_values_handler(int argc, char **argv)
+{
+	return rx_readback_values_sample(argc, argv, true);
+}
+
+// arguments of pkt_rx_all and pkt_rx_per, those of pkt_tx
+static int parse_rx_all_args(char **argv, uint8_t *frequency, uint8_t *data_length, uint8_t *payload_type, uint16_t *number_of_packets)
 {
-	uint8_t mode;
-	uint8_t frequency;
-	int frequency_arg_required = 0;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
 
+	// parse FREQUENCY
+	*frequency = parse_frequency(&return_status, argv[1]);
+	if (return_status != 0 )
+		return SC_INVALID_FREQUENCY_ARG;
+	// parse DATA_LENGTH
+	*data_length = parse_data_length(&return_status, argv[2]);
+	if (return_status != 0 )
+		return SC_INVALID_DATA_LENGTH_ARG;
+	// parse PAYLOAD_TYPE
+	*payload_type = parse_payload_type(&return_status, argv[3]);
+	if (return_status != 0 )
+		return SC_INVALID_PAYLOAD_TYPE_ARG;
+	// parse number_of_packets argument
+	*number_of_packets = parse_number_of_packets(&return_status, argv[4]);
+	if (return_status != 0 )
+		return SC_INVALID_NUMBER_OF_PACKETS_ARG;
 
-	// we need at least 1 arg: the MODE
-	if (argc < 2 )
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Open the DUTs of -p, one link each. The first DUT stays on the HCI stack,
+ *        the others are read by the thread that talks to them.
+ *
+ *  @param[in]  links   One per port of -p; each is initialized once its port is open.
+ *  @param[out] ports   The ports opened after the first; to be closed from ports[1] on.
+ *  @param[out] opened  Number of ports of -p open, also on failure.
+ *
+ * @return SC_...
+ ****************************************************************************************
+*/
+static int dut_ports_open(rx_all_link_t **links, uart_port_t *ports, int *opened)
+{
+	for (*opened = 0; *opened < g_com_port_count; (*opened)++)
 	{
-		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-		goto exit_command_handler;
+		if (*opened == 0)
+		{
+			if (InitUART(g_com_port_list[0], 115200))
+				break;
+			InitTasks();
+			rx_all_link_init(links[0], NULL);
+		}
+		else
+		{
+			if (UARTPortOpen(&ports[*opened], g_com_port_list[*opened], 115200))
+				break;
+			rx_all_link_init(links[*opened], &ports[*opened]);
+		}
 	}
-
-	// parse MODE - argv[1]
-	mode = parse_unmodulated_mode(&return_status, argv[1]);
-	if (return_status != 0 ) 
+	if (*opened < g_com_port_count)
 	{
-		return_status = SC_INVALID_UNMODULATED_CMD_MODE_ARG;
-		goto exit_command_handler;
+		fprintf(stderr, "Cannot open COM%d\n", g_com_port_list[*opened]);
+		return SC_COM_PORT_INIT_ERROR; // InitUART failed
 	}
 
-	switch (mode) {
-		case UNMODULATED_CMD_MODE_OFF: frequency_arg_required = 0; break;
-		case UNMODULATED_CMD_MODE_TX:  frequency_arg_required = 1; break;
-		case UNMODULATED_CMD_MODE_RX:  frequency_arg_required = 1; break;
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Open the DUTs of -p and the golden unit ("golden.port") for pkt_rx_all and
+ *        pkt_rx_per, see dut_ports_open().
+ *
+ *  @param[out] opened  Number of ports of -p open, also on failure.
+ *
+ * @return SC_...
+ ****************************************************************************************
+*/
+static int rx_all_open(rx_all_slot_t *slots, uart_port_t *ports, int *opened, uart_port_t *golden_port, rx_all_link_t *golden)
+{
+	long golden_com = config_get_long(RX_ALL_CONFIG_GOLDEN_PORT, -1);
+	rx_all_link_t *links[UART_MAX_PORTS];
+	int return_status;
+	int kk;
+
+	*opened = 0;
+
+	// the golden unit is not one of the DUTs; port 0 is a simulated unit of its own
+	for (kk = 0; kk < g_com_port_count; kk++)
+		if (golden_com != UART_SIM_PORT && g_com_port_list[kk] == golden_com)
+			break;
+	if (golden_com < 0 || kk < g_com_port_count)
+	{
+		fprintf(stderr, "\"%s\" must name the COM port of the golden unit, not one of -p\n", RX_ALL_CONFIG_GOLDEN_PORT);
+		return SC_COM_PORT_INIT_ERROR;
 	}
 
-	if (argc != (2 + frequency_arg_required) )
+	for (kk = 0; kk < g_com_port_count; kk++)
 	{
-		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-		goto exit_command_handler;
+		links[kk] = &slots[kk].link;
+		slots[kk].com = g_com_port_list[kk];
+		slots[kk].idle = false;
+		slots[kk].status = 0;
 	}
 
-	if ( frequency_arg_required == 1 )
+	return_status = dut_ports_open(links, ports, opened);
+	if (return_status != 0)
+		return return_status;
+
+	if (UARTPortOpen(golden_port, (int) golden_com, 115200))
 	{
-		// parse FREQUENCY
-		frequency = parse_frequency(&return_status, argv[2]);
-		if (return_status != 0 ) 
-		{
-			return_status = SC_INVALID_FREQUENCY_ARG;
-			goto exit_command_handler;\
-		}
+		fprintf(stderr, "Cannot open COM%ld\n", golden_com);
+		return SC_COM_PORT_INIT_ERROR;
 	}
-	else
+	rx_all_link_init(golden, golden_port);
+
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for the one-to-many RX test: every DUT of -p in RX on the
+ *        same channel, one burst of the golden unit ("golden.port"), the counts of
+ *        all DUTs collected at once.
+ *
+ *  argv[1..4]  <FREQUENCY> <DATA_LENGTH> <PAYLOAD_TYPE> <NUMBER_OF_PACKETS>, as pkt_tx
+ *
+ * The return values are those of stop_pkt_rx_stats for the worst DUT, and per DUT
+ * port<n>_ok, port<n>_syncerr, port<n>_crcerr and port<n>_rssi.
+ ****************************************************************************************
+*/
+int pkt_rx_all_cmd_handler(int argc, char **argv)
+{
+	static rx_all_slot_t slots[UART_MAX_PORTS];
+	uart_port_t ports[UART_MAX_PORTS];
+	uart_port_t golden_port;
+	rx_all_link_t golden;
+	uint8_t frequency, data_length, payload_type;
+	uint16_t number_of_packets;
+	bool golden_open = false;
+	int opened = 0;
+	int listening = 0;
+	int kk;
+	char name[RESULT_MAX_NAME_LEN];
+	uint16_t worst_ok = 0xFFFF, worst_sync = 0, worst_crc = 0, worst_rssi = 0xFFFF;
+	int return_status = 0;
+
+	// check number of arguments
+	if (argc != 5)
 	{
-		frequency = 0;
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
 	}
 
+	return_status = parse_rx_all_args(argv, &frequency, &data_length, &payload_type, &number_of_packets);
+	if (return_status != 0)
+		goto exit_command_handler;
+
 	//
 	// execute ..
 	//
 
-	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
-		InitTasks();
-	else
-	{
-		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+	return_status = rx_all_open(slots, ports, &opened, &golden_port, &golden);
+	if (return_status != 0)
 		goto exit_command_handler;
-	}
+	golden_open = true;
 
-	// send HCI command
-	hci_dialog_unmodulated_rx_tx(mode, frequency);
+	listening = rx_all_start(slots, g_com_port_count, frequency);
 
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	// a DUT that did not get into RX still reports its own status below
+	if (listening > 0)
+		return_status = rx_all_burst(&golden, frequency, data_length, payload_type, number_of_packets);
 
-	if (evt == NULL)
-	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
-		goto exit_command_handler;
-	}
-	
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	rx_all_stop(slots, g_com_port_count);
 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 3
-		&& evt->parameters[1] == 0x10
-		&& evt->parameters[2] == 0x40)
-	)
+	for (kk = 0; kk < g_com_port_count; kk++)
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
-		goto exit_command_handler;
-	}
+		if (return_status == 0 && slots[kk].status != 0)
+			return_status = slots[kk].status;
 
-	// event has no return parameters
+		if (slots[kk].nb_packets_received_correctly < worst_ok)
+			worst_ok = slots[kk].nb_packets_received_correctly;
+		if (slots[kk].nb_packets_with_syncerror > worst_sync)
+			worst_sync = slots[kk].nb_packets_with_syncerror;
+		if (slots[kk].nb_packets_received_with_crcerr > worst_crc)
+			worst_crc = slots[kk].nb_packets_received_with_crcerr;
+		if (slots[kk].rssi < worst_rssi)
+			worst_rssi = slots[kk].rssi;
+	}
 
-	
 exit_command_handler:
-	if(evt)
-		free(evt);
+	if (golden_open)
+		UARTPortClose(&golden_port);
+	for (kk = 1; kk < opened; kk++)
+		UARTPortClose(&ports[kk]);
 
 	printf("status = %d\n", return_status);
-	
+	if (!golden_open)
+		return return_status;
+
+	for (kk = 0; kk < g_com_port_count; kk++)
+	{
+		printf("port %3d    = status %d, received %u, syncerror %u, crcerr %u, rssi %.2f\n", slots[kk].com, slots[kk].status,
+			slots[kk].nb_packets_received_correctly, slots[kk].nb_packets_with_syncerror,
+			slots[kk].nb_packets_received_with_crcerr, (0.474f * slots[kk].rssi) - 112.4f);
+
+		sprintf(name, "port%d_ok", slots[kk].com);
+		result_put_int(name, slots[kk].nb_packets_received_correctly);
+		sprintf(name, "port%d_syncerr", slots[kk].com);
+		result_put_int(name, slots[kk].nb_packets_with_syncerror);
+		sprintf(name, "port%d_crcerr", slots[kk].com);
+		result_put_int(name, slots[kk].nb_packets_received_with_crcerr);
+		sprintf(name, "port%d_rssi", slots[kk].com);
+		result_put_double(name, (0.474f * slots[kk].rssi) - 112.4f);
+	}
+
+	printf("nb_packets_received_correctly   = %d\n", worst_ok);
+	printf("nb_packets_with_syncerror       = %d\n", worst_sync);
+	printf("nb_packets_received_with_crcerr = %d\n", worst_crc);
+	printf("rssi                            = %.2f\n", (0.474f * worst_rssi) - 112.4f);
+	result_put_int("nb_packets_received_correctly", worst_ok);
+	result_put_int("nb_packets_with_syncerror", worst_sync);
+	result_put_int("nb_packets_received_with_crcerr", worst_crc);
+	result_put_double("rssi", (0.474f * worst_rssi) - 112.4f);
+
 	return return_status;
-};
+}
 
 /*
  ****************************************************************************************
- * @brief Command handler for "Start TX continue test"
- *
- *  Command line:
- *    prodtest starttest_tx_continue <FREQUENCY> <PAYLOAD_TYPE>
+ * @brief Command handler for the PER test of the DUTs of -p: sub-bursts of "per.burst"
+ *        packets of the golden unit, as pkt_rx_all, until a sequential probability
+ *        ratio test has decided every DUT (see per.h) or the max. number of packets
+ *        is sent.
  *
- *  @param[in] argc		Command line argument count.
- *  @param[in] argv		Command line arguments.
+ *  argv[1..4]  <FREQUENCY> <DATA_LENGTH> <PAYLOAD_TYPE> <MAX_NUMBER_OF_PACKETS>
  *
- * @return error code on failure / 0 on success.
+ * The return values are per and packets of the worst DUT, and per DUT port<n>_per,
+ * port<n>_packets and port<n> (pass / fail).
  ****************************************************************************************
 */
-int starttest_tx_continue_handler(int argc, char **argv)
+int pkt_rx_per_cmd_handler(int argc, char **argv)
 {
-	uint8_t frequency, payload_type;
+	static rx_all_slot_t slots[UART_MAX_PORTS];
+	uart_port_t ports[UART_MAX_PORTS];
+	uart_port_t golden_port;
+	rx_all_link_t golden;
+	per_sprt_t sprt;
+	uint8_t frequency, data_length, payload_type;
+	uint16_t max_packets;
+	unsigned long sent = 0;
+	unsigned long packets[UART_MAX_PORTS];
+	unsigned long errors[UART_MAX_PORTS];
+	int verdict[UART_MAX_PORTS];
+	uint16_t burst;
+	bool golden_open = false;
+	int opened = 0;
+	int undecided = 0;
+	int kk;
+	char name[RESULT_MAX_NAME_LEN];
+	double per, worst_per = 0;
+	unsigned long worst_packets = 0;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
 
 	// check number of arguments
-	if (argc != 3)
+	if (argc != 5)
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
-	// parse FREQUENCY
-	frequency = parse_frequency(&return_status, argv[1]);
 
-	if (return_status != 0 ) 
-	{
-		return_status = SC_INVALID_FREQUENCY_ARG;
+	return_status = parse_rx_all_args(argv, &frequency, &data_length, &payload_type, &max_packets);
+	if (return_status != 0)
 		goto exit_command_handler;
-	}	
-	// parse PAYLOAD_TYPE 
-	payload_type = parse_payload_type(&return_status, argv[2]);
-	if (return_status != 0 ) 
+
+	// per.* of the configuration
+	if (!per_sprt_init(&sprt))
 	{
-		return_status = SC_INVALID_PAYLOAD_TYPE_ARG;
+		return_status = SC_INVALID_CONFIG;
 		goto exit_command_handler;
 	}
 
@@ -1129,122 +1395,446 @@ int starttest_tx_continue_handler(int argc, char **argv)
 	// execute ..
 	//
 
-	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
-		InitTasks();
-	else
-	{
-		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+	return_status = rx_all_open(slots, ports, &opened, &golden_port, &golden);
+	if (return_status != 0)
 		goto exit_command_handler;
-	}
-
-	// send HCI command
-	hci_dialog_tx_continuous_start(/*uint8_t*/ frequency, /*uint8_t*/ payload_type);
-
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	golden_open = true;
 
-	if (evt == NULL)
+	for (kk = 0; kk < g_com_port_count; kk++)
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
-		goto exit_command_handler;
+		packets[kk] = 0;
+		errors[kk] = 0;
+		verdict[kk] = PER_UNDECIDED;
 	}
-	
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	undecided = g_com_port_count;
 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 3
-		&& evt->parameters[1] == 0x50
-		&& evt->parameters[2] == 0x40)
-	)
+	while (undecided > 0 && sent < max_packets)
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
-		goto exit_command_handler;
+		burst = (uint16_t) (max_packets - sent < (unsigned long) sprt.burst ? max_packets - sent : sprt.burst);
+
+		if (rx_all_start(slots, g_com_port_count, frequency) > 0)
+			return_status = rx_all_burst(&golden, frequency, data_length, payload_type, burst);
+		rx_all_stop(slots, g_com_port_count);
+
+		if (return_status != 0)
+			break;
+
+		sent += burst;
+
+		// a DUT that failed to answer, or has been decided, sits out the next sub-bursts
+		for (kk = 0; kk < g_com_port_count; kk++)
+		{
+			if (slots[kk].idle)
+				continue;
+
+			if (slots[kk].status == 0)
+			{
+				packets[kk] += burst;
+				errors[kk] += burst - (slots[kk].nb_packets_received_correctly < burst ? slots[kk].nb_packets_received_correctly : burst);
+				verdict[kk] = per_update(&sprt, packets[kk], errors[kk], sent >= max_packets);
+			}
+
+			if (slots[kk].status != 0 || verdict[kk] != PER_UNDECIDED)
+			{
+				slots[kk].idle = true;
+				undecided--;
+			}
+		}
 	}
 
-	// no return parameters
+	for (kk = 0; kk < g_com_port_count && return_status == 0; kk++)
+		if (slots[kk].status != 0)
+			return_status = slots[kk].status;
+	for (kk = 0; kk < g_com_port_count && return_status == 0; kk++)
+		if (verdict[kk] == PER_FAIL)
+			return_status = SC_PER_FAILED;
 
 exit_command_handler:
-	if(evt)
-		free(evt);
+	if (golden_open)
+		UARTPortClose(&golden_port);
+	for (kk = 1; kk < opened; kk++)
+		UARTPortClose(&ports[kk]);
 
 	printf("status = %d\n", return_status);
-	
+	if (!golden_open)
+		return return_status;
+
+	for (kk = 0; kk < g_com_port_count; kk++)
+	{
+		per = packets[kk] ? 100.0 * errors[kk] / packets[kk] : 100.0;
+		if (per >= worst_per)
+		{
+			worst_per = per;
+			worst_packets = packets[kk];
+		}
+
+		printf("port %3d    = status %d, %s, per %.2f%% of %lu packets\n", slots[kk].com, slots[kk].status,
+			per_verdict_name(verdict[kk]), per, packets[kk]);
+
+		sprintf(name, "port%d", slots[kk].com);
+		result_put_str(name, per_verdict_name(verdict[kk]));
+		sprintf(name, "port%d_per", slots[kk].com);
+		result_put_double(name, per);
+		sprintf(name, "port%d_packets", slots[kk].com);
+		result_put_int(name, packets[kk]);
+	}
+
+	printf("per         = %.2f%%\n", worst_per);
+	printf("packets     = %lu of max. %u sent\n", sent, (unsigned int) max_packets);
+	result_put_double("per", worst_per);
+	result_put_int("packets", worst_packets);
+
 	return return_status;
-};
+}
 
 /*
  ****************************************************************************************
- * @brief Command handler for "End TX continue test"
+ * @brief Encode a command of broadcast: one that starts or ends a test on the DUT and
+ *        answers with a Command Complete.
  *
- *  @param[in] argc		Command line argument count.
- *  @param[in] argv		Command line arguments.
+ *  argv[0..]  start_cont_tx <FREQUENCY> <PAYLOAD_TYPE> | stop_cont_tx |
+ *             unmodulated OFF | unmodulated TX|RX <FREQUENCY> |
+ *             start_pkt_rx <FREQUENCY> | start_pkt_rx_stats <FREQUENCY> | stoptest
  *
- * @return error code on failure / 0 on success.
+ * @return SC_...
  ****************************************************************************************
 */
-int stoptest_tx_continue_handler(int argc, char **argv)
+static int broadcast_encode(int argc, char **argv, uint8_t *packet, unsigned int *size, uint16_t *opcode)
 {
+	uint8_t params[2];
+	uint8_t length = 0;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
 
+	if (strcmp(argv[0], "start_cont_tx") == 0)
+	{
+		if (argc != 3)
+			return SC_WRONG_NUMBER_OF_ARGUMENTS;
+		params[0] = parse_frequency(&return_status, argv[1]);
+		if (return_status != 0)
+			return SC_INVALID_FREQUENCY_ARG;
+		params[1] = parse_payload_type(&return_status, argv[2]);
+		if (return_status != 0)
+			return SC_INVALID_PAYLOAD_TYPE_ARG;
+		*opcode = HCI_TX_CONTINUE_TEST_CMD_OPCODE;
+		length = 2;
+	}
+	else if (strcmp(argv[0], "stop_cont_tx") == 0 || strcmp(argv[0], "stoptest") == 0)
+	{
+		if (argc != 1)
+			return SC_WRONG_NUMBER_OF_ARGUMENTS;
+		*opcode = strcmp(argv[0], "stoptest") == 0 ? 0x201F : HCI_TX_END_CONTINUE_TEST_CMD_OPCODE;
+	}
+	else if (strcmp(argv[0], "unmodulated") == 0)
+	{
+		if (argc < 2)
+			return SC_WRONG_NUMBER_OF_ARGUMENTS;
+		params[0] = parse_unmodulated_mode(&return_status, argv[1]);
+		if (return_status != 0)
+			return SC_INVALID_UNMODULATED_CMD_MODE_ARG;
+		params[1] = 0;
+		if (argc != (params[0] == UNMODULATED_CMD_MODE_OFF ? 2 : 3))
+			return SC_WRONG_NUMBER_OF_ARGUMENTS;
+		if (argc == 3)
+		{
+			params[1] = parse_frequency(&return_status, argv[2]);
+			if (return_status != 0)
+				return SC_INVALID_FREQUENCY_ARG;
+		}
+		*opcode = HCI_UNMODULATED_ON_CMD_OPCODE;
+		length = 2;
+	}
+	else if (strcmp(argv[0], "start_pkt_rx") == 0 || strcmp(argv[0], "start_pkt_rx_stats") == 0)
+	{
+		if (argc != 2)
+			return SC_WRONG_NUMBER_OF_ARGUMENTS;
+		params[0] = parse_frequency(&return_status, argv[1]);
+		if (return_status != 0)
+			return SC_INVALID_FREQUENCY_ARG;
+		*opcode = strcmp(argv[0], "start_pkt_rx") == 0 ? 0x201D : HCI_START_PROD_RX_TEST_CMD_OPCODE;
+		length = 1;
+	}
+	else
+		return SC_INVALID_COMMAND;
+
+	*size = rx_all_encode(packet, *opcode, params, length);
 
-	// check number of args
-	if (argc != 1)
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for broadcast: one command to all DUTs of -p at the same
+ *        moment, e.g. to start continuous TX on all of them for a chamber test.
+ *
+ *  argv[1..]  the command and its arguments, see broadcast_encode()
+ *
+ * The return values are per DUT port<n>_written_us and port<n>_event_us, from the
+ * release of the writes until the write has completed and until the Command Complete
+ * was in, and their spread over the DUTs, write_skew_us and event_skew_us.
+ ****************************************************************************************
+*/
+int broadcast_cmd_handler(int argc, char **argv)
+{
+	static broadcast_slot_t slots[UART_MAX_PORTS];
+	uart_port_t ports[UART_MAX_PORTS];
+	rx_all_link_t *links[UART_MAX_PORTS];
+	uint8_t packet[RX_ALL_MAX_CMD_SIZE];
+	unsigned int size = 0;
+	uint16_t opcode = 0;
+	int opened = 0;
+	int kk;
+	char name[RESULT_MAX_NAME_LEN];
+	double first_written = 0, last_written = 0, first_event = 0, last_event = 0;
+	bool written = false, answered = false;
+	int return_status = 0;
+
+	// check number of arguments
+	if (argc < 2)
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
+	return_status = broadcast_encode(argc - 1, &argv[1], packet, &size, &opcode);
+	if (return_status != 0)
+		goto exit_command_handler;
+
 	//
 	// execute ..
 	//
 
-	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
-		InitTasks();
-	else
+	for (kk = 0; kk < g_com_port_count; kk++)
 	{
-		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		links[kk] = &slots[kk].link;
+		slots[kk].com = g_com_port_list[kk];
+		memcpy(slots[kk].packet, packet, size);
+		slots[kk].size = size;
+		slots[kk].opcode = opcode;
+	}
+
+	return_status = dut_ports_open(links, ports, &opened);
+	if (return_status != 0)
 		goto exit_command_handler;
+
+	broadcast_run(slots, g_com_port_count);
+
+	for (kk = 0; kk < g_com_port_count; kk++)
+	{
+		// a slot without its thread has written nothing
+		if (slots[kk].status != SC_OUT_OF_MEMORY)
+		{
+			if (!written || slots[kk].written_us < first_written)
+				first_written = slots[kk].written_us;
+			if (!written || slots[kk].written_us > last_written)
+				last_written = slots[kk].written_us;
+			written = true;
+		}
+
+		if (slots[kk].status != 0)
+		{
+			if (return_status == 0)
+				return_status = slots[kk].status;
+			continue;
+		}
+
+		if (!answered || slots[kk].replied_us < first_event)
+			first_event = slots[kk].replied_us;
+		if (!answered || slots[kk].replied_us > last_event)
+			last_event = slots[kk].replied_us;
+		answered = true;
 	}
 
-	// send HCI command
-	hci_dialog_tx_continuous_end();
+exit_command_handler:
+	for (kk = 1; kk < opened; kk++)
+		UARTPortClose(&ports[kk]);
 
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	printf("status = %d\n", return_status);
+	if (opened == 0 || opened < g_com_port_count)
+		return return_status;
 
-	if (evt == NULL)
+	for (kk = 0; kk < g_com_port_count; kk++)
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
+		printf("port %3d    = status %d, written %.3f ms, event %.3f ms\n", slots[kk].com, slots[kk].status,
+			slots[kk].written_us / 1000, slots[kk].replied_us / 1000);
+
+		sprintf(name, "port%d_written_us", slots[kk].com);
+		result_put_int(name, (long) slots[kk].written_us);
+		sprintf(name, "port%d_event_us", slots[kk].com);
+		result_put_int(name, (long) slots[kk].replied_us);
+	}
+
+	printf("write skew  = %.3f ms\n", (last_written - first_written) / 1000);
+	printf("event skew  = %.3f ms\n", (last_event - first_event) / 1000);
+	result_put_int("write_skew_us", (long) (last_written - first_written));
+	result_put_int("event_skew_us", (long) (last_event - first_event));
+
+	return return_status;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for cont_tx_rotate: the DUTs of -p take turns in continuous
+ *        TX, one dwell each, for a number of rounds (see tx_rotate.h).
+ *
+ *  argv[1]  FREQUENCY
+ *  argv[2]  PAYLOAD_TYPE
+ *  argv[3]  dwell in ms
+ *  argv[4]  rounds
+ *  argv[5]  (optional) csv file for the on-air windows
+ *
+ * The return values are the windows run, the latest start after its slot began,
+ * max_late_us, and the longest time two DUTs were on air together, max_overlap_us.
+ ****************************************************************************************
+*/
+int cont_tx_rotate_cmd_handler(int argc, char **argv)
+{
+	static tx_rotate_slot_t slots[UART_MAX_PORTS];
+	static tx_rotate_t rotation;
+	uart_port_t ports[UART_MAX_PORTS];
+	rx_all_link_t *links[UART_MAX_PORTS];
+	tx_rotate_window_t *windows = NULL;
+	const tx_rotate_window_t *w, *prev = NULL;
+	char name[RESULT_MAX_NAME_LEN];
+	uint8_t params[2];
+	uint8_t frequency, payload_type;
+	long dwell = 0, rounds = 0;
+	int opened = 0;
+	int round, kk;
+	int count = 0;
+	double late, max_late = 0, overlap, max_overlap = 0;
+	int return_status = 0;
+
+	// check number of arguments
+	if ( !(argc == 5 || argc == 6) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+	// parse FREQUENCY
+	frequency = parse_frequency(&return_status, argv[1]);
+	if (return_status != 0 )
+	{
+		return_status = SC_INVALID_FREQUENCY_ARG;
+		goto exit_command_handler;
+	}
+	// parse PAYLOAD_TYPE
+	payload_type = parse_payload_type(&return_status, argv[2]);
+	if (return_status != 0 )
+	{
+		return_status = SC_INVALID_PAYLOAD_TYPE_ARG;
+		goto exit_command_handler;
+	}
+	dwell = parse_number(&return_status, argv[3]);
+	if (return_status != 0 || dwell <= 0)
+	{
+		return_status = SC_INVALID_TIMEOUT_ARG;
+		goto exit_command_handler;
+	}
+	rounds = parse_number(&return_status, argv[4]);
+	if (return_status != 0 || rounds <= 0 || rounds > TX_ROTATE_MAX_ROUNDS)
+	{
+		return_status = SC_INVALID_NUMBER_OF_PACKETS_ARG;
 		goto exit_command_handler;
 	}
-	
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 3
-		&& evt->parameters[1] == 0x60
-		&& evt->parameters[2] == 0x40)
-	)
+	windows = (tx_rotate_window_t *) malloc(g_com_port_count * rounds * sizeof(tx_rotate_window_t));
+	if (windows == NULL)
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		return_status = SC_OUT_OF_MEMORY;
 		goto exit_command_handler;
 	}
-	
+
+	//
+	// execute ..
+	//
+
+	params[0] = frequency;
+	params[1] = payload_type;
+	for (kk = 0; kk < g_com_port_count; kk++)
+	{
+		links[kk] = &slots[kk].link;
+		slots[kk].com = g_com_port_list[kk];
+		slots[kk].start_size = rx_all_encode(slots[kk].start, HCI_TX_CONTINUE_TEST_CMD_OPCODE, params, 2);
+		slots[kk].stop_size = rx_all_encode(slots[kk].stop, HCI_TX_END_CONTINUE_TEST_CMD_OPCODE, NULL, 0);
+		slots[kk].windows = &windows[kk * rounds];
+	}
+
+	return_status = dut_ports_open(links, ports, &opened);
+	if (return_status != 0)
+		goto exit_command_handler;
+
+	tx_rotate_run(&rotation, slots, g_com_port_count, (int) rounds, (unsigned int) dwell);
+
+	// in schedule order: how late each start went out, and how long the DUT before
+	// was still on air
+	for (round = 0; round < rounds; round++)
+		for (kk = 0; kk < g_com_port_count; kk++)
+		{
+			if (round >= slots[kk].rounds_done)
+				continue;
+
+			w = &slots[kk].windows[round];
+			count++;
+
+			late = w->start_written - w->due;
+			if (late > max_late)
+				max_late = late;
+
+			if (prev != NULL && prev->off_air > 0 && w->on_air > 0)
+			{
+				overlap = prev->off_air - w->on_air;
+				if (overlap > max_overlap)
+					max_overlap = overlap;
+			}
+			prev = w;
+		}
+
+	for (kk = 0; kk < g_com_port_count && return_status == 0; kk++)
+		return_status = slots[kk].status;
+
+	if (argc == 6 && !tx_rotate_log(&rotation, slots, argv[5]))
+	{
+		fprintf(stderr, "Cannot write %s\n", argv[5]);
+		if (return_status == 0)
+			return_status = SC_FILE_ERROR;
+	}
+
 exit_command_handler:
-	if(evt)
-		free(evt);
+	for (kk = 1; kk < opened; kk++)
+		UARTPortClose(&ports[kk]);
 
 	printf("status = %d\n", return_status);
-	
+	if (opened == g_com_port_count && opened > 0)
+	{
+		for (kk = 0; kk < g_com_port_count; kk++)
+		{
+			printf("port %3d    = status %d, %d turn(s)%s\n", slots[kk].com, slots[kk].status, slots[kk].rounds_done,
+				slots[kk].on_air ? ", may still transmit" : "");
+
+			// the stop was not answered: the rotation was aborted
+			if (slots[kk].on_air)
+			{
+				sprintf(name, "port%d_on_air", slots[kk].com);
+				result_put_int(name, 1);
+			}
+		}
+
+		printf("windows     = %d\n", count);
+		printf("max. late   = %.3f ms\n", max_late / 1000);
+		printf("max. overlap = %.3f ms\n", max_overlap / 1000);
+		result_put_int("windows", count);
+		result_put_int("max_late_us", (long) max_late);
+		result_put_int("max_overlap_us", (long) max_overlap);
+	}
+
+	free(windows);
+
 	return return_status;
-};
+}
 
 /*
  ****************************************************************************************
- * @brief Command handler for "Reset Command"
+ * @brief Command handler for "End Test Mode Command(default)"
  *
  *  @param[in] argc		Command line argument count.
  *  @param[in] argv		Command line arguments.
@@ -1252,7 +1842,7 @@ exit_command_handler:
  * @return error code on failure / 0 on success.
  ****************************************************************************************
 */
-int reset_handler(int argc, char **argv)
+int stoptest_handler(int argc, char **argv)
 {
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
@@ -1261,6 +1851,7 @@ int reset_handler(int argc, char **argv)
 	uint8_t Num_HCI_Command_Packets;
 	uint16_t opcode;
 	uint8_t status; // see: BT spec 4.0 vol 2- part D - error codes
+	uint16_t number_of_packets = 0;
 
 	// check number of args
 	if (argc != 1)
@@ -1283,10 +1874,10 @@ int reset_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_reset();
+	hci_test_end();
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
 
 	if (evt == NULL)
 	{
@@ -1297,9 +1888,9 @@ int reset_handler(int argc, char **argv)
 	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
 	if ( !( evt->event == 0x0E 
-		&& evt->length == 4
-		&& evt->parameters[1] == 0x03
-		&& evt->parameters[2] == 0x0C)
+		&& evt->length == 6
+		&& evt->parameters[1] == 0x1F
+		&& evt->parameters[2] == 0x20)
 	)
 	{
 		return_status = SC_UNEXPECTED_EVENT; // unexpected event
@@ -1310,6 +1901,7 @@ int reset_handler(int argc, char **argv)
 	Num_HCI_Command_Packets = evt->parameters[0];
 	opcode = evt->parameters[1] + 256 * evt->parameters[2];
 	status = evt->parameters[3];
+	number_of_packets = evt->parameters[4] + 256 * evt->parameters[5];
 
 	// check command completion event status
 	if (status != 0 )
@@ -1319,86 +1911,1339 @@ int reset_handler(int argc, char **argv)
 	
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
+
 
 	printf("status = %d\n", return_status);
+	printf("number_of_packets = %d\n", number_of_packets);
+	result_put_int("number_of_packets", number_of_packets);
 	
 	return return_status;
 };
 
-#define CMD__SLEEP_MODE_ACTIVE   0x00
-#define CMD__SLEEP_MODE_EXTENDED 0x01
-#define CMD__SLEEP_MODE_DEEP     0x02
-
-#define CMD__SLEEP_MODE_ACTIVE_STR   "none"
-#define CMD__SLEEP_MODE_EXTENDED_STR "extended"
-#define CMD__SLEEP_MODE_DEEP_STR     "deep"
-
-static uint8_t parse_sleep_mode(int *return_status, const char *str)
+/*
+ ****************************************************************************************
+ * @brief Command handler for "Unmodulated RX/TX"
+ *
+ * command line:
+ *   prodtest  starttest_unmodulated  OFF
+ *   prodtest  starttest_unmodulated  TX 2404
+ *   prodtest  starttest_unmodulated  RX 2404
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int starttest_unmodulated_handler(int argc, char **argv)
 {
-	uint8_t result = 0;
-	
-	*return_status = 0;
+	uint8_t mode;
+	uint8_t frequency;
+	int frequency_arg_required = 0;
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
 
-	if ( 0 == strcmp(str, CMD__SLEEP_MODE_ACTIVE_STR) )
+
+	// we need at least 1 arg: the MODE
+	if (argc < 2 )
 	{
-		result = CMD__SLEEP_MODE_ACTIVE;
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
 	}
-	else if ( 0 == strcmp(str, CMD__SLEEP_MODE_EXTENDED_STR) )
+
+	// parse MODE - argv[1]
+	mode = parse_unmodulated_mode(&return_status, argv[1]);
+	if (return_status != 0 ) 
 	{
-		result = CMD__SLEEP_MODE_EXTENDED;
+		return_status = SC_INVALID_UNMODULATED_CMD_MODE_ARG;
+		goto exit_command_handler;
 	}
-	else if ( 0 == strcmp(str, CMD__SLEEP_MODE_DEEP_STR) )
-	{
-		result = CMD__SLEEP_MODE_DEEP;
+
+	switch (mode) {
+		case UNMODULATED_CMD_MODE_OFF: frequency_arg_required = 0; break;
+		case UNMODULATED_CMD_MODE_TX:  frequency_arg_required = 1; break;
+		case UNMODULATED_CMD_MODE_RX:  frequency_arg_required = 1; break;
 	}
-	else
+
+	if (argc != (2 + frequency_arg_required) )
 	{
-		*return_status = 1;
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
 	}
 
-	return result;
-}
-
-int sleep_cmd_handler(int argc, char **argv)
-{
-    uint8_t sleep_type;
+	if ( frequency_arg_required == 1 )
+	{
+		// parse FREQUENCY
+		frequency = parse_frequency(&return_status, argv[2]);
+		if (return_status != 0 ) 
+		{
+			return_status = SC_INVALID_FREQUENCY_ARG;
+			goto exit_command_handler;\
+		}
+	}
+	else
+	{
+		frequency = 0;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	// send HCI command
+	hci_dialog_unmodulated_rx_tx(mode, frequency);
+
+	// receive reply event
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
+
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
+	
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 3
+		&& evt->parameters[1] == 0x10
+		&& evt->parameters[2] == 0x40)
+	)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// event has no return parameters
+
+	
+exit_command_handler:
+	if(evt)
+		hci_free_event(evt);
+
+	printf("status = %d\n", return_status);
+	
+	return return_status;
+};
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for "Start TX continue test"
+ *
+ *  Command line:
+ *    prodtest starttest_tx_continue <FREQUENCY> <PAYLOAD_TYPE>
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int starttest_tx_continue_handler(int argc, char **argv)
+{
+	uint8_t frequency, payload_type;
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
+
+	// check number of arguments
+	if (argc != 3)
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+	// parse FREQUENCY
+	frequency = parse_frequency(&return_status, argv[1]);
+
+	if (return_status != 0 ) 
+	{
+		return_status = SC_INVALID_FREQUENCY_ARG;
+		goto exit_command_handler;
+	}	
+	// parse PAYLOAD_TYPE 
+	payload_type = parse_payload_type(&return_status, argv[2]);
+	if (return_status != 0 ) 
+	{
+		return_status = SC_INVALID_PAYLOAD_TYPE_ARG;
+		goto exit_command_handler;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	// send HCI command
+	hci_dialog_tx_continuous_start(/*uint8_t*/ frequency, /*uint8_t*/ payload_type);
+
+	// receive reply event
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
+
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
+	
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 3
+		&& evt->parameters[1] == 0x50
+		&& evt->parameters[2] == 0x40)
+	)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// no return parameters
+
+exit_command_handler:
+	if(evt)
+		hci_free_event(evt);
+
+	printf("status = %d\n", return_status);
+	
+	return return_status;
+};
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for "End TX continue test"
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int stoptest_tx_continue_handler(int argc, char **argv)
+{
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
+
+
+	// check number of args
+	if (argc != 1)
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	// send HCI command
+	hci_dialog_tx_continuous_end();
+
+	// receive reply event
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
+
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
+	
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 3
+		&& evt->parameters[1] == 0x60
+		&& evt->parameters[2] == 0x40)
+	)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+	
+exit_command_handler:
+	if(evt)
+		hci_free_event(evt);
+
+	printf("status = %d\n", return_status);
+	
+	return return_status;
+};
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for "Reset Command"
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int reset_handler(int argc, char **argv)
+{
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
+
+	// HCI event return parameters:
+	uint8_t Num_HCI_Command_Packets;
+	uint16_t opcode;
+	uint8_t status; // see: BT spec 4.0 vol 2- part D - error codes
+
+	// check number of args
+	if (argc != 1)
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	// send HCI command
+	hci_reset();
+
+	// receive reply event
+	evt = hci_recv_event_wait(hci_cmd_timeout(RX_TIMEOUT_MILLIS));
+
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
+	
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 4
+		&& evt->parameters[1] == 0x03
+		&& evt->parameters[2] == 0x0C)
+	)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// parse event parameters
+	Num_HCI_Command_Packets = evt->parameters[0];
+	opcode = evt->parameters[1] + 256 * evt->parameters[2];
+	status = evt->parameters[3];
+
+	// check command completion event status
+	if (status != 0 )
+	{
+		return_status = SC_HCI_STANDARD_ERROR_CODE_BASE + status;
+	}
+	
+exit_command_handler:
+	if(evt)
+		hci_free_event(evt);
+
+	printf("status = %d\n", return_status);
+	
+	return return_status;
+};
+
+#define CMD__SLEEP_MODE_ACTIVE   0x00
+#define CMD__SLEEP_MODE_EXTENDED 0x01
+#define CMD__SLEEP_MODE_DEEP     0x02
+
+#define CMD__SLEEP_MODE_ACTIVE_STR   "none"
+#define CMD__SLEEP_MODE_EXTENDED_STR "extended"
+#define CMD__SLEEP_MODE_DEEP_STR     "deep"
+
+static uint8_t parse_sleep_mode(int *return_status, const char *str)
+{
+	uint8_t result = 0;
+	
+	*return_status = 0;
+
+	if ( 0 == strcmp(str, CMD__SLEEP_MODE_ACTIVE_STR) )
+	{
+		result = CMD__SLEEP_MODE_ACTIVE;
+	}
+	else if ( 0 == strcmp(str, CMD__SLEEP_MODE_EXTENDED_STR) )
+	{
+		result = CMD__SLEEP_MODE_EXTENDED;
+	}
+	else if ( 0 == strcmp(str, CMD__SLEEP_MODE_DEEP_STR) )
+	{
+		result = CMD__SLEEP_MODE_DEEP;
+	}
+	else
+	{
+		*return_status = 1;
+	}
+
+	return result;
+}
+
+int sleep_cmd_handler(int argc, char **argv)
+{
+    uint8_t sleep_type;
     uint8_t minutes;
     uint8_t seconds;
     int return_status = 0;
     hci_evt_t *evt = NULL;
 
     // check number of arguments
-    if (argc != 4)
+    if (argc != 4)
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // parse sleep_type
+    sleep_type = parse_sleep_mode(&return_status, argv[1]);
+    if (return_status != 0 ) 
+    {
+        return_status = SC_INVALID_SLEEP_CMD_MODE_ARG;
+        goto exit_command_handler;
+    }
+
+    // parse minutes
+    minutes = parse_uint8(&return_status, argv[2]);
+    if (return_status != 0 ) 
+    {
+        return_status = SC_INVALID_SLEEP_CMD_MINUTES_ARG;
+        goto exit_command_handler;
+    }
+
+    // parse seconds
+    seconds = parse_uint8(&return_status, argv[3]);
+    if (return_status != 0 ) 
+    {
+        return_status = SC_INVALID_SLEEP_CMD_SECONDS_ARG;
+        goto exit_command_handler;
+    }
+
+    //
+    // execute ..
+    //
+
+    // open COM port, initialize rx thread  and queue
+    if (!InitUART(g_com_port_number, 115200))  
+        InitTasks();
+    else
+    {
+        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+        goto exit_command_handler;
+    }
+
+    // send HCI command
+    hci_dialog_sleep(sleep_type, minutes, seconds);
+
+    // receive reply event
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
+
+    if (evt == NULL)
+    {
+        return_status = SC_RX_TIMEOUT; // rx timeout 
+        goto exit_command_handler;
+    }
+
+    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+    // check response
+    if ( !( evt->event == 0x0F
+        && evt->length == 3
+        && evt->parameters[1] == 0x70
+        && evt->parameters[2] == 0x40)
+    )
+    {
+        return_status = SC_UNEXPECTED_EVENT; // unexpected event
+        goto exit_command_handler;
+    }
+
+    // no return parameters
+
+exit_command_handler:
+    if(evt)
+        hci_free_event(evt);
+
+    printf("status = %d\n", return_status);
+
+    return return_status;
+}
+
+#define CMD__XTRIM_OP_RD  0x00
+#define CMD__XTRIM_OP_WR  0x01
+#define CMD__XTRIM_OP_EN  0x02
+#define CMD__XTRIM_OP_INC 0x03
+#define CMD__XTRIM_OP_DEC 0x04
+#define CMD__XTRIM_OP_DIS 0x05
+#define CMD__XTRIM_OP_CALTEST 0x06
+#define CMD__XTRIM_OP_CAL     0x07
+
+#define CMD__XTRIM_OP_RD_STR  "rd"
+#define CMD__XTRIM_OP_WR_STR  "wr"
+#define CMD__XTRIM_OP_EN_STR  "en"
+#define CMD__XTRIM_OP_INC_STR "inc"
+#define CMD__XTRIM_OP_DEC_STR "dec"
+#define CMD__XTRIM_OP_DIS_STR "dis"
+#define CMD__XTRIM_OP_CALTEST_STR "caltest"
+#define CMD__XTRIM_OP_CAL_STR     "cal"
+
+static uint8_t parse_xtrim_operation(int *return_status, const char *str)
+{
+    uint8_t result = 0;
+    *return_status = 0;
+
+    if      ( 0 == strcmp(str, CMD__XTRIM_OP_RD_STR)  ) { result = CMD__XTRIM_OP_RD; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_WR_STR)  ) { result = CMD__XTRIM_OP_WR; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_EN_STR)  ) { result = CMD__XTRIM_OP_EN; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_INC_STR) ) { result = CMD__XTRIM_OP_INC; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_DEC_STR) ) { result = CMD__XTRIM_OP_DEC; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_DIS_STR) ) { result = CMD__XTRIM_OP_DIS; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_CALTEST_STR) ) { result = CMD__XTRIM_OP_CALTEST; }
+    else if ( 0 == strcmp(str, CMD__XTRIM_OP_CAL_STR    ) ) { result = CMD__XTRIM_OP_CAL; }
+    else
+    {
+        *return_status = 1;
+    }
+
+    return result;
+}
+
+int xtal_trimming_cmd_handler(int argc, char **argv)
+{
+    uint8_t operation;
+    uint16_t required_number_of_args = 0;
+    uint16_t trim_value_or_delta = 0;
+    uint8_t freq_gen_gpio = 0;
+    int trim_value_or_delta_arg_required = 0;
+    uint16_t returned_trim_value = 0;
+    int return_status = 0;
+    hci_evt_t *evt = NULL;
+    unsigned int timeout = RX_TIMEOUT_MILLIS;
+
+    // check number of arguments
+    if ( !(argc == 2  || argc == 3) )
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // parse operation
+    operation = parse_xtrim_operation(&return_status, argv[1]);
+    if (return_status != 0 ) 
+    {
+        return_status = SC_INVALID_XTAL_TRIMMING_CMD_OPERATION_ARG;
+        goto exit_command_handler;
+    }
+
+    switch(operation)
+    {
+        case CMD__XTRIM_OP_RD:
+        case CMD__XTRIM_OP_EN:
+        case CMD__XTRIM_OP_DIS:
+            ///trim_value_or_delta_arg_required = 0;
+            required_number_of_args = 2;
+            break;
+        case CMD__XTRIM_OP_WR:
+        case CMD__XTRIM_OP_INC:
+        case CMD__XTRIM_OP_DEC:
+            ///trim_value_or_delta_arg_required = 1;
+            required_number_of_args = 3;
+            break;
+            
+        case CMD__XTRIM_OP_CALTEST:
+        case CMD__XTRIM_OP_CAL:
+            required_number_of_args = 3;
+            break;
+    }
+
+    // check number of arguments
+    if ( !(argc == required_number_of_args) )
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // parse args if any
+    switch(operation)
+    {
+        case CMD__XTRIM_OP_RD:
+        case CMD__XTRIM_OP_EN:
+        case CMD__XTRIM_OP_DIS:
+            break;
+        case CMD__XTRIM_OP_WR:
+        case CMD__XTRIM_OP_INC:
+        case CMD__XTRIM_OP_DEC:
+            // parse trim_value_or_delta
+            trim_value_or_delta = parse_uint16(&return_status, argv[2]);
+            if (return_status != 0 ) 
+            {
+                return_status = SC_INVALID_XTAL_TRIMMING_CMD_TRIM_VALUE_ARG;
+                goto exit_command_handler;
+            }
+            break;
+            
+        case CMD__XTRIM_OP_CALTEST:
+        case CMD__XTRIM_OP_CAL:
+            freq_gen_gpio = parse_gpio(argv[2]);
+            if (freq_gen_gpio == INVALID_GPIO )
+            {
+                return_status = SC_INVALID_GPIO_ARG;
+                goto exit_command_handler;
+            }
+            trim_value_or_delta = freq_gen_gpio;
+            timeout = 15 * 1000; // 15 seconds
+            break;
+    }
+
+    //
+    // execute ..
+    //
+
+    // open COM port, initialize rx thread  and queue
+    if (!InitUART(g_com_port_number, 115200))  
+        InitTasks();
+    else
+    {
+        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+        goto exit_command_handler;
+    }
+
+    // send HCI command
+    hci_dialog_xtal_trimming(operation, trim_value_or_delta);
+
+    // receive reply event
+    evt = hci_recv_reply(timeout, operation == CMD__XTRIM_OP_RD ? HCI_REPLY_REPEATABLE : HCI_REPLY_ONE_SHOT); // limit depends on operation
+
+    if (evt == NULL)
+    {
+        return_status = SC_RX_TIMEOUT; // rx timeout 
+        goto exit_command_handler;
+    }
+
+    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+    // check response 
+    if ( !( evt->event == 0x0E 
+        && evt->length == 5
+        && evt->parameters[1] == 0x80
+        && evt->parameters[2] == 0x40)
+    )
+    {
+        return_status = SC_UNEXPECTED_EVENT; // unexpected event
+        goto exit_command_handler;
+    }
+
+    // no return parameters
+    returned_trim_value = evt->parameters[3] + 256 * evt->parameters[4];
+
+    switch(operation)
+    {
+        case CMD__XTRIM_OP_CALTEST:
+        case CMD__XTRIM_OP_CAL:
+            if (returned_trim_value == 0x01)
+                return_status = SC_XTAL_TRIMMING_CAL_OUT_OF_RANGE_ERROR;
+            else if (returned_trim_value == 0x02)
+                return_status = SC_XTAL_TRIMMING_CAL_FREQ_NOT_CONNECTED;
+            break;
+        default:
+            break;
+    }
+
+exit_command_handler:
+    if(evt)
+        hci_free_event(evt);
+
+    printf("status     = %d\n", return_status);
+    if(operation == CMD__XTRIM_OP_RD)
+    {
+        printf("trim_value = %d\n", returned_trim_value);
+        result_put_int("trim_value", returned_trim_value);
+    }
+
+    return return_status;
+} 
+
+#define CMD__OTP_OP_RE_XTRIM_STR  "re_xtrim"
+#define CMD__OTP_OP_WE_XTRIM_STR  "we_xtrim"
+#define CMD__OTP_OP_RD_XTRIM_STR  "rd_xtrim"
+#define CMD__OTP_OP_WR_XTRIM_STR  "wr_xtrim"
+#define CMD__OTP_OP_RD_BDADDR_STR "rd_bdaddr"
+#define CMD__OTP_OP_WR_BDADDR_STR "wr_bdaddr"
+ 
+ 
+static uint8_t parse_otp_operation(int *return_status, const char *str)
+{
+    uint8_t result = 0;
+    *return_status = 0;
+
+    if      ( 0 == strcmp(str, CMD__OTP_OP_RD_XTRIM_STR)  ) { result = CMD__OTP_OP_RD_XTRIM; }
+    else if ( 0 == strcmp(str, CMD__OTP_OP_WR_XTRIM_STR)  ) { result = CMD__OTP_OP_WR_XTRIM; }
+    else if ( 0 == strcmp(str, CMD__OTP_OP_RD_BDADDR_STR) ) { result = CMD__OTP_OP_RD_BDADDR; }
+    else if ( 0 == strcmp(str, CMD__OTP_OP_WR_BDADDR_STR) ) { result = CMD__OTP_OP_WR_BDADDR; }
+	else if ( 0 == strcmp(str, CMD__OTP_OP_RE_XTRIM_STR)  ) { result = CMD__OTP_OP_RE_XTRIM; }
+	else if ( 0 == strcmp(str, CMD__OTP_OP_WE_XTRIM_STR)  ) { result = CMD__OTP_OP_WE_XTRIM; }
+    else
+    {
+        *return_status = 1;
+    }
+
+    return result;
+}
+
+/* what the OTP holds after a write whose reply was lost */
+#define OTP_STATE_UNKNOWN   0 // could not be read back
+#define OTP_STATE_BLANK     1 // not programmed, the write can be sent again
+#define OTP_STATE_WRITTEN   2 // holds the value written
+#define OTP_STATE_OTHER     3 // holds something else
+
+/* otp_write_t.operation of otp_write */
+#define OTP_WRITE_WORDS     0xFF
+
+typedef struct {
+    uint8_t operation;         // CMD__OTP_OP_WR_XTRIM, _WR_BDADDR, _WE_XTRIM or OTP_WRITE_WORDS
+    uint16_t trim_value;       // CMD__OTP_OP_WR_XTRIM
+    uint8_t *bd_addr;          // CMD__OTP_OP_WR_BDADDR
+    uint16_t otp_address;      // OTP_WRITE_WORDS
+    uint32_t *words;
+    uint8_t word_count;
+} otp_write_t;
+
+static void otp_write_send(const otp_write_t *w)
+{
+    switch(w->operation)
+    {
+        case CMD__OTP_OP_WR_XTRIM:  hci_dialog_otp_wr_xtrim(w->trim_value); break;
+        case CMD__OTP_OP_WR_BDADDR: hci_dialog_otp_wr_bdaddr(w->bd_addr); break;
+        case CMD__OTP_OP_WE_XTRIM:  hci_dialog_otp_we_xtrim(); break;
+        case OTP_WRITE_WORDS:       hci_dialog_otp_write(w->otp_address, w->words, w->word_count); break;
+    }
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read back what an OTP write programs.
+ *
+ * @return OTP_STATE_...
+ ****************************************************************************************
+*/
+static int otp_write_state(const otp_write_t *w)
+{
+    uint8_t expected[4 * MAX_READ_WRITE_OTP_WORDS];
+    uint8_t mask[4 * MAX_READ_WRITE_OTP_WORDS];
+    int length = 0, offset = 4, reply_length = 10;
+    bool blank = true, written = true;
+    hci_evt_t *evt;
+    int kk;
+
+    memset(mask, 0xFF, sizeof(mask));
+
+    switch(w->operation)
+    {
+        case CMD__OTP_OP_WR_XTRIM:
+            hci_dialog_otp_rd_xtrim();
+            expected[0] = w->trim_value & 0xFF;
+            expected[1] = w->trim_value >> 8;
+            length = 2;
+            break;
+        case CMD__OTP_OP_WR_BDADDR:
+            hci_dialog_otp_rd_bdaddr();
+            memcpy(expected, w->bd_addr, 6);
+            length = 6;
+            break;
+        case CMD__OTP_OP_WE_XTRIM:
+            hci_dialog_otp_re_xtrim();
+            expected[0] = 0x10;  // the enable bit, see hci_dialog_otp_we_xtrim()
+            mask[0] = 0x10;
+            length = 1;
+            break;
+        case OTP_WRITE_WORDS:
+            hci_dialog_otp_read(w->otp_address, w->word_count);
+            for (kk = 0; kk < w->word_count; kk++)
+            {
+                expected[4 * kk + 0] = (w->words[kk]      ) & 0xFF;
+                expected[4 * kk + 1] = (w->words[kk] >>  8) & 0xFF;
+                expected[4 * kk + 2] = (w->words[kk] >> 16) & 0xFF;
+                expected[4 * kk + 3] = (w->words[kk] >> 24) & 0xFF;
+            }
+            length = 4 * w->word_count;
+            offset = 5;
+            reply_length = 5 + length;
+            break;
+    }
+
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE);
+    if (evt == NULL || evt->event != 0x0E || evt->length != reply_length)
+    {
+        hci_free_event(evt);
+        return OTP_STATE_UNKNOWN;
+    }
+
+    for (kk = 0; kk < length; kk++)
+    {
+        if (evt->parameters[offset + kk] & mask[kk])
+            blank = false;
+        if ((evt->parameters[offset + kk] & mask[kk]) != expected[kk])
+            written = false;
+    }
+    hci_free_event(evt);
+
+    if (written)
+        return OTP_STATE_WRITTEN;
+
+    return blank ? OTP_STATE_BLANK : OTP_STATE_OTHER;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Recover from a lost reply to an OTP write. OTP is never programmed twice
+ *        blindly: after a resync the target is read back, the write counts as done
+ *        if it holds the value, and is sent again only if it is still blank.
+ *
+ * @return status code.
+ ****************************************************************************************
+*/
+static int otp_write_recover(const otp_write_t *w)
+{
+    long attempts = config_get_long(HCI_RETRY_CONFIG_ATTEMPTS, HCI_RETRY_DEFAULT_ATTEMPTS);
+    long attempt;
+    hci_evt_t *evt;
+
+    for (attempt = 1; ; attempt++)
+    {
+        if (!hci_resync())
+            return SC_RX_TIMEOUT;
+
+        switch(otp_write_state(w))
+        {
+            case OTP_STATE_WRITTEN:
+                fprintf(stderr, "No reply to the OTP write, but OTP holds the value written.\n");
+                return SC_NO_ERROR;
+            case OTP_STATE_OTHER:
+                fprintf(stderr, "No reply to the OTP write, and OTP holds another value. Not writing again.\n");
+                return SC_OTP_WRITE_MISMATCH;
+            case OTP_STATE_UNKNOWN:
+                return SC_RX_TIMEOUT;
+        }
+
+        if (attempt >= attempts)
+            return SC_RX_TIMEOUT;
+
+        fprintf(stderr, "No reply to the OTP write, and OTP is still blank. Writing again.\n");
+        otp_write_send(w);
+
+        evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
+        if (evt != NULL)
+        {
+            handle_hci_event(evt);
+            hci_free_event(evt);
+
+            // whatever the reply says, the OTP tells whether the write took
+            switch(otp_write_state(w))
+            {
+                case OTP_STATE_WRITTEN: return SC_NO_ERROR;
+                case OTP_STATE_UNKNOWN: return SC_RX_TIMEOUT;
+                default:                return SC_OTP_WRITE_MISMATCH;
+            }
+        }
+    }
+}
+
+int otp_cmd_handler(int argc, char **argv)
+{
+    uint8_t operation = 0xFF;
+    uint16_t required_number_of_args = 0;
+    uint16_t trim_value = 0;
+    uint16_t returned_trim_value = 0;
+    uint8_t bd_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    uint8_t returned_bd_addr[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t returned_xtrim_enable[4] = {0x00, 0x00, 0x00, 0x00};
+    char bd_addr_str[18];
+    int return_status = 0;
+    hci_evt_t *evt = NULL;
+    otp_write_t write;
+    bool is_write;
+    const char *bd_addr_arg;
+    pool_claim_t claim;
+    bool bd_addr_auto = false;
+    bool sent = false;
+
+    memset(&claim, 0, sizeof(claim));
+
+    // check number of arguments
+    if ( !(argc == 2  || argc == 3) )
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // parse operation
+    operation = parse_otp_operation(&return_status, argv[1]);
+    if (return_status != 0 ) 
+    {
+        return_status = SC_INVALID_OTP_CMD_OPERATION_ARG;
+        goto exit_command_handler;
+    }
+
+    switch(operation)
+    {
+        case CMD__OTP_OP_RD_XTRIM:  required_number_of_args = 2; break;
+        case CMD__OTP_OP_WR_XTRIM:  required_number_of_args = 3; break;
+        case CMD__OTP_OP_RD_BDADDR: required_number_of_args = 2; break;
+        case CMD__OTP_OP_WR_BDADDR: required_number_of_args = 3; break;
+		case CMD__OTP_OP_RE_XTRIM:  required_number_of_args = 2; break;
+		case CMD__OTP_OP_WE_XTRIM:  required_number_of_args = 2; break;
+    }
+
+    // check number of arguments
+    if ( !(argc == required_number_of_args) )
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // if the operation requires an arg
+    switch(operation)
+    {
+        case CMD__OTP_OP_RD_XTRIM:
+		case CMD__OTP_OP_RE_XTRIM:
+		case CMD__OTP_OP_WE_XTRIM:
+            break;
+
+        case CMD__OTP_OP_WR_XTRIM:
+            {
+                // parse trim value 
+                trim_value = parse_uint16(&return_status, argv[2]);
+                if (return_status != 0 ) 
+                {
+                    return_status = SC_INVALID_OTP_CMD_TRIM_VALUE_ARG;
+                    goto exit_command_handler;
+                }
+            }
+            break;
+
+        case CMD__OTP_OP_RD_BDADDR: 
+            break;
+
+        case CMD__OTP_OP_WR_BDADDR: 
+            {
+                // "auto" takes the next address of the range in the configuration
+                if (0 == strcmp(argv[2], "auto"))
+                {
+                    switch(bdaddr_next(bd_addr))
+                    {
+                        case BDADDR_OK:
+                            bd_addr_auto = true;
+                            break;
+                        case BDADDR_NO_RANGE:
+                            fprintf(stderr, "No valid %s / %s in the configuration.\n", BDADDR_CONFIG_FIRST, BDADDR_CONFIG_LAST);
+                            return_status = SC_BDADDR_RANGE_ERROR;
+                            goto exit_command_handler;
+                        case BDADDR_EXHAUSTED:
+                            fprintf(stderr, "No BD address left in the range.\n");
+                            return_status = SC_BDADDR_RANGE_ERROR;
+                            goto exit_command_handler;
+                        default:
+                            fprintf(stderr, "The BD address range state cannot be updated.\n");
+                            return_status = SC_BDADDR_RANGE_ERROR;
+                            goto exit_command_handler;
+                    }
+                    break;
+                }
+
+                // "@<pool file>" takes the next free address of the pool
+                bd_addr_arg = argv[2];
+                if (bd_addr_arg[0] == '@')
+                {
+                    if (!pool_claim(bd_addr_arg + 1, POOL_BDADDR, &claim))
+                    {
+                        return_status = SC_POOL_ERROR;
+                        goto exit_command_handler;
+                    }
+                    bd_addr_arg = claim.value;
+                }
+
+                // parse BD address
+                return_status = parse_bd_addr(bd_addr, bd_addr_arg);
+                if (return_status != 0 ) 
+                {
+                    return_status = SC_INVALID_OTP_CMD_BDADDR_ARG;
+                    goto exit_command_handler;
+                }
+            }
+            break;
+		 
+    }
+
+    // an address written before is refused before anything is burned
+    if (operation == CMD__OTP_OP_WR_BDADDR)
+    {
+        sprintf(bd_addr_str, "%02X:%02X:%02X:%02X:%02X:%02X", bd_addr[5], bd_addr[4],
+                bd_addr[3], bd_addr[2], bd_addr[1], bd_addr[0]);
+        if (history_used(HISTORY_BDADDR, bd_addr_str))
+        {
+            fprintf(stderr, "BD address %s was written before.\n", bd_addr_str);
+            return_status = SC_DUPLICATE_VALUE;
+            goto exit_command_handler;
+        }
+    }
+
+    //
+    // execute ..
+    //
+
+    // open COM port, initialize rx thread  and queue
+    if (!InitUART(g_com_port_number, 115200))  
+        InitTasks();
+    else
+    {
+        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+        goto exit_command_handler;
+    }
+
+    // send HCI command
+    switch(operation)
+    {
+        case CMD__OTP_OP_RD_XTRIM:
+            hci_dialog_otp_rd_xtrim();
+            break;
+        case CMD__OTP_OP_WR_XTRIM:
+            hci_dialog_otp_wr_xtrim (trim_value);
+            break;
+        case CMD__OTP_OP_RD_BDADDR:
+            hci_dialog_otp_rd_bdaddr();
+            break;
+        case CMD__OTP_OP_WR_BDADDR:
+            sent = true;
+            hci_dialog_otp_wr_bdaddr(bd_addr);
+            break;
+		case CMD__OTP_OP_RE_XTRIM:
+            hci_dialog_otp_re_xtrim ();
+            break;
+		case CMD__OTP_OP_WE_XTRIM:
+            hci_dialog_otp_we_xtrim ();
+            break;
+    }
+
+    // receive reply event; reads are sent again if it is lost, writes are verified
+    is_write = operation == CMD__OTP_OP_WR_XTRIM
+            || operation == CMD__OTP_OP_WR_BDADDR
+            || operation == CMD__OTP_OP_WE_XTRIM;
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, is_write ? HCI_REPLY_ONE_SHOT : HCI_REPLY_REPEATABLE);
+
+    if (evt == NULL)
+    {
+        if (is_write)
+        {
+            memset(&write, 0, sizeof(write));
+            write.operation = operation;
+            write.trim_value = trim_value;
+            write.bd_addr = bd_addr;
+            return_status = otp_write_recover(&write);
+        }
+        else
+            return_status = SC_RX_TIMEOUT; // rx timeout 
+        goto exit_command_handler;
+    }
+
+    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+    // check response 
+    if ( !( evt->event == 0x0E 
+        && evt->length == 10
+        && evt->parameters[1] == 0x90
+        && evt->parameters[2] == 0x40)
+    )
+    {
+        return_status = SC_UNEXPECTED_EVENT; // unexpected event
+        goto exit_command_handler;
+    }
+
+    // return parameters
+    switch(operation)
+    {
+        case CMD__OTP_OP_RD_XTRIM:
+            returned_trim_value = evt->parameters[4] + 256 * evt->parameters[5];
+            break;
+
+        case CMD__OTP_OP_WR_XTRIM:
+            break;
+        case CMD__OTP_OP_RD_BDADDR:
+            returned_bd_addr[0] = evt->parameters[4];
+            returned_bd_addr[1] = evt->parameters[5];
+            returned_bd_addr[2] = evt->parameters[6];
+            returned_bd_addr[3] = evt->parameters[7];
+            returned_bd_addr[4] = evt->parameters[8];
+            returned_bd_addr[5] = evt->parameters[9];
+            break;
+        case CMD__OTP_OP_WR_BDADDR:
+            // an address of the range is read back on the same connection
+            if (bd_addr_auto)
+            {
+                memset(&write, 0, sizeof(write));
+                write.operation = operation;
+                write.bd_addr = bd_addr;
+                switch(otp_write_state(&write))
+                {
+                    case OTP_STATE_WRITTEN: break;
+                    case OTP_STATE_UNKNOWN: return_status = SC_RX_TIMEOUT; break;
+                    default:                return_status = SC_OTP_WRITE_MISMATCH; break;
+                }
+            }
+            break;
+		case CMD__OTP_OP_RE_XTRIM:
+		 
+			returned_xtrim_enable[0]= evt->parameters[4];
+			 
+             break;
+	  case CMD__OTP_OP_WE_XTRIM:
+             break;
+	}
+
+exit_command_handler:
+    if(evt)
+        hci_free_event(evt);
+
+    printf("status     = %d\n", return_status);
+
+    switch(operation)
+    {
+        case CMD__OTP_OP_RD_XTRIM:
+            printf("otp_xtrim_value = %d\n", returned_trim_value );
+            result_put_int("otp_xtrim_value", returned_trim_value);
+            break;
+        case CMD__OTP_OP_WR_XTRIM:
+            break;
+        case CMD__OTP_OP_RD_BDADDR:
+            printf("otp_bd_addr = %02X:%02X:%02X:%02X:%02X:%02X" , returned_bd_addr[5],
+                                                                   returned_bd_addr[4],
+                                                                   returned_bd_addr[3],
+                                                                   returned_bd_addr[2],
+                                                                   returned_bd_addr[1],
+                                                                   returned_bd_addr[0] 
+                                                                   );
+            sprintf(bd_addr_str, "%02X:%02X:%02X:%02X:%02X:%02X", returned_bd_addr[5], returned_bd_addr[4],
+                    returned_bd_addr[3], returned_bd_addr[2], returned_bd_addr[1], returned_bd_addr[0]);
+            result_put_str("otp_bd_addr", bd_addr_str);
+            break;
+        case CMD__OTP_OP_WR_BDADDR:
+            if (return_status == SC_NO_ERROR && !history_add(HISTORY_BDADDR, bd_addr_str))
+                fprintf(stderr, "BD address %s not added to the history index.\n", bd_addr_str);
+            if (claim.claimed != 0)
+            {
+                printf("bd_addr = %s\n", claim.value);
+                result_put_str("bd_addr", claim.value);
+                pool_finish(&claim, pool_outcome(return_status, sent));
+            }
+            if (bd_addr_auto)
+            {
+                printf("bd_addr = %s\n", bd_addr_str);
+                result_put_str("bd_addr", bd_addr_str);
+                // only an address that was never sent goes back to the range
+                if (return_status == SC_COM_PORT_INIT_ERROR)
+                    bdaddr_release(bd_addr);
+            }
+            break;
+		case CMD__OTP_OP_RE_XTRIM:
+ 			if (returned_xtrim_enable[0] & 0x10) 
+                printf("otp_xtrim_enabled = 1 \n");
+			else
+                printf("otp_xtrim_enabled = 0 \n");
+            result_put_int("otp_xtrim_enabled", (returned_xtrim_enable[0] & 0x10) != 0);
+             break;
+		case CMD__OTP_OP_WE_XTRIM:
+             break;
+    }
+
+    return return_status;
+}
+
+
+int otp_read_cmd_handler(int argc, char **argv)
+{
+    uint16_t otp_address = 0x0000;
+    uint8_t word_count = 0 ;
+    uint8_t returned_word_count = 0;
+    uint32_t returned_words[MAX_READ_WRITE_OTP_WORDS];
+    int return_status = 0;
+    hci_evt_t *evt = NULL;
+    int kk = 0;
+    char field_name[16];
+
+    // check number of arguments
+    if ( !(argc == 3) )
     {
         return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
         goto exit_command_handler;
     }
 
-    // parse sleep_type
-    sleep_type = parse_sleep_mode(&return_status, argv[1]);
-    if (return_status != 0 ) 
+    // parse otp_address
+    otp_address = parse_hex_uint32(&return_status, argv[1]);
+    if (return_status != 0 
+        || (otp_address % 4 != 0)
+        || (otp_address >= 0x8000) )
     {
-        return_status = SC_INVALID_SLEEP_CMD_MODE_ARG;
+        return_status = SC_INVALID_OTP_ADDRESS_ARG;
         goto exit_command_handler;
     }
 
-    // parse minutes
-    minutes = parse_uint8(&return_status, argv[2]);
-    if (return_status != 0 ) 
+    // parse word_count
+    word_count = (uint8_t) parse_number(&return_status, argv[2]);
+    if (return_status != 0
+        || word_count == 0
+        || word_count > MAX_READ_WRITE_OTP_WORDS
+        || (otp_address + word_count * 4 > 0x8000) )
     {
-        return_status = SC_INVALID_SLEEP_CMD_MINUTES_ARG;
+        return_status = SC_INVALID_NUMBER_OF_OTP_WORDS_ARG;
         goto exit_command_handler;
     }
 
-    // parse seconds
-    seconds = parse_uint8(&return_status, argv[3]);
-    if (return_status != 0 ) 
+    //
+    // execute ..
+    //
+
+    // open COM port, initialize rx thread  and queue
+    if (!InitUART(g_com_port_number, 115200))  
+        InitTasks();
+    else
     {
-        return_status = SC_INVALID_SLEEP_CMD_SECONDS_ARG;
+        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+        goto exit_command_handler;
+    }
+
+    // send HCI command
+    hci_dialog_otp_read(otp_address, word_count);
+
+    // receive reply event
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
+
+    if (evt == NULL)
+    {
+        return_status = SC_RX_TIMEOUT; // rx timeout 
+        goto exit_command_handler;
+    }
+
+    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+    // check response 
+    if ( !( evt->event == 0x0E 
+        && evt->length == (5 + 4 * word_count)
+        && evt->parameters[1] == 0xA0
+        && evt->parameters[2] == 0x40)
+    )
+    {
+        return_status = SC_UNEXPECTED_EVENT; // unexpected event
+        goto exit_command_handler;
+    }
+
+    // return parameters
+    returned_word_count = evt->parameters[4];
+    {
+        int pos = 5;
+        for (kk = 0 ; kk < returned_word_count; ++kk, pos +=4) 
+        {
+            returned_words[kk] = evt->parameters[pos]
+                              | (evt->parameters[pos + 1] <<  8)
+                              | (evt->parameters[pos + 2] << 16)
+                              | (evt->parameters[pos + 3] << 24) ;
+        }
+    }
+
+exit_command_handler:
+    if(evt)
+        hci_free_event(evt);
+
+    printf("status = %d\n", return_status);
+    for (kk = 0 ; kk < returned_word_count; ++kk) 
+    {
+        printf("[%04X] = %08X \n", otp_address+ 4* kk, returned_words[kk]);
+        sprintf(field_name, "otp_%04X", otp_address + 4 * kk);
+        result_put_hex(field_name, returned_words[kk], 8);
+    }
+
+    return return_status;
+}
+
+
+int otp_write_cmd_handler(int argc, char **argv)
+{
+    uint16_t otp_address = 0x0000;
+    uint8_t word_count = 0 ;
+    uint8_t returned_word_count = 0;
+    uint32_t words[MAX_READ_WRITE_OTP_WORDS];
+    int return_status = 0;
+    hci_evt_t *evt = NULL;
+    otp_write_t write;
+    int kk = 0;
+
+    // check number of arguments
+    if ( !(argc >= 3) )
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // parse otp_address
+    otp_address = parse_hex_uint32(&return_status, argv[1]);
+    if (return_status != 0 
+        || (otp_address % 4 != 0)
+        || (otp_address >= 0x8000) )
+    {
+        return_status = SC_INVALID_OTP_ADDRESS_ARG;
+        goto exit_command_handler;
+    }
+
+    // the rest arguments are the words to be written in OTP
+    word_count = argc - 2;
+
+    if ( word_count == 0
+        || word_count > MAX_READ_WRITE_OTP_WORDS 
+        || (otp_address + word_count * 4 > 0x8000) )
+    {
+        return_status = SC_INVALID_NUMBER_OF_OTP_WORDS_ARG;
         goto exit_command_handler;
     }
 
+    for( kk = 0; kk < word_count; ++kk)
+    {
+        words[kk] = parse_hex_uint32(&return_status, argv[2+kk]);
+        if (return_status != 0)
+        {
+            return_status = SC_INVALID_WORD_VALUE_ARG;
+            goto exit_command_handler;
+        }
+    }
+
     //
     // execute ..
     //
@@ -1413,10 +3258,89 @@ int sleep_cmd_handler(int argc, char **argv)
     }
 
     // send HCI command
-    hci_dialog_sleep(sleep_type, minutes, seconds);
+    hci_dialog_otp_write(otp_address, words, word_count);
+
+    // receive reply event; the write is never sent again blindly, see otp_write_recover()
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
+
+    if (evt == NULL)
+    {
+        memset(&write, 0, sizeof(write));
+        write.operation = OTP_WRITE_WORDS;
+        write.otp_address = otp_address;
+        write.words = words;
+        write.word_count = word_count;
+        return_status = otp_write_recover(&write);
+        goto exit_command_handler;
+    }
+
+    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+    // check response 
+    if ( !( evt->event == 0x0E 
+        && evt->length == 5
+        && evt->parameters[1] == 0xB0
+        && evt->parameters[2] == 0x40)
+    )
+    {
+        return_status = SC_UNEXPECTED_EVENT; // unexpected event
+        goto exit_command_handler;
+    }
+
+    // return parameters
+    // none
+
+exit_command_handler:
+    if(evt)
+        hci_free_event(evt);
+
+    printf("status = %d\n", return_status);
+
+    return return_status;
+}
+
+int read_reg32_cmd_handler(int argc, char **argv)
+{
+    uint32_t register_address = 0;
+    uint32_t returned_value = 0;
+    int return_status = 0;
+    hci_evt_t *evt = NULL;
+
+    // check number of arguments
+    if ( !(argc == 2) )
+    {
+        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        goto exit_command_handler;
+    }
+
+    // parse register address
+    register_address = parse_hex_uint32(&return_status, argv[1]);
+    if (return_status != 0
+        || (register_address % 4 !=0) // address must be word aligned
+        )
+    {
+        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+        goto exit_command_handler;
+    }
+
+    //
+    // execute ..
+    //
+
+    // open COM port, initialize rx thread  and queue
+    if (!InitUART(g_com_port_number, 115200))  
+        InitTasks();
+    else
+    {
+        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+        goto exit_command_handler;
+    }
+
+    // send HCI command
+    hci_dialog_read_reg32(register_address);
 
     // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
     if (evt == NULL)
     {
@@ -1426,10 +3350,10 @@ int sleep_cmd_handler(int argc, char **argv)
 
     handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-    // check response
-    if ( !( evt->event == 0x0F
-        && evt->length == 3
-        && evt->parameters[1] == 0x70
+    // check response 
+    if ( !( evt->event == 0x0E 
+        && evt->length == 9
+        && evt->parameters[1] == 0xC0
         && evt->parameters[2] == 0x40)
     )
     {
@@ -1437,143 +3361,56 @@ int sleep_cmd_handler(int argc, char **argv)
         goto exit_command_handler;
     }
 
-    // no return parameters
+    // return parameters
+    returned_value = evt->parameters[5]
+                   | (evt->parameters[6] <<  8)
+                   | (evt->parameters[7] << 16)
+                   | (evt->parameters[8] << 24) ;
 
 exit_command_handler:
     if(evt)
-        free(evt);
+        hci_free_event(evt);
 
     printf("status = %d\n", return_status);
+    printf("value  = %08X \n", returned_value);
+    result_put_hex("value", returned_value, 8);
 
     return return_status;
 }
 
-#define CMD__XTRIM_OP_RD  0x00
-#define CMD__XTRIM_OP_WR  0x01
-#define CMD__XTRIM_OP_EN  0x02
-#define CMD__XTRIM_OP_INC 0x03
-#define CMD__XTRIM_OP_DEC 0x04
-#define CMD__XTRIM_OP_DIS 0x05
-#define CMD__XTRIM_OP_CALTEST 0x06
-#define CMD__XTRIM_OP_CAL     0x07
-
-#define CMD__XTRIM_OP_RD_STR  "rd"
-#define CMD__XTRIM_OP_WR_STR  "wr"
-#define CMD__XTRIM_OP_EN_STR  "en"
-#define CMD__XTRIM_OP_INC_STR "inc"
-#define CMD__XTRIM_OP_DEC_STR "dec"
-#define CMD__XTRIM_OP_DIS_STR "dis"
-#define CMD__XTRIM_OP_CALTEST_STR "caltest"
-#define CMD__XTRIM_OP_CAL_STR     "cal"
-
-static uint8_t parse_xtrim_operation(int *return_status, const char *str)
-{
-    uint8_t result = 0;
-    *return_status = 0;
-
-    if      ( 0 == strcmp(str, CMD__XTRIM_OP_RD_STR)  ) { result = CMD__XTRIM_OP_RD; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_WR_STR)  ) { result = CMD__XTRIM_OP_WR; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_EN_STR)  ) { result = CMD__XTRIM_OP_EN; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_INC_STR) ) { result = CMD__XTRIM_OP_INC; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_DEC_STR) ) { result = CMD__XTRIM_OP_DEC; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_DIS_STR) ) { result = CMD__XTRIM_OP_DIS; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_CALTEST_STR) ) { result = CMD__XTRIM_OP_CALTEST; }
-    else if ( 0 == strcmp(str, CMD__XTRIM_OP_CAL_STR    ) ) { result = CMD__XTRIM_OP_CAL; }
-    else
-    {
-        *return_status = 1;
-    }
-
-    return result;
-}
-
-int xtal_trimming_cmd_handler(int argc, char **argv)
+int write_reg32_cmd_handler(int argc, char **argv)
 {
-    uint8_t operation;
-    uint16_t required_number_of_args = 0;
-    uint16_t trim_value_or_delta = 0;
-    uint8_t freq_gen_gpio = 0;
-    int trim_value_or_delta_arg_required = 0;
-    uint16_t returned_trim_value = 0;
+    uint32_t register_address = 0;
+    uint32_t value = 0;
+    uint32_t returned_value = 0;
     int return_status = 0;
     hci_evt_t *evt = NULL;
-    unsigned int timeout = RX_TIMEOUT_MILLIS;
 
     // check number of arguments
-    if ( !(argc == 2  || argc == 3) )
+    if ( !(argc == 3) )
     {
         return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
         goto exit_command_handler;
     }
 
-    // parse operation
-    operation = parse_xtrim_operation(&return_status, argv[1]);
-    if (return_status != 0 ) 
+    // parse register address
+    register_address = parse_hex_uint32(&return_status, argv[1]);
+    if (return_status != 0
+        || (register_address % 4 !=0) // address must be word aligned
+        )
     {
-        return_status = SC_INVALID_XTAL_TRIMMING_CMD_OPERATION_ARG;
+        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
         goto exit_command_handler;
     }
 
-    switch(operation)
-    {
-        case CMD__XTRIM_OP_RD:
-        case CMD__XTRIM_OP_EN:
-        case CMD__XTRIM_OP_DIS:
-            ///trim_value_or_delta_arg_required = 0;
-            required_number_of_args = 2;
-            break;
-        case CMD__XTRIM_OP_WR:
-        case CMD__XTRIM_OP_INC:
-        case CMD__XTRIM_OP_DEC:
-            ///trim_value_or_delta_arg_required = 1;
-            required_number_of_args = 3;
-            break;
-            
-        case CMD__XTRIM_OP_CALTEST:
-        case CMD__XTRIM_OP_CAL:
-            required_number_of_args = 3;
-            break;
-    }
-
-    // check number of arguments
-    if ( !(argc == required_number_of_args) )
+    // parse value to be written
+    value = parse_hex_uint32(&return_status, argv[2]);
+    if (return_status != 0)
     {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+        return_status = SC_INVALID_REGISTER_VALUE_ARG;
         goto exit_command_handler;
     }
 
-    // parse args if any
-    switch(operation)
-    {
-        case CMD__XTRIM_OP_RD:
-        case CMD__XTRIM_OP_EN:
-        case CMD__XTRIM_OP_DIS:
-            break;
-        case CMD__XTRIM_OP_WR:
-        case CMD__XTRIM_OP_INC:
-        case CMD__XTRIM_OP_DEC:
-            // parse trim_value_or_delta
-            trim_value_or_delta = parse_uint16(&return_status, argv[2]);
-            if (return_status != 0 ) 
-            {
-                return_status = SC_INVALID_XTAL_TRIMMING_CMD_TRIM_VALUE_ARG;
-                goto exit_command_handler;
-            }
-            break;
-            
-        case CMD__XTRIM_OP_CALTEST:
-        case CMD__XTRIM_OP_CAL:
-            freq_gen_gpio = parse_gpio(argv[2]);
-            if (freq_gen_gpio == INVALID_GPIO )
-            {
-                return_status = SC_INVALID_GPIO_ARG;
-                goto exit_command_handler;
-            }
-            trim_value_or_delta = freq_gen_gpio;
-            timeout = 15 * 1000; // 15 seconds
-            break;
-    }
-
     //
     // execute ..
     //
@@ -1588,10 +3425,10 @@ int xtal_trimming_cmd_handler(int argc, char **argv)
     }
 
     // send HCI command
-    hci_dialog_xtal_trimming(operation, trim_value_or_delta);
+    hci_dialog_write_reg32(register_address, value);
 
     // receive reply event
-    evt = hci_recv_event_wait(timeout); // timeout depends on operation
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
     if (evt == NULL)
     {
@@ -1603,8 +3440,8 @@ int xtal_trimming_cmd_handler(int argc, char **argv)
 
     // check response 
     if ( !( evt->event == 0x0E 
-        && evt->length == 5
-        && evt->parameters[1] == 0x80
+        && evt->length == 9
+        && evt->parameters[1] == 0xC0
         && evt->parameters[2] == 0x40)
     )
     {
@@ -1612,141 +3449,40 @@ int xtal_trimming_cmd_handler(int argc, char **argv)
         goto exit_command_handler;
     }
 
-    // no return parameters
-    returned_trim_value = evt->parameters[3] + 256 * evt->parameters[4];
-
-    switch(operation)
-    {
-        case CMD__XTRIM_OP_CALTEST:
-        case CMD__XTRIM_OP_CAL:
-            if (returned_trim_value == 0x01)
-                return_status = SC_XTAL_TRIMMING_CAL_OUT_OF_RANGE_ERROR;
-            else if (returned_trim_value == 0x02)
-                return_status = SC_XTAL_TRIMMING_CAL_FREQ_NOT_CONNECTED;
-            break;
-        default:
-            break;
-    }
+    // return parameters
+    // none
 
 exit_command_handler:
     if(evt)
-        free(evt);
+        hci_free_event(evt);
 
-    printf("status     = %d\n", return_status);
-    if(operation == CMD__XTRIM_OP_RD)
-    {
-        printf("trim_value = %d\n", returned_trim_value);
-    }
+    printf("status = %d\n", return_status);
 
     return return_status;
-} 
-
-#define CMD__OTP_OP_RE_XTRIM_STR  "re_xtrim"
-#define CMD__OTP_OP_WE_XTRIM_STR  "we_xtrim"
-#define CMD__OTP_OP_RD_XTRIM_STR  "rd_xtrim"
-#define CMD__OTP_OP_WR_XTRIM_STR  "wr_xtrim"
-#define CMD__OTP_OP_RD_BDADDR_STR "rd_bdaddr"
-#define CMD__OTP_OP_WR_BDADDR_STR "wr_bdaddr"
- 
- 
-static uint8_t parse_otp_operation(int *return_status, const char *str)
-{
-    uint8_t result = 0;
-    *return_status = 0;
-
-    if      ( 0 == strcmp(str, CMD__OTP_OP_RD_XTRIM_STR)  ) { result = CMD__OTP_OP_RD_XTRIM; }
-    else if ( 0 == strcmp(str, CMD__OTP_OP_WR_XTRIM_STR)  ) { result = CMD__OTP_OP_WR_XTRIM; }
-    else if ( 0 == strcmp(str, CMD__OTP_OP_RD_BDADDR_STR) ) { result = CMD__OTP_OP_RD_BDADDR; }
-    else if ( 0 == strcmp(str, CMD__OTP_OP_WR_BDADDR_STR) ) { result = CMD__OTP_OP_WR_BDADDR; }
-	else if ( 0 == strcmp(str, CMD__OTP_OP_RE_XTRIM_STR)  ) { result = CMD__OTP_OP_RE_XTRIM; }
-	else if ( 0 == strcmp(str, CMD__OTP_OP_WE_XTRIM_STR)  ) { result = CMD__OTP_OP_WE_XTRIM; }
-    else
-    {
-        *return_status = 1;
-    }
-
-    return result;
 }
 
-int otp_cmd_handler(int argc, char **argv)
+int read_reg16_cmd_handler(int argc, char **argv)
 {
-    uint8_t operation = 0xFF;
-    uint16_t required_number_of_args = 0;
-    uint16_t trim_value = 0;
-    uint16_t returned_trim_value = 0;
-    uint8_t bd_addr[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    uint8_t returned_bd_addr[6] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t returned_xtrim_enable[4] = {0x00, 0x00, 0x00, 0x00};
+    uint32_t register_address = 0;
+    uint16_t returned_value = 0;
     int return_status = 0;
     hci_evt_t *evt = NULL;
 
     // check number of arguments
-    if ( !(argc == 2  || argc == 3) )
-    {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-        goto exit_command_handler;
-    }
-
-    // parse operation
-    operation = parse_otp_operation(&return_status, argv[1]);
-    if (return_status != 0 ) 
-    {
-        return_status = SC_INVALID_OTP_CMD_OPERATION_ARG;
-        goto exit_command_handler;
-    }
-
-    switch(operation)
-    {
-        case CMD__OTP_OP_RD_XTRIM:  required_number_of_args = 2; break;
-        case CMD__OTP_OP_WR_XTRIM:  required_number_of_args = 3; break;
-        case CMD__OTP_OP_RD_BDADDR: required_number_of_args = 2; break;
-        case CMD__OTP_OP_WR_BDADDR: required_number_of_args = 3; break;
-		case CMD__OTP_OP_RE_XTRIM:  required_number_of_args = 2; break;
-		case CMD__OTP_OP_WE_XTRIM:  required_number_of_args = 2; break;
-    }
-
-    // check number of arguments
-    if ( !(argc == required_number_of_args) )
+    if ( !(argc == 2) )
     {
         return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
         goto exit_command_handler;
     }
 
-    // if the operation requires an arg
-    switch(operation)
-    {
-        case CMD__OTP_OP_RD_XTRIM:
-		case CMD__OTP_OP_RE_XTRIM:
-		case CMD__OTP_OP_WE_XTRIM:
-            break;
-
-        case CMD__OTP_OP_WR_XTRIM:
-            {
-                // parse trim value 
-                trim_value = parse_uint16(&return_status, argv[2]);
-                if (return_status != 0 ) 
-                {
-                    return_status = SC_INVALID_OTP_CMD_TRIM_VALUE_ARG;
-                    goto exit_command_handler;
-                }
-            }
-            break;
-
-        case CMD__OTP_OP_RD_BDADDR: 
-            break;
-
-        case CMD__OTP_OP_WR_BDADDR: 
-            {
-                // parse BD address
-                return_status = parse_bd_addr(bd_addr, argv[2]);
-                if (return_status != 0 ) 
-                {
-                    return_status = SC_INVALID_OTP_CMD_BDADDR_ARG;
-                    goto exit_command_handler;
-                }
-            }
-            break;
-		 
+    // parse register address
+    register_address = parse_hex_uint32(&return_status, argv[1]);
+    if (return_status != 0
+        || (register_address % 2 !=0) // address must be word aligned
+        )
+    {
+        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+        goto exit_command_handler;
     }
 
     //
@@ -1763,30 +3499,10 @@ int otp_cmd_handler(int argc, char **argv)
     }
 
     // send HCI command
-    switch(operation)
-    {
-        case CMD__OTP_OP_RD_XTRIM:
-            hci_dialog_otp_rd_xtrim();
-            break;
-        case CMD__OTP_OP_WR_XTRIM:
-            hci_dialog_otp_wr_xtrim (trim_value);
-            break;
-        case CMD__OTP_OP_RD_BDADDR:
-            hci_dialog_otp_rd_bdaddr();
-            break;
-        case CMD__OTP_OP_WR_BDADDR:
-            hci_dialog_otp_wr_bdaddr(bd_addr);
-            break;
-		case CMD__OTP_OP_RE_XTRIM:
-            hci_dialog_otp_re_xtrim ();
-            break;
-		case CMD__OTP_OP_WE_XTRIM:
-            hci_dialog_otp_we_xtrim ();
-            break;
-    }
+    hci_dialog_read_reg16(register_address);
 
     // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
     if (evt == NULL)
     {
@@ -1798,8 +3514,8 @@ int otp_cmd_handler(int argc, char **argv)
 
     // check response 
     if ( !( evt->event == 0x0E 
-        && evt->length == 10
-        && evt->parameters[1] == 0x90
+        && evt->length == 9
+        && evt->parameters[1] == 0xC0
         && evt->parameters[2] == 0x40)
     )
     {
@@ -1808,80 +3524,27 @@ int otp_cmd_handler(int argc, char **argv)
     }
 
     // return parameters
-    switch(operation)
-    {
-        case CMD__OTP_OP_RD_XTRIM:
-            returned_trim_value = evt->parameters[4] + 256 * evt->parameters[5];
-            break;
-
-        case CMD__OTP_OP_WR_XTRIM:
-            break;
-        case CMD__OTP_OP_RD_BDADDR:
-            returned_bd_addr[0] = evt->parameters[4];
-            returned_bd_addr[1] = evt->parameters[5];
-            returned_bd_addr[2] = evt->parameters[6];
-            returned_bd_addr[3] = evt->parameters[7];
-            returned_bd_addr[4] = evt->parameters[8];
-            returned_bd_addr[5] = evt->parameters[9];
-            break;
-        case CMD__OTP_OP_WR_BDADDR:
-            break;
-		case CMD__OTP_OP_RE_XTRIM:
-		 
-			returned_xtrim_enable[0]= evt->parameters[4];
-			 
-             break;
-	  case CMD__OTP_OP_WE_XTRIM:
-             break;
-	}
+    returned_value = evt->parameters[5]
+                   | (evt->parameters[6] <<  8);
 
 exit_command_handler:
     if(evt)
-        free(evt);
-
-    printf("status     = %d\n", return_status);
+        hci_free_event(evt);
 
-    switch(operation)
-    {
-        case CMD__OTP_OP_RD_XTRIM:
-            printf("otp_xtrim_value = %d\n", returned_trim_value );
-            break;
-        case CMD__OTP_OP_WR_XTRIM:
-            break;
-        case CMD__OTP_OP_RD_BDADDR:
-            printf("otp_bd_addr = %02X:%02X:%02X:%02X:%02X:%02X" , returned_bd_addr[5],
-                                                                   returned_bd_addr[4],
-                                                                   returned_bd_addr[3],
-                                                                   returned_bd_addr[2],
-                                                                   returned_bd_addr[1],
-                                                                   returned_bd_addr[0] 
-                                                                   );
-            break;
-        case CMD__OTP_OP_WR_BDADDR:
-            break;
-		case CMD__OTP_OP_RE_XTRIM:
- 			if (returned_xtrim_enable[0] & 0x10) 
-                printf("otp_xtrim_enabled = 1 \n");
-			else
-                printf("otp_xtrim_enabled = 0 \n");
-             break;
-		case CMD__OTP_OP_WE_XTRIM:
-             break;
-    }
+    printf("status = %d\n", return_status);
+    printf("value  = %04X \n", returned_value);
+    result_put_hex("value", returned_value, 4);
 
     return return_status;
 }
 
-
-int otp_read_cmd_handler(int argc, char **argv)
+int write_reg16_cmd_handler(int argc, char **argv)
 {
-    uint16_t otp_address = 0x0000;
-    uint8_t word_count = 0 ;
-    uint8_t returned_word_count = 0;
-    uint32_t returned_words[MAX_READ_WRITE_OTP_WORDS];
+    uint32_t register_address = 0;
+    uint16_t value = 0;
+    uint16_t returned_value = 0;
     int return_status = 0;
     hci_evt_t *evt = NULL;
-    int kk = 0;
 
     // check number of arguments
     if ( !(argc == 3) )
@@ -1890,24 +3553,21 @@ int otp_read_cmd_handler(int argc, char **argv)
         goto exit_command_handler;
     }
 
-    // parse otp_address
-    otp_address = parse_hex_uint32(&return_status, argv[1]);
-    if (return_status != 0 
-        || (otp_address % 4 != 0)
-        || (otp_address >= 0x8000) )
+    // parse register address
+    register_address = parse_hex_uint32(&return_status, argv[1]);
+    if (return_status != 0
+        || (register_address % 2 !=0) // address must be word aligned
+        )
     {
-        return_status = SC_INVALID_OTP_ADDRESS_ARG;
+        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
         goto exit_command_handler;
     }
 
-    // parse word_count
-    word_count = (uint8_t) parse_number(&return_status, argv[2]);
-    if (return_status != 0
-        || word_count == 0
-        || word_count > MAX_READ_WRITE_OTP_WORDS
-        || (otp_address + word_count * 4 > 0x8000) )
+    // parse value to be written
+    value = parse_hex_uint32(&return_status, argv[2]);
+    if (return_status != 0)
     {
-        return_status = SC_INVALID_NUMBER_OF_OTP_WORDS_ARG;
+        return_status = SC_INVALID_REGISTER_VALUE_ARG;
         goto exit_command_handler;
     }
 
@@ -1925,10 +3585,10 @@ int otp_read_cmd_handler(int argc, char **argv)
     }
 
     // send HCI command
-    hci_dialog_otp_read(otp_address, word_count);
+    hci_dialog_write_reg16(register_address, value);
 
     // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+    evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
     if (evt == NULL)
     {
@@ -1940,8 +3600,8 @@ int otp_read_cmd_handler(int argc, char **argv)
 
     // check response 
     if ( !( evt->event == 0x0E 
-        && evt->length == (5 + 4 * word_count)
-        && evt->parameters[1] == 0xA0
+        && evt->length == 9
+        && evt->parameters[1] == 0xC0
         && evt->parameters[2] == 0x40)
     )
     {
@@ -1950,452 +3610,545 @@ int otp_read_cmd_handler(int argc, char **argv)
     }
 
     // return parameters
-    returned_word_count = evt->parameters[4];
-    {
-        int pos = 5;
-        for (kk = 0 ; kk < returned_word_count; ++kk, pos +=4) 
-        {
-            returned_words[kk] = evt->parameters[pos]
-                              | (evt->parameters[pos + 1] <<  8)
-                              | (evt->parameters[pos + 2] << 16)
-                              | (evt->parameters[pos + 3] << 24) ;
-        }
-    }
+    // none
 
 exit_command_handler:
     if(evt)
-        free(evt);
+        hci_free_event(evt);
 
     printf("status = %d\n", return_status);
-    for (kk = 0 ; kk < returned_word_count; ++kk) 
-    {
-        printf("[%04X] = %08X \n", otp_address+ 4* kk, returned_words[kk]);
-    }
 
     return return_status;
 }
 
 
-int otp_write_cmd_handler(int argc, char **argv)
+int write_SN_cmd_handler(int argc, char **argv)
 {
-    uint16_t otp_address = 0x0000;
-    uint8_t word_count = 0 ;
-    uint8_t returned_word_count = 0;
-    uint32_t words[MAX_READ_WRITE_OTP_WORDS];
-    int return_status = 0;
-    hci_evt_t *evt = NULL;
-    int kk = 0;
+	uint32_t register_address = 0;
+	uint16_t value = 0;
+	uint16_t returned_value = 0;
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
+	char buffer_SN[512] = "";
+	const char *text = NULL;
+	pool_claim_t claim;
+	bool sent = false;
 
-    // check number of arguments
-    if ( !(argc >= 3) )
-    {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-        goto exit_command_handler;
-    }
+	memset(&claim, 0, sizeof(claim));
 
-    // parse otp_address
-    otp_address = parse_hex_uint32(&return_status, argv[1]);
-    if (return_status != 0 
-        || (otp_address % 4 != 0)
-        || (otp_address >= 0x8000) )
-    {
-        return_status = SC_INVALID_OTP_ADDRESS_ARG;
-        goto exit_command_handler;
-    }
+	// check number of arguments
+	if ( !(argc == 2) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+
+	// parse register address
+	/*
+	register_address = parse_hex_uint32(&return_status, argv[1]);
+	if (return_status != 0
+		|| (register_address % 2 !=0) // address must be word aligned
+		)
+	{
+		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+	*/
+	// parse value to be written; "@<pool file>" takes the next free value of the pool
+	text = argv[1];
+	if (text[0] == '@')
+	{
+		if (!pool_claim(text + 1, POOL_TEXT, &claim))
+		{
+			return_status = SC_POOL_ERROR;
+			goto exit_command_handler;
+		}
+		text = claim.value;
+	}
+	value = parsse_hex_SN(&return_status, text,buffer_SN);
+	//  value = parse_hex_uint32(&return_status, argv[1]);
+
+	if (return_status != 0)
+	{
+		return_status = SC_INVALID_REGISTER_VALUE_ARG;
+		goto exit_command_handler;
+	}
+
+	// a serial number written before is refused
+	if (history_used(HISTORY_SN, text))
+	{
+		fprintf(stderr, "Serial number %s was written before.\n", text);
+		return_status = SC_DUPLICATE_VALUE;
+		goto exit_command_handler;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	// send HCI command
+	sent = true;
+	hci_dialog_write_SN(register_address, buffer_SN);
+
+	// receive reply event
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
+
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
+
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+	// check response 
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 16
+		&& evt->parameters[1] == 0xD0
+		&& evt->parameters[2] == 0x40)
+		)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// return parameters
+	// none
+
+exit_command_handler:
+	if(evt)
+		hci_free_event(evt);
+
+	printf("status = %d\n", return_status);
+
+	if (return_status == SC_NO_ERROR && !history_add(HISTORY_SN, text))
+		fprintf(stderr, "Serial number %s not added to the history index.\n", text);
+
+	if (claim.claimed != 0)
+	{
+		printf("sn = %s\n", claim.value);
+		result_put_str("sn", claim.value);
+		pool_finish(&claim, pool_outcome(return_status, sent));
+	}
 
-    // the rest arguments are the words to be written in OTP
-    word_count = argc - 2;
+	return return_status;
+}
 
-    if ( word_count == 0
-        || word_count > MAX_READ_WRITE_OTP_WORDS 
-        || (otp_address + word_count * 4 > 0x8000) )
-    {
-        return_status = SC_INVALID_NUMBER_OF_OTP_WORDS_ARG;
-        goto exit_command_handler;
-    }
 
-    for( kk = 0; kk < word_count; ++kk)
-    {
-        words[kk] = parse_hex_uint32(&return_status, argv[2+kk]);
-        if (return_status != 0)
-        {
-            return_status = SC_INVALID_WORD_VALUE_ARG;
-            goto exit_command_handler;
-        }
-    }
+int read_SN_cmd_handler(int argc, char **argv)
+{
+	uint32_t register_address = 0;
+	char returned_value[PROVISION_FIELD_SIZE] = "";
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
 
-    //
-    // execute ..
-    //
+	// check number of arguments
+	if ( !(argc == 1) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
 
-    // open COM port, initialize rx thread  and queue
-    if (!InitUART(g_com_port_number, 115200))  
-        InitTasks();
-    else
-    {
-        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
-        goto exit_command_handler;
-    }
+	// parse register address
+/*	register_address = parse_hex_uint32(&return_status, argv[1]);
+	if (return_status != 0
+		|| (register_address % 2 !=0) // address must be word aligned
+		)
+	{
+		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+	*/
+	//
+	// execute ..
+	//
 
-    // send HCI command
-    hci_dialog_otp_write(otp_address, words, word_count);
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
 
-    // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	// send HCI command
+	hci_dialog_read_SN(register_address);
 
-    if (evt == NULL)
-    {
-        return_status = SC_RX_TIMEOUT; // rx timeout 
-        goto exit_command_handler;
-    }
+	// receive reply event
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
-    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
 
-    // check response 
-    if ( !( evt->event == 0x0E 
-        && evt->length == 5
-        && evt->parameters[1] == 0xB0
-        && evt->parameters[2] == 0x40)
-    )
-    {
-        return_status = SC_UNEXPECTED_EVENT; // unexpected event
-        goto exit_command_handler;
-    }
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-    // return parameters
-    // none
+	// check response 
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 25
+		&& evt->parameters[1] == 0xD0
+		&& evt->parameters[2] == 0x40)
+		)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// return parameters
+	parse_custom_action_text(&evt->parameters[4], evt->length - 4, returned_value);
 
 exit_command_handler:
-    if(evt)
-        free(evt);
+	if(evt)
+		hci_free_event(evt);
 
-    printf("status = %d\n", return_status);
+	printf("status = %d\n", return_status);
+	printf("value  = %s \n", returned_value);
+	result_put_str("value", returned_value);
 
-    return return_status;
+	return return_status;
 }
 
-int read_reg32_cmd_handler(int argc, char **argv)
-{
-    uint32_t register_address = 0;
-    uint32_t returned_value = 0;
-    int return_status = 0;
-    hci_evt_t *evt = NULL;
 
-    // check number of arguments
-    if ( !(argc == 2) )
-    {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-        goto exit_command_handler;
-    }
 
-    // parse register address
-    register_address = parse_hex_uint32(&return_status, argv[1]);
-    if (return_status != 0
-        || (register_address % 4 !=0) // address must be word aligned
-        )
-    {
-        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
-        goto exit_command_handler;
-    }
+int write_swversion_cmd_handler(int argc, char **argv)
+{
+	uint32_t register_address = 0;
+	uint16_t value = 0;
+	uint16_t returned_value = 0;
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
+	char buffer_SN[512] = "";
+	// check number of arguments
+	if ( !(argc == 2) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
 
-    //
-    // execute ..
-    //
+	// parse register address
+	/*
+	register_address = parse_hex_uint32(&return_status, argv[1]);
+	if (return_status != 0
+		|| (register_address % 2 !=0) // address must be word aligned
+		)
+	{
+		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+	*/
+	// parse value to be written
+	value = parsse_hex_SN(&return_status, argv[1],buffer_SN);
+	if (return_status != 0)
+	{
+		return_status = SC_INVALID_REGISTER_VALUE_ARG;
+		goto exit_command_handler;
+	}
 
-    // open COM port, initialize rx thread  and queue
-    if (!InitUART(g_com_port_number, 115200))  
-        InitTasks();
-    else
-    {
-        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
-        goto exit_command_handler;
-    }
+	//
+	// execute ..
+	//
 
-    // send HCI command
-    hci_dialog_read_reg32(register_address);
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
 
-    // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	// send HCI command
+	hci_dialog_write_swversion(register_address, buffer_SN);
 
-    if (evt == NULL)
-    {
-        return_status = SC_RX_TIMEOUT; // rx timeout 
-        goto exit_command_handler;
-    }
+	// receive reply event
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
-    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
 
-    // check response 
-    if ( !( evt->event == 0x0E 
-        && evt->length == 9
-        && evt->parameters[1] == 0xC0
-        && evt->parameters[2] == 0x40)
-    )
-    {
-        return_status = SC_UNEXPECTED_EVENT; // unexpected event
-        goto exit_command_handler;
-    }
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-    // return parameters
-    returned_value = evt->parameters[5]
-                   | (evt->parameters[6] <<  8)
-                   | (evt->parameters[7] << 16)
-                   | (evt->parameters[8] << 24) ;
+	// check response 
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 16
+		&& evt->parameters[1] == 0xD0
+		&& evt->parameters[2] == 0x40)
+		)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// return parameters
+	// none
 
 exit_command_handler:
-    if(evt)
-        free(evt);
+	if(evt)
+		hci_free_event(evt);
 
-    printf("status = %d\n", return_status);
-    printf("value  = %08X \n", returned_value);
+	printf("status = %d\n", return_status);
 
-    return return_status;
+	return return_status;
 }
 
-int write_reg32_cmd_handler(int argc, char **argv)
-{
-    uint32_t register_address = 0;
-    uint32_t value = 0;
-    uint32_t returned_value = 0;
-    int return_status = 0;
-    hci_evt_t *evt = NULL;
 
-    // check number of arguments
-    if ( !(argc == 3) )
-    {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-        goto exit_command_handler;
-    }
+int read_swversion_cmd_handler(int argc, char **argv)
+{
+	uint32_t register_address = 0;
+	char returned_value[PROVISION_FIELD_SIZE] = "";
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
 
-    // parse register address
-    register_address = parse_hex_uint32(&return_status, argv[1]);
-    if (return_status != 0
-        || (register_address % 4 !=0) // address must be word aligned
-        )
-    {
-        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
-        goto exit_command_handler;
-    }
+	// check number of arguments
+	if ( !(argc == 1) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
 
-    // parse value to be written
-    value = parse_hex_uint32(&return_status, argv[2]);
-    if (return_status != 0)
-    {
-        return_status = SC_INVALID_REGISTER_VALUE_ARG;
-        goto exit_command_handler;
-    }
+	// parse register address
+/*	register_address = parse_hex_uint32(&return_status, argv[1]);
+	if (return_status != 0
+		|| (register_address % 2 !=0) // address must be word aligned
+		)
+	{
+		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+	*/
+	//
+	// execute ..
+	//
 
-    //
-    // execute ..
-    //
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
 
-    // open COM port, initialize rx thread  and queue
-    if (!InitUART(g_com_port_number, 115200))  
-        InitTasks();
-    else
-    {
-        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
-        goto exit_command_handler;
-    }
+	// send HCI command
+	hci_dialog_read_swversion(register_address);
 
-    // send HCI command
-    hci_dialog_write_reg32(register_address, value);
+	// receive reply event
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
-    // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
 
-    if (evt == NULL)
-    {
-        return_status = SC_RX_TIMEOUT; // rx timeout 
-        goto exit_command_handler;
-    }
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	// check response 
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 9
+		&& evt->parameters[1] == 0xD0
+		&& evt->parameters[2] == 0x40)
+		)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
 
-    // check response 
-    if ( !( evt->event == 0x0E 
-        && evt->length == 9
-        && evt->parameters[1] == 0xC0
-        && evt->parameters[2] == 0x40)
-    )
-    {
-        return_status = SC_UNEXPECTED_EVENT; // unexpected event
-        goto exit_command_handler;
-    }
+	// return parameters
+	parse_custom_action_text(&evt->parameters[4], evt->length - 4, returned_value);
 
-    // return parameters
-    // none
 
 exit_command_handler:
-    if(evt)
-        free(evt);
+	if(evt)
+		hci_free_event(evt);
 
-    printf("status = %d\n", return_status);
+	printf("status = %d\n", return_status);
+	printf("value  = %s \n", returned_value);
+	result_put_str("value", returned_value);
 
-    return return_status;
+	return return_status;
 }
 
-int read_reg16_cmd_handler(int argc, char **argv)
-{
-    uint32_t register_address = 0;
-    uint16_t returned_value = 0;
-    int return_status = 0;
-    hci_evt_t *evt = NULL;
 
-    // check number of arguments
-    if ( !(argc == 2) )
-    {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-        goto exit_command_handler;
-    }
 
-    // parse register address
-    register_address = parse_hex_uint32(&return_status, argv[1]);
-    if (return_status != 0
-        || (register_address % 2 !=0) // address must be word aligned
-        )
-    {
-        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
-        goto exit_command_handler;
-    }
+int write_flag_cmd_handler(int argc, char **argv)
+{
+	uint32_t register_address = 0;
+	uint16_t value = 0;
+	uint16_t returned_value = 0;
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
+	char buffer_SN[512] = "";
+	// check number of arguments
+	if ( !(argc == 2) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
 
-    //
-    // execute ..
-    //
+	// parse register address
+	/*
+	register_address = parse_hex_uint32(&return_status, argv[1]);
+	if (return_status != 0
+		|| (register_address % 2 !=0) // address must be word aligned
+		)
+	{
+		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+	*/
+	// parse value to be written
+	value = parsse_hex_SN(&return_status, argv[1],buffer_SN);
+	if (return_status != 0)
+	{
+		return_status = SC_INVALID_REGISTER_VALUE_ARG;
+		goto exit_command_handler;
+	}
 
-    // open COM port, initialize rx thread  and queue
-    if (!InitUART(g_com_port_number, 115200))  
-        InitTasks();
-    else
-    {
-        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
-        goto exit_command_handler;
-    }
+	//
+	// execute ..
+	//
 
-    // send HCI command
-    hci_dialog_read_reg16(register_address);
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
 
-    // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	// send HCI command
+	hci_dialog_write_flag(register_address, buffer_SN);
 
-    if (evt == NULL)
-    {
-        return_status = SC_RX_TIMEOUT; // rx timeout 
-        goto exit_command_handler;
-    }
+	// receive reply event
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
-    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
 
-    // check response 
-    if ( !( evt->event == 0x0E 
-        && evt->length == 9
-        && evt->parameters[1] == 0xC0
-        && evt->parameters[2] == 0x40)
-    )
-    {
-        return_status = SC_UNEXPECTED_EVENT; // unexpected event
-        goto exit_command_handler;
-    }
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-    // return parameters
-    returned_value = evt->parameters[5]
-                   | (evt->parameters[6] <<  8);
+	// check response 
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 16
+		&& evt->parameters[1] == 0xD0
+		&& evt->parameters[2] == 0x40)
+		)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
+
+	// return parameters
+	// none
 
 exit_command_handler:
-    if(evt)
-        free(evt);
+	if(evt)
+		hci_free_event(evt);
 
-    printf("status = %d\n", return_status);
-    printf("value  = %04X \n", returned_value);
+	printf("status = %d\n", return_status);
 
-    return return_status;
+	return return_status;
 }
 
-int write_reg16_cmd_handler(int argc, char **argv)
-{
-    uint32_t register_address = 0;
-    uint16_t value = 0;
-    uint16_t returned_value = 0;
-    int return_status = 0;
-    hci_evt_t *evt = NULL;
-
-    // check number of arguments
-    if ( !(argc == 3) )
-    {
-        return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
-        goto exit_command_handler;
-    }
 
-    // parse register address
-    register_address = parse_hex_uint32(&return_status, argv[1]);
-    if (return_status != 0
-        || (register_address % 2 !=0) // address must be word aligned
-        )
-    {
-        return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
-        goto exit_command_handler;
-    }
+int read_flag_cmd_handler(int argc, char **argv)
+{
+	uint32_t register_address = 0;
+	char returned_value[PROVISION_FIELD_SIZE] = "";
+	int return_status = 0;
+	hci_evt_t *evt = NULL;
 
-    // parse value to be written
-    value = parse_hex_uint32(&return_status, argv[2]);
-    if (return_status != 0)
-    {
-        return_status = SC_INVALID_REGISTER_VALUE_ARG;
-        goto exit_command_handler;
-    }
+	// check number of arguments
+	if ( !(argc == 1) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
 
-    //
-    // execute ..
-    //
+	// parse register address
+/*	register_address = parse_hex_uint32(&return_status, argv[1]);
+	if (return_status != 0
+		|| (register_address % 2 !=0) // address must be word aligned
+		)
+	{
+		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+	*/
+	//
+	// execute ..
+	//
 
-    // open COM port, initialize rx thread  and queue
-    if (!InitUART(g_com_port_number, 115200))  
-        InitTasks();
-    else
-    {
-        return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
-        goto exit_command_handler;
-    }
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))  
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
 
-    // send HCI command
-    hci_dialog_write_reg16(register_address, value);
+	// send HCI command
+	hci_dialog_read_flag(register_address);
 
-    // receive reply event
-    evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	// receive reply event
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
-    if (evt == NULL)
-    {
-        return_status = SC_RX_TIMEOUT; // rx timeout 
-        goto exit_command_handler;
-    }
+	if (evt == NULL)
+	{
+		return_status = SC_RX_TIMEOUT; // rx timeout 
+		goto exit_command_handler;
+	}
 
-    handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	handle_hci_event(evt); ////////////////////////////////////////////// print evt
 
-    // check response 
-    if ( !( evt->event == 0x0E 
-        && evt->length == 9
-        && evt->parameters[1] == 0xC0
-        && evt->parameters[2] == 0x40)
-    )
-    {
-        return_status = SC_UNEXPECTED_EVENT; // unexpected event
-        goto exit_command_handler;
-    }
+	// check response 
+	if ( !( evt->event == 0x0E 
+		&& evt->length == 16
+		&& evt->parameters[1] == 0xD0
+		&& evt->parameters[2] == 0x40)
+		)
+	{
+		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		goto exit_command_handler;
+	}
 
-    // return parameters
-    // none
+	// return parameters
+	parse_custom_action_text(&evt->parameters[4], evt->length - 4, returned_value);
 
 exit_command_handler:
-    if(evt)
-        free(evt);
+	if(evt)
+		hci_free_event(evt);
 
-    printf("status = %d\n", return_status);
+	printf("status = %d\n", return_status);
+	printf("value  = %s \n", returned_value);
+	result_put_str("value", returned_value);
 
-    return return_status;
+	return return_status;
 }
 
 
-int write_SN_cmd_handler(int argc, char **argv)
+int write_PSN_cmd_handler(int argc, char **argv)
 {
 	uint32_t register_address = 0;
 	uint16_t value = 0;
@@ -2403,6 +4156,10 @@ int write_SN_cmd_handler(int argc, char **argv)
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
 	char buffer_SN[512] = "";
+	const char *text = NULL;
+	pool_claim_t claim;
+	bool sent = false;
+	memset(&claim, 0, sizeof(claim));
 
 	// check number of arguments
 	if ( !(argc == 2) )
@@ -2422,10 +4179,18 @@ int write_SN_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 	*/
-	// parse value to be written
-	value = parsse_hex_SN(&return_status, argv[1],buffer_SN);
-	//  value = parse_hex_uint32(&return_status, argv[1]);
-
+	// parse value to be written; "@<pool file>" takes the next free value of the pool
+	text = argv[1];
+	if (text[0] == '@')
+	{
+		if (!pool_claim(text + 1, POOL_TEXT, &claim))
+		{
+			return_status = SC_POOL_ERROR;
+			goto exit_command_handler;
+		}
+		text = claim.value;
+	}
+	value = parsse_hex_SN(&return_status, text,buffer_SN);
 	if (return_status != 0)
 	{
 		return_status = SC_INVALID_REGISTER_VALUE_ARG;
@@ -2446,11 +4211,11 @@ int write_SN_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-
-	hci_dialog_write_SN(register_address, buffer_SN);
+	sent = true;
+	hci_dialog_write_PSN(register_address, buffer_SN);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
 	if (evt == NULL)
 	{
@@ -2476,18 +4241,25 @@ int write_SN_cmd_handler(int argc, char **argv)
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 
+	if (claim.claimed != 0)
+	{
+		printf("psn = %s\n", claim.value);
+		result_put_str("psn", claim.value);
+		pool_finish(&claim, pool_outcome(return_status, sent));
+	}
+
 	return return_status;
 }
 
 
-int read_SN_cmd_handler(int argc, char **argv)
+int read_PSN_cmd_handler(int argc, char **argv)
 {
 	uint32_t register_address = 0;
-	uint16_t returned_value = 0;
+	char returned_value[PROVISION_FIELD_SIZE] = "";
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
 
@@ -2522,10 +4294,10 @@ int read_SN_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_read_SN(register_address);
+	hci_dialog_read_PSN(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
 	if (evt == NULL)
 	{
@@ -2537,7 +4309,7 @@ int read_SN_cmd_handler(int argc, char **argv)
 
 	// check response 
 	if ( !( evt->event == 0x0E 
-		&& evt->length == 25
+		&& evt->length == 16
 		&& evt->parameters[1] == 0xD0
 		&& evt->parameters[2] == 0x40)
 		)
@@ -2546,56 +4318,93 @@ int read_SN_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// return parameters;
-	//returned_value = evt->parameters[1]
-	//| (evt->parameters[2] <<  8);
+	// return parameters
+	parse_custom_action_text(&evt->parameters[4], evt->length - 4, returned_value);
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
-	printf("value  = %04X \n", returned_value);
+	printf("value  = %s \n", returned_value);
+	result_put_str("value", returned_value);
 
 	return return_status;
 }
-
-
-
-int write_swversion_cmd_handler(int argc, char **argv)
+/*
+ ****************************************************************************************
+ * @brief Write SN, PSN, software version and flag with one custom action and read
+ *        them all back with one more, in place of a write and a read for each field.
+ *        "-" leaves a field as it is; SN and PSN take "@<pool file>" like write_SN.
+ *
+ * @return status code.
+ ****************************************************************************************
+*/
+int provision_cmd_handler(int argc, char **argv)
 {
-	uint32_t register_address = 0;
-	uint16_t value = 0;
-	uint16_t returned_value = 0;
+	static const char *field_names[PROVISION_FIELDS] = { "sn", "psn", "swversion", "flag" };
+	char fields[PROVISION_FIELDS][PROVISION_FIELD_SIZE];
+	char returned_value[PROVISION_FIELD_SIZE];
+	pool_claim_t claims[2];        // PROVISION_FIELD_SN, PROVISION_FIELD_PSN
+	uint8_t mask = 0;
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
-	char buffer_SN[512] = "";
+	const char *text;
+	bool sent = false;
+	bool read_back[PROVISION_FIELDS];   // the DUT holds the field as written
+	int kk;
+
+	memset(fields, 0, sizeof(fields));
+	memset(claims, 0, sizeof(claims));
+	memset(read_back, 0, sizeof(read_back));
+
 	// check number of arguments
-	if ( !(argc == 2) )
+	if ( !(argc == 1 + PROVISION_FIELDS) )
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	// parse register address
-	/*
-	register_address = parse_hex_uint32(&return_status, argv[1]);
-	if (return_status != 0
-		|| (register_address % 2 !=0) // address must be word aligned
-		)
+	// parse the fields
+	for (kk = 0; kk < PROVISION_FIELDS; kk++)
 	{
-		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
-		goto exit_command_handler;
+		text = argv[1 + kk];
+		if (0 == strcmp(text, "-"))
+			continue;
+
+		if (text[0] == '@' && kk <= PROVISION_FIELD_PSN)
+		{
+			if (!pool_claim(text + 1, POOL_TEXT, &claims[kk]))
+			{
+				return_status = SC_POOL_ERROR;
+				goto exit_command_handler;
+			}
+			text = claims[kk].value;
+		}
+
+		if (text[0] == 0 || strlen(text) >= PROVISION_FIELD_SIZE)
+		{
+			return_status = SC_INVALID_REGISTER_VALUE_ARG;
+			goto exit_command_handler;
+		}
+		strcpy(fields[kk], text);
+		mask |= 1 << kk;
 	}
-	*/
-	// parse value to be written
-	value = parsse_hex_SN(&return_status, argv[1],buffer_SN);
-	if (return_status != 0)
+
+	if (mask == 0)
 	{
 		return_status = SC_INVALID_REGISTER_VALUE_ARG;
 		goto exit_command_handler;
 	}
 
+	// a serial number written before is refused
+	if ((mask & (1 << PROVISION_FIELD_SN)) && history_used(HISTORY_SN, fields[PROVISION_FIELD_SN]))
+	{
+		fprintf(stderr, "Serial number %s was written before.\n", fields[PROVISION_FIELD_SN]);
+		return_status = SC_DUPLICATE_VALUE;
+		goto exit_command_handler;
+	}
+
 	//
 	// execute ..
 	//
@@ -2610,10 +4419,42 @@ int write_swversion_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_write_swversion(register_address, buffer_SN);
+	sent = true;
+	hci_dialog_write_provision(mask, fields);
 
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	// receive reply event; a lost reply is settled by the read back
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
+
+	if (evt == NULL)
+	{
+		if (!hci_resync())
+		{
+			return_status = SC_RX_TIMEOUT; // rx timeout 
+			goto exit_command_handler;
+		}
+		fprintf(stderr, "No reply to the provisioning write, reading the fields back.\n");
+	}
+	else
+	{
+		handle_hci_event(evt); ////////////////////////////////////////////// print evt
+
+		// check response 
+		if ( !( evt->event == 0x0E 
+			&& evt->length == 16
+			&& evt->parameters[1] == 0xD0
+			&& evt->parameters[2] == 0x40)
+			)
+		{
+			return_status = SC_UNEXPECTED_EVENT; // unexpected event
+			goto exit_command_handler;
+		}
+		hci_free_event(evt);
+	}
+
+	// read all fields back
+	hci_dialog_read_provision();
+
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
 	if (evt == NULL)
 	{
@@ -2625,7 +4466,7 @@ int write_swversion_cmd_handler(int argc, char **argv)
 
 	// check response 
 	if ( !( evt->event == 0x0E 
-		&& evt->length == 16
+		&& evt->length == PROVISION_REPLY_LENGTH
 		&& evt->parameters[1] == 0xD0
 		&& evt->parameters[2] == 0x40)
 		)
@@ -2634,20 +4475,49 @@ int write_swversion_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// return parameters
-	// none
+	// return parameters: each field written must read back as written
+	for (kk = 0; kk < PROVISION_FIELDS; kk++)
+	{
+		if (!(mask & (1 << kk)))
+			continue;
+
+		parse_custom_action_text(&evt->parameters[4 + kk * PROVISION_FIELD_SIZE], PROVISION_FIELD_SIZE, returned_value);
+		if (0 != strcmp(returned_value, fields[kk]))
+		{
+			fprintf(stderr, "%s reads back as \"%s\".\n", field_names[kk], returned_value);
+			return_status = SC_PROVISION_MISMATCH;
+		}
+		else
+			read_back[kk] = true;
+	}
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 
-	return return_status;
-}
+	for (kk = 0; kk < PROVISION_FIELDS; kk++)
+	{
+		if (mask & (1 << kk))
+		{
+			printf("%s = %s\n", field_names[kk], fields[kk]);
+			result_put_str(field_names[kk], fields[kk]);
+		}
+	}
 
+	// a field that reads back as written is on the DUT, whatever became of the others
+	if (read_back[PROVISION_FIELD_SN] && !history_add(HISTORY_SN, fields[PROVISION_FIELD_SN]))
+		fprintf(stderr, "Serial number %s not added to the history index.\n", fields[PROVISION_FIELD_SN]);
 
-int read_swversion_cmd_handler(int argc, char **argv)
+	for (kk = 0; kk < 2; kk++)
+		if (claims[kk].claimed != 0)
+			pool_finish(&claims[kk], read_back[kk] ? POOL_WRITTEN : pool_outcome(return_status, sent));
+
+	return return_status;
+}
+/*doco lixiping fix for ticket/1 20180607 begin*/
+int read_MAC_cmd_handler(int argc, char **argv)
 {
 	uint32_t register_address = 0;
 	uint16_t returned_value = 0;
@@ -2685,10 +4555,10 @@ int read_swversion_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_read_swversion(register_address);
+	hci_dialog_read_MAC(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
 	if (evt == NULL)
 	{
@@ -2700,7 +4570,7 @@ int read_swversion_cmd_handler(int argc, char **argv)
 
 	// check response 
 	if ( !( evt->event == 0x0E 
-		&& evt->length == 9
+		&& evt->length == 16
 		&& evt->parameters[1] == 0xD0
 		&& evt->parameters[2] == 0x40)
 		)
@@ -2710,56 +4580,36 @@ int read_swversion_cmd_handler(int argc, char **argv)
 	}
 
 	// return parameters;
-	returned_value = evt->parameters[1]
-	| (evt->parameters[2] <<  8)
-	| (evt->parameters[3] <<  16)
-	| (evt->parameters[4] <<  24)
-	| (evt->parameters[5] <<  32)
-	| (evt->parameters[6] <<  40)
-	| (evt->parameters[7] <<  48)
-	| (evt->parameters[8] <<  56)
-	| (evt->parameters[9] <<  64);
-	/*
-	| (evt->parameters[10] <<  72)
-	| (evt->parameters[11] <<  80)
-	| (evt->parameters[12] <<  88)
-	| (evt->parameters[13] <<  96)
-	| (evt->parameters[14] <<  104)
-	| (evt->parameters[15] <<  112)
-	| (evt->parameters[16] <<  120);
-	*/
-
+	//returned_value = evt->parameters[5]
+	//| (evt->parameters[6] <<  8);
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
 
-
-
-int write_flag_cmd_handler(int argc, char **argv)
+int go_sleep_cmd_handler(int argc, char **argv)
 {
 	uint32_t register_address = 0;
-	uint16_t value = 0;
 	uint16_t returned_value = 0;
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
-	char buffer_SN[512] = "";
+
 	// check number of arguments
-	if ( !(argc == 2) )
+	if ( !(argc == 1) )
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
 	// parse register address
-	/*
-	register_address = parse_hex_uint32(&return_status, argv[1]);
+/*	register_address = parse_hex_uint32(&return_status, argv[1]);
 	if (return_status != 0
 		|| (register_address % 2 !=0) // address must be word aligned
 		)
@@ -2768,14 +4618,6 @@ int write_flag_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 	*/
-	// parse value to be written
-	value = parsse_hex_SN(&return_status, argv[1],buffer_SN);
-	if (return_status != 0)
-	{
-		return_status = SC_INVALID_REGISTER_VALUE_ARG;
-		goto exit_command_handler;
-	}
-
 	//
 	// execute ..
 	//
@@ -2790,10 +4632,10 @@ int write_flag_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_write_flag(register_address, buffer_SN);
+	hci_dialog_go_sleep(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
 	if (evt == NULL)
 	{
@@ -2814,20 +4656,22 @@ int write_flag_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// return parameters
-	// none
+	// return parameters;
+	//returned_value = evt->parameters[5]
+	//| (evt->parameters[6] <<  8);
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
+	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
 
-
-int read_flag_cmd_handler(int argc, char **argv)
+int read_vbat_cmd_handler(int argc, char **argv)
 {
 	uint32_t register_address = 0;
 	uint16_t returned_value = 0;
@@ -2865,10 +4709,10 @@ int read_flag_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_read_flag(register_address);
+	hci_dialog_read_vbat(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_REPEATABLE); // sent again if the reply is lost
 
 	if (evt == NULL)
 	{
@@ -2895,33 +4739,31 @@ int read_flag_cmd_handler(int argc, char **argv)
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
 
-
-int write_PSN_cmd_handler(int argc, char **argv)
+int write_fpsenser_zeor_handler(int argc, char **argv)   // write_fpsenser_zeor_handler
 {
 	uint32_t register_address = 0;
-	uint16_t value = 0;
 	uint16_t returned_value = 0;
 	int return_status = 0;
 	hci_evt_t *evt = NULL;
-	char buffer_SN[512] = "";
+
 	// check number of arguments
-	if ( !(argc == 2) )
+	if ( !(argc == 1) )
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
 	// parse register address
-	/*
-	register_address = parse_hex_uint32(&return_status, argv[1]);
+/*	register_address = parse_hex_uint32(&return_status, argv[1]);
 	if (return_status != 0
 		|| (register_address % 2 !=0) // address must be word aligned
 		)
@@ -2930,14 +4772,6 @@ int write_PSN_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 	*/
-	// parse value to be written
-	value = parsse_hex_SN(&return_status, argv[1],buffer_SN);
-	if (return_status != 0)
-	{
-		return_status = SC_INVALID_REGISTER_VALUE_ARG;
-		goto exit_command_handler;
-	}
-
 	//
 	// execute ..
 	//
@@ -2952,10 +4786,10 @@ int write_PSN_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_write_PSN(register_address, buffer_SN);
+	hci_dialog_write_fpsenser_zero(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
 	if (evt == NULL)
 	{
@@ -2976,20 +4810,22 @@ int write_PSN_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// return parameters
-	// none
+	// return parameters;
+	//returned_value = evt->parameters[5]
+	//| (evt->parameters[6] <<  8);
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
+	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
 
-
-int read_PSN_cmd_handler(int argc, char **argv)
+int write_bpsenser_zero_handler(int argc, char **argv) //write_bpsenser_zero_handler
 {
 	uint32_t register_address = 0;
 	uint16_t returned_value = 0;
@@ -3027,10 +4863,10 @@ int read_PSN_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_read_PSN(register_address);
+	hci_dialog_write_bpsenser_zero(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
 	if (evt == NULL)
 	{
@@ -3057,15 +4893,15 @@ int read_PSN_cmd_handler(int argc, char **argv)
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
-/*doco lixiping fix for ticket/1 20180607 begin*/
-int read_MAC_cmd_handler(int argc, char **argv)
+int write_fpsenser_work_handler(int argc, char **argv) //write_fpsenser_work_handler
 {
 	uint32_t register_address = 0;
 	uint16_t returned_value = 0;
@@ -3103,10 +4939,10 @@ int read_MAC_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_read_MAC(register_address);
+	hci_dialog_write_fpsenser_work(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
 	if (evt == NULL)
 	{
@@ -3133,15 +4969,16 @@ int read_MAC_cmd_handler(int argc, char **argv)
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
 
-int go_sleep_cmd_handler(int argc, char **argv)
+int write_bpsenser_work_handler(int argc, char **argv) //write_bpsenser_work_handler
 {
 	uint32_t register_address = 0;
 	uint16_t returned_value = 0;
@@ -3179,10 +5016,10 @@ int go_sleep_cmd_handler(int argc, char **argv)
 	}
 
 	// send HCI command
-	hci_dialog_go_sleep(register_address);
+	hci_dialog_write_bpsenser_work(register_address);
 
 	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	evt = hci_recv_reply(RX_TIMEOUT_MILLIS, HCI_REPLY_ONE_SHOT);
 
 	if (evt == NULL)
 	{
@@ -3209,44 +5046,116 @@ int go_sleep_cmd_handler(int argc, char **argv)
 
 exit_command_handler:
 	if(evt)
-		free(evt);
+		hci_free_event(evt);
 
 	printf("status = %d\n", return_status);
 	printf("value  = %04X \n", returned_value);
+	result_put_hex("value", returned_value, 4);
 
 	return return_status;
 }
+/*doco lixiping fix for ticket/1 20180607 end*/
 
-int read_vbat_cmd_handler(int argc, char **argv)
+
+static int parse_bulk_target(int *return_status, const char *str)
 {
-	uint32_t register_address = 0;
-	uint16_t returned_value = 0;
+	*return_status = 0;
+
+	if (0 == strcmp(str, "otp"))
+		return BULK_TARGET_OTP;
+	if (0 == strcmp(str, "ram"))
+		return BULK_TARGET_RAM;
+	if (0 == strcmp(str, "flash"))
+		return BULK_TARGET_FLASH;
+
+	*return_status = 1;
+	return 0;
+}
+
+static int bulk_status(int rc)
+{
+	switch (rc)
+	{
+		case BULK_NO_ERROR:     return SC_NO_ERROR;
+		case BULK_ERR_TIMEOUT:  return SC_RX_TIMEOUT;
+		case BULK_ERR_REJECTED: return SC_BULK_TRANSFER_REJECTED;
+		case BULK_ERR_ARGUMENT: return SC_INVALID_BULK_SIZE_ARG;
+	}
+
+	return SC_UNEXPECTED_EVENT;
+}
+
+static void print_bulk_stats(const bulk_stats_t *stats)
+{
+	printf("bytes       = %u\n", stats->bytes);
+	printf("time        = %u ms\n", stats->millis);
+	printf("rate        = %u bytes/s\n", stats->millis ? (uint32_t) ((uint64_t) stats->bytes * 1000 / stats->millis) : 0);
+	printf("block size  = %u, window = %u\n", stats->block_size, stats->window);
+	printf("retransmits = %u, crc errors = %u, timeouts = %u\n", stats->retransmits, stats->crc_errors, stats->timeouts);
+	if (stats->dut_status >= BULK_ACK_BAD_TARGET)
+		printf("dut status  = 0x%02X\n", stats->dut_status);
+
+	result_put_int("bytes", stats->bytes);
+	result_put_int("millis", stats->millis);
+	result_put_int("retransmits", stats->retransmits);
+	result_put_int("crc_errors", stats->crc_errors);
+	result_put_int("timeouts", stats->timeouts);
+}
+
+int bulk_read_cmd_handler(int argc, char **argv)
+{
+	int target = 0;
+	uint32_t address = 0;
+	long size = 0;
+	uint8_t *buf = NULL;
+	FILE *fp = NULL;
+	bulk_stats_t stats;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
+
+	memset(&stats, 0, sizeof(stats));
 
 	// check number of arguments
-	if ( !(argc == 1) )
+	if ( !(argc == 5) )
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	// parse register address
-/*	register_address = parse_hex_uint32(&return_status, argv[1]);
-	if (return_status != 0
-		|| (register_address % 2 !=0) // address must be word aligned
-		)
+	target = parse_bulk_target(&return_status, argv[1]);
+	if (return_status != 0)
 	{
-		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		return_status = SC_INVALID_BULK_TARGET_ARG;
 		goto exit_command_handler;
 	}
-	*/
+
+	address = parse_hex_uint32(&return_status, argv[2]);
+	if (return_status != 0)
+	{
+		return_status = SC_INVALID_BULK_ADDRESS_ARG;
+		goto exit_command_handler;
+	}
+
+	size = parse_number(&return_status, argv[3]);
+	if (return_status != 0 || size <= 0)
+	{
+		return_status = SC_INVALID_BULK_SIZE_ARG;
+		goto exit_command_handler;
+	}
+
+	buf = (uint8_t *) malloc(size);
+	fp = fopen(argv[4], "wb");
+	if (buf == NULL || fp == NULL)
+	{
+		return_status = SC_FILE_ERROR;
+		goto exit_command_handler;
+	}
+
 	//
 	// execute ..
 	//
 
 	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
+	if (!InitUART(g_com_port_number, 115200))
 		InitTasks();
 	else
 	{
@@ -3254,75 +5163,372 @@ int read_vbat_cmd_handler(int argc, char **argv)
 		goto exit_command_handler;
 	}
 
-	// send HCI command
-	hci_dialog_read_vbat(register_address);
+	return_status = bulk_status(bulk_read((uint8_t) target, address, buf, size, &stats));
+	if (return_status != SC_NO_ERROR)
+		goto exit_command_handler;
 
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	if (fwrite(buf, 1, size, fp) != (size_t) size)
+		return_status = SC_FILE_ERROR;
 
-	if (evt == NULL)
+exit_command_handler:
+	if (fp)
+		fclose(fp);
+	if (buf)
+		free(buf);
+
+	printf("status = %d\n", return_status);
+	print_bulk_stats(&stats);
+
+	return return_status;
+}
+
+int bulk_write_cmd_handler(int argc, char **argv)
+{
+	int target = 0;
+	uint32_t address = 0;
+	long size = 0;
+	uint8_t *buf = NULL;
+	FILE *fp = NULL;
+	bulk_stats_t stats;
+	int return_status = 0;
+
+	memset(&stats, 0, sizeof(stats));
+
+	// check number of arguments
+	if ( !(argc == 4) )
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	target = parse_bulk_target(&return_status, argv[1]);
+	if (return_status != 0)
+	{
+		return_status = SC_INVALID_BULK_TARGET_ARG;
+		goto exit_command_handler;
+	}
 
-	// check response 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 16
-		&& evt->parameters[1] == 0xD0
-		&& evt->parameters[2] == 0x40)
-		)
+	address = parse_hex_uint32(&return_status, argv[2]);
+	if (return_status != 0)
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		return_status = SC_INVALID_BULK_ADDRESS_ARG;
 		goto exit_command_handler;
 	}
 
-	// return parameters;
-	//returned_value = evt->parameters[5]
-	//| (evt->parameters[6] <<  8);
+	fp = fopen(argv[3], "rb");
+	if (fp == NULL)
+	{
+		return_status = SC_FILE_ERROR;
+		goto exit_command_handler;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size <= 0)
+	{
+		return_status = SC_INVALID_BULK_SIZE_ARG;
+		goto exit_command_handler;
+	}
+
+	buf = (uint8_t *) malloc(size);
+	if (buf == NULL || fread(buf, 1, size, fp) != (size_t) size)
+	{
+		return_status = SC_FILE_ERROR;
+		goto exit_command_handler;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open COM port, initialize rx thread  and queue
+	if (!InitUART(g_com_port_number, 115200))
+		InitTasks();
+	else
+	{
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	return_status = bulk_status(bulk_write((uint8_t) target, address, buf, size, &stats));
 
 exit_command_handler:
-	if(evt)
-		free(evt);
+	if (fp)
+		fclose(fp);
+	if (buf)
+		free(buf);
 
 	printf("status = %d\n", return_status);
-	printf("value  = %04X \n", returned_value);
+	print_bulk_stats(&stats);
 
 	return return_status;
 }
 
-int write_fpsenser_zeor_handler(int argc, char **argv)   // write_fpsenser_zeor_handler
+
+/*
+ ****************************************************************************************
+ * @brief Download firmware (normally the HCI test firmware) into DUT RAM with
+ *        the boot ROM's UART protocol, on all ports of -p at once. The first
+ *        port stays open and is handed to HCI; the others are closed.
+ *
+ *  argv[1]  image file
+ *  argv[2]  (optional) baud rate of the boot ROM, 115200 by default
+ ****************************************************************************************
+*/
+int load_fw_cmd_handler(int argc, char **argv)
 {
-	uint32_t register_address = 0;
-	uint16_t returned_value = 0;
+	const fw_image_t *image;
+	long baud_rate = FW_BOOT_DEFAULT_BAUD_RATE;
+	fw_gang_slot_t slots[UART_MAX_PORTS];
+	uart_port_t ports[UART_MAX_PORTS];
+	HANDLE done[UART_MAX_PORTS];
+	unsigned int ready_millis;
+	unsigned int probes;
+	int opened = 0;
+	int kk;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
+
+	memset(slots, 0, sizeof(slots));
 
 	// check number of arguments
-	if ( !(argc == 1) )
+	if ( !(argc == 2 || argc == 3) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+
+	if (argc == 3)
+	{
+		baud_rate = parse_number(&return_status, argv[2]);
+		if (return_status != 0 || baud_rate <= 0)
+		{
+			return_status = SC_INVALID_BAUD_RATE_ARG;
+			goto exit_command_handler;
+		}
+	}
+
+	image = fw_image_get(argv[1]);
+	if (image == NULL)
+	{
+		return_status = SC_FILE_ERROR;
+		goto exit_command_handler;
+	}
+
+	//
+	// execute ..
+	//
+
+	// open the COM ports at the baud rate of the boot ROM; the reception thread
+	// is started only when the image runs
+	for (opened = 0; opened < g_com_port_count; opened++)
+	{
+		if (opened == 0)
+		{
+			slots[0].port = UARTGetPort();
+			if (InitUART(g_com_port_list[0], baud_rate))
+				break;
+		}
+		else
+		{
+			slots[opened].port = &ports[opened];
+			if (UARTPortOpen(&ports[opened], g_com_port_list[opened], baud_rate))
+				break;
+		}
+	}
+	if (opened < g_com_port_count)
+	{
+		fprintf(stderr, "Cannot open COM%d\n", g_com_port_list[opened]);
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+	for (kk = 0; kk < g_com_port_count; kk++)
+	{
+		if (!line_auto(slots[kk].port))
+		{
+			fprintf(stderr, "Waiting for the boot ROM, reset the DUTs.\n");
+			break;
+		}
+	}
+
+	fw_gang_start(slots, g_com_port_count, image);
+	for (kk = 0; kk < g_com_port_count; kk++)
+		done[kk] = slots[kk].done;
+
+	// progress of every port, until all are done
+	while (WaitForMultipleObjects(g_com_port_count, done, TRUE, 250) == WAIT_TIMEOUT)
+	{
+		for (kk = 0; kk < g_com_port_count; kk++)
+			fprintf(stderr, "%3d:%3d%% ", g_com_port_list[kk], (int) (slots[kk].sent * 100 / image->size));
+		fprintf(stderr, "\r");
+	}
+
+	printf("image size  = %u bytes, checksum = 0x%02X\n", (unsigned int) image->size, image->checksum);
+	for (kk = 0; kk < g_com_port_count; kk++)
+	{
+		printf("port %3d    = %s, %u ms, %d attempt(s)\n", g_com_port_list[kk],
+			fw_boot_error_name(slots[kk].rc), (unsigned int) slots[kk].millis, slots[kk].attempts);
+
+		if (slots[kk].rc != FW_NO_ERROR)
+			return_status = SC_FW_DOWNLOAD_FAILED;
+	}
+
+	// the test firmware talks HCI at 115200; go on as soon as it answers
+	if (slots[0].rc == FW_NO_ERROR)
+	{
+		if (UARTSetBaudRate(115200))
+		{
+			return_status = SC_COM_PORT_INIT_ERROR;
+			goto exit_command_handler;
+		}
+		InitTasks();
+
+		if (!hci_wait_ready(HCI_READY_DEFAULT_DEADLINE_MILLIS, &ready_millis, &probes))
+			return_status = SC_RX_TIMEOUT;
+		else
+		{
+			printf("ready after = %u ms\n", ready_millis);
+			result_put_int("ready_millis", ready_millis);
+		}
+	}
+
+exit_command_handler:
+	for (kk = 1; kk < opened; kk++)
+		UARTPortClose(&ports[kk]);
+	for (kk = 0; kk < UART_MAX_PORTS; kk++)
+		if (slots[kk].done != NULL)
+			CloseHandle(slots[kk].done);
+
+	printf("status = %d\n", return_status);
+
+	return return_status;
+}
+
+
+/*
+ ****************************************************************************************
+ * @brief Run a DTR/RTS sequence on all ports of -p.
+ *
+ *  argv[1]  reset | boot | release | name of a sequence in the configuration |
+ *           a sequence, e.g. "dtr:1 sleep:20 dtr:0"
+ ****************************************************************************************
+*/
+int line_cmd_handler(int argc, char **argv)
+{
+	const char *sequence;
+	uart_port_t ports[UART_MAX_PORTS];
+	uart_port_t *port;
+	int opened = 0;
+	int kk;
+	int return_status = 0;
+
+	// check number of arguments
+	if ( !(argc == 2) )
+	{
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
+		goto exit_command_handler;
+	}
+
+	sequence = line_sequence(argv[1]);
+	if (sequence == NULL)
+		sequence = argv[1];
+
+	//
+	// execute ..
+	//
+
+	for (opened = 0; opened < g_com_port_count; opened++)
+	{
+		if (opened == 0)
+		{
+			port = UARTGetPort();
+			if (InitUART(g_com_port_list[0], 115200))
+				break;
+		}
+		else
+		{
+			port = &ports[opened];
+			if (UARTPortOpen(port, g_com_port_list[opened], 115200))
+				break;
+		}
+
+		if (!line_run(port, sequence))
+		{
+			opened++;
+			return_status = SC_INVALID_LINE_SEQUENCE_ARG;
+			goto exit_command_handler;
+		}
+	}
+	if (opened < g_com_port_count)
+	{
+		fprintf(stderr, "Cannot open COM%d\n", g_com_port_list[opened]);
+		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		goto exit_command_handler;
+	}
+
+exit_command_handler:
+	for (kk = 1; kk < opened; kk++)
+		UARTPortClose(&ports[kk]);
+
+	printf("status = %d\n", return_status);
+
+	return return_status;
+}
+
+
+/*
+ ****************************************************************************************
+ * @brief Wait until the DUT firmware answers, e.g. after power-up, and report
+ *        how long that took.
+ *
+ *  argv[1]  (optional) max. time in ms, HCI_READY_DEFAULT_DEADLINE_MILLIS by default
+ *  argv[2]  (optional) "reset": reset the DUT with the reset line sequence first
+ ****************************************************************************************
+*/
+int wait_ready_cmd_handler(int argc, char **argv)
+{
+	long deadline = HCI_READY_DEFAULT_DEADLINE_MILLIS;
+	bool reset = false;
+	unsigned int ready_millis = 0;
+	unsigned int probes = 0;
+	DWORD start;
+	DWORD reset_millis;
+	int return_status = 0;
+
+	// check number of arguments
+	if ( !(argc >= 1 && argc <= 3) )
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	// parse register address
-/*	register_address = parse_hex_uint32(&return_status, argv[1]);
-	if (return_status != 0
-		|| (register_address % 2 !=0) // address must be word aligned
-		)
+	if (argc >= 2)
+	{
+		deadline = parse_number(&return_status, argv[1]);
+		if (return_status != 0 || deadline <= 0)
+		{
+			return_status = SC_INVALID_TIMEOUT_ARG;
+			goto exit_command_handler;
+		}
+	}
+
+	if (argc == 3)
 	{
-		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
-		goto exit_command_handler;
+		if (strcmp(argv[2], "reset") != 0)
+		{
+			return_status = SC_INVALID_LINE_SEQUENCE_ARG;
+			goto exit_command_handler;
+		}
+		reset = true;
 	}
-	*/
+
 	//
 	// execute ..
 	//
 
 	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
+	if (!InitUART(g_com_port_number, 115200))
 		InitTasks();
 	else
 	{
@@ -3330,270 +5536,332 @@ int write_fpsenser_zeor_handler(int argc, char **argv)   // write_fpsenser_zeor_
 		goto exit_command_handler;
 	}
 
-	// send HCI command
-	hci_dialog_write_fpsenser_zero(register_address);
-
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
-
-	if (evt == NULL)
+	// the boot time counts from the start of the reset
+	start = GetTickCount();
+	if (reset && !line_run(UARTGetPort(), line_sequence(LINE_SEQ_RESET)))
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
+		return_status = SC_INVALID_LINE_SEQUENCE_ARG;
 		goto exit_command_handler;
 	}
 
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	reset_millis = GetTickCount() - start;
 
-	// check response 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 16
-		&& evt->parameters[1] == 0xD0
-		&& evt->parameters[2] == 0x40)
-		)
+	if (reset_millis >= (DWORD) deadline
+		|| !hci_wait_ready(deadline - reset_millis, &ready_millis, &probes))
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		return_status = SC_RX_TIMEOUT;
 		goto exit_command_handler;
 	}
 
-	// return parameters;
-	//returned_value = evt->parameters[5]
-	//| (evt->parameters[6] <<  8);
+	printf("boot time   = %u ms\n", (unsigned int) (reset_millis + ready_millis));
+	printf("probes      = %u\n", probes);
+	result_put_int("boot_millis", reset_millis + ready_millis);
+	result_put_int("probes", probes);
 
 exit_command_handler:
-	if(evt)
-		free(evt);
-
 	printf("status = %d\n", return_status);
-	printf("value  = %04X \n", returned_value);
 
 	return return_status;
 }
 
-int write_bpsenser_zero_handler(int argc, char **argv) //write_bpsenser_zero_handler
+/*
+ ****************************************************************************************
+ * @brief Command handler for "timeouts": print the reply latency profile that the
+ *        timeouts of the other commands are derived from.
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int timeouts_cmd_handler(int argc, char **argv)
 {
-	uint32_t register_address = 0;
-	uint16_t returned_value = 0;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
 
-	// check number of arguments
-	if ( !(argc == 1) )
+	//check number of arguments
+	if (argc != 1)
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	// parse register address
-/*	register_address = parse_hex_uint32(&return_status, argv[1]);
-	if (return_status != 0
-		|| (register_address % 2 !=0) // address must be word aligned
-		)
+	latency_print();
+
+exit_command_handler:
+	printf("status = %d\n", return_status);
+
+	return return_status;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for "plan": run the steps of a plan file on one open port.
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int plan_cmd_handler(int argc, char **argv)
+{
+	int return_status = 0;
+	plan_t *plan = NULL;
+
+	//check number of arguments
+	if (argc != 2 && argc != 3)
 	{
-		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
-	*/
-	//
-	// execute ..
-	//
 
-	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
-		InitTasks();
-	else
+	if (argc == 3 && strcmp(argv[2], "resume") != 0)
 	{
-		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		return_status = SC_PLAN_ERROR;
 		goto exit_command_handler;
 	}
 
-	// send HCI command
-	hci_dialog_write_bpsenser_zero(register_address);
-
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
-
-	if (evt == NULL)
+	if (argc == 3 && !journal_is_open())
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
+		fprintf(stderr, "plan: resume needs a journal (-j) \n");
+		return_status = SC_PLAN_ERROR;
 		goto exit_command_handler;
 	}
 
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
-
-	// check response 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 16
-		&& evt->parameters[1] == 0xD0
-		&& evt->parameters[2] == 0x40)
-		)
+	plan = (plan_t *) malloc(sizeof(plan_t));
+	if (plan == NULL || !plan_load(plan, argv[1]))
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
+		return_status = SC_PLAN_ERROR;
 		goto exit_command_handler;
 	}
+	plan->resume = (argc == 3);
 
-	// return parameters;
-	//returned_value = evt->parameters[5]
-	//| (evt->parameters[6] <<  8);
+	//
+	// execute ..
+	//
+
+	return_status = plan_run(plan);
+	plan_free(plan);
 
 exit_command_handler:
-	if(evt)
-		free(evt);
+	free(plan);
 
-	printf("status = %d\n", return_status);
-	printf("value  = %04X \n", returned_value);
+	printf("plan status = %d\n", return_status);
 
 	return return_status;
 }
-int write_fpsenser_work_handler(int argc, char **argv) //write_fpsenser_work_handler
+
+/*
+ ****************************************************************************************
+ * @brief Command handler for "journal": print the records of a results journal.
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int journal_cmd_handler(int argc, char **argv)
 {
-	uint32_t register_address = 0;
-	uint16_t returned_value = 0;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
+	int records;
 
-	// check number of arguments
-	if ( !(argc == 1) )
+	//check number of arguments
+	if (argc != 2)
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	// parse register address
-/*	register_address = parse_hex_uint32(&return_status, argv[1]);
-	if (return_status != 0
-		|| (register_address % 2 !=0) // address must be word aligned
-		)
+	records = journal_dump(argv[1]);
+	if (records < 0)
 	{
-		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		return_status = SC_FILE_ERROR;
 		goto exit_command_handler;
 	}
-	*/
-	//
-	// execute ..
-	//
 
-	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
-		InitTasks();
-	else
-	{
-		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
-		goto exit_command_handler;
-	}
+	printf("records = %d\n", records);
+	result_put_int("records", records);
 
-	// send HCI command
-	hci_dialog_write_fpsenser_work(register_address);
+exit_command_handler:
+	printf("status = %d\n", return_status);
 
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
+	return return_status;
+}
 
-	if (evt == NULL)
+/*
+ ****************************************************************************************
+ * @brief Command handler for "pool": create a pool of serial numbers or BD addresses,
+ *        print its state, or free the claim of a process that no longer runs.
+ *
+ *  @param[in] argc		Command line argument count.
+ *  @param[in] argv		Command line arguments.
+ *
+ * @return error code on failure / 0 on success.
+ ****************************************************************************************
+*/
+int pool_cmd_handler(int argc, char **argv)
+{
+	int return_status = 0;
+	uint8_t bd_addr[6];
+	uint64_t first = 0;
+	unsigned long count = 0;
+	unsigned long digits = 0;
+	char *endptr;
+	int kk, rc;
+
+	if (argc < 3)
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
+		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
+	if (strcmp(argv[1], "create") == 0 && argc == 6 && strcmp(argv[3], "bdaddr") == 0)
+	{
+		// pool create <file> bdaddr <first BD address> <count>
+		errno = 0;
+		count = strtoul(argv[5], &endptr, 10);
+		if (parse_bd_addr(bd_addr, argv[4]) != 0 || *endptr != 0 || errno != 0)
+		{
+			return_status = SC_INVALID_POOL_ARG;
+			goto exit_command_handler;
+		}
+		for (kk = 5; kk >= 0; kk--)
+			first = (first << 8) | bd_addr[kk];
+
+		if (!pool_create(argv[2], POOL_BDADDR, "", first, count, 0))
+			return_status = SC_POOL_ERROR;
+	}
+	else if (strcmp(argv[1], "create") == 0 && argc == 8 && strcmp(argv[3], "text") == 0)
+	{
+		// pool create <file> text <prefix> <first> <count> <digits>
+		errno = 0;
+		first = strtoul(argv[5], &endptr, 10);
+		if (*endptr == 0)
+			count = strtoul(argv[6], &endptr, 10);
+		if (*endptr == 0)
+			digits = strtoul(argv[7], &endptr, 10);
+		if (*endptr != 0 || errno != 0)
+		{
+			return_status = SC_INVALID_POOL_ARG;
+			goto exit_command_handler;
+		}
 
-	// check response 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 16
-		&& evt->parameters[1] == 0xD0
-		&& evt->parameters[2] == 0x40)
-		)
+		if (!pool_create(argv[2], POOL_TEXT, argv[4], first, count, digits))
+			return_status = SC_POOL_ERROR;
+	}
+	else if (strcmp(argv[1], "status") == 0 && argc == 3)
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
-		goto exit_command_handler;
+		rc = pool_status(argv[2]);
+		if (rc < 0)
+			return_status = SC_POOL_ERROR;
+		else
+			result_put_int("orphans", rc);
+	}
+	else if (strcmp(argv[1], "release") == 0 && argc == 4)
+	{
+		rc = pool_release(argv[2], argv[3]);
+		if (rc < 0)
+			return_status = SC_POOL_ERROR;
+		else if (rc > 0)
+			return_status = SC_INVALID_POOL_ARG; // not a value of the pool, not claimed, or its process still runs
+	}
+	else
+	{
+		return_status = SC_INVALID_POOL_ARG;
 	}
-
-	// return parameters;
-	//returned_value = evt->parameters[5]
-	//| (evt->parameters[6] <<  8);
 
 exit_command_handler:
-	if(evt)
-		free(evt);
-
 	printf("status = %d\n", return_status);
-	printf("value  = %04X \n", returned_value);
 
 	return return_status;
 }
 
-int write_bpsenser_work_handler(int argc, char **argv) //write_bpsenser_work_handler
+/*
+ ****************************************************************************************
+ * @brief history create <index file> <values>
+ *        history import <index file> <journal or -o csv file> ...
+ *        history check  <index file> <BD address or serial number>
+ *        history status <index file>
+ *
+ * @return status code; check returns SC_DUPLICATE_VALUE for a value in the index.
+ ****************************************************************************************
+*/
+int history_cmd_handler(int argc, char **argv)
 {
-	uint32_t register_address = 0;
-	uint16_t returned_value = 0;
 	int return_status = 0;
-	hci_evt_t *evt = NULL;
+	unsigned long values;
+	uint8_t bd_addr[6];
+	char *endptr;
+	int kk, rc;
 
-	// check number of arguments
-	if ( !(argc == 1) )
+	if (argc < 3)
 	{
 		return_status = SC_WRONG_NUMBER_OF_ARGUMENTS;
 		goto exit_command_handler;
 	}
 
-	// parse register address
-/*	register_address = parse_hex_uint32(&return_status, argv[1]);
-	if (return_status != 0
-		|| (register_address % 2 !=0) // address must be word aligned
-		)
+	if (strcmp(argv[1], "create") == 0 && argc == 4)
 	{
-		return_status = SC_INVALID_REGISTER_ADDRESS_ARG;
+		errno = 0;
+		values = strtoul(argv[3], &endptr, 10);
+		if (*endptr != 0 || errno != 0 || values == 0)
+		{
+			return_status = SC_INVALID_HISTORY_ARG;
+			goto exit_command_handler;
+		}
+		if (!history_create(argv[2], (uint32_t) values))
+			return_status = SC_FILE_ERROR;
 		goto exit_command_handler;
 	}
-	*/
-	//
-	// execute ..
-	//
 
-	// open COM port, initialize rx thread  and queue
-	if (!InitUART(g_com_port_number, 115200))  
-		InitTasks();
-	else
+	if (!(strcmp(argv[1], "import") == 0 && argc >= 4)
+		&& !(strcmp(argv[1], "check") == 0 && argc == 4)
+		&& !(strcmp(argv[1], "status") == 0 && argc == 3))
 	{
-		return_status = SC_COM_PORT_INIT_ERROR; // InitUART failed
+		return_status = SC_INVALID_HISTORY_ARG;
 		goto exit_command_handler;
 	}
 
-	// send HCI command
-	hci_dialog_write_bpsenser_work(register_address);
-
-	// receive reply event
-	evt = hci_recv_event_wait(RX_TIMEOUT_MILLIS); // wait for RX_TIMEOUT_MILLIS milliseconds
-
-	if (evt == NULL)
+	if (!history_open(argv[2]))
 	{
-		return_status = SC_RX_TIMEOUT; // rx timeout 
+		return_status = SC_FILE_ERROR;
 		goto exit_command_handler;
 	}
 
-	handle_hci_event(evt); ////////////////////////////////////////////// print evt
-
-	// check response 
-	if ( !( evt->event == 0x0E 
-		&& evt->length == 16
-		&& evt->parameters[1] == 0xD0
-		&& evt->parameters[2] == 0x40)
-		)
+	if (strcmp(argv[1], "import") == 0)
 	{
-		return_status = SC_UNEXPECTED_EVENT; // unexpected event
-		goto exit_command_handler;
+		for (kk = 3; kk < argc; kk++)
+		{
+			rc = history_import(argv[kk]);
+			if (rc < 0)
+			{
+				fprintf(stderr, "Cannot import \"%s\"\n", argv[kk]);
+				return_status = SC_FILE_ERROR;
+				break;
+			}
+			printf("%s: %d new values\n", argv[kk], rc);
+		}
+	}
+	else if (strcmp(argv[1], "check") == 0)
+	{
+		// a BD address, else a serial number
+		if (parse_bd_addr(bd_addr, argv[3]) == 0)
+			rc = history_used(HISTORY_BDADDR, argv[3]);
+		else
+			rc = history_used(HISTORY_SN, argv[3]);
+		printf("used = %d\n", rc);
+		result_put_int("used", rc);
+		if (rc)
+			return_status = SC_DUPLICATE_VALUE;
 	}
 
-	// return parameters;
-	//returned_value = evt->parameters[5]
-	//| (evt->parameters[6] <<  8);
+	history_status();
+	history_close();
 
 exit_command_handler:
-	if(evt)
-		free(evt);
-
 	printf("status = %d\n", return_status);
-	printf("value  = %04X \n", returned_value);
 
 	return return_status;
 }
-/*doco lixiping fix for ticket/1 20180607 end*/
-
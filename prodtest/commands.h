@@ -49,6 +49,30 @@
 #define SC_XTAL_TRIMMING_CAL_FREQ_NOT_CONNECTED     27
 #define SC_INVALID_REGISTER_ADDRESS_ARG             28
 #define SC_INVALID_REGISTER_VALUE_ARG               29
+#define SC_INVALID_BULK_TARGET_ARG                  30
+#define SC_INVALID_BULK_ADDRESS_ARG                 31
+#define SC_INVALID_BULK_SIZE_ARG                    32
+#define SC_FILE_ERROR                               33
+#define SC_BULK_TRANSFER_REJECTED                   34
+#define SC_INVALID_BAUD_RATE_ARG                    35
+#define SC_FW_DOWNLOAD_FAILED                       36
+#define SC_INVALID_LINE_SEQUENCE_ARG                37
+#define SC_INVALID_TIMEOUT_ARG                      38
+#define SC_OTP_WRITE_MISMATCH                       39
+#define SC_PLAN_ERROR                               40
+#define SC_LIMIT_FAILED                             41
+#define SC_PLAN_FAILED                              42
+#define SC_INVALID_OUTPUT_FORMAT                    43
+#define SC_POOL_ERROR                               44
+#define SC_INVALID_POOL_ARG                         45
+#define SC_BDADDR_RANGE_ERROR                       46
+#define SC_PROVISION_MISMATCH                       47
+#define SC_DUPLICATE_VALUE                          48
+#define SC_INVALID_HISTORY_ARG                      49
+#define SC_GOLDEN_UNIT_BUSY                         50
+#define SC_PER_FAILED                               51
+#define SC_OUT_OF_MEMORY                            52
+#define SC_INVALID_CONFIG                           53
 
 #define SC_HCI_STANDARD_ERROR_CODE_BASE           1000
 
@@ -59,11 +83,21 @@
 #define MAX_READ_WRITE_OTP_WORDS 60
 
 /* command handlers */
+typedef int (*cmd_handler_t) (int argc, char **argv);
+
+cmd_handler_t cmd_lookup(const char *name);
+
 int starttest_tx_param_len_3_handler(int argc, char **argv);
 int starttest_tx_param_len_5_handler(int argc, char **argv);
 int starttest_rx_default_handler(int argc, char **argv);
 int starttest_rx_readback_values_handler(int argc, char **argv);
 int stoptest_rx_readback_values_handler(int argc, char **argv);
+int peek_rx_readback_values_handler(int argc, char **argv);
+int monitor_rx_readback_values_handler(int argc, char **argv);
+int pkt_rx_all_cmd_handler(int argc, char **argv);
+int pkt_rx_per_cmd_handler(int argc, char **argv);
+int broadcast_cmd_handler(int argc, char **argv);
+int cont_tx_rotate_cmd_handler(int argc, char **argv);
 int stoptest_handler(int argc, char **argv);
 int starttest_unmodulated_handler(int argc, char **argv);
 int starttest_tx_continue_handler(int argc, char **argv);
@@ -90,6 +124,7 @@ int read_flag_cmd_handler(int argc, char **argv);
 
 int write_PSN_cmd_handler(int argc, char **argv);
 int read_PSN_cmd_handler(int argc, char **argv);
+int provision_cmd_handler(int argc, char **argv);
 /*doco lixiping fix for ticket/1 20180607 begin*/
 int read_MAC_cmd_handler(int argc, char **argv);
 int go_sleep_cmd_handler(int argc, char **argv);
@@ -99,6 +134,16 @@ int write_bpsenser_zero_handler(int argc, char **argv);
 int write_fpsenser_work_handler(int argc, char **argv);
 int write_bpsenser_work_handler(int argc, char **argv);
 /*doco lixiping fix for ticket/1 20180607 end*/
+int bulk_read_cmd_handler(int argc, char **argv);
+int bulk_write_cmd_handler(int argc, char **argv);
+int load_fw_cmd_handler(int argc, char **argv);
+int line_cmd_handler(int argc, char **argv);
+int wait_ready_cmd_handler(int argc, char **argv);
+int timeouts_cmd_handler(int argc, char **argv);
+int plan_cmd_handler(int argc, char **argv);
+int journal_cmd_handler(int argc, char **argv);
+int pool_cmd_handler(int argc, char **argv);
+int history_cmd_handler(int argc, char **argv);
 /* utils*/
 long parse_number(int *return_status, const char * str);
 
@@ -0,0 +1,202 @@
+/**
+****************************************************************************************
+*
+* @file config.c
+*
+* @brief Fixture configuration: "key = value" lines read from a file.
+*
+* Blank lines and lines starting with '#' are ignored. A later line for the
+* same key replaces the earlier one.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "config.h"
+
+static struct {
+	char key[CONFIG_MAX_KEY_LEN];
+	char value[CONFIG_MAX_VALUE_LEN];
+} config_entries[CONFIG_MAX_ENTRIES];
+static int config_count;
+
+// strip leading and trailing white space in place
+static char *config_trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char) *s))
+		s++;
+
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char) end[-1]))
+		end--;
+	*end = 0;
+
+	return s;
+}
+
+static void config_set(const char *key, const char *value)
+{
+	int kk;
+
+	for (kk = 0; kk < config_count; kk++)
+		if (strcmp(config_entries[kk].key, key) == 0)
+			break;
+
+	if (kk == CONFIG_MAX_ENTRIES)
+		return;
+	if (kk == config_count)
+		config_count++;
+
+	strncpy(config_entries[kk].key, key, CONFIG_MAX_KEY_LEN - 1);
+	strncpy(config_entries[kk].value, value, CONFIG_MAX_VALUE_LEN - 1);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read a configuration file.
+ *
+ *  @param[in] path  File.
+ *
+ * @return false if the file cannot be read or has a line without '='.
+ ****************************************************************************************
+*/
+bool config_load(const char *path)
+{
+	char line[CONFIG_MAX_KEY_LEN + CONFIG_MAX_VALUE_LEN + 8];
+	char *key;
+	char *eq;
+	FILE *fp;
+	bool ok = true;
+	int saved_errno = errno;
+
+	// the argument parsers check errno after strtol(): a missing file is no error of theirs
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		errno = saved_errno;
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		key = config_trim(line);
+		if (key[0] == 0 || key[0] == '#')
+			continue;
+
+		eq = strchr(key, '=');
+		if (eq == NULL)
+		{
+			ok = false;
+			continue;
+		}
+		*eq = 0;
+
+		config_set(config_trim(key), config_trim(eq + 1));
+	}
+
+	fclose(fp);
+	errno = saved_errno;
+
+	return ok;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Path of a file in the directory of the executable.
+ *
+ *  @param[in]  name  File name.
+ *  @param[out] path  Receives the path.
+ *  @param[in]  size  Size of path.
+ *
+ * @return false if the path does not fit.
+ ****************************************************************************************
+*/
+bool config_exe_path(const char *name, char *path, size_t size)
+{
+	char *slash;
+
+	if (GetModuleFileName(NULL, path, (DWORD) size) == 0)
+		return false;
+
+	slash = strrchr(path, '\\');
+	slash = slash ? slash + 1 : path;
+	if (slash - path + strlen(name) >= size)
+		return false;
+	strcpy(slash, name);
+
+	return true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read CONFIG_DEFAULT_FILE_NAME from the directory of the executable,
+ *        if there is one.
+ ****************************************************************************************
+*/
+bool config_load_default(void)
+{
+	char path[MAX_PATH];
+
+	if (!config_exe_path(CONFIG_DEFAULT_FILE_NAME, path, sizeof(path)))
+		return false;
+
+	return config_load(path);
+}
+
+const char *config_get(const char *key, const char *def)
+{
+	int kk;
+
+	for (kk = 0; kk < config_count; kk++)
+		if (strcmp(config_entries[kk].key, key) == 0)
+			return config_entries[kk].value;
+
+	return def;
+}
+
+long config_get_long(const char *key, long def)
+{
+	const char *value = config_get(key, NULL);
+	char *endptr;
+	long result;
+
+	if (value == NULL)
+		return def;
+
+	result = strtol(value, &endptr, 0);
+	if (endptr == value || *endptr != 0)
+		return def;
+
+	return result;
+}
+
+double config_get_double(const char *key, double def)
+{
+	const char *value = config_get(key, NULL);
+	char *endptr;
+	double result;
+
+	if (value == NULL)
+		return def;
+
+	result = strtod(value, &endptr);
+	if (endptr == value || *endptr != 0)
+		return def;
+
+	return result;
+}
@@ -0,0 +1,40 @@
+/**
+****************************************************************************************
+*
+* @file config.h
+*
+* @brief Fixture configuration: "key = value" lines read from a file.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _CONFIG_H_
+#define _CONFIG_H_
+
+#include <stddef.h>
+
+#include "stdbool.h"
+
+/* read from the directory of prodtest.exe when -f is not given */
+#define CONFIG_DEFAULT_FILE_NAME "prodtest.cfg"
+
+#define CONFIG_MAX_ENTRIES    128
+#define CONFIG_MAX_KEY_LEN    64
+#define CONFIG_MAX_VALUE_LEN  256
+
+bool config_load(const char *path);
+bool config_load_default(void);
+bool config_exe_path(const char *name, char *path, size_t size);
+
+const char *config_get(const char *key, const char *def);
+long config_get_long(const char *key, long def);
+double config_get_double(const char *key, double def);
+
+#endif /* _CONFIG_H_ */
@@ -0,0 +1,846 @@
+/**
+****************************************************************************************
+*
+* @file dut_sim.c
+*
+* @brief Simulated DUT behind COM port 0, for running prodtest without hardware.
+*
+* UARTSend() hands every host frame to dut_sim_write(), which answers it right
+* away; the answers are queued as raw bytes that the reception thread picks up
+* with dut_sim_read(), so they go through the same framer and queues as bytes
+* from a real port. HCI commands get a successful Command Complete, which for
+* the OTP commands reads or programs the simulated OTP and for the custom
+* actions (0x40D0) the provisioning fields (SN, PSN...); the bulk transfer
+* protocol of bulk.c is implemented against simulated OTP, RAM and flash. A
+* full transmit buffer drops whole frames, like a UART overrun would.
+*
+* The DUT starts out running the test firmware. DTR is its reset line and RTS
+* its boot mode pin (see linectl.h): when DTR is released with RTS asserted
+* it enters its boot ROM, which takes an image with the UART boot protocol
+* (see fw_load.c) into RAM and then runs the test firmware again; otherwise
+* the test firmware restarts.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "dut_sim.h"
+#include "bulk.h"
+#include "fe_msg.h"
+#include "fw_load.h"
+#include "uart.h"
+#include "host_hci.h"
+
+#define SIM_GET16(p) ((uint16_t) ((p)[0] | ((p)[1] << 8)))
+#define SIM_GET32(p) ((uint32_t) ((p)[0] | ((p)[1] << 8) | ((p)[2] << 16) | ((uint32_t) (p)[3] << 24)))
+
+// OTP header fields of the otp command (0x4090), as in the DA14580 OTP header
+#define SIM_OTP_XTRIM_ENABLE  0x7F78
+#define SIM_OTP_XTRIM         0x7F8C
+#define SIM_OTP_BDADDR        0x7FD4
+
+// boot ROM states
+enum {
+	SIM_FIRMWARE,             // running the test firmware
+	SIM_ROM_HEADER,           // STX sent, waiting for SOH and the length
+	SIM_ROM_IMAGE,            // taking the image
+	SIM_ROM_CHECKSUM          // checksum sent, waiting for the host's ACK
+};
+
+struct dut_sim {
+	uint8_t otp[DUT_SIM_OTP_SIZE];
+	uint8_t ram[DUT_SIM_RAM_SIZE];
+	uint8_t flash[DUT_SIM_FLASH_SIZE];
+	uint8_t fields[PROVISION_FIELDS][PROVISION_FIELD_SIZE];
+
+	// DUT -> host bytes, written by the sending thread and read by the reception thread
+	uint8_t tx_buf[DUT_SIM_TX_BUFFER_SIZE];
+	unsigned long tx_head;
+	unsigned long tx_count;
+	HANDLE tx_sem;
+	HANDLE tx_has_data;
+
+	// control lines
+	bool dtr;                 // reset held
+	bool rts;                 // boot mode pin
+
+	DWORD boot_start;         // GetTickCount() when the test firmware started
+	bool  booting;            // test firmware not answering yet
+
+	// bulk transfer in progress, only touched by the sending thread
+	struct {
+		bool     active;
+		uint8_t  op;
+		uint8_t *mem;
+		uint32_t size;
+		uint16_t block_size;
+		uint8_t  window;
+		uint32_t block_count;
+		uint32_t base;            // read: first block not acknowledged by the host
+		uint32_t next;            // read: next block to send
+		uint32_t expected;        // write: next block to program
+		uint32_t since_ack;       // write: blocks programmed since the last ack
+		bool     resend_requested;
+	} bulk;
+
+	// RX with readback values (0x4020 .. 0x4030), counted under sim_air_lock
+	struct {
+		bool     active;
+		uint8_t  frequency;
+		uint16_t received;
+		uint16_t rssi;
+	} rx;
+
+	// boot ROM, only touched by the sending thread
+	struct {
+		int      state;
+		uint8_t  header[3];
+		uint32_t count;           // header or image bytes received
+		uint32_t size;
+		uint8_t  checksum;
+	} rom;
+};
+
+// the simulated DUTs of the process share the air: a TX burst of one of them is
+// received by the others in RX on its channel
+static dut_sim_t *sim_air[UART_MAX_PORTS + 1];
+static HANDLE sim_air_lock;
+
+/* raw RSSI of a packet on the air, about -65 dBm */
+#define SIM_AIR_RSSI  100
+
+/*
+ ****************************************************************************************
+ * @brief Create a simulated DUT, running the test firmware.
+ *
+ * @return the DUT, NULL if out of memory.
+ ****************************************************************************************
+*/
+dut_sim_t *dut_sim_open(void)
+{
+	dut_sim_t *sim = (dut_sim_t *) malloc(sizeof(dut_sim_t));
+	int kk;
+
+	if (sim == NULL)
+		return NULL;
+
+	memset(sim, 0, sizeof(dut_sim_t));
+	sim->tx_sem = CreateMutex(NULL, FALSE, NULL);
+	sim->tx_has_data = CreateEvent(0, TRUE, FALSE, NULL);
+
+	memset(sim->flash, 0xFF, sizeof(sim->flash)); // erased
+	sim->rom.state = SIM_FIRMWARE;
+
+	// ports are opened by the main thread only
+	if (sim_air_lock == NULL)
+		sim_air_lock = CreateMutex(NULL, FALSE, NULL);
+
+	WaitForSingleObject(sim_air_lock, INFINITE);
+	for (kk = 0; kk < UART_MAX_PORTS + 1; kk++)
+		if (sim_air[kk] == NULL)
+		{
+			sim_air[kk] = sim;
+			break;
+		}
+	ReleaseMutex(sim_air_lock);
+
+	return sim;
+}
+
+void dut_sim_close(dut_sim_t *sim)
+{
+	int kk;
+
+	WaitForSingleObject(sim_air_lock, INFINITE);
+	for (kk = 0; kk < UART_MAX_PORTS + 1; kk++)
+		if (sim_air[kk] == sim)
+			sim_air[kk] = NULL;
+	ReleaseMutex(sim_air_lock);
+
+	CloseHandle(sim->tx_sem);
+	CloseHandle(sim->tx_has_data);
+	free(sim);
+}
+
+static void sim_tx(dut_sim_t *sim, uint8_t indicator, const uint8_t *data, unsigned int len)
+{
+	unsigned long pos;
+	unsigned int kk;
+
+	WaitForSingleObject(sim->tx_sem, INFINITE);
+
+	if (sim->tx_count + 1 + len <= DUT_SIM_TX_BUFFER_SIZE)
+	{
+		pos = (sim->tx_head + sim->tx_count) % DUT_SIM_TX_BUFFER_SIZE;
+		sim->tx_buf[pos] = indicator;
+		for (kk = 0; kk < len; kk++)
+			sim->tx_buf[(pos + 1 + kk) % DUT_SIM_TX_BUFFER_SIZE] = data[kk];
+		sim->tx_count += 1 + len;
+
+		SetEvent(sim->tx_has_data);
+	}
+
+	ReleaseMutex(sim->tx_sem);
+}
+
+// raw bytes, for the boot ROM
+static void sim_tx_raw(dut_sim_t *sim, uint8_t b)
+{
+	WaitForSingleObject(sim->tx_sem, INFINITE);
+
+	if (sim->tx_count < DUT_SIM_TX_BUFFER_SIZE)
+	{
+		sim->tx_buf[(sim->tx_head + sim->tx_count) % DUT_SIM_TX_BUFFER_SIZE] = b;
+		sim->tx_count++;
+
+		SetEvent(sim->tx_has_data);
+	}
+
+	ReleaseMutex(sim->tx_sem);
+}
+
+static void sim_command_complete(dut_sim_t *sim, uint16_t opcode, uint8_t status)
+{
+	uint8_t evt[6];
+
+	evt[0] = 0x0E;            // Command Complete
+	evt[1] = 4;
+	evt[2] = 1;               // num HCI command packets
+	evt[3] = opcode & 0xFF;
+	evt[4] = opcode >> 8;
+	evt[5] = status;
+
+	sim_tx(sim, 0x04, evt, sizeof(evt));
+}
+
+// Command Complete with return parameters after the status
+static void sim_command_complete_params(dut_sim_t *sim, uint16_t opcode, uint8_t status, const uint8_t *ret, unsigned int len)
+{
+	uint8_t evt[6 + 4 * 60 + 1];
+
+	evt[0] = 0x0E;
+	evt[1] = (uint8_t) (4 + len);
+	evt[2] = 1;
+	evt[3] = opcode & 0xFF;
+	evt[4] = opcode >> 8;
+	evt[5] = status;
+	memcpy(&evt[6], ret, len);
+
+	sim_tx(sim, 0x04, evt, 6 + len);
+}
+
+// OTP only ever gets bits set
+static void sim_otp_program(dut_sim_t *sim, uint32_t addr, const uint8_t *data, unsigned int len)
+{
+	unsigned int kk;
+
+	for (kk = 0; kk < len && addr + kk < DUT_SIM_OTP_SIZE; kk++)
+		sim->otp[addr + kk] |= data[kk];
+}
+
+// HCI commands on OTP: otp (0x4090), otp_read (0x40A0) and otp_write (0x40B0)
+static bool sim_otp_command(dut_sim_t *sim, uint16_t opcode, const uint8_t *param, unsigned int len)
+{
+	uint8_t ret[1 + 4 * 60];
+	uint32_t addr;
+	unsigned int count;
+
+	memset(ret, 0, sizeof(ret));
+
+	switch (opcode)
+	{
+		case 0x4090:
+			if (len < 7)
+				return false;
+			switch (param[0])
+			{
+				case 0x00: memcpy(ret, &sim->otp[SIM_OTP_XTRIM], 2); break;
+				case 0x01: sim_otp_program(sim, SIM_OTP_XTRIM, &param[1], 2); break;
+				case 0x02: memcpy(ret, &sim->otp[SIM_OTP_BDADDR], 6); break;
+				case 0x03: sim_otp_program(sim, SIM_OTP_BDADDR, &param[1], 6); break;
+				case 0x04: ret[0] = sim->otp[SIM_OTP_XTRIM_ENABLE]; break;
+				case 0x05: sim_otp_program(sim, SIM_OTP_XTRIM_ENABLE, &param[1], 1); break;
+				default: return false;
+			}
+			sim_command_complete_params(sim, opcode, 0x00, ret, 6);
+			return true;
+
+		case 0x40A0:
+		case 0x40B0:
+			if (len < 3)
+				return false;
+			addr = SIM_GET16(param);
+			count = param[2];
+			if (count > 60 || addr + 4 * count > DUT_SIM_OTP_SIZE)
+				return false;
+			if (opcode == 0x40B0)
+			{
+				if (len < 3 + 4 * count)
+					return false;
+				sim_otp_program(sim, addr, &param[3], 4 * count);
+				ret[0] = (uint8_t) count;
+				sim_command_complete_params(sim, opcode, 0x00, ret, 1);
+			}
+			else
+			{
+				ret[0] = (uint8_t) count;
+				memcpy(&ret[1], &sim->otp[addr], 4 * count);
+				sim_command_complete_params(sim, opcode, 0x00, ret, 1 + 4 * count);
+			}
+			return true;
+	}
+
+	return false;
+}
+
+// Command Complete without a status byte, as the firmware sends it for its own RF tests
+static void sim_command_done(dut_sim_t *sim, uint8_t event, uint16_t opcode, const uint8_t *ret, unsigned int len)
+{
+	uint8_t evt[5 + 8];
+
+	evt[0] = event;
+	evt[1] = (uint8_t) (3 + len);
+	evt[2] = 1;
+	evt[3] = opcode & 0xFF;
+	evt[4] = opcode >> 8;
+	memcpy(&evt[5], ret, len);
+
+	sim_tx(sim, 0x04, evt, 5 + len);
+}
+
+// RF tests: RX with readback values (0x4020, 0x4030, and 0x40E0 for the counts so far)
+// and a TX burst (0x201E with the number of packets), received by the other simulated DUTs
+static bool sim_rf_command(dut_sim_t *sim, uint16_t opcode, const uint8_t *param, unsigned int len)
+{
+	uint8_t ret[8];
+	uint16_t packets;
+	int kk;
+
+	memset(ret, 0, sizeof(ret));
+
+	switch (opcode)
+	{
+		case HCI_START_PROD_RX_TEST_CMD_OPCODE:
+			if (len < 1)
+				return false;
+			WaitForSingleObject(sim_air_lock, INFINITE);
+			sim->rx.active = true;
+			sim->rx.frequency = param[0];
+			sim->rx.received = 0;
+			sim->rx.rssi = 0;
+			ReleaseMutex(sim_air_lock);
+			sim_command_done(sim, 0x0E, opcode, NULL, 0);
+			return true;
+
+		case HCI_LE_END_PROD_RX_TEST_CMD_OPCODE:
+		case HCI_PEEK_PROD_RX_STATS_CMD_OPCODE:
+			WaitForSingleObject(sim_air_lock, INFINITE);
+			if (opcode == HCI_LE_END_PROD_RX_TEST_CMD_OPCODE)
+				sim->rx.active = false;
+			ret[0] = sim->rx.received & 0xFF;
+			ret[1] = sim->rx.received >> 8;
+			ret[6] = sim->rx.rssi & 0xFF;
+			ret[7] = sim->rx.rssi >> 8;
+			ReleaseMutex(sim_air_lock);
+			sim_command_done(sim, 0x0E, opcode, ret, 8);
+			return true;
+
+		// replies without a status byte, as the handlers expect them
+		case HCI_UNMODULATED_ON_CMD_OPCODE:
+		case HCI_TX_CONTINUE_TEST_CMD_OPCODE:
+		case HCI_TX_END_CONTINUE_TEST_CMD_OPCODE:
+			sim_command_done(sim, 0x0E, opcode, NULL, 0);
+			return true;
+
+		case 0x201E:
+			if (len < 5)
+				return false;
+			packets = SIM_GET16(&param[3]);
+			sim_command_done(sim, 0x0F, opcode, NULL, 0);
+			WaitForSingleObject(sim_air_lock, INFINITE);
+			for (kk = 0; kk < UART_MAX_PORTS + 1; kk++)
+				if (sim_air[kk] != NULL && sim_air[kk] != sim && sim_air[kk]->rx.active && sim_air[kk]->rx.frequency == param[0])
+				{
+					sim_air[kk]->rx.received = (uint16_t) (sim_air[kk]->rx.received + packets < 0xFFFF ? sim_air[kk]->rx.received + packets : 0xFFFF);
+					sim_air[kk]->rx.rssi = SIM_AIR_RSSI;
+				}
+			ReleaseMutex(sim_air_lock);
+			sim_command_done(sim, 0x0E, 0x4040, NULL, 0);
+			return true;
+	}
+
+	return false;
+}
+
+// custom actions: field and return length of the single field reads and writes
+// (operations 0..7: read/write SN, swversion, flag, PSN), as the test firmware has them
+static const int sim_single_field[4] = { PROVISION_FIELD_SN, PROVISION_FIELD_SWVERSION, PROVISION_FIELD_FLAG, PROVISION_FIELD_PSN };
+static const unsigned int sim_single_read_length[4] = { 21, 5, 12, 12 };
+
+#define SIM_CUSTOM_WRITE_LENGTH  12
+
+static bool sim_custom_action(dut_sim_t *sim, const uint8_t *param, unsigned int len)
+{
+	uint8_t ret[PROVISION_FIELDS * PROVISION_FIELD_SIZE];
+	uint8_t *field;
+	unsigned int kk;
+
+	memset(ret, 0, sizeof(ret));
+
+	if (len < 1)
+		return false;
+
+	if (param[0] <= CMD__REGISTER_RW_OP_WRITE_PSN)
+	{
+		field = sim->fields[sim_single_field[param[0] / 2]];
+		if (param[0] & 1)
+		{
+			if (len < PROVISION_FIELD_SIZE)
+				return false;
+			memcpy(field, &param[1], PROVISION_FIELD_SIZE - 1);
+			field[PROVISION_FIELD_SIZE - 1] = 0;
+			sim_command_complete_params(sim, HCI_CUSTOM_ACTION_CMD_OPCODE, 0x00, ret, SIM_CUSTOM_WRITE_LENGTH);
+		}
+		else
+		{
+			memcpy(ret, field, PROVISION_FIELD_SIZE);
+			sim_command_complete_params(sim, HCI_CUSTOM_ACTION_CMD_OPCODE, 0x00, ret, sim_single_read_length[param[0] / 2]);
+		}
+		return true;
+	}
+
+	switch (param[0])
+	{
+		case CMD__REGISTER_RW_OP_WRITE_PROVISION:
+			if (len < PROVISION_WRITE_LENGTH)
+				return false;
+			for (kk = 0; kk < PROVISION_FIELDS; kk++)
+				if (param[1] & (1 << kk))
+					memcpy(sim->fields[kk], &param[2 + kk * PROVISION_FIELD_SIZE], PROVISION_FIELD_SIZE);
+			sim_command_complete_params(sim, HCI_CUSTOM_ACTION_CMD_OPCODE, 0x00, ret, SIM_CUSTOM_WRITE_LENGTH);
+			return true;
+
+		case CMD__REGISTER_RW_OP_READ_PROVISION:
+			memcpy(ret, sim->fields, sizeof(ret));
+			sim_command_complete_params(sim, HCI_CUSTOM_ACTION_CMD_OPCODE, 0x00, ret, sizeof(ret));
+			return true;
+	}
+
+	return false;
+}
+
+// send a bulk message, crc appended
+static void sim_fe_send(dut_sim_t *sim, uint16_t type, const uint8_t *param, uint16_t length)
+{
+	uint8_t msg[FE_MSG_HDR_SIZE + MAX_PACKET_LENGTH];
+
+	msg[0] = type & 0xFF;
+	msg[1] = type >> 8;
+	msg[2] = BULK_HOST_TASK;
+	msg[3] = 0;
+	msg[4] = BULK_DUT_TASK;
+	msg[5] = 0;
+	msg[6] = (length + BULK_CRC_SIZE) & 0xFF;
+	msg[7] = (length + BULK_CRC_SIZE) >> 8;
+	memcpy(&msg[FE_MSG_HDR_SIZE], param, length);
+	bulk_msg_seal(type, &msg[FE_MSG_HDR_SIZE], length);
+
+	sim_tx(sim, 0x05, msg, FE_MSG_HDR_SIZE + length + BULK_CRC_SIZE);
+}
+
+static void sim_bulk_ack(dut_sim_t *sim, uint32_t next_seq, uint8_t status)
+{
+	uint8_t p[BULK_ACK_LEN];
+
+	p[0] = next_seq & 0xFF;
+	p[1] = (next_seq >> 8) & 0xFF;
+	p[2] = status;
+
+	sim_fe_send(sim, BULK_ACK, p, sizeof(p));
+}
+
+static uint16_t sim_bulk_block_len(dut_sim_t *sim, uint32_t seq)
+{
+	uint32_t left = sim->bulk.size - seq * sim->bulk.block_size;
+
+	return (uint16_t) (left < sim->bulk.block_size ? left : sim->bulk.block_size);
+}
+
+// read: send everything the window allows
+static void sim_bulk_send_window(dut_sim_t *sim)
+{
+	uint8_t p[MAX_PACKET_LENGTH];
+	uint16_t len;
+
+	for (; sim->bulk.next < sim->bulk.block_count && sim->bulk.next < sim->bulk.base + sim->bulk.window; sim->bulk.next++)
+	{
+		len = sim_bulk_block_len(sim, sim->bulk.next);
+
+		p[0] = sim->bulk.next & 0xFF;
+		p[1] = (sim->bulk.next >> 8) & 0xFF;
+		memcpy(&p[2], &sim->bulk.mem[sim->bulk.next * sim->bulk.block_size], len);
+
+		sim_fe_send(sim, BULK_DATA, p, 2 + len);
+	}
+}
+
+static uint8_t sim_bulk_memory(dut_sim_t *sim, uint8_t target, uint32_t address, uint32_t size, uint8_t **mem)
+{
+	switch (target)
+	{
+		case BULK_TARGET_OTP:
+			if (address > DUT_SIM_OTP_SIZE || size > DUT_SIM_OTP_SIZE - address)
+				return BULK_ACK_BAD_RANGE;
+			*mem = &sim->otp[address];
+			break;
+
+		case BULK_TARGET_RAM:
+			if (address < DUT_SIM_RAM_BASE
+				|| address - DUT_SIM_RAM_BASE > DUT_SIM_RAM_SIZE
+				|| size > DUT_SIM_RAM_SIZE - (address - DUT_SIM_RAM_BASE))
+				return BULK_ACK_BAD_RANGE;
+			*mem = &sim->ram[address - DUT_SIM_RAM_BASE];
+			break;
+
+		case BULK_TARGET_FLASH:
+			if (address > DUT_SIM_FLASH_SIZE || size > DUT_SIM_FLASH_SIZE - address)
+				return BULK_ACK_BAD_RANGE;
+			*mem = &sim->flash[address];
+			break;
+
+		default:
+			return BULK_ACK_BAD_TARGET;
+	}
+
+	return BULK_ACK_OK;
+}
+
+static void sim_bulk_start(dut_sim_t *sim, const uint8_t *p, uint16_t len)
+{
+	uint8_t rsp[BULK_START_RSP_LEN];
+	uint8_t status;
+	uint16_t block_size;
+	uint8_t window;
+
+	if (len < BULK_START_REQ_LEN)
+		return;
+
+	memset(&sim->bulk, 0, sizeof(sim->bulk));
+
+	block_size = SIM_GET16(&p[10]);
+	window = p[12];
+	if (block_size == 0 || block_size > BULK_MAX_BLOCK_SIZE)
+		block_size = BULK_DEFAULT_BLOCK_SIZE;
+	if (window == 0)
+		window = 1;
+
+	status = sim_bulk_memory(sim, p[1], SIM_GET32(&p[2]), SIM_GET32(&p[6]), &sim->bulk.mem);
+	if (p[0] != BULK_OP_READ && p[0] != BULK_OP_WRITE)
+		status = BULK_ACK_BAD_TARGET;
+
+	rsp[0] = status;
+	rsp[1] = block_size & 0xFF;
+	rsp[2] = block_size >> 8;
+	rsp[3] = window;
+	sim_fe_send(sim, BULK_START_RSP, rsp, sizeof(rsp));
+
+	if (status != BULK_ACK_OK)
+		return;
+
+	sim->bulk.active = true;
+	sim->bulk.op = p[0];
+	sim->bulk.size = SIM_GET32(&p[6]);
+	sim->bulk.block_size = block_size;
+	sim->bulk.window = window;
+	sim->bulk.block_count = (sim->bulk.size + block_size - 1) / block_size;
+
+	if (sim->bulk.op == BULK_OP_READ)
+		sim_bulk_send_window(sim);
+}
+
+static void sim_bulk_host_ack(dut_sim_t *sim, const uint8_t *p, uint16_t len)
+{
+	uint32_t next_seq;
+
+	if (!sim->bulk.active || sim->bulk.op != BULK_OP_READ || len < BULK_ACK_LEN)
+		return;
+
+	next_seq = SIM_GET16(p);
+	if (next_seq > sim->bulk.block_count)
+		return;
+
+	if (p[2] == BULK_ACK_RESEND)
+	{
+		sim->bulk.base = next_seq;
+		sim->bulk.next = next_seq;
+	}
+	else if (next_seq > sim->bulk.base)
+	{
+		sim->bulk.base = next_seq;
+	}
+
+	sim_bulk_send_window(sim);
+}
+
+static void sim_bulk_data(dut_sim_t *sim, const uint8_t *p, uint16_t len)
+{
+	uint32_t seq;
+	uint16_t block_len;
+
+	if (!sim->bulk.active || sim->bulk.op != BULK_OP_WRITE || len < 2)
+		return;
+
+	seq = SIM_GET16(p);
+
+	if (seq == sim->bulk.expected
+		&& seq < sim->bulk.block_count
+		&& len == 2 + sim_bulk_block_len(sim, seq))
+	{
+		block_len = len - 2;
+		memcpy(&sim->bulk.mem[seq * sim->bulk.block_size], &p[2], block_len);
+		sim->bulk.expected++;
+		sim->bulk.resend_requested = false;
+
+		if (++sim->bulk.since_ack >= (uint32_t) (sim->bulk.window + 1) / 2 || sim->bulk.expected == sim->bulk.block_count)
+		{
+			sim_bulk_ack(sim, sim->bulk.expected, BULK_ACK_OK);
+			sim->bulk.since_ack = 0;
+		}
+	}
+	else if (seq < sim->bulk.expected)
+	{
+		// our ack got lost and the host went back: tell it again where we are
+		sim_bulk_ack(sim, sim->bulk.expected, BULK_ACK_OK);
+	}
+	else if (!sim->bulk.resend_requested)
+	{
+		sim_bulk_ack(sim, sim->bulk.expected, BULK_ACK_RESEND);
+		sim->bulk.resend_requested = true;
+	}
+}
+
+static void sim_fe_msg(dut_sim_t *sim, const uint8_t *msg, unsigned int len)
+{
+	uint16_t type;
+	uint16_t length;
+
+	if (len < FE_MSG_HDR_SIZE)
+		return;
+
+	type = SIM_GET16(&msg[0]);
+	length = SIM_GET16(&msg[6]);
+	if (SIM_GET16(&msg[2]) != BULK_DUT_TASK || length != len - FE_MSG_HDR_SIZE)
+		return;
+
+	if (!bulk_msg_valid(type, &msg[FE_MSG_HDR_SIZE], length))
+	{
+		// a corrupted block shows up as a gap at the next one, like a lost block
+		return;
+	}
+	length -= BULK_CRC_SIZE;
+
+	switch (type)
+	{
+		case BULK_START_REQ: sim_bulk_start(sim, &msg[FE_MSG_HDR_SIZE], length); break;
+		case BULK_ACK:       sim_bulk_host_ack(sim, &msg[FE_MSG_HDR_SIZE], length); break;
+		case BULK_DATA:      sim_bulk_data(sim, &msg[FE_MSG_HDR_SIZE], length); break;
+	}
+}
+
+// reset: anything pending is lost
+static void sim_reset(dut_sim_t *sim)
+{
+	WaitForSingleObject(sim->tx_sem, INFINITE);
+	sim->tx_head = 0;
+	sim->tx_count = 0;
+	ResetEvent(sim->tx_has_data);
+	ReleaseMutex(sim->tx_sem);
+
+	memset(&sim->bulk, 0, sizeof(sim->bulk));
+	memset(&sim->rom, 0, sizeof(sim->rom));
+	sim->rom.state = SIM_FIRMWARE;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Drive a control line of the simulated DUT.
+ *
+ *  @param[in] sim   DUT.
+ *  @param[in] line  UART_LINE_DTR (reset) or UART_LINE_RTS (boot mode).
+ *  @param[in] on    true to assert.
+ ****************************************************************************************
+*/
+void dut_sim_set_line(dut_sim_t *sim, int line, bool on)
+{
+	if (line == UART_LINE_RTS)
+	{
+		sim->rts = on;
+		return;
+	}
+
+	if (on && !sim->dtr)
+		sim_reset(sim);
+
+	if (!on && sim->dtr && sim->rts)
+	{
+		// out of reset into the boot ROM, which announces itself
+		sim->rom.state = SIM_ROM_HEADER;
+		sim_tx_raw(sim, FW_BOOT_STX);
+	}
+	else if (!on && sim->dtr)
+	{
+		sim->booting = true;
+		sim->boot_start = GetTickCount();
+	}
+
+	sim->dtr = on;
+}
+
+static void sim_rom_byte(dut_sim_t *sim, uint8_t b)
+{
+	switch (sim->rom.state)
+	{
+		case SIM_ROM_HEADER:
+			if (sim->rom.count == 0 && b != FW_BOOT_SOH)
+			{
+				sim_tx_raw(sim, FW_BOOT_STX); // not for us, try again
+				break;
+			}
+
+			sim->rom.header[sim->rom.count++] = b;
+			if (sim->rom.count < sizeof(sim->rom.header))
+				break;
+
+			sim->rom.size = sim->rom.header[1] | (sim->rom.header[2] << 8);
+			sim->rom.count = 0;
+			sim->rom.checksum = 0;
+			if (sim->rom.size == 0 || sim->rom.size > DUT_SIM_RAM_SIZE)
+			{
+				sim_tx_raw(sim, FW_BOOT_NAK);
+				sim_tx_raw(sim, FW_BOOT_STX);
+				break;
+			}
+
+			sim_tx_raw(sim, FW_BOOT_ACK);
+			sim->rom.state = SIM_ROM_IMAGE;
+			break;
+
+		case SIM_ROM_IMAGE:
+			sim->ram[sim->rom.count++] = b;
+			sim->rom.checksum ^= b;
+			if (sim->rom.count == sim->rom.size)
+			{
+				sim_tx_raw(sim, sim->rom.checksum);
+				sim->rom.state = SIM_ROM_CHECKSUM;
+			}
+			break;
+
+		case SIM_ROM_CHECKSUM:
+			if (b == FW_BOOT_ACK)
+			{
+				sim->rom.state = SIM_FIRMWARE;
+				sim->booting = true;
+				sim->boot_start = GetTickCount();
+			}
+			else
+			{
+				sim->rom.state = SIM_ROM_HEADER;
+				sim->rom.count = 0;
+				sim_tx_raw(sim, FW_BOOT_STX);
+			}
+			break;
+	}
+}
+
+/*
+ ****************************************************************************************
+ * @brief Process a frame sent by the host.
+ *
+ *  @param[in] data  Frame, starting with the packet indicator.
+ *  @param[in] len   Number of bytes.
+ ****************************************************************************************
+*/
+void dut_sim_write(dut_sim_t *sim, const uint8_t *data, unsigned int len)
+{
+	unsigned int kk;
+
+	if (sim->dtr)
+		return; // held in reset
+
+	if (sim->rom.state != SIM_FIRMWARE)
+	{
+		// the boot ROM takes a plain byte stream
+		for (kk = 0; kk < len; kk++)
+			sim_rom_byte(sim, data[kk]);
+		return;
+	}
+
+	// the test firmware needs a while before it listens
+	if (sim->booting && GetTickCount() - sim->boot_start < DUT_SIM_BOOT_MILLIS)
+		return;
+	sim->booting = false;
+
+	if (len < 1)
+		return;
+
+	switch (data[0])
+	{
+		case 0x01: // HCI command
+			if (len >= 4 && SIM_GET16(&data[1]) == HCI_CUSTOM_ACTION_CMD_OPCODE && sim_custom_action(sim, &data[4], len - 4))
+				break;
+			if (len >= 4 && sim_rf_command(sim, SIM_GET16(&data[1]), &data[4], len - 4))
+				break;
+			if (len >= 4 && !sim_otp_command(sim, SIM_GET16(&data[1]), &data[4], len - 4))
+				sim_command_complete(sim, SIM_GET16(&data[1]), 0x00);
+			break;
+
+		case 0x05: // FE message
+			sim_fe_msg(sim, &data[1], len - 1);
+			break;
+	}
+}
+
+/*
+ ****************************************************************************************
+ * @brief Take the bytes the simulated DUT has sent.
+ *
+ *  @param[out] buf     Receives the bytes.
+ *  @param[in]  size    Size of buf.
+ *  @param[in]  millis  Max. time to wait for a byte.
+ *
+ * @return number of bytes copied to buf, 0 on timeout.
+ ****************************************************************************************
+*/
+unsigned long dut_sim_read(dut_sim_t *sim, uint8_t *buf, unsigned long size, uint32_t millis)
+{
+	unsigned long n = 0;
+
+	if (WaitForSingleObject(sim->tx_has_data, millis) != WAIT_OBJECT_0)
+		return 0;
+
+	WaitForSingleObject(sim->tx_sem, INFINITE);
+
+	while (n < size && sim->tx_count > 0)
+	{
+		buf[n++] = sim->tx_buf[sim->tx_head];
+		sim->tx_head = (sim->tx_head + 1) % DUT_SIM_TX_BUFFER_SIZE;
+		sim->tx_count--;
+	}
+
+	if (sim->tx_count == 0)
+		ResetEvent(sim->tx_has_data);
+
+	ReleaseMutex(sim->tx_sem);
+
+	return n;
+}
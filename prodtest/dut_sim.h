@@ -0,0 +1,47 @@
+/**
+****************************************************************************************
+*
+* @file dut_sim.h
+*
+* @brief Simulated DUT behind COM port 0, for running prodtest without hardware.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _DUT_SIM_H_
+#define _DUT_SIM_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+
+/* memories of the simulated DUT, addressed like on the DA14580 */
+#define DUT_SIM_OTP_SIZE    0x8000
+#define DUT_SIM_RAM_BASE    0x20000000
+#define DUT_SIM_RAM_SIZE    0xA800
+#define DUT_SIM_FLASH_SIZE  0x40000
+
+/* time from reset (or boot ROM download) until the test firmware answers */
+#define DUT_SIM_BOOT_MILLIS 30
+
+/* bytes the DUT -> host direction buffers, like the UART driver's queue */
+#define DUT_SIM_TX_BUFFER_SIZE 0x10000
+
+/* one per opened port 0, so that a gang of them can be simulated */
+typedef struct dut_sim dut_sim_t;
+
+dut_sim_t *dut_sim_open(void);
+void dut_sim_close(dut_sim_t *sim);
+void dut_sim_set_line(dut_sim_t *sim, int line, bool on);
+
+void dut_sim_write(dut_sim_t *sim, const uint8_t *data, unsigned int len);
+unsigned long dut_sim_read(dut_sim_t *sim, uint8_t *buf, unsigned long size, uint32_t millis);
+
+#endif /* _DUT_SIM_H_ */
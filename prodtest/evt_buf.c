@@ -0,0 +1,259 @@
+/**
+****************************************************************************************
+*
+* @file evt_buf.c
+*
+* @brief Pooled, reference counted buffers for received (and sent) frames.
+*
+* The reception thread copies every complete frame once, into a buffer from a
+* fixed pool, and hands the same buffer to the command handler queue and to
+* every tap (capture, metrics). Consumers only read it; the last one to call
+* evt_buf_release() returns it to the pool.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "evt_buf.h"
+
+static evt_buf_t evt_pool[EVT_BUF_POOL_SIZE];
+static evt_buf_t *evt_free_list;
+
+// a critical section, not a mutex: this is taken for every frame and never waits long
+static CRITICAL_SECTION evt_lock;
+static bool evt_initialized = false;
+
+static struct {
+	evt_tap_t tap;
+	void *ctx;
+} evt_taps[EVT_BUF_MAX_TAPS];
+static volatile LONG evt_tap_count;
+
+static evt_buf_stats_t evt_stats;
+
+void evt_buf_init(void)
+{
+	int kk;
+
+	if (evt_initialized)
+		return;
+
+	InitializeCriticalSection(&evt_lock);
+
+	evt_free_list = NULL;
+	for (kk = EVT_BUF_POOL_SIZE - 1; kk >= 0; kk--)
+	{
+		evt_pool[kk].pooled = true;
+		evt_pool[kk].next_free = evt_free_list;
+		evt_free_list = &evt_pool[kk];
+	}
+
+	evt_initialized = true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Get a buffer holding a copy of a frame, with one reference for the caller.
+ *
+ *  @param[in] direction     EVT_BUF_RX or EVT_BUF_TX.
+ *  @param[in] payload_type  Packet indicator.
+ *  @param[in] data          Frame, indicator not included.
+ *  @param[in] length        Number of bytes, up to HCI_FRAMER_MAX_FRAME_SIZE.
+ *
+ * @return the buffer.
+ ****************************************************************************************
+*/
+evt_buf_t *evt_buf_alloc(uint8_t direction, uint8_t payload_type, const uint8_t *data, uint16_t length)
+{
+	evt_buf_t *buf;
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+
+	EnterCriticalSection(&evt_lock);
+
+	buf = evt_free_list;
+	if (buf != NULL)
+		evt_free_list = buf->next_free;
+
+	evt_stats.allocs++;
+	if (++evt_stats.in_use > evt_stats.peak_in_use)
+		evt_stats.peak_in_use = evt_stats.in_use;
+	if (buf == NULL)
+		evt_stats.heap_allocs++;
+
+	LeaveCriticalSection(&evt_lock);
+
+	if (buf == NULL)
+	{
+		buf = (evt_buf_t *) malloc(sizeof(evt_buf_t));
+		buf->pooled = false;
+	}
+
+	if (length > sizeof(buf->data))
+		length = sizeof(buf->data);
+
+	buf->next_free = NULL;
+	buf->refs = 1;
+	buf->direction = direction;
+	buf->payload_type = payload_type;
+	buf->length = length;
+	buf->stamp = now.QuadPart;
+	memcpy(buf->data, data, length);
+
+	return buf;
+}
+
+void evt_buf_ref(evt_buf_t *buf)
+{
+	InterlockedIncrement(&buf->refs);
+}
+
+void evt_buf_release(evt_buf_t *buf)
+{
+	if (buf == NULL || InterlockedDecrement(&buf->refs) != 0)
+		return;
+
+	EnterCriticalSection(&evt_lock);
+
+	evt_stats.in_use--;
+	if (buf->pooled)
+	{
+		buf->next_free = evt_free_list;
+		evt_free_list = buf;
+	}
+
+	LeaveCriticalSection(&evt_lock);
+
+	if (!buf->pooled)
+		free(buf);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Get the buffer from a pointer to its data, e.g. an hci_evt_t.
+ ****************************************************************************************
+*/
+evt_buf_t *evt_buf_of(const void *data)
+{
+	return (evt_buf_t *) ((const uint8_t *) data - offsetof(evt_buf_t, data));
+}
+
+/*
+ ****************************************************************************************
+ * @brief Have a function called for every published buffer.
+ *
+ *  Taps run on the thread that publishes, i.e. mostly the reception thread, so
+ *  they must not block; one that needs to do I/O takes a reference and hands the
+ *  buffer to a thread of its own.
+ *
+ *  @param[in] tap  Function.
+ *  @param[in] ctx  Passed to the function.
+ *
+ * @return false if EVT_BUF_MAX_TAPS are registered already.
+ ****************************************************************************************
+*/
+bool evt_tap_add(evt_tap_t tap, void *ctx)
+{
+	bool added = false;
+	int kk;
+
+	evt_buf_init();
+
+	EnterCriticalSection(&evt_lock);
+
+	for (kk = 0; kk < EVT_BUF_MAX_TAPS; kk++)
+	{
+		if (evt_taps[kk].tap == NULL)
+		{
+			evt_taps[kk].tap = tap;
+			evt_taps[kk].ctx = ctx;
+			InterlockedIncrement(&evt_tap_count);
+			added = true;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&evt_lock);
+
+	return added;
+}
+
+void evt_tap_remove(evt_tap_t tap, void *ctx)
+{
+	int kk;
+
+	EnterCriticalSection(&evt_lock);
+
+	for (kk = 0; kk < EVT_BUF_MAX_TAPS; kk++)
+	{
+		if (evt_taps[kk].tap == tap && evt_taps[kk].ctx == ctx)
+		{
+			evt_taps[kk].tap = NULL;
+			evt_taps[kk].ctx = NULL;
+			InterlockedDecrement(&evt_tap_count);
+		}
+	}
+
+	LeaveCriticalSection(&evt_lock);
+}
+
+/*
+ ****************************************************************************************
+ * @brief true if any tap is registered, so that senders can skip publishing.
+ ****************************************************************************************
+*/
+bool evt_tapped(void)
+{
+	return evt_tap_count != 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Hand a buffer to every tap. The caller keeps its own reference.
+ ****************************************************************************************
+*/
+void evt_buf_publish(evt_buf_t *buf)
+{
+	evt_tap_t taps[EVT_BUF_MAX_TAPS];
+	void *ctxs[EVT_BUF_MAX_TAPS];
+	int n = 0;
+	int kk;
+
+	if (evt_tap_count == 0)
+		return;
+
+	EnterCriticalSection(&evt_lock);
+
+	for (kk = 0; kk < EVT_BUF_MAX_TAPS; kk++)
+	{
+		if (evt_taps[kk].tap != NULL)
+		{
+			taps[n] = evt_taps[kk].tap;
+			ctxs[n] = evt_taps[kk].ctx;
+			n++;
+		}
+	}
+
+	LeaveCriticalSection(&evt_lock);
+
+	for (kk = 0; kk < n; kk++)
+		taps[kk](buf, ctxs[kk]);
+}
+
+void evt_buf_get_stats(evt_buf_stats_t *stats)
+{
+	EnterCriticalSection(&evt_lock);
+	*stats = evt_stats;
+	LeaveCriticalSection(&evt_lock);
+}
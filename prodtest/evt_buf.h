@@ -0,0 +1,72 @@
+/**
+****************************************************************************************
+*
+* @file evt_buf.h
+*
+* @brief Pooled, reference counted buffers for received (and sent) frames.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _EVT_BUF_H_
+#define _EVT_BUF_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "stdbool.h"
+#include "hci_framer.h"
+
+/* buffers preallocated; when all are in use evt_buf_alloc() falls back to malloc */
+#define EVT_BUF_POOL_SIZE 32
+
+/* max. number of taps */
+#define EVT_BUF_MAX_TAPS 4
+
+/* direction */
+#define EVT_BUF_RX 0 // received from the DUT
+#define EVT_BUF_TX 1 // sent to the DUT
+
+typedef struct evt_buf {
+	struct evt_buf *next_free;
+	volatile LONG refs;
+	bool     pooled;
+	uint8_t  direction;       // EVT_BUF_RX / EVT_BUF_TX
+	uint8_t  payload_type;    // packet indicator: 0x01 HCI cmd, 0x04 HCI evt, 0x05 FE msg
+	uint16_t length;          // bytes at data, indicator not included
+	LONGLONG stamp;           // QueryPerformanceCounter() when the frame was complete
+	uint8_t  data[HCI_FRAMER_MAX_FRAME_SIZE];
+} evt_buf_t;
+
+/* called for every published buffer; a tap that keeps it must take a reference */
+typedef void (*evt_tap_t)(evt_buf_t *buf, void *ctx);
+
+typedef struct {
+	uint32_t allocs;
+	uint32_t heap_allocs;     // pool was empty
+	uint32_t in_use;
+	uint32_t peak_in_use;
+} evt_buf_stats_t;
+
+void evt_buf_init(void);
+
+evt_buf_t *evt_buf_alloc(uint8_t direction, uint8_t payload_type, const uint8_t *data, uint16_t length);
+void evt_buf_ref(evt_buf_t *buf);
+void evt_buf_release(evt_buf_t *buf);
+evt_buf_t *evt_buf_of(const void *data);
+
+bool evt_tap_add(evt_tap_t tap, void *ctx);
+void evt_tap_remove(evt_tap_t tap, void *ctx);
+bool evt_tapped(void);
+void evt_buf_publish(evt_buf_t *buf);
+
+void evt_buf_get_stats(evt_buf_stats_t *stats);
+
+#endif /* _EVT_BUF_H_ */
@@ -0,0 +1,293 @@
+/**
+****************************************************************************************
+*
+* @file fe_msg.c
+*
+* @brief FE (0x05) message channels.
+*
+* The reception thread hands every complete FE message to fe_deliver(), which
+* queues it on the channel that subscribed to its type and source task. FE
+* messages carry a 16-bit length, so unlike HCI events they are not limited to
+* 255 bytes and can be used for large transfers.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "fe_msg.h"
+#include "queue.h"
+#include "uart.h"
+
+struct fe_channel {
+	bool        used;
+	uint16_t    type;         // FE_MSG_ANY or message type
+	uint16_t    src_task;     // FE_MSG_ANY or source task id
+	uint32_t    depth;        // messages waiting in queue
+	QueueRecord queue;
+};
+
+static fe_channel_t fe_channels[FE_MAX_CHANNELS];
+
+static HANDLE FEMsgSem = NULL; // protects fe_channels and fe_stats
+
+static fe_stats_t fe_stats;
+
+#define FE_GET16(p) ((uint16_t) ((p)[0] | ((p)[1] << 8)))
+
+/*
+ ****************************************************************************************
+ * @brief Create the channel table. Called by InitTasks() before the reception
+ *        thread starts.
+ ****************************************************************************************
+*/
+void fe_init(void)
+{
+	int kk;
+
+	if (FEMsgSem != NULL)
+		return;
+
+	FEMsgSem = CreateMutex(NULL, FALSE, NULL);
+
+	for (kk = 0; kk < FE_MAX_CHANNELS; kk++)
+	{
+		memset(&fe_channels[kk], 0, sizeof(fe_channel_t));
+		fe_channels[kk].queue.HasData = CreateEvent(0, TRUE, FALSE, NULL);
+	}
+}
+
+/*
+ ****************************************************************************************
+ * @brief Subscribe to FE messages.
+ *
+ *  A message goes to a single channel: the one whose type and task match most
+ *  specifically, i.e. an exact type beats an exact task beats FE_MSG_ANY.
+ *
+ *  @param[in] type      Message type or FE_MSG_ANY.
+ *  @param[in] src_task  Task id of the sender on the DUT or FE_MSG_ANY.
+ *
+ * @return the channel, NULL if all FE_MAX_CHANNELS are in use.
+ ****************************************************************************************
+*/
+fe_channel_t *fe_subscribe(uint16_t type, uint16_t src_task)
+{
+	fe_channel_t *ch = NULL;
+	int kk;
+
+	WaitForSingleObject(FEMsgSem, INFINITE);
+
+	for (kk = 0; kk < FE_MAX_CHANNELS; kk++)
+	{
+		if (!fe_channels[kk].used)
+		{
+			ch = &fe_channels[kk];
+			ch->used = true;
+			ch->type = type;
+			ch->src_task = src_task;
+			ch->depth = 0;
+			break;
+		}
+	}
+
+	ReleaseMutex(FEMsgSem);
+
+	return ch;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Close a channel and free the messages still queued on it.
+ *
+ *  @param[in] ch  Channel returned by fe_subscribe().
+ ****************************************************************************************
+*/
+void fe_unsubscribe(fe_channel_t *ch)
+{
+	void *msg;
+
+	if (ch == NULL)
+		return;
+
+	WaitForSingleObject(FEMsgSem, INFINITE);
+
+	while ((msg = DeQueue(&ch->queue)) != NULL)
+		free(msg);
+
+	ch->depth = 0;
+	ch->used = false;
+
+	ReleaseMutex(FEMsgSem);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait for a message on a channel.
+ *
+ *  @param[in] ch      Channel returned by fe_subscribe().
+ *  @param[in] millis  Timeout in milliseconds.
+ *
+ * @return the message, to be released with free(), or NULL on timeout.
+ ****************************************************************************************
+*/
+fe_msg_t *fe_recv_wait(fe_channel_t *ch, unsigned int millis)
+{
+	fe_msg_t *msg = NULL;
+	DWORD start = GetTickCount();
+	DWORD elapsed = 0;
+
+	// the queue may be empty after the wake-up: another reader took the message
+	while (msg == NULL && elapsed <= millis)
+	{
+		if (WaitForSingleObject(ch->queue.HasData, millis - elapsed) != WAIT_OBJECT_0)
+			return NULL;
+
+		WaitForSingleObject(FEMsgSem, INFINITE);
+
+		msg = (fe_msg_t *) DeQueue(&ch->queue);
+		if (msg != NULL)
+			ch->depth--;
+
+		ReleaseMutex(FEMsgSem);
+
+		elapsed = GetTickCount() - start;
+	}
+
+	return msg;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Send an FE message.
+ *
+ *  @param[in] type      Message type.
+ *  @param[in] dst_task  Destination task id.
+ *  @param[in] src_task  Source task id.
+ *  @param[in] length    Number of parameter bytes, up to MAX_PACKET_LENGTH.
+ *  @param[in] param     Parameter bytes.
+ *
+ * @return true if the message was sent.
+ ****************************************************************************************
+*/
+bool fe_send(uint16_t type, uint16_t dst_task, uint16_t src_task, uint16_t length, const uint8_t *param)
+{
+	uint8_t msg[FE_MSG_HDR_SIZE + MAX_PACKET_LENGTH];
+
+	if (length > MAX_PACKET_LENGTH)
+		return false;
+
+	msg[0] = type & 0xFF;     // LSB first
+	msg[1] = type >> 8;
+	msg[2] = dst_task & 0xFF;
+	msg[3] = dst_task >> 8;
+	msg[4] = src_task & 0xFF;
+	msg[5] = src_task >> 8;
+	msg[6] = length & 0xFF;
+	msg[7] = length >> 8;
+
+	if (length)
+		memcpy(&msg[FE_MSG_HDR_SIZE], param, length);
+
+	UARTSend(0x05, FE_MSG_HDR_SIZE + length, msg);
+
+	return true;
+}
+
+static fe_channel_t *fe_find_channel(uint16_t type, uint16_t src_task)
+{
+	fe_channel_t *best = NULL;
+	int best_score = -1;
+	int score;
+	int kk;
+
+	for (kk = 0; kk < FE_MAX_CHANNELS; kk++)
+	{
+		fe_channel_t *ch = &fe_channels[kk];
+
+		if (!ch->used)
+			continue;
+		if (ch->type != FE_MSG_ANY && ch->type != type)
+			continue;
+		if (ch->src_task != FE_MSG_ANY && ch->src_task != src_task)
+			continue;
+
+		score = (ch->type != FE_MSG_ANY ? 2 : 0) + (ch->src_task != FE_MSG_ANY ? 1 : 0);
+		if (score > best_score)
+		{
+			best = ch;
+			best_score = score;
+		}
+	}
+
+	return best;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Queue a received FE message on its channel. Called by the reception thread.
+ *
+ *  @param[in] data    Message, indicator not included.
+ *  @param[in] length  Number of bytes at data.
+ ****************************************************************************************
+*/
+void fe_deliver(const uint8_t *data, uint16_t length)
+{
+	fe_channel_t *ch;
+	fe_msg_t *msg;
+	uint16_t param_length;
+
+	if (FEMsgSem == NULL)
+		return;
+
+	WaitForSingleObject(FEMsgSem, INFINITE);
+
+	param_length = length >= FE_MSG_HDR_SIZE ? FE_GET16(&data[6]) : 0;
+	if (length < FE_MSG_HDR_SIZE || param_length != length - FE_MSG_HDR_SIZE)
+	{
+		fe_stats.malformed++;
+		goto done;
+	}
+
+	ch = fe_find_channel(FE_GET16(&data[0]), FE_GET16(&data[4]));
+	if (ch == NULL)
+	{
+		fe_stats.unclaimed++;
+		goto done;
+	}
+
+	if (ch->depth >= FE_CHANNEL_MAX_DEPTH)
+	{
+		fe_stats.overflows++;
+		goto done;
+	}
+
+	msg = (fe_msg_t *) malloc(sizeof(fe_msg_t) + param_length);
+	msg->type = FE_GET16(&data[0]);
+	msg->dst_task = FE_GET16(&data[2]);
+	msg->src_task = FE_GET16(&data[4]);
+	msg->length = param_length;
+	memcpy(msg->param, &data[FE_MSG_HDR_SIZE], param_length);
+
+	EnQueue(&ch->queue, msg);
+	ch->depth++;
+	fe_stats.delivered++;
+
+done:
+	ReleaseMutex(FEMsgSem);
+}
+
+void fe_get_stats(fe_stats_t *stats)
+{
+	WaitForSingleObject(FEMsgSem, INFINITE);
+	*stats = fe_stats;
+	ReleaseMutex(FEMsgSem);
+}
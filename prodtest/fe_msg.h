@@ -0,0 +1,68 @@
+/**
+****************************************************************************************
+*
+* @file fe_msg.h
+*
+* @brief FE (0x05) message channels: demultiplexing of received messages per type /
+*        task and sending of FE messages.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _FE_MSG_H_
+#define _FE_MSG_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+
+/* FE message header, indicator not included: type, dstid, srcid, length */
+#define FE_MSG_HDR_SIZE 8
+
+/* wildcard for fe_subscribe() */
+#define FE_MSG_ANY 0xFFFF
+
+/* max. number of channels subscribed at the same time */
+#define FE_MAX_CHANNELS 8
+
+/* messages a channel holds before new ones are dropped */
+#define FE_CHANNEL_MAX_DEPTH 64
+
+typedef struct {
+	uint16_t type;
+	uint16_t dst_task;
+	uint16_t src_task;
+	uint16_t length;
+	uint8_t  param[1];        // length bytes
+} fe_msg_t;
+
+typedef struct {
+	uint32_t delivered;       // messages queued on a channel
+	uint32_t unclaimed;       // messages no channel subscribed to
+	uint32_t overflows;       // messages dropped because the channel was full
+	uint32_t malformed;       // messages whose length field does not match the frame
+} fe_stats_t;
+
+typedef struct fe_channel fe_channel_t;
+
+void fe_init(void);
+
+fe_channel_t *fe_subscribe(uint16_t type, uint16_t src_task);
+void fe_unsubscribe(fe_channel_t *ch);
+
+fe_msg_t *fe_recv_wait(fe_channel_t *ch, unsigned int millis);
+
+bool fe_send(uint16_t type, uint16_t dst_task, uint16_t src_task, uint16_t length, const uint8_t *param);
+
+void fe_deliver(const uint8_t *data, uint16_t length);
+
+void fe_get_stats(fe_stats_t *stats);
+
+#endif /* _FE_MSG_H_ */
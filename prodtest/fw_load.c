@@ -0,0 +1,252 @@
+/**
+****************************************************************************************
+*
+* @file fw_load.c
+*
+* @brief Firmware download over the DA14580 UART boot protocol.
+*
+* After reset the boot ROM sends STX and waits for SOH and the 16 bit image
+* length, which it ACKs (or NAKs). It then takes the image, answers with the
+* XOR of all image bytes and starts the image once the host ACKs that. The
+* protocol runs on the raw port, before the reception thread is started, so
+* that the port can go straight on to HCI when the image is running.
+*
+* A gang download runs the protocol on every port of a fixture at once, one
+* thread per port, all reading the same memory mapped image.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <process.h>
+#include <string.h>
+#include <windows.h>
+
+#include "fw_load.h"
+#include "uart.h"
+
+static fw_image_t fw_image_cache[FW_IMAGE_CACHE_SIZE];
+
+/*
+ ****************************************************************************************
+ * @brief Get an image file, mapped and checksummed only on first use.
+ *
+ *  @param[in] path  Image file.
+ *
+ * @return the image, NULL if the file cannot be read, is empty or too large.
+ ****************************************************************************************
+*/
+const fw_image_t *fw_image_get(const char *path)
+{
+	fw_image_t *image = NULL;
+	DWORD size;
+	DWORD kk;
+	uint8_t checksum = 0;
+
+	for (kk = 0; kk < FW_IMAGE_CACHE_SIZE; kk++)
+	{
+		if (fw_image_cache[kk].data != NULL && strcmp(fw_image_cache[kk].path, path) == 0)
+			return &fw_image_cache[kk];
+		if (fw_image_cache[kk].data == NULL && image == NULL)
+			image = &fw_image_cache[kk];
+	}
+
+	if (image == NULL || strlen(path) >= sizeof(image->path))
+		return NULL;
+
+	image->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (image->file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize(image->file, NULL);
+	if (size == 0 || size == INVALID_FILE_SIZE || size > FW_MAX_IMAGE_SIZE)
+		goto fail;
+
+	image->mapping = CreateFileMapping(image->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (image->mapping == NULL)
+		goto fail;
+
+	image->data = (const uint8_t *) MapViewOfFile(image->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (image->data == NULL)
+		goto fail;
+
+	for (kk = 0; kk < size; kk++)
+		checksum ^= image->data[kk];
+
+	strcpy(image->path, path);
+	image->size = size;
+	image->checksum = checksum;
+
+	return image;
+
+fail:
+	if (image->mapping != NULL)
+		CloseHandle(image->mapping);
+	CloseHandle(image->file);
+	memset(image, 0, sizeof(fw_image_t));
+
+	return NULL;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait for a byte from the boot ROM.
+ *
+ * @return the byte, -1 on timeout.
+ ****************************************************************************************
+*/
+static int fw_boot_recv(uart_port_t *port, uint32_t millis)
+{
+	uint8_t b;
+
+	if (UARTPortRead(port, &b, 1, millis) != 1)
+		return -1;
+
+	return b;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Download an image with the boot ROM protocol. The DUT must have been
+ *        reset, and the port opened at the baud rate of the boot ROM.
+ *
+ *  @param[in]  port                Port.
+ *  @param[in]  image               Image.
+ *  @param[out] sent                Image bytes written so far, may be NULL.
+ *  @param[in]  stx_timeout_millis  Max. time to wait for the boot ROM.
+ *
+ * @return FW_NO_ERROR when the image runs, FW_ERR_... otherwise.
+ ****************************************************************************************
+*/
+int fw_boot_uart(uart_port_t *port, const fw_image_t *image, volatile LONG *sent, uint32_t stx_timeout_millis)
+{
+	uint8_t hdr[3];
+	uint32_t pos;
+	uint32_t chunk;
+	uint8_t reply;
+	DWORD start = GetTickCount();
+	DWORD elapsed;
+	int b;
+
+	// the boot ROM repeats STX until it gets an answer; skip any noise before it
+	do
+	{
+		elapsed = GetTickCount() - start;
+		if (elapsed >= stx_timeout_millis)
+			return FW_ERR_NO_STX;
+		b = fw_boot_recv(port, stx_timeout_millis - elapsed);
+	} while (b != FW_BOOT_STX);
+
+	hdr[0] = FW_BOOT_SOH;
+	hdr[1] = image->size & 0xFF;
+	hdr[2] = (image->size >> 8) & 0xFF;
+	UARTPortWrite(port, hdr, sizeof(hdr));
+
+	// a second STX may already be on its way
+	do
+	{
+		b = fw_boot_recv(port, FW_BOOT_REPLY_TIMEOUT_MILLIS);
+	} while (b == FW_BOOT_STX);
+
+	if (b == FW_BOOT_NAK)
+		return FW_ERR_NAK;
+	if (b != FW_BOOT_ACK)
+		return FW_ERR_TIMEOUT;
+
+	for (pos = 0; pos < image->size; pos += chunk)
+	{
+		chunk = image->size - pos < FW_BOOT_CHUNK_SIZE ? image->size - pos : FW_BOOT_CHUNK_SIZE;
+		UARTPortWrite(port, &image->data[pos], chunk);
+		if (sent != NULL)
+			InterlockedExchange(sent, pos + chunk);
+	}
+
+	// UARTPortWrite() returns when the driver has taken the image, which may be well
+	// before the last byte is on the wire
+	b = fw_boot_recv(port, FW_BOOT_REPLY_TIMEOUT_MILLIS + (uint32_t) ((image->size * 10ULL * 1000) / port->baud_rate));
+	if (b < 0)
+		return FW_ERR_TIMEOUT;
+
+	if ((uint8_t) b != image->checksum)
+	{
+		reply = FW_BOOT_NAK;
+		UARTPortWrite(port, &reply, 1);
+		return FW_ERR_CHECKSUM;
+	}
+
+	reply = FW_BOOT_ACK;
+	UARTPortWrite(port, &reply, 1);
+
+	return FW_NO_ERROR;
+}
+
+const char *fw_boot_error_name(int rc)
+{
+	switch (rc)
+	{
+		case FW_NO_ERROR:     return "ok";
+		case FW_ERR_NO_STX:   return "no answer from boot ROM";
+		case FW_ERR_NAK:      return "image length refused";
+		case FW_ERR_TIMEOUT:  return "boot ROM stopped answering";
+		case FW_ERR_CHECKSUM: return "checksum mismatch";
+	}
+
+	return "unknown";
+}
+
+static void fw_gang_proc(PVOID arg)
+{
+	fw_gang_slot_t *slot = (fw_gang_slot_t *) arg;
+	DWORD start = GetTickCount();
+
+	for (slot->attempts = 1; ; slot->attempts++)
+	{
+		InterlockedExchange(&slot->sent, 0);
+		UARTPortResetDUT(slot->port);
+
+		slot->rc = fw_boot_uart(slot->port, slot->image, &slot->sent, FW_BOOT_STX_TIMEOUT_MILLIS);
+		if (slot->rc == FW_NO_ERROR || slot->attempts == FW_GANG_MAX_ATTEMPTS)
+			break;
+
+		// a failed download sends the boot ROM back to STX, or it is reset above
+	}
+
+	slot->millis = GetTickCount() - start;
+	SetEvent(slot->done);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Start downloading an image on several ports at once. Each slot gets
+ *        its own thread, which retries up to FW_GANG_MAX_ATTEMPTS times and
+ *        sets slot->done when finished.
+ *
+ *  @param[in,out] slots  One per port; port must be set and open.
+ *  @param[in]     count  Number of slots.
+ *  @param[in]     image  Image, shared by all threads.
+ ****************************************************************************************
+*/
+void fw_gang_start(fw_gang_slot_t *slots, int count, const fw_image_t *image)
+{
+	int kk;
+
+	for (kk = 0; kk < count; kk++)
+	{
+		slots[kk].image = image;
+		slots[kk].sent = 0;
+		slots[kk].attempts = 0;
+		slots[kk].rc = FW_ERR_NO_STX;
+		slots[kk].millis = 0;
+		slots[kk].done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+		_beginthread(fw_gang_proc, 10000, &slots[kk]);
+	}
+}
@@ -0,0 +1,87 @@
+/**
+****************************************************************************************
+*
+* @file fw_load.h
+*
+* @brief Firmware download over the DA14580 UART boot protocol.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _FW_LOAD_H_
+#define _FW_LOAD_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "uart.h"
+
+/* boot ROM protocol bytes */
+#define FW_BOOT_STX 0x02
+#define FW_BOOT_SOH 0x01
+#define FW_BOOT_ACK 0x06
+#define FW_BOOT_NAK 0x15
+
+/* the boot ROM loads the image into SysRAM (42 kB) */
+#define FW_MAX_IMAGE_SIZE 0xA800
+
+/* baud rate of the boot ROM on P0_2/P0_3, the fastest of its UART pin pairs */
+#define FW_BOOT_DEFAULT_BAUD_RATE 115200
+
+/* how long to wait for the boot ROM to announce itself after reset */
+#define FW_BOOT_STX_TIMEOUT_MILLIS 5000
+
+/* how long the boot ROM may take to answer the header and the checksum */
+#define FW_BOOT_REPLY_TIMEOUT_MILLIS 1000
+
+/* images kept mapped during one run */
+#define FW_IMAGE_CACHE_SIZE 4
+
+/* the image is written in chunks of this size, for progress reporting */
+#define FW_BOOT_CHUNK_SIZE 1024
+
+/* attempts per port of a gang download */
+#define FW_GANG_MAX_ATTEMPTS 3
+
+/* fw_boot_uart() return codes */
+#define FW_NO_ERROR          0
+#define FW_ERR_NO_STX        1 // boot ROM did not announce itself
+#define FW_ERR_NAK           2 // header refused
+#define FW_ERR_TIMEOUT       3 // no answer to header or image
+#define FW_ERR_CHECKSUM      4 // boot ROM received the image corrupted
+
+typedef struct {
+	char     path[MAX_PATH];
+	HANDLE   file;
+	HANDLE   mapping;
+	const uint8_t *data;      // read-only view, shared by all ports
+	uint32_t size;
+	uint8_t  checksum;        // XOR of all bytes, as echoed by the boot ROM
+} fw_image_t;
+
+/* one port of a gang download */
+typedef struct {
+	uart_port_t *port;        // open, at the baud rate of the boot ROM
+	volatile LONG sent;       // image bytes written in the current attempt
+	int      attempts;
+	int      rc;              // FW_NO_ERROR / FW_ERR_...
+	DWORD    millis;          // from the first attempt until the image runs
+	HANDLE   done;            // set when the port has finished, for WaitForMultipleObjects()
+	const fw_image_t *image;
+} fw_gang_slot_t;
+
+const fw_image_t *fw_image_get(const char *path);
+
+int fw_boot_uart(uart_port_t *port, const fw_image_t *image, volatile LONG *sent, uint32_t stx_timeout_millis);
+const char *fw_boot_error_name(int rc);
+
+void fw_gang_start(fw_gang_slot_t *slots, int count, const fw_image_t *image);
+
+#endif /* _FW_LOAD_H_ */
@@ -0,0 +1,339 @@
+/**
+****************************************************************************************
+*
+* @file hci_framer.c
+*
+* @brief H4 / FE message framing parser for the UART reception path.
+*
+* The parser does no I/O: the reception thread pushes whatever bytes it read,
+* together with the current tick count, and pulls complete frames out. A frame
+* whose header fails the sanity checks, or which stalls for longer than the
+* inter-byte timeout, is dropped and its bytes (minus the indicator) are scanned
+* again, so a lost byte costs the corrupted frame only and not the ones behind it.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <string.h>
+
+#include "hci_framer.h"
+#include "hci_scan.h"
+
+// length limits of the HCI events the test firmware may send
+typedef struct {
+	uint8_t event;
+	uint8_t min_length;
+	uint8_t max_length;
+} hci_evt_length_t;
+
+static const hci_evt_length_t hci_evt_lengths[] = {
+	{ 0x05, 4,   4 },  // Disconnection Complete
+	{ 0x08, 4,   4 },  // Encryption Change
+	{ 0x0E, 3, 255 },  // Command Complete
+	{ 0x0F, 3,   4 },  // Command Status (test firmware sends 3 bytes)
+	{ 0x10, 1,   1 },  // Hardware Error
+	{ 0x13, 5, 255 },  // Number Of Completed Packets
+	{ 0x1A, 1,   1 },  // Data Buffer Overflow
+	{ 0x30, 3,   3 },  // Encryption Key Refresh Complete
+	{ 0x3E, 1, 255 },  // LE Meta event
+	{ 0xFF, 0, 255 },  // Vendor specific
+	{ 0, 0, 0 }        // end marker
+};
+
+static bool hci_evt_length_valid(uint8_t event, uint8_t length)
+{
+	int kk;
+
+	for (kk = 0; hci_evt_lengths[kk].event != 0; kk++)
+	{
+		if (hci_evt_lengths[kk].event == event)
+		{
+			return (length >= hci_evt_lengths[kk].min_length
+				&& length <= hci_evt_lengths[kk].max_length);
+		}
+	}
+
+	return false; // unknown event code, most likely noise
+}
+
+/*
+ ****************************************************************************************
+ * @brief Drop the frame under construction.
+ *
+ *  Its bytes, minus the indicator that got us into the wrong frame, stay in buf
+ *  until framer_requeue() puts them in front of the replay buffer.
+ *
+ *  @param[in] f     Framer.
+ ****************************************************************************************
+*/
+static void framer_reject(hci_framer_t *f)
+{
+	f->rejected = f->pos > 1 ? f->pos - 1 : 0;
+
+	f->state = HCI_FRAMER_STATE_IDLE;
+	f->pos = 0;
+	f->expected = 0;
+}
+
+static void framer_requeue(hci_framer_t *f)
+{
+	uint16_t keep = f->rejected;
+	uint16_t left = f->replay_len - f->replay_pos;
+
+	// bytes still waiting in the replay buffer follow the ones of the dropped frame
+	memmove(&f->replay[keep], &f->replay[f->replay_pos], left);
+	memcpy(&f->replay[0], &f->buf[1], keep);
+
+	f->replay_pos = 0;
+	f->replay_len = keep + left;
+	f->rejected = 0;
+}
+
+static void framer_complete(hci_framer_t *f)
+{
+	if (f->payload_type == HCI_FRAMER_HCI_EVT)
+		f->stats.frames_hci++;
+	else
+		f->stats.frames_fe++;
+
+	f->state = HCI_FRAMER_STATE_IDLE;
+	f->frame_ready = true;
+}
+
+static void framer_check_header(hci_framer_t *f)
+{
+	uint16_t data_length;
+
+	if (f->payload_type == HCI_FRAMER_HCI_EVT)
+	{
+		if (!hci_evt_length_valid(f->buf[1], f->buf[2]))
+		{
+			f->stats.resyncs++;
+			framer_reject(f);
+			return;
+		}
+		data_length = f->buf[2];
+	}
+	else
+	{
+		data_length = f->buf[7] + 256 * f->buf[8];
+		if (data_length > MAX_PACKET_LENGTH)
+		{
+			f->stats.resyncs++;
+			framer_reject(f);
+			return;
+		}
+	}
+
+	f->expected = f->pos + data_length;
+
+	if (f->pos == f->expected)
+		framer_complete(f);
+	else
+		f->state = HCI_FRAMER_STATE_BODY;
+}
+
+static void framer_start(hci_framer_t *f, uint8_t indicator)
+{
+	f->payload_type = indicator;
+	f->buf[0] = indicator;
+	f->pos = 1;
+	f->expected = (indicator == HCI_FRAMER_HCI_EVT) ? HCI_FRAMER_HCI_EVT_HDR_SIZE
+	                                                : HCI_FRAMER_FE_MSG_HDR_SIZE;
+	f->state = HCI_FRAMER_STATE_HEADER;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Parse bytes until a frame is complete, a header is rejected or data runs out.
+ *
+ *  @param[in] f     Framer.
+ *  @param[in] data  Bytes to parse.
+ *  @param[in] len   Number of bytes.
+ *
+ * @return number of bytes consumed.
+ ****************************************************************************************
+*/
+static unsigned int framer_feed(hci_framer_t *f, const uint8_t *data, unsigned int len)
+{
+	unsigned int used = 0;
+	unsigned int n;
+
+	while (used < len && !f->frame_ready && !f->rejected)
+	{
+		if (f->state == HCI_FRAMER_STATE_IDLE)
+		{
+			// skip everything up to the next candidate indicator in one go
+			n = hci_scan_indicator(&data[used], len - used);
+			f->stats.bytes_discarded += n;
+			used += n;
+
+			if (used < len)
+				framer_start(f, data[used++]);
+		}
+		else
+		{
+			// copy as much of the header or body as is available
+			n = f->expected - f->pos;
+			if (n > len - used)
+				n = len - used;
+
+			memcpy(&f->buf[f->pos], &data[used], n);
+			f->pos += (uint16_t) n;
+			used += n;
+
+			if (f->pos == f->expected)
+			{
+				if (f->state == HCI_FRAMER_STATE_HEADER)
+					framer_check_header(f);
+				else
+					framer_complete(f);
+			}
+		}
+	}
+
+	return used;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Initialize a framer.
+ *
+ *  @param[in] f                   Framer.
+ *  @param[in] inter_byte_timeout  Max. gap in milliseconds between two bytes of a frame.
+ ****************************************************************************************
+*/
+void hci_framer_init(hci_framer_t *f, uint32_t inter_byte_timeout)
+{
+	memset(f, 0, sizeof(hci_framer_t));
+
+	f->inter_byte_timeout = inter_byte_timeout;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Forget any partial frame and pending bytes, e.g. after a port purge.
+ *
+ *  @param[in] f     Framer.
+ ****************************************************************************************
+*/
+void hci_framer_reset(hci_framer_t *f)
+{
+	f->state = HCI_FRAMER_STATE_IDLE;
+	f->pos = 0;
+	f->expected = 0;
+	f->frame_ready = false;
+	f->replay_pos = 0;
+	f->replay_len = 0;
+	f->rejected = 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Feed received bytes to the framer.
+ *
+ *  Parsing stops as soon as a frame is complete; the caller must pull it and push
+ *  the remaining bytes again. Pushing zero bytes is valid and only applies the
+ *  inter-byte timeout and rescans pending bytes.
+ *
+ *  @param[in] f     Framer.
+ *  @param[in] data  Received bytes.
+ *  @param[in] len   Number of received bytes.
+ *  @param[in] now   Current tick count in milliseconds.
+ *
+ * @return number of bytes of data consumed.
+ ****************************************************************************************
+*/
+unsigned int hci_framer_push(hci_framer_t *f, const uint8_t *data, unsigned int len, uint32_t now)
+{
+	unsigned int used = 0;
+
+	if (f->frame_ready)
+		return 0;
+
+	// the link went quiet in the middle of a frame: drop it and rescan its bytes
+	if (f->state != HCI_FRAMER_STATE_IDLE
+		&& f->replay_pos == f->replay_len
+		&& (int32_t)(now - f->deadline) >= 0)
+	{
+		f->stats.timeouts++;
+		framer_reject(f);
+	}
+
+	// rescanned bytes always go before new ones
+	for (;;)
+	{
+		if (f->rejected)
+			framer_requeue(f);
+
+		if (f->frame_ready)
+			break;
+
+		if (f->replay_pos < f->replay_len)
+			f->replay_pos += framer_feed(f, &f->replay[f->replay_pos], f->replay_len - f->replay_pos);
+		else if (used < len)
+			used += framer_feed(f, &data[used], len - used);
+		else
+			break;
+	}
+
+	if (f->state != HCI_FRAMER_STATE_IDLE)
+		f->deadline = now + f->inter_byte_timeout;
+
+	return used;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Get the frame completed by the last push.
+ *
+ *  @param[in]  f      Framer.
+ *  @param[out] frame  Frame; its data points into the framer.
+ *
+ * @return true if a frame was available.
+ ****************************************************************************************
+*/
+bool hci_framer_pull(hci_framer_t *f, hci_frame_t *frame)
+{
+	if (!f->frame_ready)
+		return false;
+
+	frame->payload_type = f->payload_type;
+	frame->length = f->pos - 1;
+	frame->data = &f->buf[1];
+
+	f->frame_ready = false;
+	f->pos = 0;
+	f->expected = 0;
+
+	return true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Time the reception thread may block before the framer needs a push.
+ *
+ *  @param[in] f     Framer.
+ *  @param[in] now   Current tick count in milliseconds.
+ *
+ * @return milliseconds until the partial frame expires, 0xFFFFFFFF (INFINITE) if idle.
+ ****************************************************************************************
+*/
+uint32_t hci_framer_wait_millis(const hci_framer_t *f, uint32_t now)
+{
+	int32_t left;
+
+	if (f->state == HCI_FRAMER_STATE_IDLE)
+		return 0xFFFFFFFF;
+
+	left = (int32_t)(f->deadline - now);
+
+	return left > 0 ? (uint32_t) left : 0;
+}
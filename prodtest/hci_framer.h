@@ -0,0 +1,91 @@
+/**
+****************************************************************************************
+*
+* @file hci_framer.h
+*
+* @brief H4 / FE message framing parser for the UART reception path.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _HCI_FRAMER_H_
+#define _HCI_FRAMER_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+
+#define MAX_PACKET_LENGTH 350
+#define MIN_PACKET_LENGTH 9
+
+/* packet indicators */
+#define HCI_FRAMER_HCI_EVT 0x04
+#define HCI_FRAMER_FE_MSG  0x05
+
+/* header sizes, indicator byte included */
+#define HCI_FRAMER_HCI_EVT_HDR_SIZE 3 // 1 (0x04) + 1 (event) + 1 (length)
+#define HCI_FRAMER_FE_MSG_HDR_SIZE  9 // 1 (0x05) + 2 (type) + 2 (dstid) + 2 (srcid) + 2 (length)
+
+/* largest frame the parser has to hold, indicator byte included */
+#define HCI_FRAMER_MAX_FRAME_SIZE (HCI_FRAMER_FE_MSG_HDR_SIZE + MAX_PACKET_LENGTH)
+
+/* a partial frame is dropped when no byte arrives for this long */
+#define HCI_FRAMER_INTER_BYTE_TIMEOUT_MILLIS 20
+
+enum
+{
+	HCI_FRAMER_STATE_IDLE = 0,
+	HCI_FRAMER_STATE_HEADER,
+	HCI_FRAMER_STATE_BODY
+};
+
+typedef struct {
+	uint32_t frames_hci;      // complete HCI events delivered
+	uint32_t frames_fe;       // complete FE messages delivered
+	uint32_t bytes_discarded; // bytes skipped while looking for an indicator
+	uint32_t resyncs;         // headers rejected by the sanity checks
+	uint32_t timeouts;        // partial frames dropped on an inter-byte timeout
+} hci_framer_stats_t;
+
+typedef struct {
+	uint8_t  payload_type;    // 0x04 = HCI event, 0x05 = FE msg
+	uint16_t length;          // number of bytes at data (indicator not included)
+	const uint8_t *data;      // valid until the next hci_framer_push()
+} hci_frame_t;
+
+typedef struct {
+	uint8_t  state;
+	uint8_t  payload_type;
+	uint16_t pos;             // bytes held in buf, indicator included
+	uint16_t expected;        // full frame size once the header is known
+	uint32_t deadline;        // tick count at which a partial frame expires
+	uint32_t inter_byte_timeout;
+	bool     frame_ready;
+
+	// bytes of a rejected frame that still have to be rescanned
+	uint16_t rejected;
+	uint16_t replay_pos;
+	uint16_t replay_len;
+
+	hci_framer_stats_t stats;
+
+	uint8_t  buf[HCI_FRAMER_MAX_FRAME_SIZE];
+	uint8_t  replay[HCI_FRAMER_MAX_FRAME_SIZE];
+} hci_framer_t;
+
+void hci_framer_init(hci_framer_t *f, uint32_t inter_byte_timeout);
+void hci_framer_reset(hci_framer_t *f);
+
+unsigned int hci_framer_push(hci_framer_t *f, const uint8_t *data, unsigned int len, uint32_t now);
+bool hci_framer_pull(hci_framer_t *f, hci_frame_t *frame);
+
+uint32_t hci_framer_wait_millis(const hci_framer_t *f, uint32_t now);
+
+#endif /* _HCI_FRAMER_H_ */
@@ -0,0 +1,253 @@
+/**
+****************************************************************************************
+*
+* @file hci_scan.c
+*
+* @brief Search for the next H4 / FE packet indicator in a block of received bytes.
+*
+* Used by the framer while it is idle, i.e. after a DUT reset or while the boot ROM
+* is chattering, to skip everything up to the next 0x04 / 0x05 in one call instead
+* of examining one byte at a time. The SSE2 / AVX2 versions are picked at run time
+* and fall back to the scalar loop on other CPUs.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include "hci_scan.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define HCI_SCAN_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define HCI_SCAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HCI_SCAN_TARGET(isa)
+#endif
+
+// no windows.h here: the framer benchmark builds this file on its own
+#ifdef _MSC_VER
+#define HCI_SCAN_CAS(p, old, new) _InterlockedCompareExchangePointer((void * volatile *) (p), (void *) (new), (void *) (old))
+#else
+#define HCI_SCAN_CAS(p, old, new) __sync_val_compare_and_swap((p), (old), (new))
+#endif
+
+// 0x04 (HCI event) and 0x05 (FE msg) only differ in bit 0
+#define INDICATOR_MASK  0xFE
+#define INDICATOR_VALUE 0x04
+
+typedef unsigned int (*scan_fn_t)(const uint8_t *data, unsigned int len);
+
+static unsigned int scan_scalar(const uint8_t *data, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+	{
+		if ((data[i] & INDICATOR_MASK) == INDICATOR_VALUE)
+			break;
+	}
+
+	return i;
+}
+
+#ifdef HCI_SCAN_X86
+
+static unsigned int first_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+
+	_BitScanForward(&idx, mask);
+
+	return idx;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+HCI_SCAN_TARGET("sse2")
+static unsigned int scan_sse2(const uint8_t *data, unsigned int len)
+{
+	unsigned int i = 0;
+	uint32_t mask;
+	__m128i x;
+	__m128i m = _mm_set1_epi8((char) INDICATOR_MASK);
+	__m128i v = _mm_set1_epi8((char) INDICATOR_VALUE);
+
+	for (; i + 16 <= len; i += 16)
+	{
+		x = _mm_loadu_si128((const __m128i *) &data[i]);
+		mask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(x, m), v));
+		if (mask)
+			return i + first_bit(mask);
+	}
+
+	return i + scan_scalar(&data[i], len - i);
+}
+
+HCI_SCAN_TARGET("avx2")
+static unsigned int scan_avx2(const uint8_t *data, unsigned int len)
+{
+	unsigned int i = 0;
+	uint32_t mask;
+	__m256i x;
+	__m256i m = _mm256_set1_epi8((char) INDICATOR_MASK);
+	__m256i v = _mm256_set1_epi8((char) INDICATOR_VALUE);
+
+	for (; i + 32 <= len; i += 32)
+	{
+		x = _mm256_loadu_si256((const __m256i *) &data[i]);
+		mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(x, m), v));
+		if (mask)
+			return i + first_bit(mask);
+	}
+
+	// clear the upper YMM halves before running legacy SSE code, or every
+	// chunk tail pays the AVX / SSE transition penalty
+	_mm256_zeroupper();
+
+	return i + scan_sse2(&data[i], len - i);
+}
+
+static int best_supported(void)
+{
+#ifdef _MSC_VER
+	int regs[4];
+	int max_leaf;
+	int best = HCI_SCAN_SCALAR;
+
+	__cpuid(regs, 0);
+	max_leaf = regs[0];
+
+	__cpuid(regs, 1);
+	if (regs[3] & (1 << 26))
+		best = HCI_SCAN_SSE2;
+
+	// AVX2 needs the CPU flag and the OS saving the YMM registers (OSXSAVE + XCR0)
+	if (max_leaf >= 7 && (regs[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6)
+	{
+		__cpuidex(regs, 7, 0);
+		if (regs[1] & (1 << 5))
+			best = HCI_SCAN_AVX2;
+	}
+
+	return best;
+#else
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return HCI_SCAN_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return HCI_SCAN_SSE2;
+
+	return HCI_SCAN_SCALAR;
+#endif
+}
+
+#else
+
+static int best_supported(void)
+{
+	return HCI_SCAN_SCALAR;
+}
+
+#endif // HCI_SCAN_X86
+
+// written once by the first caller; the per-port RX threads may all get there at once
+static scan_fn_t volatile scan_fn = NULL;
+
+static scan_fn_t scan_pick(int *impl)
+{
+	int best = best_supported();
+
+	if (*impl == HCI_SCAN_AUTO || *impl > best)
+		*impl = best;
+
+	switch (*impl)
+	{
+#ifdef HCI_SCAN_X86
+		case HCI_SCAN_AVX2: return scan_avx2;
+		case HCI_SCAN_SSE2: return scan_sse2;
+#endif
+	}
+
+	*impl = HCI_SCAN_SCALAR;
+	return scan_scalar;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Choose the scan implementation.
+ *
+ *  @param[in] impl  HCI_SCAN_AUTO or a specific HCI_SCAN_xxx; an implementation
+ *                   the CPU does not support is downgraded to the best one it does.
+ *
+ * @return the implementation in use.
+ ****************************************************************************************
+*/
+int hci_scan_select(int impl)
+{
+	scan_fn_t fn = scan_pick(&impl);
+	scan_fn_t seen = scan_fn;
+	scan_fn_t prev;
+
+	while ((prev = (scan_fn_t) HCI_SCAN_CAS(&scan_fn, seen, fn)) != seen)
+		seen = prev;
+
+	return impl;
+}
+
+const char *hci_scan_name(int impl)
+{
+	switch (impl)
+	{
+		case HCI_SCAN_SCALAR: return "scalar";
+		case HCI_SCAN_SSE2:   return "sse2";
+		case HCI_SCAN_AVX2:   return "avx2";
+	}
+
+	return "auto";
+}
+
+/*
+ ****************************************************************************************
+ * @brief Find the next packet indicator (0x04 or 0x05).
+ *
+ *  @param[in] data  Bytes to search.
+ *  @param[in] len   Number of bytes.
+ *
+ * @return offset of the first indicator, len if there is none.
+ ****************************************************************************************
+*/
+unsigned int hci_scan_indicator(const uint8_t *data, unsigned int len)
+{
+	scan_fn_t fn = scan_fn;
+	scan_fn_t prev;
+	int impl = HCI_SCAN_AUTO;
+
+	if (fn == NULL)
+	{
+		fn = scan_pick(&impl);
+
+		// keep whatever another thread or hci_scan_select() got in first
+		prev = (scan_fn_t) HCI_SCAN_CAS(&scan_fn, (scan_fn_t) NULL, fn);
+		if (prev != NULL)
+			fn = prev;
+	}
+
+	return fn(data, len);
+}
@@ -0,0 +1,34 @@
+/**
+****************************************************************************************
+*
+* @file hci_scan.h
+*
+* @brief Search for the next H4 / FE packet indicator in a block of received bytes.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _HCI_SCAN_H_
+#define _HCI_SCAN_H_
+
+#include <stdint.h>
+
+/* scan implementations */
+#define HCI_SCAN_AUTO   0 // best one the CPU supports
+#define HCI_SCAN_SCALAR 1
+#define HCI_SCAN_SSE2   2
+#define HCI_SCAN_AVX2   3
+
+int hci_scan_select(int impl);
+const char *hci_scan_name(int impl);
+
+unsigned int hci_scan_indicator(const uint8_t *data, unsigned int len);
+
+#endif /* _HCI_SCAN_H_ */
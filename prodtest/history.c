@@ -0,0 +1,510 @@
+/**
+****************************************************************************************
+*
+* @file history.c
+*
+* @brief Index of the BD addresses and serial numbers ever written.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+#include "journal.h"
+#include "result.h"
+
+/* -o csv records: fields before the name,value pairs of the return values */
+#define HISTORY_CSV_FIXED     7
+#define HISTORY_CSV_MAX_LINE  8192
+#define HISTORY_CSV_MAX_CELLS (HISTORY_CSV_FIXED + 2 * RESULT_MAX_FIELDS)
+
+static HANDLE history_file = INVALID_HANDLE_VALUE;
+static HANDLE history_mapping;
+static history_header_t *history_header;
+static history_slot_t *history_slots;
+
+// the slot of a value: its kind, then the value, zero padded
+static bool history_key(int kind, const char *value, history_slot_t *key)
+{
+	unsigned int b[6];
+
+	memset(key, 0, sizeof(history_slot_t));
+	key->kind = (char) kind;
+
+	if (kind == HISTORY_BDADDR)
+	{
+		if (strlen(value) != 17
+		    || sscanf(value, "%02X:%02X:%02X:%02X:%02X:%02X", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+			return false;
+		sprintf(key->value, "%02X%02X%02X%02X%02X%02X", b[0], b[1], b[2], b[3], b[4], b[5]);
+		return true;
+	}
+
+	if (value[0] == 0)
+		return false;
+
+	strncpy(key->value, value, HISTORY_MAX_VALUE_LEN);
+	return true;
+}
+
+// FNV-1a
+static uint32_t history_hash(const history_slot_t *key)
+{
+	const uint8_t *p = (const uint8_t *) key;
+	uint32_t hash = 2166136261UL;
+	int kk;
+
+	for (kk = 0; kk < (int) sizeof(history_slot_t); kk++)
+		hash = (hash ^ p[kk]) * 16777619UL;
+
+	return hash;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Look a value up.
+ *
+ * @return slot of the value, or the free slot where it would go (*found false);
+ *         -1 if neither is there.
+ ****************************************************************************************
+*/
+static long history_find(const history_slot_t *key, bool *found)
+{
+	uint32_t mask = history_header->slot_count - 1;
+	uint32_t index = history_hash(key) & mask;
+	history_slot_t *slot;
+	uint32_t kk;
+
+	*found = false;
+
+	for (kk = 0; kk < history_header->slot_count; kk++, index = (index + 1) & mask)
+	{
+		slot = &history_slots[index];
+		if (((volatile history_slot_t *) slot)->kind == 0)
+			return (long) index;
+
+		// the value was written before its kind
+		MemoryBarrier();
+		if (memcmp(slot, key, sizeof(history_slot_t)) == 0)
+		{
+			*found = true;
+			return (long) index;
+		}
+	}
+
+	return -1;
+}
+
+// with the mutex held; false if the index is full
+static bool history_insert(const history_slot_t *key, bool flush)
+{
+	history_slot_t *slot;
+	bool found;
+	long index;
+
+	index = history_find(key, &found);
+	if (found)
+		return true;
+
+	if (index < 0 || (uint32_t) history_header->count + 1 > history_header->slot_count / 4 * 3)
+	{
+		fprintf(stderr, "history: index full\n");
+		return false;
+	}
+
+	slot = &history_slots[index];
+	memcpy(slot->value, key->value, HISTORY_MAX_VALUE_LEN);
+	MemoryBarrier();
+	((volatile history_slot_t *) slot)->kind = key->kind;
+	InterlockedIncrement(&history_header->count);
+
+	if (flush)
+	{
+		FlushViewOfFile(slot, sizeof(history_slot_t));
+		FlushViewOfFile(history_header, sizeof(history_header_t));
+	}
+
+	return true;
+}
+
+static HANDLE history_lock(void)
+{
+	HANDLE mutex = CreateMutex(NULL, FALSE, HISTORY_MUTEX_NAME);
+
+	if (mutex == NULL)
+		return NULL;
+
+	if (WaitForSingleObject(mutex, HISTORY_LOCK_MILLIS) == WAIT_TIMEOUT)
+	{
+		CloseHandle(mutex);
+		return NULL;
+	}
+
+	return mutex;
+}
+
+static void history_unlock(HANDLE mutex)
+{
+	ReleaseMutex(mutex);
+	CloseHandle(mutex);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Create an empty index.
+ *
+ *  @param[in] path    Index file; must not exist.
+ *  @param[in] values  Number of values it is to hold; it gets twice as many slots.
+ *
+ * @return false if it exists or cannot be written.
+ ****************************************************************************************
+*/
+bool history_create(const char *path, uint32_t values)
+{
+	history_header_t header;
+	history_slot_t zero[256];
+	uint32_t slot_count = 1024;
+	uint32_t kk;
+	FILE *fp;
+
+	while (slot_count < HISTORY_MAX_SLOTS && slot_count / 2 < values)
+		slot_count *= 2;
+	if (slot_count / 4 * 3 < values)
+		return false;
+
+	fp = fopen(path, "rb");
+	if (fp != NULL)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, HISTORY_FILE_MAGIC, 4);
+	header.slot_count = slot_count;
+	fwrite(&header, sizeof(header), 1, fp);
+
+	memset(zero, 0, sizeof(zero));
+	for (kk = 0; kk < slot_count; kk += 256)
+		fwrite(zero, sizeof(zero), 1, fp);
+
+	return fclose(fp) == 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Map an index for the lookups and additions of this process.
+ *
+ * @return false if it cannot be opened or is not an index.
+ ****************************************************************************************
+*/
+bool history_open(const char *path)
+{
+	DWORD size;
+
+	if (history_header != NULL)
+		return false;
+
+	history_file = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (history_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	size = GetFileSize(history_file, NULL);
+	if (size == INVALID_FILE_SIZE || size < sizeof(history_header_t))
+		goto fail;
+
+	history_mapping = CreateFileMapping(history_file, NULL, PAGE_READWRITE, 0, 0, NULL);
+	if (history_mapping == NULL)
+		goto fail;
+
+	history_header = (history_header_t *) MapViewOfFile(history_mapping, FILE_MAP_WRITE, 0, 0, 0);
+	if (history_header == NULL)
+		goto fail;
+
+	if (memcmp(history_header->magic, HISTORY_FILE_MAGIC, 4) != 0
+		|| history_header->slot_count > HISTORY_MAX_SLOTS
+		|| (history_header->slot_count & (history_header->slot_count - 1)) != 0
+		|| size != sizeof(history_header_t) + history_header->slot_count * sizeof(history_slot_t))
+		goto fail;
+
+	history_slots = (history_slot_t *) (history_header + 1);
+
+	return true;
+
+fail:
+	if (history_header != NULL)
+		UnmapViewOfFile(history_header);
+	if (history_mapping != NULL)
+		CloseHandle(history_mapping);
+	CloseHandle(history_file);
+	history_file = INVALID_HANDLE_VALUE;
+	history_mapping = NULL;
+	history_header = NULL;
+
+	return false;
+}
+
+void history_close(void)
+{
+	if (history_header == NULL)
+		return;
+
+	UnmapViewOfFile(history_header);
+	CloseHandle(history_mapping);
+	CloseHandle(history_file);
+	history_file = INVALID_HANDLE_VALUE;
+	history_mapping = NULL;
+	history_header = NULL;
+	history_slots = NULL;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Tell if a value was written before.
+ *
+ *  @param[in] kind   HISTORY_BDADDR ("XX:XX:XX:XX:XX:XX") or HISTORY_SN.
+ *
+ * @return false as well when no index is open.
+ ****************************************************************************************
+*/
+bool history_used(int kind, const char *value)
+{
+	history_slot_t key;
+	bool found;
+
+	if (history_header == NULL || !history_key(kind, value, &key))
+		return false;
+
+	history_find(&key, &found);
+
+	return found;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Add a value the DUT now holds; nothing is done when no index is open.
+ *
+ * @return false if the value cannot be added.
+ ****************************************************************************************
+*/
+bool history_add(int kind, const char *value)
+{
+	history_slot_t key;
+	HANDLE mutex;
+	bool ok;
+
+	if (history_header == NULL)
+		return true;
+
+	if (!history_key(kind, value, &key))
+		return false;
+
+	mutex = history_lock();
+	if (mutex == NULL)
+		return false;
+
+	ok = history_insert(&key, true);
+
+	history_unlock(mutex);
+
+	return ok;
+}
+
+static const char *history_field(const result_field_t *values, int count, const char *name)
+{
+	int kk;
+
+	for (kk = 0; kk < count; kk++)
+		if (strcmp(values[kk].name, name) == 0)
+			return values[kk].text;
+
+	return NULL;
+}
+
+// the values a successful command wrote, or read from a DUT
+static void history_add_record(int argc, char **argv, int status, const result_field_t *values, int count)
+{
+	history_slot_t key;
+	const char *text;
+
+	if (status != 0 || argc < 1)
+		return;
+
+	text = history_field(values, count, "bd_addr");
+	if (text == NULL && argc >= 3 && strcmp(argv[0], "otp") == 0 && strcmp(argv[1], "wr_bdaddr") == 0)
+		text = argv[2];
+	if (text != NULL && history_key(HISTORY_BDADDR, text, &key))
+		history_insert(&key, false);
+
+	// a blank OTP is not an address
+	text = history_field(values, count, "otp_bd_addr");
+	if (text != NULL && strspn(text, "F:") != strlen(text) && strspn(text, "0:") != strlen(text)
+	    && history_key(HISTORY_BDADDR, text, &key))
+		history_insert(&key, false);
+
+	text = history_field(values, count, "sn");
+	if (text == NULL && argc >= 2 && strcmp(argv[0], "write_SN") == 0 && argv[1][0] != '@')
+		text = argv[1];
+	if (text == NULL && strcmp(argv[0], "read_SN") == 0)
+		text = history_field(values, count, "value");
+	if (text != NULL && history_key(HISTORY_SN, text, &key))
+		history_insert(&key, false);
+}
+
+static void history_journal_visit(const journal_record_t *rec, void *ctx)
+{
+	history_add_record(rec->argc, (char **) rec->argv, rec->status, rec->values, rec->value_count);
+}
+
+// split a CSV line in place; quotes are taken off
+static int history_csv_split(char *line, char **cells, int max_cells)
+{
+	char *in = line, *out;
+	int count = 0;
+
+	while (count < max_cells)
+	{
+		cells[count++] = out = in;
+		if (*in == '"')
+		{
+			for (in++; *in != 0; in++)
+			{
+				if (*in == '"' && in[1] == '"')
+					in++;
+				else if (*in == '"')
+				{
+					in++;
+					break;
+				}
+				*out++ = *in;
+			}
+		}
+		while (*in != 0 && *in != ',' && *in != '\r' && *in != '\n')
+			*out++ = *in++;
+
+		if (*in != ',')
+		{
+			*out = 0;
+			break;
+		}
+		in++;
+		*out = 0;
+	}
+
+	return count;
+}
+
+static int history_import_csv(FILE *fp)
+{
+	static char line[HISTORY_CSV_MAX_LINE];
+	static result_field_t values[RESULT_MAX_FIELDS];
+	char *cells[HISTORY_CSV_MAX_CELLS];
+	char *argv[JOURNAL_MAX_ARGS];
+	char *arg;
+	int cell_count, argc, count, kk;
+
+	if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, "time,port,command,", 18) != 0)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		cell_count = history_csv_split(line, cells, HISTORY_CSV_MAX_CELLS);
+		if (cell_count < HISTORY_CSV_FIXED)
+			continue;
+
+		// the command, and its arguments from one column
+		argc = 0;
+		argv[argc++] = cells[2];
+		for (arg = strtok(cells[3], " "); arg != NULL && argc < JOURNAL_MAX_ARGS; arg = strtok(NULL, " "))
+			argv[argc++] = arg;
+
+		count = 0;
+		for (kk = HISTORY_CSV_FIXED; kk + 1 < cell_count && count < RESULT_MAX_FIELDS; kk += 2, count++)
+		{
+			strncpy(values[count].name, cells[kk], RESULT_MAX_NAME_LEN - 1);
+			values[count].name[RESULT_MAX_NAME_LEN - 1] = 0;
+			strncpy(values[count].text, cells[kk + 1], RESULT_MAX_TEXT_LEN - 1);
+			values[count].text[RESULT_MAX_TEXT_LEN - 1] = 0;
+			values[count].type = RESULT_STR;
+		}
+
+		history_add_record(argc, argv, atoi(cells[5]), values, count);
+	}
+
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Add the values of earlier production to the open index.
+ *
+ *  @param[in] path  A journal, or the records of -o csv.
+ *
+ * @return number of values new to the index, -1 if the file cannot be read.
+ ****************************************************************************************
+*/
+int history_import(const char *path)
+{
+	char magic[4];
+	LONG before;
+	HANDLE mutex;
+	FILE *fp;
+	int rc;
+
+	if (history_header == NULL)
+		return -1;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		return -1;
+
+	mutex = history_lock();
+	if (mutex == NULL)
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	before = history_header->count;
+
+	if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, JOURNAL_FILE_MAGIC, 4) == 0)
+	{
+		fclose(fp);
+		rc = journal_scan(path, history_journal_visit, NULL) < 0 ? -1 : 0;
+	}
+	else
+	{
+		rewind(fp);
+		rc = history_import_csv(fp);
+		fclose(fp);
+	}
+
+	FlushViewOfFile(history_header, 0);
+	history_unlock(mutex);
+
+	return rc < 0 ? -1 : (int) (history_header->count - before);
+}
+
+void history_status(void)
+{
+	if (history_header == NULL)
+		return;
+
+	printf("values = %ld\n", (long) history_header->count);
+	printf("slots  = %lu\n", (unsigned long) history_header->slot_count);
+}
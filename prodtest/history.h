@@ -0,0 +1,74 @@
+/**
+****************************************************************************************
+*
+* @file history.h
+*
+* @brief Index of the BD addresses and serial numbers ever written, to refuse a
+*        duplicate before it is burned.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "stdbool.h"
+
+/*
+ * The index file is a hash set with open addressing: a header, then a power of
+ * two of slots, each a kind byte and the value itself, so a lookup compares
+ * exact values and touches a slot or two of the mapped file whatever the size
+ * of the production history. Lookups take no lock; a value is added under a
+ * named mutex, the kind byte written last.
+ *
+ * "history.index = <file>" in the configuration makes otp wr_bdaddr, write_SN
+ * and provision refuse a value found in the index, and add the value once the
+ * DUT holds it. "history import" fills the index from journals and -o csv
+ * records of earlier production.
+ */
+#define HISTORY_FILE_MAGIC    "PTH1"
+#define HISTORY_CONFIG_INDEX  "history.index"
+#define HISTORY_MUTEX_NAME    "prodtest_history_index"
+#define HISTORY_LOCK_MILLIS   5000
+
+/* value kinds, 0 marks a free slot */
+#define HISTORY_BDADDR  'B'   // 12 hex digits, most significant first
+#define HISTORY_SN      'S'
+
+#define HISTORY_MAX_VALUE_LEN  15   // what write_SN sends of a serial number
+#define HISTORY_MAX_SLOTS      0x2000000
+
+typedef struct {
+	char          magic[4];
+	uint32_t      slot_count;      // power of two
+	volatile LONG count;
+	uint32_t      reserved[13];
+} history_header_t;
+
+typedef struct {
+	char          kind;
+	char          value[HISTORY_MAX_VALUE_LEN];
+} history_slot_t;
+
+bool history_create(const char *path, uint32_t values);
+
+bool history_open(const char *path);
+void history_close(void);
+
+bool history_used(int kind, const char *value);
+bool history_add(int kind, const char *value);
+
+int  history_import(const char *path);
+void history_status(void);
+
+#endif /* _HISTORY_H_ */
@@ -27,12 +27,22 @@
 #include "host_hci.h"
 #include "uart.h"
 #include "queue.h"
+#include "evt_buf.h"
+#include "linectl.h"
+#include "latency.h"
+#include "config.h"
 
 
 
 
 /* HCI TEST MODE */
 
+static uint32_t hci_last_cmd_key; // latency profile key of the last command sent
+
+// copy of the last command sent, for hci_recv_reply() to send it again
+static uint8_t hci_last_cmd[3 + 255];
+static unsigned int hci_last_cmd_length;
+
 void send_hci_command(hci_cmd_t *cmd)
 {
 #ifdef DEVELOPMENT_MESSAGES
@@ -50,6 +60,9 @@ void send_hci_command(hci_cmd_t *cmd)
 	fprintf(stderr, "\n");
 #endif //DEVELOPMENT_MESSAGES
 
+	hci_last_cmd_key = latency_key_of((unsigned char *) cmd, cmd->length + 3);
+	hci_last_cmd_length = cmd->length + 3;
+	memcpy(hci_last_cmd, cmd, hci_last_cmd_length);
 	UARTSend(0x01, cmd->length + 3/*sizeof(hci_cmd_header_t)*/, (unsigned char *) cmd);
 
 	free(cmd);
@@ -68,11 +81,53 @@ void *alloc_hci_command(unsigned short opcode, unsigned char length)
     return cmd;
 }
 
+/*
+ ****************************************************************************************
+ * @brief Time to wait for the reply to the last command sent, from the latency
+ *        profile of that command.
+ *
+ *  @param[in] max_millis  Limit of the handler, used while the profile knows too
+ *                         little about the command.
+ ****************************************************************************************
+*/
+unsigned int hci_cmd_timeout(unsigned int max_millis)
+{
+	return latency_timeout(hci_last_cmd_key, max_millis);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait for an event. On a timeout the DUT is reset with the LINE_SEQ_RESET
+ *        sequence if the fixture allows that, so that it is alive again for the
+ *        next command.
+ *
+ *  @param[in] millis  Max. time to wait.
+ *
+ * @return the event, to be freed with hci_free_event(); NULL on timeout.
+ ****************************************************************************************
+*/
 hci_evt_t *hci_recv_event_wait(unsigned int millis)
+{
+	hci_evt_t *evt = hci_recv_event_try(millis);
+
+	if (evt == NULL && line_auto(UARTGetPort()))
+	{
+		fprintf(stderr, "No answer from the DUT, resetting it.\n");
+		line_run(UARTGetPort(), line_sequence(LINE_SEQ_RESET));
+	}
+
+	return evt;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait for an event, without recovery on a timeout.
+ ****************************************************************************************
+*/
+hci_evt_t *hci_recv_event_try(unsigned int millis)
 {	
-	QueueElement *qe;
+	evt_buf_t *buf;
 	DWORD dw;
-	hci_evt_t *evt;
 	
 	dw = WaitForSingleObject(QueueHasAvailableData, millis); // wait until elements are available
 	if (dw != WAIT_OBJECT_0)	
@@ -81,15 +136,191 @@ hci_evt_t *hci_recv_event_wait(unsigned int millis)
 	}
 
 	WaitForSingleObject(UARTRxQueueSem, INFINITE);
-	qe = (QueueElement *) DeQueue(&UARTRxQueue); 
+	buf = (evt_buf_t *) DeQueue(&UARTRxQueue); 
 	ReleaseMutex(UARTRxQueueSem);
 
-	evt = (hci_evt_t *) qe->payload;
+	return (hci_evt_t *) buf->data;
+};
+
+void hci_free_event(hci_evt_t *evt)
+{
+	if (evt)
+		evt_buf_release(evt_buf_of(evt));
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait until the DUT firmware answers HCI, probing with HCI Reset. The
+ *        interval between probes starts short and doubles, so a DUT that comes
+ *        up quickly is found quickly without flooding a slow one.
+ *
+ *  @param[in]  deadline_millis  Max. total time.
+ *  @param[out] ready_millis     Time until the first Command Complete.
+ *  @param[out] probes           Number of HCI Reset commands sent.
+ *
+ * @return true if the DUT answered before the deadline.
+ ****************************************************************************************
+*/
+bool hci_wait_ready(unsigned int deadline_millis, unsigned int *ready_millis, unsigned int *probes)
+{
+	DWORD start = GetTickCount();
+	DWORD elapsed = 0;
+	DWORD interval = HCI_READY_FIRST_PROBE_MILLIS;
+	DWORD probe_start;
+	DWORD wait;
+	hci_evt_t *evt;
+	bool ready = false;
+
+	*probes = 0;
+
+	while (!ready && elapsed < deadline_millis)
+	{
+		hci_reset();
+		(*probes)++;
+		probe_start = GetTickCount();
+
+		// a late answer to an earlier probe counts just as well
+		for (;;)
+		{
+			elapsed = GetTickCount() - start;
+			if (elapsed >= deadline_millis || GetTickCount() - probe_start >= interval)
+				break;
+			wait = interval - (GetTickCount() - probe_start);
+			if (wait > deadline_millis - elapsed)
+				wait = deadline_millis - elapsed;
+
+			evt = hci_recv_event_try(wait);
+			if (evt == NULL)
+				break;
+
+			ready = evt->event == 0x0E
+				&& evt->length >= 4
+				&& evt->parameters[1] == 0x03
+				&& evt->parameters[2] == 0x0C;
+			hci_free_event(evt);
+			if (ready)
+				break;
+		}
+
+		elapsed = GetTickCount() - start;
+		interval = interval * 2 < HCI_READY_MAX_PROBE_MILLIS ? interval * 2 : HCI_READY_MAX_PROBE_MILLIS;
+	}
+
+	*ready_millis = elapsed;
+
+	// answers to the other probes that are already in, so the next command
+	// does not take one of them for its own
+	while ((evt = hci_recv_event_try(0)) != NULL)
+		hci_free_event(evt);
+
+	return ready;
+}
+
+// true if evt is the Command Complete / Command Status for opcode; both carry the
+// opcode in parameters 1 and 2 in this firmware
+static bool hci_is_reply(hci_evt_t *evt, uint16_t opcode)
+{
+	if ((evt->event == 0x0E || evt->event == 0x0F) && evt->length >= 3)
+		return evt->parameters[1] + 256 * evt->parameters[2] == opcode;
 
-	free(qe);
+	return false;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Bring the link to the DUT back to a known state after a lost reply: wait
+ *        until the firmware answers HCI Reset, resetting the DUT first if it does
+ *        not and the fixture allows that. Late answers are dropped.
+ *
+ * @return true if the DUT answers.
+ ****************************************************************************************
+*/
+bool hci_resync(void)
+{
+	unsigned int ready_millis, probes;
+
+	if (hci_wait_ready(HCI_RETRY_READY_MILLIS, &ready_millis, &probes))
+		return true;
+
+	if (!line_auto(UARTGetPort()))
+		return false;
+
+	line_run(UARTGetPort(), line_sequence(LINE_SEQ_RESET));
+
+	return hci_wait_ready(HCI_RETRY_READY_MILLIS, &ready_millis, &probes);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait for the reply to the last command sent. Events that answer an
+ *        earlier command are dropped. A command that can be repeated (a read) is
+ *        sent again after a resync when its reply does not come, up to
+ *        "retry.attempts" times in all, and the DUT is reset if it never answers.
+ *
+ *  @param[in] max_millis  Limit of the handler for one attempt, see hci_cmd_timeout().
+ *  @param[in] repeatable  HCI_REPLY_REPEATABLE or HCI_REPLY_ONE_SHOT.
+ *
+ * @return the reply, to be freed with hci_free_event(); NULL if there was none.
+ ****************************************************************************************
+*/
+hci_evt_t *hci_recv_reply(unsigned int max_millis, bool repeatable)
+{
+	uint8_t cmd[sizeof(hci_last_cmd)];
+	unsigned int length = hci_last_cmd_length;
+	uint16_t opcode = hci_last_cmd[0] + 256 * hci_last_cmd[1];
+	long attempts = 1;
+	long attempt;
+	hci_cmd_t *again;
+	hci_evt_t *evt = NULL;
+	DWORD start, timeout, elapsed;
+
+	memcpy(cmd, hci_last_cmd, length);
+	if (repeatable)
+		attempts = config_get_long(HCI_RETRY_CONFIG_ATTEMPTS, HCI_RETRY_DEFAULT_ATTEMPTS);
+
+	for (attempt = 1; ; attempt++)
+	{
+		timeout = hci_cmd_timeout(max_millis);
+		start = GetTickCount();
+
+		for (;;)
+		{
+			elapsed = GetTickCount() - start;
+			if (elapsed >= timeout)
+				break;
+
+			evt = hci_recv_event_try(timeout - elapsed);
+			if (evt == NULL || hci_is_reply(evt, opcode))
+				break;
+
+			hci_free_event(evt); // late answer to an earlier command
+			evt = NULL;
+		}
+
+		if (evt != NULL || attempt >= attempts)
+			break;
+
+		fprintf(stderr, "No reply to command 0x%04X, sending it again (%ld of %ld).\n",
+		        opcode, attempt + 1, attempts);
+
+		if (!hci_resync())
+			break;
+
+		again = (hci_cmd_t *) alloc_hci_command(opcode, (unsigned char) (length - 3));
+		memcpy(again, cmd, length);
+		send_hci_command(again);
+	}
+
+	// after a one-shot command the caller decides, see hci_resync(): a reset would
+	// take the firmware of a UART-booted DUT before it can be asked what it did
+	if (evt == NULL && repeatable && line_auto(UARTGetPort()))
+	{
+		fprintf(stderr, "No answer from the DUT, resetting it.\n");
+		line_run(UARTGetPort(), line_sequence(LINE_SEQ_RESET));
+	}
 
 	return evt;
-};
+}
 
 
 
@@ -212,6 +443,15 @@ bool __stdcall hci_dialog_rx_readback_test_end()
     return(true);
 }
 
+bool __stdcall hci_dialog_rx_readback_peek()
+{
+    hci_cmd_t *cmd = (hci_cmd_t *) alloc_hci_command (HCI_PEEK_PROD_RX_STATS_CMD_OPCODE, 0);
+
+    send_hci_command((void *)cmd);
+
+    return(true);
+}
+
 bool __stdcall hci_dialog_unmodulated_rx_tx(uint8_t mode, uint8_t frequency)
 {
     hci_cmd_t *cmd = (hci_cmd_t *) alloc_hci_command (0x4010, 2); 
@@ -824,3 +1064,27 @@ bool __stdcall hci_dialog_write_bpsenser_work(uint32_t reg_addr )
 	return(true);
 }
 /*doco lixiping fix for ticket/1 20180607 end*/
+
+bool __stdcall hci_dialog_write_provision(uint8_t mask, char fields[PROVISION_FIELDS][PROVISION_FIELD_SIZE])
+{
+	hci_cmd_t *cmd = (hci_cmd_t *) alloc_hci_command (HCI_CUSTOM_ACTION_CMD_OPCODE, PROVISION_WRITE_LENGTH);
+
+	cmd->parameters[0] = CMD__REGISTER_RW_OP_WRITE_PROVISION;
+	cmd->parameters[1] = mask;
+	memcpy(&cmd->parameters[2], fields, PROVISION_FIELDS * PROVISION_FIELD_SIZE);
+
+	send_hci_command(cmd);
+
+	return(true);
+}
+
+bool __stdcall hci_dialog_read_provision(void)
+{
+	hci_cmd_t *cmd = (hci_cmd_t *) alloc_hci_command (HCI_CUSTOM_ACTION_CMD_OPCODE, 1);
+
+	cmd->parameters[0] = CMD__REGISTER_RW_OP_READ_PROVISION;
+
+	send_hci_command(cmd);
+
+	return(true);
+}
@@ -52,6 +52,7 @@ typedef struct {
 #define HCI_UNMODULATED_ON_CMD_OPCODE	(0x4010) 	
 #define HCI_START_PROD_RX_TEST_CMD_OPCODE 	(0x4020)	
 #define HCI_LE_END_PROD_RX_TEST_CMD_OPCODE 	(0x4030)	
+#define HCI_PEEK_PROD_RX_STATS_CMD_OPCODE  	(0x40E0)	// counts of 0x4030, the test goes on
 #define HCI_TX_CONTINUE_TEST_CMD_OPCODE 	(0x4050)	
 #define HCI_TX_END_CONTINUE_TEST_CMD_OPCODE  	(0x4060)	
 #define HCI_REGISTER_RW_CMD_OPCODE              (0x40C0)
@@ -90,7 +91,52 @@ typedef struct {
 #define CMD__REGISTER_RW_OP_WRITE_FPSENSER_WORK  (13)
 #define CMD__REGISTER_RW_OP_WRITE_BPSENSER_WORK  (14)
 /*doco lixiping fix for ticket/1 20180607 end*/
+
+// provisioning: the fields of write_SN, write_PSN, write_swversion and write_flag
+// in one command, and all of them read back in one reply
+#define CMD__REGISTER_RW_OP_WRITE_PROVISION  (15)
+#define CMD__REGISTER_RW_OP_READ_PROVISION   (16)
+
+#define PROVISION_FIELD_SN         0
+#define PROVISION_FIELD_PSN        1
+#define PROVISION_FIELD_SWVERSION  2
+#define PROVISION_FIELD_FLAG       3
+#define PROVISION_FIELDS           4
+#define PROVISION_FIELD_SIZE       16   // up to 15 characters, zero padded
+
+/* write: operation, mask of the fields written (bit PROVISION_FIELD_...), the fields;
+   read reply: status, the fields */
+#define PROVISION_WRITE_LENGTH     (2 + PROVISION_FIELDS * PROVISION_FIELD_SIZE)
+#define PROVISION_REPLY_LENGTH     (4 + PROVISION_FIELDS * PROVISION_FIELD_SIZE)
+
+void *alloc_hci_command(unsigned short opcode, unsigned char length);
+void send_hci_command(hci_cmd_t *cmd);
+
 hci_evt_t *hci_recv_event_wait(unsigned int millis);
+hci_evt_t *hci_recv_event_try(unsigned int millis);
+unsigned int hci_cmd_timeout(unsigned int max_millis);
+
+/* hci_wait_ready(): first and max. interval between HCI Reset probes */
+#define HCI_READY_FIRST_PROBE_MILLIS   5
+#define HCI_READY_MAX_PROBE_MILLIS     200
+#define HCI_READY_DEFAULT_DEADLINE_MILLIS 5000
+
+bool hci_wait_ready(unsigned int deadline_millis, unsigned int *ready_millis, unsigned int *probes);
+
+/* hci_recv_reply(): commands that only read can be sent again, writes cannot */
+#define HCI_REPLY_REPEATABLE  true
+#define HCI_REPLY_ONE_SHOT    false
+
+/* attempts of a repeatable command, "retry.attempts" in the configuration */
+#define HCI_RETRY_CONFIG_ATTEMPTS   "retry.attempts"
+#define HCI_RETRY_DEFAULT_ATTEMPTS  3
+
+/* resync between attempts: max. time for the DUT to answer HCI Reset */
+#define HCI_RETRY_READY_MILLIS      1000
+
+hci_evt_t *hci_recv_reply(unsigned int max_millis, bool repeatable);
+bool hci_resync(void);
+void hci_free_event(hci_evt_t *evt);
 void handle_hci_event( hci_evt_t * evt);
 
 
@@ -103,6 +149,7 @@ bool __stdcall hci_test_end();
 bool __stdcall hci_dialog_tx_test(uint8_t frequency, uint8_t length, uint8_t payload, uint16_t number_of_packets);
 bool __stdcall hci_dialog_rx_readback_test(uint8_t frequency);
 bool __stdcall hci_dialog_rx_readback_test_end();
+bool __stdcall hci_dialog_rx_readback_peek();
 bool __stdcall hci_dialog_unmodulated_rx_tx(uint8_t mode, uint8_t frequency);
 bool __stdcall hci_dialog_tx_continuous_start(uint8_t frequency, uint8_t payload_type);
 bool __stdcall hci_dialog_tx_continuous_end();
@@ -147,5 +194,8 @@ bool __stdcall hci_dialog_write_fpsenser_work(uint32_t reg_addr);
 bool __stdcall hci_dialog_write_bpsenser_work(uint32_t reg_addr);
 /*doco lixiping fix for ticket/1 20180607 end*/
 
+bool __stdcall hci_dialog_write_provision(uint8_t mask, char fields[PROVISION_FIELDS][PROVISION_FIELD_SIZE]);
+bool __stdcall hci_dialog_read_provision(void);
+
 
 #endif //_HOST_HCI_H_
\ No newline at end of file
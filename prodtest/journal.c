@@ -0,0 +1,656 @@
+/**
+****************************************************************************************
+*
+* @file journal.c
+*
+* @brief Append-only binary journal of the results, per station.
+*
+* Every command and plan step appends a frame to a memory buffer, which a
+* writer thread writes to the file and commits to the disk. Frames added while
+* the writer commits go out with the next commit, so one flush covers all the
+* results of a burst and the test path never waits for the disk.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <windows.h>
+#include <process.h>
+
+#include "journal.h"
+#include "result.h"
+
+/* 100 ns intervals from 1601 (FILETIME) to 1970 */
+#define JOURNAL_FILETIME_EPOCH_DELTA  116444736000000000ULL
+
+typedef struct {
+	uint8_t  *data;
+	size_t    size;
+	size_t    length;
+	bool      overflow;
+} journal_buf_t;
+
+// opened for appending only: each WriteFile() lands whole at the end of the file,
+// also with other prodtest processes writing to the same journal
+static HANDLE journal_file = INVALID_HANDLE_VALUE;
+
+static CRITICAL_SECTION journal_lock;
+static HANDLE journal_has_data;   // auto reset
+static HANDLE journal_done;       // set when the writer thread exits
+static volatile BOOL journal_stop;
+static bool journal_active = false;
+
+// frames are added to the fill buffer; the writer swaps it with the empty one
+static uint8_t *journal_fill;
+static uint8_t *journal_flush;
+static size_t journal_fill_length;
+static uint32_t journal_drops;
+
+static char journal_path[MAX_PATH];
+static unsigned long long journal_session;
+
+// the DUT, as far as the commands run so far tell
+static char journal_unit_bd_addr[RESULT_MAX_TEXT_LEN];
+static char journal_unit_sn[RESULT_MAX_TEXT_LEN];
+
+static uint32_t journal_crc32(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	int bit;
+
+	while (len--)
+	{
+		crc ^= *data++;
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+
+	return ~crc;
+}
+
+static unsigned long long journal_now(void)
+{
+	FILETIME ft;
+
+	GetSystemTimeAsFileTime(&ft);
+
+	return (((unsigned long long) ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+static void put_bytes(journal_buf_t *buf, const void *data, size_t len)
+{
+	if (buf->overflow || buf->length + len > buf->size)
+	{
+		buf->overflow = true;
+		return;
+	}
+	memcpy(buf->data + buf->length, data, len);
+	buf->length += len;
+}
+
+static void put_le(journal_buf_t *buf, unsigned long long v, int bytes)
+{
+	uint8_t le[8];
+	int kk;
+
+	for (kk = 0; kk < bytes; kk++)
+		le[kk] = (uint8_t) (v >> (8 * kk));
+	put_bytes(buf, le, bytes);
+}
+
+static void put_str(journal_buf_t *buf, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (len > 255)
+		len = 255;
+	put_le(buf, len, 1);
+	put_bytes(buf, str, len);
+}
+
+static void put_value(journal_buf_t *buf, const result_field_t *field)
+{
+	unsigned long long bits;
+
+	put_le(buf, field->type, 1);
+	put_str(buf, field->name);
+
+	switch (field->type)
+	{
+	case RESULT_INT:
+		put_le(buf, (uint32_t) (int32_t) field->number, 4);
+		break;
+	case RESULT_HEX:
+		put_le(buf, (uint32_t) field->number, 4);
+		put_le(buf, strlen(field->text), 1);
+		break;
+	case RESULT_DOUBLE:
+		memcpy(&bits, &field->number, 8);
+		put_le(buf, bits, 8);
+		break;
+	default:
+		put_str(buf, field->text);
+		break;
+	}
+}
+
+static void journal_copy(char *dst, const char *src)
+{
+	strncpy(dst, src, RESULT_MAX_TEXT_LEN - 1);
+	dst[RESULT_MAX_TEXT_LEN - 1] = 0;
+}
+
+// BD address and serial number of the DUT, from the commands that write or read them
+static void journal_identify(int argc, char **argv)
+{
+	const result_field_t *field;
+
+	// a blank OTP does not tell one DUT from another
+	field = result_find("otp_bd_addr");
+	if (field != NULL && strspn(field->text, "F:") != strlen(field->text)
+		&& strspn(field->text, "0:") != strlen(field->text))
+		journal_copy(journal_unit_bd_addr, field->text);
+
+	// a value taken from a pool is returned as bd_addr / sn
+	field = result_find("bd_addr");
+	if (field != NULL)
+		journal_copy(journal_unit_bd_addr, field->text);
+	else if (argc >= 3 && strcmp(argv[0], "otp") == 0 && strcmp(argv[1], "wr_bdaddr") == 0 && argv[2][0] != '@')
+		journal_copy(journal_unit_bd_addr, argv[2]);
+
+	field = result_find("sn");
+	if (field != NULL)
+		journal_copy(journal_unit_sn, field->text);
+	else if (argc >= 2 && strcmp(argv[0], "write_SN") == 0 && argv[1][0] != '@')
+		journal_copy(journal_unit_sn, argv[1]);
+
+	field = result_find("value");
+	if (field != NULL && strcmp(argv[0], "read_SN") == 0)
+		journal_copy(journal_unit_sn, field->text);
+}
+
+static void journal_writer(PVOID unused)
+{
+	uint8_t *data;
+	size_t length;
+	DWORD written;
+
+	for (;;)
+	{
+		EnterCriticalSection(&journal_lock);
+		data = journal_fill;
+		length = journal_fill_length;
+		journal_fill = journal_flush;
+		journal_fill_length = 0;
+		journal_flush = data;
+		LeaveCriticalSection(&journal_lock);
+
+		if (length != 0)
+		{
+			// one write per batch, so that frames of other processes do not come between
+			if (!WriteFile(journal_file, data, (DWORD) length, &written, NULL) || written != length)
+				fprintf(stderr, "journal: write failed\n");
+			FlushFileBuffers(journal_file);
+			continue;
+		}
+
+		if (journal_stop)
+			break;
+
+		WaitForSingleObject(journal_has_data, INFINITE);
+	}
+
+	SetEvent(journal_done);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Open the journal, and create it if it does not exist.
+ *
+ *  @param[in] path  Journal file; records are appended to what it holds.
+ *
+ * @return true on success.
+ ****************************************************************************************
+*/
+bool journal_open(const char *path)
+{
+	LARGE_INTEGER size;
+	DWORD written;
+
+	if (journal_active)
+		return false;
+
+	journal_file = CreateFile(path, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (journal_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	strncpy(journal_path, path, MAX_PATH - 1);
+	journal_path[MAX_PATH - 1] = 0;
+
+	if (GetFileSizeEx(journal_file, &size) && size.QuadPart == 0)
+	{
+		WriteFile(journal_file, JOURNAL_FILE_MAGIC, 4, &written, NULL);
+		FlushFileBuffers(journal_file);
+	}
+
+	journal_fill = (uint8_t *) malloc(JOURNAL_BUFFER_SIZE);
+	journal_flush = (uint8_t *) malloc(JOURNAL_BUFFER_SIZE);
+	if (journal_fill == NULL || journal_flush == NULL)
+	{
+		free(journal_fill);
+		free(journal_flush);
+		CloseHandle(journal_file);
+		journal_file = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	InitializeCriticalSection(&journal_lock);
+	journal_has_data = CreateEvent(NULL, FALSE, FALSE, NULL);
+	journal_done = CreateEvent(NULL, TRUE, FALSE, NULL);
+	journal_fill_length = 0;
+	journal_drops = 0;
+	journal_stop = FALSE;
+	journal_session = journal_now();
+	journal_unit_bd_addr[0] = 0;
+	journal_unit_sn[0] = 0;
+	journal_active = true;
+
+	_beginthread(journal_writer, 10000, NULL);
+
+	return true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Commit the records not written yet and close the journal.
+ ****************************************************************************************
+*/
+void journal_close(void)
+{
+	if (!journal_active)
+		return;
+
+	journal_stop = TRUE;
+	SetEvent(journal_has_data);
+	WaitForSingleObject(journal_done, INFINITE);
+
+	if (journal_drops)
+		fprintf(stderr, "journal: %u records dropped\n", (unsigned int) journal_drops);
+
+	CloseHandle(journal_file);
+	journal_file = INVALID_HANDLE_VALUE;
+
+	free(journal_fill);
+	free(journal_flush);
+	CloseHandle(journal_has_data);
+	CloseHandle(journal_done);
+	DeleteCriticalSection(&journal_lock);
+	journal_active = false;
+}
+
+bool journal_is_open(void)
+{
+	return journal_active;
+}
+
+unsigned long long journal_session_id(void)
+{
+	return journal_session;
+}
+
+// BD address and serial number of the DUT, "" until a command tells them
+const char *journal_dut_bd_addr(void)
+{
+	return journal_unit_bd_addr;
+}
+
+const char *journal_dut_sn(void)
+{
+	return journal_unit_sn;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Add the record of a command that ended; its return values are taken from result.c.
+ *
+ *  @param[in] port        COM port of the DUT.
+ *  @param[in] argc, argv  The command and its arguments.
+ *  @param[in] line        Plan file line of a plan step, 0 otherwise.
+ *  @param[in] status      Status the command returned.
+ *  @param[in] micros      Time the command took.
+ ****************************************************************************************
+*/
+void journal_append(int port, int argc, char **argv, int line, int status, uint32_t micros)
+{
+	static uint8_t frame[JOURNAL_FRAME_HEADER + JOURNAL_MAX_PAYLOAD];
+	journal_buf_t payload;
+	journal_buf_t header;
+	size_t count_at;
+	size_t length;
+	int count = 0;
+	int kk;
+
+	if (!journal_active)
+		return;
+
+	journal_identify(argc, argv);
+
+	payload.data = frame + JOURNAL_FRAME_HEADER;
+	payload.size = JOURNAL_MAX_PAYLOAD;
+	payload.length = 0;
+	payload.overflow = false;
+
+	put_le(&payload, journal_session, 8);
+	put_le(&payload, journal_now(), 8);
+	put_le(&payload, port, 2);
+	put_le(&payload, line, 2);
+	put_le(&payload, (uint32_t) status, 4);
+	put_le(&payload, micros, 4);
+	put_str(&payload, journal_unit_bd_addr);
+	put_str(&payload, journal_unit_sn);
+
+	if (argc > 255)
+		argc = 255;
+	put_le(&payload, argc, 1);
+	for (kk = 0; kk < argc; kk++)
+		put_str(&payload, argv[kk]);
+
+	if (payload.overflow)
+		return;
+
+	// values that do not fit are left out
+	count_at = payload.length;
+	put_le(&payload, 0, 1);
+	for (kk = 0; kk < result_count() && count < 255; kk++)
+	{
+		length = payload.length;
+		put_value(&payload, result_field(kk));
+		if (payload.overflow)
+		{
+			payload.length = length;
+			payload.overflow = false;
+			break;
+		}
+		count++;
+	}
+	payload.data[count_at] = (uint8_t) count;
+
+	header.data = frame;
+	header.size = JOURNAL_FRAME_HEADER;
+	header.length = 0;
+	header.overflow = false;
+	put_le(&header, JOURNAL_SYNC, 2);
+	put_le(&header, payload.length, 2);
+	put_le(&header, journal_crc32(payload.data, payload.length), 4);
+
+	EnterCriticalSection(&journal_lock);
+	if (journal_fill_length + JOURNAL_FRAME_HEADER + payload.length > JOURNAL_BUFFER_SIZE)
+	{
+		journal_drops++;
+	}
+	else
+	{
+		memcpy(journal_fill + journal_fill_length, frame, JOURNAL_FRAME_HEADER + payload.length);
+		journal_fill_length += JOURNAL_FRAME_HEADER + payload.length;
+	}
+	LeaveCriticalSection(&journal_lock);
+
+	SetEvent(journal_has_data);
+}
+
+typedef struct {
+	const uint8_t *data;
+	size_t         length;
+	size_t         pos;
+	bool           bad;
+} journal_reader_t;
+
+static unsigned long long get_le(journal_reader_t *rd, int bytes)
+{
+	unsigned long long v = 0;
+	int kk;
+
+	if (rd->bad || rd->pos + bytes > rd->length)
+	{
+		rd->bad = true;
+		return 0;
+	}
+	for (kk = 0; kk < bytes; kk++)
+		v |= (unsigned long long) rd->data[rd->pos + kk] << (8 * kk);
+	rd->pos += bytes;
+
+	return v;
+}
+
+// longer strings are cut to size - 1 characters
+static void get_str(journal_reader_t *rd, char *str, size_t size)
+{
+	size_t len = (size_t) get_le(rd, 1);
+
+	str[0] = 0;
+	if (rd->bad || rd->pos + len > rd->length)
+	{
+		rd->bad = true;
+		return;
+	}
+	memcpy(str, rd->data + rd->pos, len < size ? len : size - 1);
+	str[len < size ? len : size - 1] = 0;
+	rd->pos += len;
+}
+
+static bool journal_parse(const uint8_t *data, size_t length, journal_record_t *rec)
+{
+	journal_reader_t rd;
+	result_field_t *field;
+	unsigned long long bits;
+	int digits;
+	int count, kk;
+
+	rd.data = data;
+	rd.length = length;
+	rd.pos = 0;
+	rd.bad = false;
+
+	rec->session = get_le(&rd, 8);
+	rec->time = get_le(&rd, 8);
+	rec->port = (int) get_le(&rd, 2);
+	rec->line = (int) get_le(&rd, 2);
+	rec->status = (int32_t) (uint32_t) get_le(&rd, 4);
+	rec->micros = (uint32_t) get_le(&rd, 4);
+	get_str(&rd, rec->bd_addr, sizeof(rec->bd_addr));
+	get_str(&rd, rec->sn, sizeof(rec->sn));
+
+	count = (int) get_le(&rd, 1);
+	rec->argc = 0;
+	for (kk = 0; kk < count && !rd.bad; kk++)
+	{
+		if (rec->argc < JOURNAL_MAX_ARGS)
+		{
+			get_str(&rd, rec->args[rec->argc], JOURNAL_MAX_ARG_LEN);
+			rec->argv[rec->argc] = rec->args[rec->argc];
+			rec->argc++;
+		}
+		else
+		{
+			get_str(&rd, rec->args[0], 1);
+		}
+	}
+
+	count = (int) get_le(&rd, 1);
+	rec->value_count = 0;
+	for (kk = 0; kk < count && !rd.bad && kk < RESULT_MAX_FIELDS; kk++)
+	{
+		field = &rec->values[rec->value_count++];
+		field->type = (int) get_le(&rd, 1);
+		get_str(&rd, field->name, RESULT_MAX_NAME_LEN);
+		switch (field->type)
+		{
+		case RESULT_INT:
+			field->number = (int32_t) (uint32_t) get_le(&rd, 4);
+			sprintf(field->text, "%ld", (long) field->number);
+			break;
+		case RESULT_HEX:
+			field->number = (double) get_le(&rd, 4);
+			digits = (int) get_le(&rd, 1);
+			sprintf(field->text, "%0*lX", digits, (unsigned long) field->number);
+			break;
+		case RESULT_DOUBLE:
+			bits = get_le(&rd, 8);
+			memcpy(&field->number, &bits, 8);
+			sprintf(field->text, "%.2f", field->number);
+			break;
+		default:
+			field->number = 0;
+			get_str(&rd, field->text, RESULT_MAX_TEXT_LEN);
+			break;
+		}
+	}
+
+	return !rd.bad && rec->argc > 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read a journal and hand every record in it to a visitor, in the order written.
+ *
+ *  @param[in] path   Journal file, NULL for the open journal (what is committed of it).
+ *  @param[in] visit  Called for each record; the record is only valid during the call.
+ *  @param[in] ctx    Passed to visit.
+ *
+ * @return number of records, -1 if the file cannot be read.
+ ****************************************************************************************
+*/
+int journal_scan(const char *path, journal_visit_t visit, void *ctx)
+{
+	static journal_record_t rec;
+	FILE *file;
+	uint8_t *data;
+	long size;
+	size_t pos;
+	size_t length;
+	uint32_t crc;
+	int records = 0;
+
+	if (path == NULL)
+		path = journal_path;
+
+	file = fopen(path, "rb");
+	if (file == NULL)
+		return -1;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = (uint8_t *) malloc(size > 0 ? size : 1);
+	if (data == NULL || fread(data, 1, size, file) != (size_t) size
+		|| size < 4 || memcmp(data, JOURNAL_FILE_MAGIC, 4) != 0)
+	{
+		free(data);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	rec.skipped = 0;
+	pos = 4;
+	while (pos + JOURNAL_FRAME_HEADER <= (size_t) size)
+	{
+		length = data[pos + 2] | (data[pos + 3] << 8);
+		crc = data[pos + 4] | (data[pos + 5] << 8) | (data[pos + 6] << 16) | ((uint32_t) data[pos + 7] << 24);
+
+		if (data[pos] != (JOURNAL_SYNC & 0xFF) || data[pos + 1] != (JOURNAL_SYNC >> 8)
+			|| pos + JOURNAL_FRAME_HEADER + length > (size_t) size
+			|| journal_crc32(data + pos + JOURNAL_FRAME_HEADER, length) != crc
+			|| !journal_parse(data + pos + JOURNAL_FRAME_HEADER, length, &rec))
+		{
+			// torn or damaged frame: look for the next one
+			pos++;
+			rec.skipped++;
+			continue;
+		}
+
+		visit(&rec, ctx);
+		rec.skipped = 0;
+
+		pos += JOURNAL_FRAME_HEADER + length;
+		records++;
+	}
+
+	if (pos < (size_t) size)
+		printf("journal: %u damaged bytes at the end\n", (unsigned int) (size - pos));
+
+	free(data);
+
+	return records;
+}
+
+static void journal_print_time(unsigned long long ft, const char *format)
+{
+	char text[32];
+	time_t t = (time_t) ((ft - JOURNAL_FILETIME_EPOCH_DELTA) / 10000000);
+
+	strftime(text, sizeof(text), format, gmtime(&t));
+	printf("%s.%03u", text, (unsigned int) ((ft / 10000) % 1000));
+}
+
+static void journal_print(const journal_record_t *rec, void *ctx)
+{
+	unsigned long long *session = (unsigned long long *) ctx;
+	int kk;
+
+	if (rec->skipped)
+		printf("journal: %u damaged bytes\n", (unsigned int) rec->skipped);
+
+	if (rec->session != *session)
+	{
+		printf("session ");
+		journal_print_time(rec->session, "%Y-%m-%d %H:%M:%S");
+		printf(" UTC, port %d\n", rec->port);
+		*session = rec->session;
+	}
+
+	printf("  ");
+	journal_print_time(rec->time, "%H:%M:%S");
+	if (rec->bd_addr[0])
+		printf(" BD %s", rec->bd_addr);
+	if (rec->sn[0])
+		printf(" SN %s", rec->sn);
+	if (rec->line != 0)
+		printf(" line %d:", rec->line);
+
+	for (kk = 0; kk < rec->argc; kk++)
+		printf(" %s", rec->argv[kk]);
+	printf(" = %d, %u.%03u ms", rec->status, (unsigned int) (rec->micros / 1000), (unsigned int) (rec->micros % 1000));
+
+	for (kk = 0; kk < rec->value_count; kk++)
+		printf("%s %s = %s", kk == 0 ? ";" : ",", rec->values[kk].name, rec->values[kk].text);
+	printf("\n");
+}
+
+/*
+ ****************************************************************************************
+ * @brief Print the records of a journal.
+ *
+ *  @param[in] path  Journal file.
+ *
+ * @return number of records printed, -1 if the file cannot be read.
+ ****************************************************************************************
+*/
+int journal_dump(const char *path)
+{
+	unsigned long long session = 0;
+
+	return journal_scan(path, journal_print, &session);
+}
@@ -0,0 +1,95 @@
+/**
+****************************************************************************************
+*
+* @file journal.h
+*
+* @brief Append-only binary journal of the results, per station.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+#include "result.h"
+
+/*
+ * The file starts with JOURNAL_FILE_MAGIC, then one frame per command or plan
+ * step, all numbers little endian:
+ *
+ *   u16 JOURNAL_SYNC, u16 payload length, u32 CRC-32 of the payload, payload
+ *
+ * payload:
+ *   u64 session     FILETIME when the prodtest process started
+ *   u64 time        FILETIME when the command ended
+ *   u16 port, u16 plan line (0: not in a plan), i32 status, u32 duration in us
+ *   str BD address, str serial number of the DUT, as far as known ("" if not)
+ *   u8 argc, argc * str
+ *   u8 count, count * value
+ *
+ * str:   u8 length, characters
+ * value: u8 type (RESULT_INT...), str name, then
+ *        RESULT_INT i32 | RESULT_HEX u32, u8 digits | RESULT_DOUBLE 8 byte IEEE | RESULT_STR str
+ *
+ * A frame cut short by a crash fails its CRC; the reader skips to the next sync.
+ * Several prodtest processes, e.g. one per DUT of a station, may share a
+ * journal: the file is opened for appending only and each batch of frames is
+ * appended with one write, so frames of different processes never interleave.
+ */
+#define JOURNAL_FILE_MAGIC   "PTJ1"
+#define JOURNAL_SYNC         0xA55A
+#define JOURNAL_FRAME_HEADER 8
+#define JOURNAL_MAX_PAYLOAD  0xFFFF
+
+/* records waiting for the writer thread; further records are counted as dropped */
+#define JOURNAL_BUFFER_SIZE  0x40000
+
+#define JOURNAL_CONFIG_FILE  "journal.file"
+
+/* a record as read back; longer arguments are cut */
+#define JOURNAL_MAX_ARGS     64
+#define JOURNAL_MAX_ARG_LEN  64
+
+typedef struct {
+	unsigned long long session;
+	unsigned long long time;
+	int            port;
+	int            line;
+	int            status;
+	uint32_t       micros;
+	char           bd_addr[RESULT_MAX_TEXT_LEN];
+	char           sn[RESULT_MAX_TEXT_LEN];
+	int            argc;
+	char          *argv[JOURNAL_MAX_ARGS];
+	char           args[JOURNAL_MAX_ARGS][JOURNAL_MAX_ARG_LEN];
+	int            value_count;
+	result_field_t values[RESULT_MAX_FIELDS];
+	size_t         skipped;           // damaged bytes just before this record
+} journal_record_t;
+
+typedef void (*journal_visit_t)(const journal_record_t *rec, void *ctx);
+
+bool journal_open(const char *path);
+void journal_close(void);
+bool journal_is_open(void);
+
+unsigned long long journal_session_id(void);
+const char *journal_dut_bd_addr(void);
+const char *journal_dut_sn(void);
+
+void journal_append(int port, int argc, char **argv, int line, int status, uint32_t micros);
+
+int journal_scan(const char *path, journal_visit_t visit, void *ctx);
+int journal_dump(const char *path);
+
+#endif /* _JOURNAL_H_ */
@@ -0,0 +1,538 @@
+/**
+****************************************************************************************
+*
+* @file latency.c
+*
+* @brief Reply latency profile of the HCI commands, and the timeouts derived from it.
+*
+* An evt_buf tap pairs every command sent with the Command Complete / Command
+* Status event that answers it and adds the time between the two frames to a
+* histogram per command. The histograms are kept in a file across runs, so a
+* dead DUT is detected after a few times the usual reply time of the command
+* rather than after a fixed 10 s.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "latency.h"
+#include "config.h"
+#include "evt_buf.h"
+
+typedef struct {
+	uint32_t key;
+	uint32_t base[LATENCY_BUCKETS];    // read from the profile
+	uint32_t added[LATENCY_BUCKETS];   // measured in this run
+} latency_entry_t;
+
+static latency_entry_t latency_entries[LATENCY_MAX_KEYS];
+static int latency_count;
+
+static uint32_t latency_bounds_us[LATENCY_BUCKETS]; // upper bound of each bucket
+static char latency_path[MAX_PATH];
+
+static CRITICAL_SECTION latency_lock;
+static bool latency_active = false;
+static bool latency_lock_initialized = false;
+static LONGLONG latency_qpc_freq;
+
+// command waiting for its answer
+static bool latency_pending;
+static uint32_t latency_pending_key;
+static uint16_t latency_pending_opcode;
+static LONGLONG latency_pending_stamp;
+
+// last command sent, for the completion of an operation it started (pkt_tx)
+static bool latency_last_valid;
+static uint16_t latency_last_opcode;
+static LONGLONG latency_last_stamp;
+
+/*
+ ****************************************************************************************
+ * @brief Key of a command.
+ *
+ *  @param[in] cmd     Command: opcode, length, parameters.
+ *  @param[in] length  Number of bytes at cmd.
+ ****************************************************************************************
+*/
+uint32_t latency_key_of(const uint8_t *cmd, unsigned int length)
+{
+	uint16_t opcode;
+
+	if (length < 3)
+		return 0;
+	opcode = cmd[0] | (cmd[1] << 8);
+
+	switch (opcode)
+	{
+		case 0x4080: // xtal trimming
+		case 0x4090: // otp xtrim / bdaddr
+		case 0x40C0: // register read/write
+		case 0x40D0: // custom action
+			if (length > 3)
+				return LATENCY_KEY(opcode, cmd[3]);
+			break;
+	}
+
+	return LATENCY_KEY(opcode, 0);
+}
+
+static bool latency_has_op(uint32_t key)
+{
+	switch (key >> 8)
+	{
+		case 0x4080:
+		case 0x4090:
+		case 0x40C0:
+		case 0x40D0:
+			return true;
+	}
+
+	return false;
+}
+
+static void latency_key_name(uint32_t key, char *name)
+{
+	if (latency_has_op(key))
+		sprintf(name, "%04X.%02X", (unsigned int) (key >> 8), (unsigned int) (key & 0xFF));
+	else
+		sprintf(name, "%04X", (unsigned int) (key >> 8));
+}
+
+static latency_entry_t *latency_entry(uint32_t key, bool create)
+{
+	int kk;
+
+	for (kk = 0; kk < latency_count; kk++)
+		if (latency_entries[kk].key == key)
+			return &latency_entries[kk];
+
+	if (!create || latency_count == LATENCY_MAX_KEYS)
+		return NULL;
+
+	memset(&latency_entries[latency_count], 0, sizeof(latency_entry_t));
+	latency_entries[latency_count].key = key;
+
+	return &latency_entries[latency_count++];
+}
+
+static void latency_init_bounds(void)
+{
+	int kk;
+
+	for (kk = 0; kk < LATENCY_FINE_BUCKETS; kk++)
+		latency_bounds_us[kk] = (kk + 1) * LATENCY_FINE_US;
+	for (; kk < LATENCY_BUCKETS - 1; kk++)
+		latency_bounds_us[kk] = latency_bounds_us[kk - 1] / 4 * 5;
+	latency_bounds_us[LATENCY_BUCKETS - 1] = 0xFFFFFFFF;
+}
+
+static int latency_bucket(uint32_t us)
+{
+	int kk;
+
+	for (kk = 0; kk < LATENCY_BUCKETS - 1; kk++)
+		if (us < latency_bounds_us[kk])
+			break;
+
+	return kk;
+}
+
+static void latency_record(uint32_t key, LONGLONG ticks)
+{
+	latency_entry_t *entry = latency_entry(key, true);
+	uint32_t us;
+
+	if (entry == NULL || ticks < 0)
+		return;
+
+	us = (uint32_t) (ticks * 1000000 / latency_qpc_freq);
+	entry->added[latency_bucket(us)]++;
+}
+
+static void latency_tap(evt_buf_t *buf, void *ctx)
+{
+	uint16_t opcode;
+
+	if (buf->direction == EVT_BUF_TX)
+	{
+		if (buf->payload_type != 0x01 || buf->length < 3)
+			return;
+
+		EnterCriticalSection(&latency_lock);
+		latency_pending = true;
+		latency_pending_key = latency_key_of(buf->data, buf->length);
+		latency_pending_opcode = buf->data[0] | (buf->data[1] << 8);
+		latency_pending_stamp = buf->stamp;
+		latency_last_valid = true;
+		latency_last_opcode = latency_pending_opcode;
+		latency_last_stamp = buf->stamp;
+		LeaveCriticalSection(&latency_lock);
+		return;
+	}
+
+	if (buf->payload_type != 0x04)
+		return;
+
+	if (buf->data[0] == 0x0E && buf->length >= 5)      // Command Complete
+		opcode = buf->data[3] | (buf->data[4] << 8);
+	else if (buf->data[0] == 0x0F && buf->length >= 5) // Command Status: 3 bytes in this firmware
+		opcode = buf->data[3] | (buf->data[4] << 8);
+	else
+		return;
+
+	if (opcode == 0)
+		return; // only returns command credits
+
+	EnterCriticalSection(&latency_lock);
+
+	if (latency_pending && opcode == latency_pending_opcode)
+	{
+		latency_record(latency_pending_key, buf->stamp - latency_pending_stamp);
+		latency_pending = false;
+	}
+	else if (!latency_pending && latency_last_valid && opcode != latency_last_opcode
+	         && buf->data[0] == 0x0E)
+	{
+		// end of an operation started by the last command, e.g. 0x4040 after pkt_tx
+		latency_record(LATENCY_KEY(opcode, 0), buf->stamp - latency_last_stamp);
+		latency_last_valid = false;
+	}
+
+	LeaveCriticalSection(&latency_lock);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read a profile into the base counts.
+ *
+ * @return false if the file cannot be opened.
+ ****************************************************************************************
+*/
+static bool latency_read(const char *path)
+{
+	char line[32 + LATENCY_BUCKETS * 11];
+	latency_entry_t *entry;
+	unsigned long opcode, op;
+	char *p, *endptr;
+	FILE *fp;
+	int kk;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return false;
+
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (line[0] == '#')
+			continue;
+
+		opcode = strtoul(line, &endptr, 16);
+		if (endptr == line || opcode > 0xFFFF)
+			continue;
+		op = 0;
+		if (*endptr == '.')
+		{
+			p = endptr + 1;
+			op = strtoul(p, &endptr, 16);
+			if (endptr == p || op > 0xFF)
+				continue;
+		}
+
+		entry = latency_entry(LATENCY_KEY(opcode, op), true);
+		if (entry == NULL)
+			break;
+
+		p = endptr;
+		for (kk = 0; kk < LATENCY_BUCKETS; kk++)
+		{
+			entry->base[kk] += strtoul(p, &endptr, 10);
+			if (endptr == p)
+				break;
+			p = endptr;
+		}
+	}
+
+	fclose(fp);
+
+	return true;
+}
+
+static bool latency_write(const char *path)
+{
+	char tmp[MAX_PATH + 4];
+	char name[16];
+	uint32_t total;
+	FILE *fp;
+	int kk, bb;
+
+	sprintf(tmp, "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (fp == NULL)
+		return false;
+
+	fprintf(fp, "# prodtest reply latency profile: <opcode>[.<operation>] <count per bucket>, see latency.h\n");
+
+	for (kk = 0; kk < latency_count; kk++)
+	{
+		total = 0;
+		for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+			total += latency_entries[kk].base[bb];
+		if (total == 0)
+			continue;
+
+		latency_key_name(latency_entries[kk].key, name);
+		fprintf(fp, "%s", name);
+		for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+			fprintf(fp, " %u", (unsigned int) latency_entries[kk].base[bb]);
+		fprintf(fp, "\n");
+	}
+
+	if (fclose(fp) != 0)
+		return false;
+
+	return MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read the profile and start measuring the replies.
+ *
+ * @return false if the replies cannot be measured.
+ ****************************************************************************************
+*/
+bool latency_open(void)
+{
+	LARGE_INTEGER freq;
+	const char *path;
+
+	if (latency_active)
+		return true;
+
+	latency_init_bounds();
+
+	path = config_get(LATENCY_CONFIG_PROFILE, NULL);
+	if (path != NULL)
+	{
+		strncpy(latency_path, path, sizeof(latency_path) - 1);
+	}
+	else if (!config_exe_path(LATENCY_DEFAULT_FILE_NAME, latency_path, sizeof(latency_path)))
+	{
+		latency_path[0] = 0;
+	}
+
+	if (latency_path[0] != 0)
+		latency_read(latency_path); // none yet on a new fixture
+
+	QueryPerformanceFrequency(&freq);
+	latency_qpc_freq = freq.QuadPart;
+
+	if (!latency_lock_initialized)
+	{
+		InitializeCriticalSection(&latency_lock);
+		latency_lock_initialized = true;
+	}
+	latency_pending = false;
+	latency_last_valid = false;
+
+	if (!evt_tap_add(latency_tap, NULL))
+		return false;
+
+	latency_active = true;
+
+	return true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Stop measuring and add the replies of this run to the profile file. The
+ *        file is read again first, as other instances may have updated it meanwhile.
+ ****************************************************************************************
+*/
+void latency_close(void)
+{
+	HANDLE mutex;
+	uint32_t total;
+	bool any = false;
+	int kk, bb;
+
+	if (!latency_active)
+		return;
+
+	evt_tap_remove(latency_tap, NULL);
+	latency_active = false;
+
+	for (kk = 0; kk < latency_count && !any; kk++)
+		for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+			if (latency_entries[kk].added[bb])
+				any = true;
+
+	if (!any || latency_path[0] == 0)
+		return;
+
+	mutex = CreateMutex(NULL, FALSE, LATENCY_MUTEX_NAME);
+	if (mutex == NULL)
+		return;
+	if (WaitForSingleObject(mutex, LATENCY_SAVE_LOCK_MILLIS) == WAIT_TIMEOUT)
+	{
+		CloseHandle(mutex);
+		return;
+	}
+
+	EnterCriticalSection(&latency_lock);
+
+	for (kk = 0; kk < latency_count; kk++)
+		memset(latency_entries[kk].base, 0, sizeof(latency_entries[kk].base));
+	latency_read(latency_path);
+
+	for (kk = 0; kk < latency_count; kk++)
+	{
+		total = 0;
+		for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+		{
+			latency_entries[kk].base[bb] += latency_entries[kk].added[bb];
+			latency_entries[kk].added[bb] = 0;
+			total += latency_entries[kk].base[bb];
+		}
+
+		if (total > LATENCY_MAX_SAMPLES)
+			for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+				latency_entries[kk].base[bb] /= 2;
+	}
+
+	if (!latency_write(latency_path))
+		fprintf(stderr, "Cannot update latency profile \"%s\" \n", latency_path);
+
+	LeaveCriticalSection(&latency_lock);
+
+	ReleaseMutex(mutex);
+	CloseHandle(mutex);
+}
+
+// p99.9 in us, 0 if the key has too few samples or it is in the open bucket
+static uint32_t latency_quantile_us(latency_entry_t *entry, uint32_t *samples)
+{
+	uint32_t total = 0;
+	uint32_t target, sum = 0;
+	int bb;
+
+	for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+		total += entry->base[bb] + entry->added[bb];
+	*samples = total;
+	if (total == 0)
+		return 0;
+
+	target = (uint32_t) (((unsigned long long) total * LATENCY_QUANTILE_PER_10000 + 9999) / 10000);
+	for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+	{
+		sum += entry->base[bb] + entry->added[bb];
+		if (sum >= target)
+			break;
+	}
+
+	if (bb >= LATENCY_BUCKETS - 1)
+		return 0;
+
+	return latency_bounds_us[bb];
+}
+
+/*
+ ****************************************************************************************
+ * @brief Time to wait for the reply to a command.
+ *
+ *  @param[in] key  Command, see latency_key_of().
+ *  @param[in] def  The handler's own limit; used until the profile has enough samples,
+ *                  and as the ceiling unless the configuration sets one.
+ *
+ * @return the timeout in ms.
+ ****************************************************************************************
+*/
+unsigned int latency_timeout(uint32_t key, unsigned int def)
+{
+	char cfg_key[32];
+	latency_entry_t *entry;
+	unsigned long long timeout;
+	uint32_t samples, us;
+	long value;
+
+	strcpy(cfg_key, "timeout.");
+	latency_key_name(key, cfg_key + strlen(cfg_key));
+	value = config_get_long(cfg_key, -1);
+	if (value < 0 && latency_has_op(key))
+	{
+		// "timeout.40C0" covers all operations
+		cfg_key[strlen(cfg_key) - 3] = 0;
+		value = config_get_long(cfg_key, -1);
+	}
+	if (value >= 0)
+		return (unsigned int) value;
+
+	if (!latency_lock_initialized)
+		return def;
+
+	EnterCriticalSection(&latency_lock);
+	entry = latency_entry(key, false);
+	us = entry ? latency_quantile_us(entry, &samples) : 0;
+	LeaveCriticalSection(&latency_lock);
+
+	if (us == 0 || samples < (uint32_t) config_get_long(LATENCY_CONFIG_SAMPLES, LATENCY_DEFAULT_MIN_SAMPLES))
+		return def;
+
+	timeout = ((unsigned long long) us * config_get_long(LATENCY_CONFIG_MARGIN, LATENCY_DEFAULT_MARGIN_PERCENT) / 100 + 999) / 1000;
+	if (timeout < (unsigned long long) config_get_long(LATENCY_CONFIG_FLOOR, LATENCY_DEFAULT_FLOOR_MILLIS))
+		timeout = config_get_long(LATENCY_CONFIG_FLOOR, LATENCY_DEFAULT_FLOOR_MILLIS);
+	if (timeout > (unsigned long long) config_get_long(LATENCY_CONFIG_CEILING, def))
+		timeout = config_get_long(LATENCY_CONFIG_CEILING, def);
+
+	return (unsigned int) timeout;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Print the profile: samples, median and p99.9 per command.
+ ****************************************************************************************
+*/
+void latency_print(void)
+{
+	latency_entry_t *entry;
+	uint32_t samples, sum, p999;
+	char name[16];
+	int kk, bb;
+
+	printf("profile = %s\n", latency_path[0] ? latency_path : "(none)");
+
+	for (kk = 0; kk < latency_count; kk++)
+	{
+		entry = &latency_entries[kk];
+		p999 = latency_quantile_us(entry, &samples);
+		if (samples == 0)
+			continue;
+
+		sum = 0;
+		for (bb = 0; bb < LATENCY_BUCKETS; bb++)
+		{
+			sum += entry->base[bb] + entry->added[bb];
+			if (sum * 2 >= samples)
+				break;
+		}
+
+		latency_key_name(entry->key, name);
+		printf("%-8s samples = %6u, p50 < %8.2f ms, ", name, (unsigned int) samples,
+		       latency_bounds_us[bb < LATENCY_BUCKETS - 1 ? bb : LATENCY_BUCKETS - 2] / 1000.0);
+		if (p999)
+			printf("p99.9 < %8.2f ms\n", p999 / 1000.0);
+		else
+			printf("p99.9 > %8.2f ms\n", latency_bounds_us[LATENCY_BUCKETS - 2] / 1000.0);
+	}
+}
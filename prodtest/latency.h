@@ -0,0 +1,75 @@
+/**
+****************************************************************************************
+*
+* @file latency.h
+*
+* @brief Reply latency profile of the HCI commands, and the timeouts derived from it.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+
+/*
+ * Commands are told apart by opcode, and for the opcodes that carry an
+ * operation in their first parameter (xtrim, otp, register r/w, custom
+ * actions) by operation too: a key is written "40C0.0A" (opcode 0x40C0,
+ * operation 10) or "201E" in the profile and in the configuration.
+ */
+#define LATENCY_KEY(opcode, op) (((uint32_t) (opcode) << 8) | (op))
+
+/* histogram: 250 us buckets up to 4 ms, then each bucket 25% wider; the last one is open */
+#define LATENCY_BUCKETS       64
+#define LATENCY_FINE_BUCKETS  16
+#define LATENCY_FINE_US       250
+
+#define LATENCY_MAX_KEYS      64
+
+/* counts of a key are halved beyond this, so that the profile follows a slower firmware */
+#define LATENCY_MAX_SAMPLES   20000
+
+/* profile, in the directory of prodtest.exe unless "timeout.profile" names another file */
+#define LATENCY_DEFAULT_FILE_NAME  "prodtest.lat"
+
+/* serializes the update of the profile by prodtest instances running in parallel */
+#define LATENCY_MUTEX_NAME         "prodtest_latency_profile"
+#define LATENCY_SAVE_LOCK_MILLIS   5000
+
+/*
+ * timeout = p99.9 of the profile * margin, kept between floor and ceiling.
+ * Until a key has enough samples, the handler's own limit is used. The floor
+ * stays well above the scheduler tick (15.6 ms): with line.auto a timeout
+ * resets the DUT.
+ * "timeout.<key> = <ms>" fixes the timeout of one command.
+ */
+#define LATENCY_QUANTILE_PER_10000       9990
+#define LATENCY_DEFAULT_MARGIN_PERCENT   300
+#define LATENCY_DEFAULT_FLOOR_MILLIS     100
+#define LATENCY_DEFAULT_MIN_SAMPLES      50
+
+#define LATENCY_CONFIG_PROFILE  "timeout.profile"
+#define LATENCY_CONFIG_MARGIN   "timeout.margin"    // percent
+#define LATENCY_CONFIG_FLOOR    "timeout.floor"     // ms
+#define LATENCY_CONFIG_CEILING  "timeout.ceiling"   // ms, default: the handler's own limit
+#define LATENCY_CONFIG_SAMPLES  "timeout.samples"   // min. samples before the profile is used
+
+bool latency_open(void);
+void latency_close(void);
+
+uint32_t latency_key_of(const uint8_t *cmd, unsigned int length);
+unsigned int latency_timeout(uint32_t key, unsigned int def);
+void latency_print(void);
+
+#endif /* _LATENCY_H_ */
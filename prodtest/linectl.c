@@ -0,0 +1,112 @@
+/**
+****************************************************************************************
+*
+* @file linectl.c
+*
+* @brief DTR/RTS sequences that reset the DUT or put it in boot mode.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "linectl.h"
+#include "config.h"
+
+/*
+ ****************************************************************************************
+ * @brief Get a named sequence, from the configuration or the built-in default.
+ *
+ *  @param[in] name  LINE_SEQ_RESET, LINE_SEQ_BOOT, LINE_SEQ_RELEASE or a name
+ *                   defined in the configuration only.
+ *
+ * @return the sequence, NULL if there is none of that name.
+ ****************************************************************************************
+*/
+const char *line_sequence(const char *name)
+{
+	char key[CONFIG_MAX_KEY_LEN];
+	const char *def = NULL;
+
+	if (strcmp(name, LINE_SEQ_RESET) == 0)
+		def = LINE_DEFAULT_RESET;
+	else if (strcmp(name, LINE_SEQ_BOOT) == 0)
+		def = LINE_DEFAULT_BOOT;
+	else if (strcmp(name, LINE_SEQ_RELEASE) == 0)
+		def = LINE_DEFAULT_RELEASE;
+
+	if (strlen(name) + 6 > sizeof(key))
+		return def;
+	sprintf(key, "line.%s", name);
+
+	return config_get(key, def);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Run a sequence on a port.
+ *
+ *  @param[in] port      Open port.
+ *  @param[in] sequence  Steps, see linectl.h.
+ *
+ * @return false on a malformed step; the steps before it have been run.
+ ****************************************************************************************
+*/
+bool line_run(uart_port_t *port, const char *sequence)
+{
+	const char *p = sequence;
+	char *endptr;
+	long value;
+	int step;
+
+	for (;;)
+	{
+		while (*p == ' ' || *p == '\t' || *p == ',')
+			p++;
+		if (*p == 0)
+			break;
+
+		if (strncmp(p, "dtr:", 4) == 0)
+			step = UART_LINE_DTR;
+		else if (strncmp(p, "rts:", 4) == 0)
+			step = UART_LINE_RTS;
+		else if (strncmp(p, "sleep:", 6) == 0)
+			step = -1;
+		else
+			return false;
+
+		p = strchr(p, ':') + 1;
+		value = strtol(p, &endptr, 10);
+		if (endptr == p || value < 0)
+			return false;
+		p = endptr;
+
+		if (step < 0)
+			Sleep(value);
+		else if (UARTPortSetLine(port, step, value != 0))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ ****************************************************************************************
+ * @brief true if the DUT on a port can be reset without the operator: the
+ *        simulated DUT always, a real one when LINE_CONFIG_AUTO is set.
+ ****************************************************************************************
+*/
+bool line_auto(uart_port_t *port)
+{
+	return port->sim != NULL || config_get_long(LINE_CONFIG_AUTO, 0) != 0;
+}
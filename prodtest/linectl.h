@@ -0,0 +1,47 @@
+/**
+****************************************************************************************
+*
+* @file linectl.h
+*
+* @brief DTR/RTS sequences that reset the DUT or put it in boot mode.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _LINECTL_H_
+#define _LINECTL_H_
+
+#include "stdbool.h"
+#include "uart.h"
+
+/*
+ * A sequence is a list of steps separated by blanks or commas:
+ *   dtr:<0|1>     deassert / assert DTR
+ *   rts:<0|1>     deassert / assert RTS
+ *   sleep:<ms>    wait
+ * The fixture wires DTR to RESET and RTS to the boot mode pin; a sequence
+ * named <name> can be replaced with "line.<name> = ..." in the configuration.
+ */
+#define LINE_SEQ_RESET    "reset"     // restart the DUT
+#define LINE_SEQ_BOOT     "boot"      // restart the DUT into its boot ROM
+#define LINE_SEQ_RELEASE  "release"   // let go of both lines
+
+#define LINE_DEFAULT_RESET    "dtr:1 sleep:10 dtr:0 sleep:50"
+#define LINE_DEFAULT_BOOT     "rts:1 dtr:1 sleep:10 dtr:0 sleep:10 rts:0"
+#define LINE_DEFAULT_RELEASE  "dtr:0 rts:0"
+
+/* "line.auto = 1": the fixture is wired, reset DUTs without asking the operator */
+#define LINE_CONFIG_AUTO  "line.auto"
+
+const char *line_sequence(const char *name);
+bool line_run(uart_port_t *port, const char *sequence);
+bool line_auto(uart_port_t *port);
+
+#endif /* _LINECTL_H_ */
@@ -24,6 +24,13 @@
 #include "queue.h"
 #include "commands.h"
 #include "getopt.h"
+#include "capture.h"
+#include "latency.h"
+#include "output.h"
+#include "journal.h"
+#include "bdaddr.h"
+#include "history.h"
+#include "config.h"
 #include "ble_580_sw_version.h" 
 
 #define CMD__STARTTEST_TX_PARAM_LEN_3     "cont_pkt_tx"  //"starttest_tx_param_len_3"
@@ -31,6 +38,10 @@
 #define CMD__STARTTEST_RX_DEFAULT         "start_pkt_rx" //"starttest_rx_default"
 #define CMD__STARTTEST_RX_READBACK_VALUES "start_pkt_rx_stats" // "starttest_rx_readback_values"
 #define CMD__STOPTEST_RX_READBACK_VALUES  "stop_pkt_rx_stats"  // "stoptest_rx_readback_values"
+#define CMD__PEEK_RX_READBACK_VALUES      "peek_pkt_rx_stats"
+#define CMD__MONITOR_RX_READBACK_VALUES   "monitor_pkt_rx_stats"
+#define CMD__PKT_RX_ALL                   "pkt_rx_all"
+#define CMD__PKT_RX_PER                   "pkt_rx_per"
 #define CMD__STOPTEST                     "stoptest"
 #define CMD__STARTTEST_UNMODULATED        "unmodulated" // "starttest_unmodulated"
 #define CMD__STARTTEST_TX_CONTINUE        "start_cont_tx" // "starttest_tx_continue"
@@ -53,6 +64,7 @@
 #define CMD__READ_FLAG					"read_flag"
 #define CMD__WRITE_PSN					  "write_PSN"
 #define CMD__READ_PSN					  "read_PSN"
+#define CMD__PROVISION					  "provision"
 /*doco lixiping fix for ticket/1 20180607 begin*/
 #define CMD__READ_MAC					  "read_mac"
 #define CMD__GO_SLEEP					  "go_sleep"
@@ -62,11 +74,22 @@
 #define CMD__WRITE_FPSENSER_WORK		  "write_fpsenser_work"
 #define CMD__WRITE_BPSENSER_WORK		  "write_bpsenser_work"
 /*doco lixiping fix for ticket/1 20180607 end*/
-typedef int (*cmd_handler_t) (int argc, char **argv);
-
+#define CMD__BULK_READ                    "bulk_read"
+#define CMD__BULK_WRITE                   "bulk_write"
+#define CMD__LOAD_FW                      "load_fw"
+#define CMD__LINE                         "line"
+#define CMD__WAIT_READY                   "wait_ready"
+#define CMD__TIMEOUTS                     "timeouts"
+#define CMD__PLAN                         "plan"
+#define CMD__JOURNAL                      "journal"
+#define CMD__POOL                         "pool"
+#define CMD__HISTORY                      "history"
+#define CMD__BROADCAST                    "broadcast"
+#define CMD__CONT_TX_ROTATE               "cont_tx_rotate"
 typedef struct {
 	char cmd_name[64];
 	cmd_handler_t cmd_handler;
+	bool no_port;                  // runs without a DUT
 } cmd_t;
 
 
@@ -81,6 +104,12 @@ cmd_t cmd_table[] = {
     { CMD__STARTTEST_RX_DEFAULT         , starttest_rx_default_handler},
     { CMD__STARTTEST_RX_READBACK_VALUES , starttest_rx_readback_values_handler},
     { CMD__STOPTEST_RX_READBACK_VALUES  , stoptest_rx_readback_values_handler},
+    { CMD__PEEK_RX_READBACK_VALUES      , peek_rx_readback_values_handler},
+    { CMD__MONITOR_RX_READBACK_VALUES   , monitor_rx_readback_values_handler},
+    { CMD__PKT_RX_ALL                   , pkt_rx_all_cmd_handler},
+    { CMD__PKT_RX_PER                   , pkt_rx_per_cmd_handler},
+    { CMD__BROADCAST                    , broadcast_cmd_handler},
+    { CMD__CONT_TX_ROTATE               , cont_tx_rotate_cmd_handler},
     { CMD__STOPTEST                     , stoptest_handler},
     { CMD__STARTTEST_UNMODULATED        , starttest_unmodulated_handler},
     { CMD__STARTTEST_TX_CONTINUE        , starttest_tx_continue_handler},
@@ -104,6 +133,7 @@ cmd_t cmd_table[] = {
 	{ CMD__READ_FLAG					, read_flag_cmd_handler},
 	{ CMD__WRITE_PSN					, write_PSN_cmd_handler},
 	{ CMD__READ_PSN						, read_PSN_cmd_handler},
+	{ CMD__PROVISION					, provision_cmd_handler},
 	{ CMD__READ_MAC						, read_MAC_cmd_handler},
 	{ CMD__GO_SLEEP						, go_sleep_cmd_handler},
 	{ CMD__READ_VBAT					, read_vbat_cmd_handler},
@@ -112,15 +142,94 @@ cmd_t cmd_table[] = {
 	{ CMD__WRITE_FPSENSER_WORK			, write_fpsenser_work_handler},
 	{ CMD__WRITE_BPSENSER_WORK			, write_bpsenser_work_handler},
 	/*doco lixiping fix for ticket/1 20180607 end*/
+    { CMD__BULK_READ                    , bulk_read_cmd_handler},
+    { CMD__BULK_WRITE                   , bulk_write_cmd_handler},
+    { CMD__LOAD_FW                      , load_fw_cmd_handler},
+    { CMD__LINE                         , line_cmd_handler},
+    { CMD__WAIT_READY                   , wait_ready_cmd_handler},
+    { CMD__TIMEOUTS                     , timeouts_cmd_handler},
+    { CMD__PLAN                         , plan_cmd_handler},
+    { CMD__JOURNAL                      , journal_cmd_handler, true},
+    { CMD__POOL                         , pool_cmd_handler, true},
+    { CMD__HISTORY                      , history_cmd_handler, true},
 
     { "",0}
 };
 
 
+/*
+ ****************************************************************************************
+ * @brief Handler of a command, NULL if there is no such command.
+ ****************************************************************************************
+*/
+cmd_handler_t cmd_lookup(const char *name)
+{
+	int kk;
+
+	for (kk = 0; cmd_table[kk].cmd_name[0] != 0; kk++)
+		if (strcmp(name, cmd_table[kk].cmd_name) == 0)
+			return cmd_table[kk].cmd_handler;
+
+	return NULL;
+}
+
 int g_com_port_number;
 
+// all ports of -p, g_com_port_number is the first one
+int g_com_port_list[UART_MAX_PORTS];
+int g_com_port_count;
+
 void print_usage(void);
 
+/*
+ ****************************************************************************************
+ * @brief Parse the -p option: a port number, or a list of them and of ranges,
+ *        e.g. "3,5,8-11".
+ *
+ * @return 0 on success / 1 on failure.
+ ****************************************************************************************
+*/
+static int parse_port_list(const char *str)
+{
+	char *endptr;
+	long first, last;
+
+	g_com_port_count = 0;
+
+	for (;;)
+	{
+		first = strtol(str, &endptr, 10);
+		if (endptr == str || first < 0)
+			return 1;
+		last = first;
+
+		if (*endptr == '-')
+		{
+			str = endptr + 1;
+			last = strtol(str, &endptr, 10);
+			if (endptr == str || last < first)
+				return 1;
+		}
+
+		for (; first <= last; first++)
+		{
+			if (g_com_port_count == UART_MAX_PORTS)
+				return 1;
+			g_com_port_list[g_com_port_count++] = first;
+		}
+
+		if (*endptr == 0)
+			break;
+		if (*endptr != ',')
+			return 1;
+		str = endptr + 1;
+	}
+
+	g_com_port_number = g_com_port_list[0];
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	int help_option = 0;
@@ -131,11 +240,16 @@ int main(int argc, char **argv)
 	int opt;
 	int cmd_argc;
 	char ** cmd_argv;
+	char *capture_path = NULL;
+	char *config_path = NULL;
+	char *output_format = NULL;
+	const char *journal_path = NULL;
+	const char *history_path;
 
 	__progname = argv[0]; // used by getopt
 
 	// parse command line switches
-	while( ( opt = getopt( argc, argv, "hvp:" ) )!= -1 )  
+	while( ( opt = getopt( argc, argv, "hvp:c:f:o:j:" ) )!= -1 )  
  	{
 		switch( opt ) 
 		{
@@ -144,20 +258,24 @@ int main(int argc, char **argv)
 				exit(SC_NO_ERROR);
 				break;
 			case 'p':
+				if (parse_port_list(optarg) != 0)
 				{
-					int return_status;
-					long com_port_number = 0;
-
-					com_port_number = parse_number(&return_status, optarg);
-					if(return_status !=0 )
-					{
-						fprintf(stderr, "Illegal com port number in -p option \n");
-						exit(SC_INVALID_COM_PORT_NUMBER);
-					}
-					
-					com_port_option = 1;
-					g_com_port_number = com_port_number;
+					fprintf(stderr, "Illegal com port number in -p option \n");
+					exit(SC_INVALID_COM_PORT_NUMBER);
 				}
+				com_port_option = 1;
+				break;
+			case 'c':
+				capture_path = optarg;
+				break;
+			case 'f':
+				config_path = optarg;
+				break;
+			case 'o':
+				output_format = optarg;
+				break;
+			case 'j':
+				journal_path = optarg;
 				break;
 			case 'v':
 				printf("%s\n",DA14580_SW_VERSION);
@@ -174,6 +292,19 @@ int main(int argc, char **argv)
 		exit(SC_NO_ERROR);
 	}
 
+	if (config_path != NULL)
+	{
+		if (!config_load(config_path))
+		{
+			fprintf(stderr, "Cannot read configuration file \"%s\" \n", config_path);
+			exit(SC_FILE_ERROR);
+		}
+	}
+	else
+	{
+		config_load_default();
+	}
+
 	// remaining arguments are interpreted as
 	//   <cmd> <cmd_arg_1> <cmd_arg_2>  ... <cmd_arg_n>
 	// and the following will hold:
@@ -215,7 +346,7 @@ int main(int argc, char **argv)
 	}
 
 	// all commands require a COM port
-	if (!com_port_option) 
+	if (!com_port_option && !cmd->no_port) 
 	{
 		fprintf(stderr, "Option -p is required. \n");
 		print_usage();
@@ -225,7 +356,46 @@ int main(int argc, char **argv)
 	//
 	// execute command
 	//
+	if (capture_path != NULL && !capture_open(capture_path))
+	{
+		fprintf(stderr, "Cannot create capture file \"%s\" \n", capture_path);
+		exit(SC_FILE_ERROR);
+	}
+
+	if (journal_path == NULL)
+		journal_path = config_get(JOURNAL_CONFIG_FILE, NULL);
+	if (journal_path != NULL && !cmd->no_port && !journal_open(journal_path))
+	{
+		fprintf(stderr, "Cannot open journal \"%s\" \n", journal_path);
+		exit(SC_FILE_ERROR);
+	}
+
+	history_path = config_get(HISTORY_CONFIG_INDEX, NULL);
+	if (history_path != NULL && !cmd->no_port && !history_open(history_path))
+	{
+		fprintf(stderr, "Cannot open history index \"%s\" \n", history_path);
+		exit(SC_FILE_ERROR);
+	}
+
+	if (!output_open(output_format != NULL ? output_format : "text", g_com_port_number))
+	{
+		fprintf(stderr, "Illegal output format in -o option \n");
+		exit(SC_INVALID_OUTPUT_FORMAT);
+	}
+
+	if (!latency_open())
+		fprintf(stderr, "Reply latencies are not measured. \n");
+
+	output_begin(cmd_argc, cmd_argv, 0);
 	rc = cmd->cmd_handler(cmd_argc, cmd_argv);
+	output_end(rc);
+
+	output_close();
+	bdaddr_close();
+	history_close();
+	journal_close();
+	latency_close();
+	capture_close();
 
 	return rc;
 
@@ -242,12 +412,17 @@ void print_usage(void)
     printf("prodtest -p <COM port number> start_pkt_rx <FREQUENCY> \n");
     printf("prodtest -p <COM port number> start_pkt_rx_stats <FREQUENCY> \n");
     printf("prodtest -p <COM port number> stop_pkt_rx_stats \n");
+    printf("prodtest -p <COM port number> peek_pkt_rx_stats \n");
+    printf("prodtest -p <COM port number> monitor_pkt_rx_stats <interval in ms> <samples> [<packets>] \n");
+    printf("prodtest -p <COM port list> pkt_rx_all <FREQUENCY> <DATA_LENGTH> <PAYLOAD_TYPE> <NUMBER_OF_PACKETS> \n");
+    printf("prodtest -p <COM port list> pkt_rx_per <FREQUENCY> <DATA_LENGTH> <PAYLOAD_TYPE> <MAX_NUMBER_OF_PACKETS> \n");
     printf("prodtest -p <COM port number> stoptest \n");
     printf("prodtest -p <COM port number> unmodulated OFF \n");
     printf("prodtest -p <COM port number> unmodulated TX <FREQUENCY> \n");
     printf("prodtest -p <COM port number> unmodulated RX <FREQUENCY> \n");
     printf("prodtest -p <COM port number> start_cont_tx <FREQUENCY> <PAYLOAD_TYPE> \n");
     printf("prodtest -p <COM port number> stop_cont_tx \n");
+    printf("prodtest -p <COM port list> cont_tx_rotate <FREQUENCY> <PAYLOAD_TYPE> <dwell in ms> <rounds> [<csv file>] \n");
     printf("prodtest -p <COM port number> reset \n");
 
     printf("prodtest -p <COM port number> sleep none     <minutes> <seconds> \n");
@@ -266,6 +441,7 @@ void print_usage(void)
     printf("prodtest -p <COM port number> otp wr_xtrim <decimal trim value> \n");
     printf("prodtest -p <COM port number> otp rd_xtrim                      \n");
     printf("prodtest -p <COM port number> otp wr_bdaddr <BD address>        \n");
+    printf("prodtest -p <COM port number> otp wr_bdaddr auto                \n");
     printf("prodtest -p <COM port number> otp rd_bdaddr                     \n");
     printf("prodtest -p <COM port number> otp re_xtrim                     \n");
     printf("prodtest -p <COM port number> otp we_xtrim                     \n");
@@ -273,11 +449,46 @@ void print_usage(void)
     printf("prodtest -p <COM port number> otp_read  <otp address in hex> <word_count> \n");
     printf("prodtest -p <COM port number> otp_write <otp address in hex> <word 1> ... <word n>\n");
 
+    printf("prodtest -p <COM port number> provision <SN|-> <PSN|-> <swversion|-> <flag|->                 \n");
+
     printf("prodtest -p <COM port number> read_reg32  <address of 32 bit reg. in hex>                       \n");
     printf("prodtest -p <COM port number> write_reg32 <address of 32 bit reg. in hex> <32 bit value in hex> \n");
     printf("prodtest -p <COM port number> read_reg16  <address of 16 bit reg. in hex>                       \n");
     printf("prodtest -p <COM port number> write_reg16 <address of 16 bit reg. in hex> <16 bit value in hex> \n");
 
+    printf("prodtest -p <COM port number> bulk_read  <otp|ram|flash> <address in hex> <byte count> <file> \n");
+    printf("prodtest -p <COM port number> bulk_write <otp|ram|flash> <address in hex> <file>              \n");
+
+    printf("prodtest -p <COM port number> load_fw <image file> [<boot ROM baud rate>]                      \n");
+    printf("prodtest -p <COM port number> line <reset|boot|release|<sequence>>                             \n");
+    printf("prodtest -p <COM port list> broadcast <start_cont_tx|stop_cont_tx|unmodulated|start_pkt_rx|start_pkt_rx_stats|stoptest> [<args>] \n");
+    printf("prodtest -p <COM port number> wait_ready [<max. time in ms> [reset]]                           \n");
+    printf("prodtest -p <COM port number> timeouts                                                         \n");
+    printf("prodtest -p <COM port number> plan <plan file> [resume]                                        \n");
+    printf("prodtest journal <journal file>                                                                \n");
+    printf("prodtest pool create <pool file> text <prefix> <first> <count> <digits>                        \n");
+    printf("prodtest pool create <pool file> bdaddr <first BD address> <count>                             \n");
+    printf("prodtest pool status <pool file>                                                               \n");
+    printf("prodtest pool release <pool file> <value>                                                      \n");
+    printf("prodtest history create <index file> <values>                                                  \n");
+    printf("prodtest history import <index file> <journal or csv file> ...                                 \n");
+    printf("prodtest history check <index file> <BD address or SN>                                         \n");
+    printf("prodtest history status <index file>                                                           \n");
+
+    printf("COM port number 0 selects a simulated DUT. \n");
+    printf("-p takes a list of ports for load_fw, line, broadcast, cont_tx_rotate, pkt_rx_all and pkt_rx_per, e.g. -p 3,5,8-11; other commands use the first. \n");
+    printf("pkt_rx_all puts all DUTs into RX at once and sends the packets from the golden unit on \"golden.port\" of the configuration. \n");
+    printf("pkt_rx_per sends sub-bursts of \"per.burst\" packets until each DUT passes or fails, see \"per.good\", \"per.bad\", \"per.alpha\" and \"per.beta\". \n");
+    printf("Option -f <file> reads the configuration from <file> instead of prodtest.cfg. \n");
+    printf("Option -o json|csv writes one record per command, and per plan step, to the standard output; the rest goes to the standard error. \n");
+    printf("write_SN, write_PSN, provision and otp wr_bdaddr take @<pool file> for the SN, PSN or BD address: the next free value of the pool is written. \n");
+    printf("\"history.index = <file>\" in the configuration refuses a BD address or SN written before; history import fills the index from journals and csv records. \n");
+    printf("otp wr_bdaddr auto writes the next address of \"bdaddr.first\" .. \"bdaddr.last\" in the configuration and reads it back. \n");
+    printf("Option -j <file> appends the results to a binary journal, as does \"journal.file = <file>\" in the configuration. \n");
+    printf("Option -c <file> captures the UART traffic into a btsnoop file. \n");
+    printf("Reads are sent again when their reply is lost, \"retry.attempts = <n>\" times in all; a lost reply to an OTP write is checked by reading the OTP back. \n");
+    printf("Reply timeouts are learned per command into prodtest.lat; \"timeout.<opcode> = <ms>\" in the configuration fixes one. \n");
+
     printf("prodtest -v \n");
 }
   
\ No newline at end of file
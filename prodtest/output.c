@@ -0,0 +1,284 @@
+/**
+****************************************************************************************
+*
+* @file output.c
+*
+* @brief Machine-readable records of the commands run (-o json|csv).
+*
+* A record is written when a command, or a plan step, is done: the command
+* and its arguments, the status, the time it took and the return values the
+* handler put in result.c. Records go through a large stdio buffer on a copy
+* of the standard output handle; the handlers' own printout is moved to
+* standard error, so the MES reads the records without any parsing of text.
+* The same records go to the journal when one is open, whatever the format.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <io.h>
+#include <windows.h>
+
+#include "output.h"
+#include "result.h"
+#include "journal.h"
+
+typedef struct {
+	int            argc;
+	char         **argv;
+	int            line;
+	LARGE_INTEGER  start;
+	char           time[24];
+} output_record_t;
+
+static int output_format = OUTPUT_TEXT;
+static int output_port;
+static FILE *output_file;
+static bool output_active;        // records are written to output_file or the journal
+static bool output_header_done;
+
+static output_record_t output_stack[OUTPUT_MAX_DEPTH];
+static int output_depth;
+
+/*
+ ****************************************************************************************
+ * @brief Select the output format and take over standard output for the records.
+ *
+ * @param[in] format  "json", "csv" or "text".
+ * @param[in] port    COM port number written in the records.
+ *
+ * @return false if the format is unknown or standard output cannot be duplicated.
+ ****************************************************************************************
+*/
+bool output_open(const char *format, int port)
+{
+	int fd;
+
+	output_port = port;
+	output_active = journal_is_open();
+
+	if (strcmp(format, "text") == 0)
+	{
+		output_format = OUTPUT_TEXT;
+		return true;
+	}
+
+	if (strcmp(format, "json") == 0)
+		output_format = OUTPUT_JSON;
+	else if (strcmp(format, "csv") == 0)
+		output_format = OUTPUT_CSV;
+	else
+		return false;
+
+	fflush(stdout);
+	fd = _dup(_fileno(stdout));
+	if (fd < 0)
+		return false;
+
+	output_file = _fdopen(fd, "w");
+	if (output_file == NULL)
+	{
+		_close(fd);
+		return false;
+	}
+	setvbuf(output_file, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+	// from now on printf() writes to standard error
+	_dup2(_fileno(stderr), _fileno(stdout));
+	output_active = true;
+
+	return true;
+}
+
+void output_close(void)
+{
+	output_active = false;
+
+	if (output_file == NULL)
+		return;
+
+	fclose(output_file);
+	output_file = NULL;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Start the record of a command; the return values put before this are dropped.
+ *
+ * @param[in] argc, argv  The command and its arguments. Must stay valid until output_end().
+ * @param[in] line        Plan file line of a plan step, 0 otherwise.
+ ****************************************************************************************
+*/
+void output_begin(int argc, char **argv, int line)
+{
+	output_record_t *record;
+	time_t now;
+
+	if (!output_active)
+		return;
+
+	// the records of nested commands beyond the depth are not written
+	if (output_depth++ >= OUTPUT_MAX_DEPTH)
+		return;
+
+	record = &output_stack[output_depth - 1];
+	record->argc = argc;
+	record->argv = argv;
+	record->line = line;
+
+	time(&now);
+	strftime(record->time, sizeof(record->time), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	result_clear();
+	QueryPerformanceCounter(&record->start);
+}
+
+static void output_json_string(const char *str)
+{
+	fputc('"', output_file);
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fprintf(output_file, "\\%c", *str);
+		else if ((unsigned char) *str < 0x20)
+			fprintf(output_file, "\\u%04X", (unsigned char) *str);
+		else
+			fputc(*str, output_file);
+	}
+	fputc('"', output_file);
+}
+
+static void output_csv_string(const char *str)
+{
+	if (strpbrk(str, ",\"\r\n") == NULL)
+	{
+		fputs(str, output_file);
+		return;
+	}
+
+	fputc('"', output_file);
+	for (; *str; str++)
+	{
+		if (*str == '"')
+			fputc('"', output_file);
+		fputc(*str, output_file);
+	}
+	fputc('"', output_file);
+}
+
+static void output_json(const output_record_t *record, int status, double millis)
+{
+	const result_field_t *field;
+	int kk;
+
+	fprintf(output_file, "{\"time\":\"%s\",\"port\":%d,\"command\":", record->time, output_port);
+	output_json_string(record->argv[0]);
+
+	fputs(",\"args\":[", output_file);
+	for (kk = 1; kk < record->argc; kk++)
+	{
+		if (kk > 1)
+			fputc(',', output_file);
+		output_json_string(record->argv[kk]);
+	}
+
+	fprintf(output_file, "],\"line\":%d,\"status\":%d,\"millis\":%.1f,\"values\":{", record->line, status, millis);
+	for (kk = 0; kk < result_count(); kk++)
+	{
+		field = result_field(kk);
+		if (kk > 0)
+			fputc(',', output_file);
+		output_json_string(field->name);
+		fputc(':', output_file);
+		// hex values keep their digits, as a string
+		if (field->type == RESULT_INT || field->type == RESULT_DOUBLE)
+			fputs(field->text, output_file);
+		else
+			output_json_string(field->text);
+	}
+	fputs("}}\n", output_file);
+}
+
+static void output_csv(const output_record_t *record, int status, double millis)
+{
+	char args[1024];
+	const result_field_t *field;
+	size_t len = 0;
+	int kk;
+
+	if (!output_header_done)
+	{
+		fputs("time,port,command,args,line,status,millis,values\n", output_file);
+		output_header_done = true;
+	}
+
+	// the arguments in one column, separated by blanks
+	args[0] = 0;
+	for (kk = 1; kk < record->argc; kk++)
+	{
+		if (len + strlen(record->argv[kk]) + 2 > sizeof(args))
+			break;
+		if (kk > 1)
+			args[len++] = ' ';
+		strcpy(args + len, record->argv[kk]);
+		len += strlen(record->argv[kk]);
+	}
+
+	fprintf(output_file, "%s,%d,", record->time, output_port);
+	output_csv_string(record->argv[0]);
+	fputc(',', output_file);
+	output_csv_string(args);
+	fprintf(output_file, ",%d,%d,%.1f", record->line, status, millis);
+
+	for (kk = 0; kk < result_count(); kk++)
+	{
+		field = result_field(kk);
+		fputc(',', output_file);
+		output_csv_string(field->name);
+		fputc(',', output_file);
+		output_csv_string(field->text);
+	}
+	fputc('\n', output_file);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Write the record of the command started last.
+ *
+ * @param[in] status  Status the command returned.
+ ****************************************************************************************
+*/
+void output_end(int status)
+{
+	output_record_t *record;
+	LARGE_INTEGER now, freq;
+	double millis;
+
+	if (!output_active || output_depth == 0)
+		return;
+
+	if (output_depth-- > OUTPUT_MAX_DEPTH)
+		return;
+
+	record = &output_stack[output_depth];
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	millis = (double) (now.QuadPart - record->start.QuadPart) * 1000.0 / (double) freq.QuadPart;
+
+	journal_append(output_port, record->argc, record->argv, record->line, status, (uint32_t) (millis * 1000.0));
+
+	if (output_format == OUTPUT_JSON)
+		output_json(record, status, millis);
+	else if (output_format == OUTPUT_CSV)
+		output_csv(record, status, millis);
+}
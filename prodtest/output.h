@@ -0,0 +1,54 @@
+/**
+****************************************************************************************
+*
+* @file output.h
+*
+* @brief Machine-readable records of the commands run (-o json|csv).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include "stdbool.h"
+
+/*
+ * With -o json or -o csv, standard output carries one record per command
+ * and nothing else; what the handlers print for the operator goes to
+ * standard error.
+ *
+ * json: one object per line
+ *   {"time":"2015-06-01T08:30:00Z","port":3,"command":"otp","args":["rd_xtrim"],
+ *    "line":0,"status":0,"millis":12.5,"values":{"otp_xtrim_value":1034}}
+ *
+ * csv: a header, then one row per record; the return values follow as
+ * name,value column pairs
+ *   time,port,command,args,line,status,millis,values
+ *   2015-06-01T08:30:00Z,3,otp,rd_xtrim,0,0,12.5,otp_xtrim_value,1034
+ *
+ * "line" is the plan file line of a plan step, 0 for a command run on its own.
+ */
+
+/* output formats */
+#define OUTPUT_TEXT  0
+#define OUTPUT_JSON  1
+#define OUTPUT_CSV   2
+
+#define OUTPUT_BUFFER_SIZE  0x10000
+#define OUTPUT_MAX_DEPTH    4     // a plan step runs inside the plan command
+
+bool output_open(const char *format, int port);
+void output_close(void);
+
+void output_begin(int argc, char **argv, int line);
+void output_end(int status);
+
+#endif /* _OUTPUT_H_ */
@@ -0,0 +1,97 @@
+/**
+****************************************************************************************
+*
+* @file per.c
+*
+* @brief Packet error rate test that stops as soon as a sequential probability
+*        ratio test has decided pass or fail.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "per.h"
+#include "config.h"
+
+/*
+ ****************************************************************************************
+ * @brief Thresholds of the test, from the configuration.
+ *
+ * @return false if the configuration does not make a test, e.g. per.good >= per.bad.
+ ****************************************************************************************
+*/
+bool per_sprt_init(per_sprt_t *sprt)
+{
+	double p0 = config_get_double(PER_CONFIG_GOOD, PER_DEFAULT_GOOD) / 100;
+	double p1 = config_get_double(PER_CONFIG_BAD, PER_DEFAULT_BAD) / 100;
+	double alpha = config_get_double(PER_CONFIG_ALPHA, PER_DEFAULT_ALPHA);
+	double beta = config_get_double(PER_CONFIG_BETA, PER_DEFAULT_BETA);
+
+	sprt->burst = config_get_long(PER_CONFIG_BURST, PER_DEFAULT_BURST);
+
+	if (!(p0 > 0 && p0 < p1 && p1 < 1) || !(alpha > 0 && alpha < 0.5) || !(beta > 0 && beta < 0.5)
+	    || sprt->burst <= 0 || sprt->burst > 0xFFFF)
+	{
+		fprintf(stderr, "per: need 0 < %s < %s < 100, 0 < %s, %s < 0.5 and 0 < %s <= 65535\n",
+			PER_CONFIG_GOOD, PER_CONFIG_BAD, PER_CONFIG_ALPHA, PER_CONFIG_BETA, PER_CONFIG_BURST);
+		return false;
+	}
+
+	sprt->error_llr = log(p1 / p0);
+	sprt->good_llr = log((1 - p1) / (1 - p0));
+	sprt->pass_below = log(beta / (1 - alpha));
+	sprt->fail_above = log((1 - beta) / alpha);
+
+	return true;
+}
+
+double per_llr(const per_sprt_t *sprt, unsigned long packets, unsigned long errors)
+{
+	return errors * sprt->error_llr + (packets - errors) * sprt->good_llr;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Weigh the packets of a DUT so far.
+ *
+ *  @param[in] packets  Packets sent to the DUT.
+ *  @param[in] errors   Of them, the ones not received correctly.
+ *  @param[in] last     No more packets will be sent: decide anyway.
+ *
+ * @return PER_UNDECIDED / PER_PASS / PER_FAIL.
+ ****************************************************************************************
+*/
+int per_update(const per_sprt_t *sprt, unsigned long packets, unsigned long errors, bool last)
+{
+	double llr = per_llr(sprt, packets, errors);
+
+	if (llr <= sprt->pass_below)
+		return PER_PASS;
+	if (llr >= sprt->fail_above)
+		return PER_FAIL;
+	if (!last)
+		return PER_UNDECIDED;
+
+	// truncated: the hypothesis the ratio is nearer to
+	return llr - sprt->pass_below <= sprt->fail_above - llr ? PER_PASS : PER_FAIL;
+}
+
+const char *per_verdict_name(int verdict)
+{
+	switch (verdict)
+	{
+		case PER_PASS: return "pass";
+		case PER_FAIL: return "fail";
+	}
+
+	return "undecided";
+}
@@ -0,0 +1,70 @@
+/**
+****************************************************************************************
+*
+* @file per.h
+*
+* @brief Packet error rate test that stops as soon as a sequential probability
+*        ratio test (SPRT) has decided pass or fail (pkt_rx_per).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _PER_H_
+#define _PER_H_
+
+#include <stdint.h>
+
+#include "stdbool.h"
+
+/*
+ * The golden unit sends sub-bursts of "per.burst" packets to the DUTs, as
+ * pkt_rx_all does; after each one the errors of every DUT so far are weighed:
+ * a packet not received correctly adds ln(p1 / p0) to the log-likelihood
+ * ratio of the DUT, a good one ln((1 - p1) / (1 - p0)), with p0 the PER of a
+ * good DUT ("per.good") and p1 that of a bad one ("per.bad"), in percent. The
+ * DUT passes once the ratio is below ln(beta / (1 - alpha)) and fails once it
+ * is above ln((1 - beta) / alpha): alpha ("per.alpha") is the risk to fail a
+ * good DUT, beta ("per.beta") that to pass a bad one. A DUT decided is left
+ * out of the next sub-bursts. One still undecided after the max. number of
+ * packets gets the hypothesis its ratio is nearer to.
+ */
+#define PER_CONFIG_GOOD   "per.good"
+#define PER_CONFIG_BAD    "per.bad"
+#define PER_CONFIG_ALPHA  "per.alpha"
+#define PER_CONFIG_BETA   "per.beta"
+#define PER_CONFIG_BURST  "per.burst"
+
+/* the BLE receiver sensitivity is given at a PER of 30.8% */
+#define PER_DEFAULT_GOOD   10.0
+#define PER_DEFAULT_BAD    30.8
+#define PER_DEFAULT_ALPHA  0.001
+#define PER_DEFAULT_BETA   0.001
+#define PER_DEFAULT_BURST  100
+
+/* per_update() */
+#define PER_UNDECIDED  0
+#define PER_PASS       1
+#define PER_FAIL       2
+
+typedef struct {
+	double error_llr;         // ln(p1 / p0)
+	double good_llr;          // ln((1 - p1) / (1 - p0))
+	double pass_below;        // ln(beta / (1 - alpha))
+	double fail_above;        // ln((1 - beta) / alpha)
+	long   burst;
+} per_sprt_t;
+
+bool per_sprt_init(per_sprt_t *sprt);
+
+int  per_update(const per_sprt_t *sprt, unsigned long packets, unsigned long errors, bool last);
+double per_llr(const per_sprt_t *sprt, unsigned long packets, unsigned long errors);
+const char *per_verdict_name(int verdict);
+
+#endif /* _PER_H_ */
@@ -0,0 +1,847 @@
+/**
+****************************************************************************************
+*
+* @file plan.c
+*
+* @brief Test plans: a station flow of prodtest commands, run in one process.
+*
+* The plan file is compiled once into a list of steps, with the handlers looked
+* up, the arguments split and the labels resolved; running a step is then a call
+* of its handler on the port that stays open for the whole plan. See plan.h for
+* the format.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+
+#include "plan.h"
+#include "output.h"
+#include "journal.h"
+#include "bdaddr.h"
+#include "config.h"
+
+static char *plan_strdup(const char *s)
+{
+	char *copy = (char *) malloc(strlen(s) + 1);
+
+	if (copy != NULL)
+		strcpy(copy, s);
+
+	return copy;
+}
+
+// split a line in place into blank separated words, up to a '#'
+static int plan_split(char *line, char **words, int max)
+{
+	int count = 0;
+	char *p = line;
+
+	for (;;)
+	{
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == 0 || *p == '#' || count == max)
+			break;
+
+		words[count++] = p;
+		while (*p && *p != ' ' && *p != '\t')
+			p++;
+		if (*p)
+			*p++ = 0;
+	}
+
+	return count;
+}
+
+static bool plan_number(const char *s, double *value)
+{
+	char *endptr;
+
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		*value = (double) strtoul(s, &endptr, 16);
+	else
+		*value = strtod(s, &endptr);
+
+	return endptr != s && *endptr == 0;
+}
+
+static bool plan_compare_op(const char *s, int *op)
+{
+	if (strcmp(s, "<") == 0)       *op = PLAN_LT;
+	else if (strcmp(s, "<=") == 0) *op = PLAN_LE;
+	else if (strcmp(s, "==") == 0) *op = PLAN_EQ;
+	else if (strcmp(s, "!=") == 0) *op = PLAN_NE;
+	else if (strcmp(s, ">=") == 0) *op = PLAN_GE;
+	else if (strcmp(s, ">") == 0)  *op = PLAN_GT;
+	else return false;
+
+	return true;
+}
+
+// clauses after the command: words[0] is the first word after a '|'
+static bool plan_clause(plan_op_t *op, char **words, int count)
+{
+	plan_limit_t *limit;
+
+	if (count == 4 && strcmp(words[0], "when") == 0)
+	{
+		op->has_when = true;
+		op->when.name = plan_strdup(words[1]);
+		return plan_compare_op(words[2], &op->when.op) && plan_number(words[3], &op->when.value);
+	}
+
+	if (count == 4 && strcmp(words[0], "limit") == 0)
+	{
+		if (op->limit_count == PLAN_MAX_LIMITS)
+			return false;
+		limit = &op->limits[op->limit_count++];
+		limit->name = plan_strdup(words[1]);
+		limit->has_min = strcmp(words[2], "-") != 0;
+		limit->has_max = strcmp(words[3], "-") != 0;
+		if (limit->has_min && !plan_number(words[2], &limit->min))
+			return false;
+		if (limit->has_max && !plan_number(words[3], &limit->max))
+			return false;
+		return true;
+	}
+
+	if (count == 1 && strcmp(words[0], "golden") == 0)
+	{
+		op->golden = true;
+		return true;
+	}
+
+	if (count == 1 && strcmp(words[0], "anytime") == 0)
+	{
+		op->anytime = true;
+		return true;
+	}
+
+	if (count == 2 && strcmp(words[0], "onfail") == 0)
+	{
+		if (strcmp(words[1], "stop") == 0)
+			op->onfail = PLAN_ONFAIL_STOP;
+		else if (strcmp(words[1], "continue") == 0)
+			op->onfail = PLAN_ONFAIL_CONTINUE;
+		else
+			op->onfail_label = plan_strdup(words[1]);
+		return true;
+	}
+
+	return false;
+}
+
+// compile the words of one step
+static bool plan_step(plan_op_t *op, char **words, int count)
+{
+	int kk, start;
+
+	// the command and its arguments end at the first '|'
+	for (kk = 0; kk < count && strcmp(words[kk], "|") != 0; kk++)
+		;
+	if (kk > PLAN_MAX_ARGS)
+		return false;
+	op->argc = kk;
+
+	if (strcmp(words[0], "goto") == 0)
+	{
+		if (op->argc != 2)
+			return false;
+		op->kind = PLAN_OP_GOTO;
+		op->target_label = plan_strdup(words[1]);
+	}
+	else if (strcmp(words[0], "pass") == 0)
+	{
+		if (op->argc != 1)
+			return false;
+		op->kind = PLAN_OP_PASS;
+	}
+	else if (strcmp(words[0], "fail") == 0)
+	{
+		if (op->argc > 2)
+			return false;
+		op->kind = PLAN_OP_FAIL;
+		op->status = SC_PLAN_FAILED;
+		if (op->argc == 2)
+			op->status = atoi(words[1]);
+	}
+	else
+	{
+		op->kind = PLAN_OP_COMMAND;
+		op->handler = cmd_lookup(words[0]);
+		if (op->handler == NULL || op->handler == plan_cmd_handler)
+		{
+			fprintf(stderr, "plan: line %d: unknown command \"%s\" \n", op->line, words[0]);
+			return false;
+		}
+	}
+
+	for (kk = 0; kk < op->argc; kk++)
+		op->argv[kk] = plan_strdup(words[kk]);
+
+	// clauses
+	while (kk < count)
+	{
+		start = ++kk; // after the '|'
+		while (kk < count && strcmp(words[kk], "|") != 0)
+			kk++;
+		if (kk == start || !plan_clause(op, &words[start], kk - start))
+			return false;
+	}
+
+	// a step that may run early must not depend on the steps before it
+	if (op->anytime)
+	{
+		if (op->kind != PLAN_OP_COMMAND || op->golden || op->has_when || op->onfail_label != NULL)
+			return false;
+		for (kk = 1; kk < op->argc; kk++)
+			if (op->argv[kk][0] == '$')
+				return false;
+	}
+
+	return true;
+}
+
+static int plan_find_label(plan_t *plan, const char *name)
+{
+	int kk;
+
+	for (kk = 0; kk < plan->label_count; kk++)
+		if (strcmp(plan->label_names[kk], name) == 0)
+			return plan->label_steps[kk];
+
+	return -1;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read and compile a plan.
+ *
+ *  @param[out] plan  Compiled plan, to be freed with plan_free().
+ *  @param[in]  path  Plan file.
+ *
+ * @return false if the file cannot be read or is not a valid plan; the reason has
+ *         been printed.
+ ****************************************************************************************
+*/
+bool plan_load(plan_t *plan, const char *path)
+{
+	char line[PLAN_MAX_LINE_LEN];
+	char spaced[3 * PLAN_MAX_LINE_LEN];
+	char *words[PLAN_MAX_ARGS + 4 * PLAN_MAX_LIMITS + 8];
+	int count, line_number = 0, kk, nn;
+	char *colon;
+	plan_op_t *op;
+	FILE *fp;
+	bool ok = true;
+
+	memset(plan, 0, sizeof(plan_t));
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		fprintf(stderr, "plan: cannot read \"%s\" \n", path);
+		return false;
+	}
+
+	while (ok && fgets(line, sizeof(line), fp) != NULL)
+	{
+		line_number++;
+		line[strcspn(line, "\r\n")] = 0;
+
+		// '|' is a word of its own, blanks around it or not
+		for (kk = 0, nn = 0; line[kk]; kk++)
+		{
+			if (line[kk] == '|')
+			{
+				spaced[nn++] = ' ';
+				spaced[nn++] = '|';
+				spaced[nn++] = ' ';
+			}
+			else
+				spaced[nn++] = line[kk];
+		}
+		spaced[nn] = 0;
+
+		count = plan_split(spaced, words, sizeof(words) / sizeof(words[0]));
+		if (count == 0)
+			continue;
+
+		// label
+		colon = words[0] + strlen(words[0]) - 1;
+		if (*colon == ':')
+		{
+			*colon = 0;
+			if (plan->label_count == PLAN_MAX_STEPS || plan_find_label(plan, words[0]) >= 0)
+			{
+				fprintf(stderr, "plan: line %d: label \"%s\" defined twice \n", line_number, words[0]);
+				ok = false;
+				break;
+			}
+			plan->label_names[plan->label_count] = plan_strdup(words[0]);
+			plan->label_steps[plan->label_count++] = plan->count;
+			for (kk = 1; kk < count; kk++)
+				words[kk - 1] = words[kk];
+			if (--count == 0)
+				continue;
+		}
+
+		if (plan->count == PLAN_MAX_STEPS)
+		{
+			fprintf(stderr, "plan: line %d: more than %d steps \n", line_number, PLAN_MAX_STEPS);
+			ok = false;
+			break;
+		}
+
+		op = &plan->ops[plan->count++];
+		op->line = line_number;
+		op->onfail = PLAN_ONFAIL_STOP;
+		if (!plan_step(op, words, count))
+		{
+			fprintf(stderr, "plan: line %d: invalid step \n", line_number);
+			ok = false;
+		}
+	}
+
+	fclose(fp);
+
+	// resolve the labels; one at the end of the plan ends it, passed
+	for (kk = 0; ok && kk < plan->count; kk++)
+	{
+		op = &plan->ops[kk];
+		if (op->target_label != NULL && (op->target = plan_find_label(plan, op->target_label)) < 0)
+			ok = false;
+		if (op->onfail_label != NULL && (op->onfail = plan_find_label(plan, op->onfail_label)) < 0)
+			ok = false;
+		if (!ok)
+			fprintf(stderr, "plan: line %d: unknown label \n", op->line);
+	}
+
+	if (!ok)
+		plan_free(plan);
+
+	return ok;
+}
+
+void plan_free(plan_t *plan)
+{
+	plan_op_t *op;
+	int kk, aa;
+
+	for (kk = 0; kk < plan->count; kk++)
+	{
+		op = &plan->ops[kk];
+		for (aa = 0; aa < op->argc; aa++)
+			free(op->argv[aa]);
+		for (aa = 0; aa < op->limit_count; aa++)
+			free(op->limits[aa].name);
+		free(op->when.name);
+		free(op->target_label);
+		free(op->onfail_label);
+	}
+
+	for (kk = 0; kk < plan->label_count; kk++)
+		free(plan->label_names[kk]);
+
+	free(plan->checkpoint);
+
+	memset(plan, 0, sizeof(plan_t));
+}
+
+static result_field_t *plan_var(plan_t *plan, const char *name)
+{
+	int kk;
+
+	for (kk = 0; kk < plan->var_count; kk++)
+		if (strcmp(plan->vars[kk].name, name) == 0)
+			return &plan->vars[kk];
+
+	return NULL;
+}
+
+// keep the return values of the step just run
+static void plan_keep_results(plan_t *plan)
+{
+	const result_field_t *field;
+	result_field_t *var;
+	int kk;
+
+	for (kk = 0; kk < result_count(); kk++)
+	{
+		field = result_field(kk);
+		var = plan_var(plan, field->name);
+		if (var == NULL)
+		{
+			if (plan->var_count == PLAN_MAX_VARS)
+				continue;
+			var = &plan->vars[plan->var_count++];
+		}
+		*var = *field;
+	}
+}
+
+static bool plan_when(plan_t *plan, const plan_cond_t *cond)
+{
+	result_field_t *var = plan_var(plan, cond->name);
+
+	if (var == NULL || var->type == RESULT_STR)
+		return false;
+
+	switch (cond->op)
+	{
+		case PLAN_LT: return var->number <  cond->value;
+		case PLAN_LE: return var->number <= cond->value;
+		case PLAN_EQ: return var->number == cond->value;
+		case PLAN_NE: return var->number != cond->value;
+		case PLAN_GE: return var->number >= cond->value;
+		case PLAN_GT: return var->number >  cond->value;
+	}
+
+	return false;
+}
+
+// an OTP write: done once in the life of a DUT
+static bool plan_one_shot(const plan_op_t *op)
+{
+	if (strcmp(op->argv[0], "otp_write") == 0)
+		return true;
+
+	if (op->argc >= 2 && strcmp(op->argv[0], "otp") == 0)
+		return strcmp(op->argv[1], "wr_xtrim") == 0 || strcmp(op->argv[1], "wr_bdaddr") == 0
+			|| strcmp(op->argv[1], "we_xtrim") == 0;
+
+	if (op->argc >= 2 && strcmp(op->argv[0], "bulk_write") == 0)
+		return strcmp(op->argv[1], "otp") == 0;
+
+	return false;
+}
+
+// the step of the plan that a journal record is of; -1 if none
+static int plan_step_of(plan_t *plan, const journal_record_t *rec)
+{
+	plan_op_t *op;
+	int kk, nn;
+
+	for (kk = 0; kk < plan->count; kk++)
+	{
+		op = &plan->ops[kk];
+		if (op->kind != PLAN_OP_COMMAND || op->line != rec->line || op->argc != rec->argc)
+			continue;
+
+		// a $<name> argument may have had any value
+		for (nn = 0; nn < op->argc; nn++)
+			if (op->argv[nn][0] != '$' && strncmp(op->argv[nn], rec->argv[nn], JOURNAL_MAX_ARG_LEN - 1) != 0)
+				break;
+
+		return nn == op->argc ? kk : -1;
+	}
+
+	return -1;
+}
+
+// pass 1: the sessions in which the DUT was identified
+static void plan_find_sessions(const journal_record_t *rec, void *ctx)
+{
+	plan_checkpoint_t *cp = ((plan_t *) ctx)->checkpoint;
+	const char *bd_addr = journal_dut_bd_addr();
+	const char *sn = journal_dut_sn();
+	int kk;
+
+	if (rec->session == journal_session_id())
+		return;
+	if (!(bd_addr[0] && strcmp(rec->bd_addr, bd_addr) == 0) && !(sn[0] && strcmp(rec->sn, sn) == 0))
+		return;
+
+	for (kk = 0; kk < cp->session_count; kk++)
+		if (cp->sessions[kk] == rec->session)
+			return;
+
+	if (cp->session_count < PLAN_RESUME_MAX_SESSIONS)
+		cp->sessions[cp->session_count++] = rec->session;
+}
+
+// pass 2: the steps that passed in those sessions
+static void plan_find_steps(const journal_record_t *rec, void *ctx)
+{
+	plan_t *plan = (plan_t *) ctx;
+	plan_checkpoint_t *cp = plan->checkpoint;
+	int step, kk;
+
+	for (kk = 0; kk < cp->session_count; kk++)
+		if (cp->sessions[kk] == rec->session)
+			break;
+	if (kk == cp->session_count || rec->line == 0 || rec->status != SC_NO_ERROR)
+		return;
+
+	step = plan_step_of(plan, rec);
+	if (step < 0)
+		return;
+
+	if (rec->session > cp->last_session)
+		cp->last_session = rec->session;
+	cp->step_session[step] = rec->session;
+	if (plan_one_shot(&plan->ops[step]))
+		cp->one_shot_done[step] = true;
+
+	if (cp->value_count + rec->value_count > PLAN_RESUME_MAX_VALUES)
+	{
+		cp->first[step] = -1;
+		return;
+	}
+	cp->first[step] = cp->value_count;
+	cp->count[step] = rec->value_count;
+	memcpy(&cp->values[cp->value_count], rec->values, rec->value_count * sizeof(result_field_t));
+	cp->value_count += rec->value_count;
+}
+
+// read the checkpoint of the DUT from the journal, as soon as a step has told who it is
+static void plan_load_checkpoint(plan_t *plan)
+{
+	plan_checkpoint_t *cp;
+	int done = 0;
+	int kk;
+
+	if (!plan->resume || plan->checkpoint != NULL)
+		return;
+	if (journal_dut_bd_addr()[0] == 0 && journal_dut_sn()[0] == 0)
+		return;
+
+	cp = (plan_checkpoint_t *) calloc(1, sizeof(plan_checkpoint_t));
+	if (cp == NULL)
+	{
+		plan->resume = false;
+		return;
+	}
+	for (kk = 0; kk < PLAN_MAX_STEPS; kk++)
+		cp->first[kk] = -1;
+	plan->checkpoint = cp;
+
+	journal_scan(NULL, plan_find_sessions, plan);
+	if (cp->session_count != 0)
+		journal_scan(NULL, plan_find_steps, plan);
+
+	for (kk = 0; kk < plan->count; kk++)
+		if (cp->step_session[kk] != 0 && cp->step_session[kk] == cp->last_session)
+			done++;
+
+	printf("resume: %d sessions of the DUT in the journal, %d steps passed in the last one\n", cp->session_count, done);
+}
+
+// whether a step is taken from the checkpoint instead of run
+static bool plan_resumed(plan_t *plan, const plan_op_t *op)
+{
+	plan_checkpoint_t *cp = plan->checkpoint;
+	int step = (int) (op - plan->ops);
+
+	if (cp == NULL)
+		return false;
+
+	if (plan->resuming && cp->step_session[step] == cp->last_session && cp->last_session != 0
+		&& cp->first[step] >= 0)
+		return true;
+
+	// from here on the steps run, except the OTP writes done before
+	plan->resuming = false;
+
+	return cp->one_shot_done[step];
+}
+
+// put the return values the journal holds of a step, as if it had just run
+static void plan_restore(plan_t *plan, const plan_op_t *op)
+{
+	plan_checkpoint_t *cp = plan->checkpoint;
+	const result_field_t *field;
+	int step = (int) (op - plan->ops);
+	int kk;
+
+	printf("line %d: %s %s\n", op->line, op->argv[0],
+		plan->resuming ? "taken from the journal" : "was done before, not repeated");
+
+	if (cp->first[step] < 0)
+		return;
+
+	for (kk = 0; kk < cp->count[step]; kk++)
+	{
+		field = &cp->values[cp->first[step] + kk];
+		switch (field->type)
+		{
+			case RESULT_INT:    result_put_int(field->name, (long) field->number); break;
+			case RESULT_HEX:    result_put_hex(field->name, (unsigned long) field->number, (int) strlen(field->text)); break;
+			case RESULT_DOUBLE: result_put_double(field->name, field->number); break;
+			default:            result_put_str(field->name, field->text); break;
+		}
+	}
+}
+
+// run one command step, return its status
+static int plan_command(plan_t *plan, plan_op_t *op)
+{
+	char *argv[PLAN_MAX_ARGS];
+	const result_field_t *field;
+	result_field_t *var;
+	plan_limit_t *limit;
+	int status;
+	int kk;
+
+	for (kk = 0; kk < op->argc; kk++)
+	{
+		argv[kk] = op->argv[kk];
+		if (argv[kk][0] != '$')
+			continue;
+
+		var = plan_var(plan, argv[kk] + 1);
+		if (var == NULL)
+		{
+			fprintf(stderr, "plan: line %d: no value for %s \n", op->line, argv[kk]);
+			return SC_PLAN_ERROR;
+		}
+		argv[kk] = var->text;
+	}
+
+	result_clear();
+	output_begin(op->argc, argv, op->line);
+	if (plan_resumed(plan, op))
+	{
+		plan_restore(plan, op);
+		status = SC_NO_ERROR;
+	}
+	else
+	{
+		status = op->handler(op->argc, argv);
+	}
+	plan_keep_results(plan);
+
+	for (kk = 0; kk < op->limit_count && status == SC_NO_ERROR; kk++)
+	{
+		limit = &op->limits[kk];
+		field = result_find(limit->name);
+		if (field == NULL || field->type == RESULT_STR
+			|| (limit->has_min && field->number < limit->min)
+			|| (limit->has_max && field->number > limit->max))
+		{
+			printf("limit %s = %s fails \n", limit->name, field ? field->text : "(none)");
+			status = SC_LIMIT_FAILED;
+		}
+	}
+
+	output_end(status);
+
+	plan_load_checkpoint(plan);
+
+	return status;
+}
+
+// the next anytime step after pc not run yet, -1 if there is none
+static int plan_next_anytime(plan_t *plan, int pc)
+{
+	int kk;
+
+	for (kk = pc + 1; kk < plan->count; kk++)
+		if (plan->ops[kk].anytime && !plan->early_done[kk])
+			return kk;
+
+	return -1;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Lease the golden unit for the golden steps from pc on. While another DUT
+ *        holds it, the anytime steps after pc are run.
+ *
+ *  @param[in,out] failed  Step that failed, if an anytime step ended the plan.
+ *
+ * @return SC_NO_ERROR with the lease held, else the status that ends the plan.
+ ****************************************************************************************
+*/
+static int plan_lease_golden(plan_t *plan, int pc, int *failed)
+{
+	char name[sizeof(PLAN_GOLDEN_MUTEX_PREFIX) + 64];
+	long timeout = config_get_long(PLAN_GOLDEN_CONFIG_TIMEOUT, PLAN_GOLDEN_DEFAULT_TIMEOUT);
+	DWORD start = GetTickCount();
+	DWORD elapsed, wait;
+	HANDLE mutex;
+	plan_op_t *op;
+	int next, status;
+
+	strcpy(name, PLAN_GOLDEN_MUTEX_PREFIX);
+	strncat(name, config_get(PLAN_GOLDEN_CONFIG_NAME, PLAN_GOLDEN_DEFAULT_NAME), 63);
+
+	mutex = CreateMutex(NULL, FALSE, name);
+	if (mutex == NULL)
+		return SC_GOLDEN_UNIT_BUSY;
+
+	for (;;)
+	{
+		// a DUT that stopped while holding the lease leaves it abandoned
+		wait = WaitForSingleObject(mutex, 0);
+		if (wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED)
+			break;
+
+		next = plan_next_anytime(plan, pc);
+		if (next < 0)
+		{
+			elapsed = GetTickCount() - start;
+			wait = WaitForSingleObject(mutex, (long) elapsed < timeout ? (DWORD) (timeout - elapsed) : 0);
+			if (wait == WAIT_OBJECT_0 || wait == WAIT_ABANDONED)
+				break;
+			fprintf(stderr, "plan: line %d: the golden unit stayed busy \n", plan->ops[pc].line);
+			CloseHandle(mutex);
+			*failed = pc;
+			return SC_GOLDEN_UNIT_BUSY;
+		}
+
+		op = &plan->ops[next];
+		plan->early_done[next] = true;
+		status = plan_command(plan, op);
+		printf("line %d: %s = %d, run while the golden unit is busy\n", op->line, op->argv[0], status);
+
+		if (status != SC_NO_ERROR && op->onfail == PLAN_ONFAIL_STOP)
+		{
+			CloseHandle(mutex);
+			*failed = next;
+			return status;
+		}
+	}
+
+	plan->golden_lease = mutex;
+	plan->golden_wait += GetTickCount() - start;
+
+	return SC_NO_ERROR;
+}
+
+static void plan_release_golden(plan_t *plan)
+{
+	if (plan->golden_lease == NULL)
+		return;
+
+	ReleaseMutex(plan->golden_lease);
+	CloseHandle(plan->golden_lease);
+	plan->golden_lease = NULL;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Run a compiled plan.
+ *
+ * @return SC_NO_ERROR if it passed, else the status of the step that ended it.
+ ****************************************************************************************
+*/
+int plan_run(plan_t *plan)
+{
+	plan_op_t *op;
+	int pc = 0;
+	int status = SC_NO_ERROR;
+	int steps = 0;
+	DWORD start = GetTickCount();
+	DWORD step_start;
+	int kk;
+
+	plan->var_count = 0;
+	plan->resuming = plan->resume;
+	plan->golden_wait = 0;
+	memset(plan->early_done, 0, sizeof(plan->early_done));
+
+	// the BD address is taken while the tests before the OTP write run
+	for (kk = 0; kk < plan->count; kk++)
+	{
+		op = &plan->ops[kk];
+		if (op->kind == PLAN_OP_COMMAND && op->argc == 3 && strcmp(op->argv[0], "otp") == 0
+		    && strcmp(op->argv[1], "wr_bdaddr") == 0 && strcmp(op->argv[2], "auto") == 0)
+		{
+			bdaddr_prefetch();
+			break;
+		}
+	}
+
+	while (pc < plan->count)
+	{
+		op = &plan->ops[pc];
+
+		// a loop of gotos only would never end
+		if (++steps > 100 * PLAN_MAX_STEPS)
+		{
+			status = SC_PLAN_ERROR;
+			break;
+		}
+
+		if (op->kind == PLAN_OP_GOTO)
+		{
+			pc = op->target;
+			continue;
+		}
+		if (op->kind == PLAN_OP_PASS)
+			break;
+		if (op->kind == PLAN_OP_FAIL)
+		{
+			status = op->status;
+			break;
+		}
+
+		// already run while waiting for the golden unit
+		if (plan->early_done[pc])
+		{
+			plan->early_done[pc] = false;
+			pc++;
+			continue;
+		}
+
+		if (!op->golden)
+			plan_release_golden(plan);
+
+		if (op->has_when && !plan_when(plan, &op->when))
+		{
+			pc++;
+			continue;
+		}
+
+		if (op->golden && plan->golden_lease == NULL)
+		{
+			status = plan_lease_golden(plan, pc, &pc);
+			if (status != SC_NO_ERROR)
+				break;
+		}
+
+		step_start = GetTickCount();
+		status = plan_command(plan, op);
+		printf("line %d: %s = %d, %u ms\n", op->line, op->argv[0], status, (unsigned int) (GetTickCount() - step_start));
+
+		if (status != SC_NO_ERROR && op->onfail == PLAN_ONFAIL_STOP)
+			break;
+
+		if (status != SC_NO_ERROR && op->onfail >= 0)
+			pc = op->onfail;
+		else
+			pc++;
+		status = SC_NO_ERROR;
+	}
+
+	plan_release_golden(plan);
+
+	printf("plan time = %u ms\n", (unsigned int) (GetTickCount() - start));
+
+	// return values of the plan itself: the line that ended it, if it failed
+	result_clear();
+	if (status != SC_NO_ERROR && pc < plan->count)
+		result_put_int("failed_line", plan->ops[pc].line);
+
+	for (pc = 0; pc < plan->count && !plan->ops[pc].golden; pc++)
+		;
+	if (pc < plan->count)
+	{
+		printf("golden wait = %u ms\n", (unsigned int) plan->golden_wait);
+		result_put_int("golden_wait_ms", plan->golden_wait);
+	}
+
+	return status;
+}
@@ -0,0 +1,174 @@
+/**
+****************************************************************************************
+*
+* @file plan.h
+*
+* @brief Test plans: a station flow of prodtest commands, run in one process.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _PLAN_H_
+#define _PLAN_H_
+
+#include <windows.h>
+
+#include "stdbool.h"
+#include "commands.h"
+#include "result.h"
+
+/*
+ * A plan file has one step per line, '#' starts a comment:
+ *
+ *   [<label>:] <command> [<arg> ...] [| <clause>] ...
+ *
+ * <command> is any prodtest command, with its usual arguments, or
+ *   goto <label>        go on at <label>
+ *   pass                end the plan, passed
+ *   fail [<status>]     end the plan, failed with <status> (SC_PLAN_FAILED)
+ *
+ * Clauses:
+ *   when <name> <op> <number>     run the step only if an earlier return value
+ *                                 compares true; <op> is < <= == != >= >
+ *   limit <name> <min> <max>      the step fails unless its return value <name>
+ *                                 is within [<min>, <max>]; '-' leaves a side open
+ *   onfail <label>|continue|stop  when the step fails: go on at <label>, go on
+ *                                 with the next step, or end the plan (default)
+ *   golden                        the step needs the golden unit of the fixture
+ *   anytime                       the step stands on its own (no when, no $<name>,
+ *                                 no onfail <label>) and may run early
+ *
+ * An argument $<name> is replaced with the last return value of that name, as
+ * the command printed it, e.g.  otp wr_xtrim $trim_value
+ *
+ * Example:
+ *         xtrim cal 7                | limit trim_value 800 1300 | onfail no_trim
+ *         otp wr_xtrim $trim_value
+ *         start_pkt_rx_stats 19
+ *         stop_pkt_rx_stats          | limit nb_packets_received_correctly 900 - | limit rssi -70 -
+ *         pass
+ *   no_trim: fail 100
+ *
+ * "plan <file> resume" picks up a flow that a station crash cut short, from the
+ * journal (-j). Once a step has told who the DUT is (otp rd_bdaddr, read_SN, ...),
+ * the steps that passed in the last session of that DUT are not run again: their
+ * return values are taken from the journal, up to the first step that did not
+ * pass there. An OTP write that passed in any session of the DUT is never repeated.
+ * Identify the DUT early in the plan; the steps before that are run again.
+ *
+ * One golden unit serves the DUTs of a fixture, each DUT run by a prodtest of
+ * its own. A run of consecutive golden steps leases the unit ("golden.name" in
+ * the configuration names it), so that an RF test runs back to back with no
+ * other DUT in between; the lease ends with the first step that is not golden.
+ * While another DUT holds the lease, the plan runs its later anytime steps (OTP,
+ * serial number, vbat...) instead of waiting; they are not run again when the
+ * plan gets to them. Waiting longer than "golden.timeout" ms fails the plan.
+ */
+
+#define PLAN_MAX_STEPS     256
+#define PLAN_MAX_ARGS      64   // otp_write takes up to 60 words
+#define PLAN_MAX_LIMITS    8
+#define PLAN_MAX_LINE_LEN  1024
+#define PLAN_MAX_VARS      256
+#define PLAN_RESUME_MAX_SESSIONS  64
+#define PLAN_RESUME_MAX_VALUES    2048
+
+#define PLAN_GOLDEN_CONFIG_NAME     "golden.name"
+#define PLAN_GOLDEN_CONFIG_TIMEOUT  "golden.timeout"
+#define PLAN_GOLDEN_DEFAULT_NAME    "golden"
+#define PLAN_GOLDEN_DEFAULT_TIMEOUT 600000
+#define PLAN_GOLDEN_MUTEX_PREFIX    "prodtest_golden_"
+
+/* plan_op_t.kind */
+#define PLAN_OP_COMMAND  0
+#define PLAN_OP_GOTO     1
+#define PLAN_OP_PASS     2
+#define PLAN_OP_FAIL     3
+
+/* plan_op_t.onfail, or the index of the step to go on with */
+#define PLAN_ONFAIL_STOP      -1
+#define PLAN_ONFAIL_CONTINUE  -2
+
+/* plan_cond_t.op */
+enum { PLAN_LT, PLAN_LE, PLAN_EQ, PLAN_NE, PLAN_GE, PLAN_GT };
+
+typedef struct {
+	char   *name;
+	int     op;
+	double  value;
+} plan_cond_t;
+
+typedef struct {
+	char   *name;
+	bool    has_min, has_max;
+	double  min, max;
+} plan_limit_t;
+
+typedef struct {
+	int            kind;
+	int            line;              // in the plan file
+	cmd_handler_t  handler;
+	int            argc;
+	char          *argv[PLAN_MAX_ARGS];
+	bool           has_when;
+	plan_cond_t    when;
+	int            limit_count;
+	plan_limit_t   limits[PLAN_MAX_LIMITS];
+	int            onfail;
+	bool           golden;            // needs the golden unit
+	bool           anytime;           // may run early, while waiting for the golden unit
+	int            target;            // PLAN_OP_GOTO: step index
+	int            status;            // PLAN_OP_FAIL
+	char          *target_label;      // until resolved
+	char          *onfail_label;
+} plan_op_t;
+
+/* what the journal holds of earlier sessions of the DUT */
+typedef struct {
+	unsigned long long sessions[PLAN_RESUME_MAX_SESSIONS]; // of the DUT
+	int            session_count;
+	unsigned long long last_session;
+	unsigned long long step_session[PLAN_MAX_STEPS];       // last session the step passed in
+	bool           one_shot_done[PLAN_MAX_STEPS];
+	int            first[PLAN_MAX_STEPS];                  // its return values in values[], -1: none kept
+	int            count[PLAN_MAX_STEPS];
+	result_field_t values[PLAN_RESUME_MAX_VALUES];
+	int            value_count;
+} plan_checkpoint_t;
+
+typedef struct {
+	plan_op_t  ops[PLAN_MAX_STEPS];
+	int        count;
+
+	// a label on a line of its own belongs to the next step
+	char      *label_names[PLAN_MAX_STEPS];
+	int        label_steps[PLAN_MAX_STEPS];
+	int        label_count;
+
+	// return values of the steps run so far
+	result_field_t vars[PLAN_MAX_VARS];
+	int        var_count;
+
+	// "resume": steps are taken from the checkpoint while resuming is set
+	bool       resume;
+	bool       resuming;
+	plan_checkpoint_t *checkpoint;     // once the DUT is known
+
+	// golden unit lease, and the anytime steps run while waiting for it
+	HANDLE     golden_lease;
+	DWORD      golden_wait;            // ms waited in all
+	bool       early_done[PLAN_MAX_STEPS];
+} plan_t;
+
+bool plan_load(plan_t *plan, const char *path);
+int plan_run(plan_t *plan);
+void plan_free(plan_t *plan);
+
+#endif /* _PLAN_H_ */
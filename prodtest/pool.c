@@ -0,0 +1,386 @@
+/**
+****************************************************************************************
+*
+* @file pool.c
+*
+* @brief Pools of serial numbers and BD addresses, shared by the prodtest instances
+*        of a station.
+*
+* A claim hands out the slot after the shared "next" counter, so parallel claims
+* start at different slots and nearly always get it with the first exchange. A
+* claim left by a crashed process stays claimed, as does one whose write may
+* have reached the DUT. "pool status" lists the claims of processes that no
+* longer run, "pool release" frees one once the operator has checked the DUT.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+static bool pool_open(const char *path, pool_t *pool)
+{
+	DWORD size;
+
+	memset(pool, 0, sizeof(pool_t));
+
+	pool->file = CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pool->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	size = GetFileSize(pool->file, NULL);
+	if (size == INVALID_FILE_SIZE || size < sizeof(pool_header_t))
+		goto fail;
+
+	pool->mapping = CreateFileMapping(pool->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+	if (pool->mapping == NULL)
+		goto fail;
+
+	pool->header = (pool_header_t *) MapViewOfFile(pool->mapping, FILE_MAP_WRITE, 0, 0, 0);
+	if (pool->header == NULL)
+		goto fail;
+
+	if (memcmp(pool->header->magic, POOL_FILE_MAGIC, 4) != 0
+		|| pool->header->count > POOL_MAX_COUNT
+		|| size != sizeof(pool_header_t) + pool->header->count * sizeof(LONGLONG))
+		goto fail;
+
+	pool->slots = (volatile LONGLONG *) (pool->header + 1);
+
+	return true;
+
+fail:
+	if (pool->header != NULL)
+		UnmapViewOfFile(pool->header);
+	if (pool->mapping != NULL)
+		CloseHandle(pool->mapping);
+	CloseHandle(pool->file);
+	memset(pool, 0, sizeof(pool_t));
+
+	return false;
+}
+
+static void pool_close(pool_t *pool)
+{
+	if (pool->header == NULL)
+		return;
+
+	UnmapViewOfFile(pool->header);
+	CloseHandle(pool->mapping);
+	CloseHandle(pool->file);
+	memset(pool, 0, sizeof(pool_t));
+}
+
+static void pool_format(const pool_t *pool, uint32_t index, char *value)
+{
+	uint64_t v = pool->header->first + index;
+
+	if (pool->header->kind == POOL_BDADDR)
+		sprintf(value, "%02X:%02X:%02X:%02X:%02X:%02X",
+			(unsigned int) (v >> 40) & 0xFF, (unsigned int) (v >> 32) & 0xFF, (unsigned int) (v >> 24) & 0xFF,
+			(unsigned int) (v >> 16) & 0xFF, (unsigned int) (v >> 8) & 0xFF, (unsigned int) v & 0xFF);
+	else
+		sprintf(value, "%s%0*lu", pool->header->prefix, (int) pool->header->digits, (unsigned long) v);
+}
+
+// index of a value in the pool, -1 if it is not one of its values
+static long pool_index_of(const pool_t *pool, const char *value)
+{
+	char text[POOL_MAX_VALUE_LEN + 1];
+	unsigned int b[6];
+	uint64_t v;
+	size_t len = strlen(pool->header->prefix);
+	char *endptr;
+	int kk;
+
+	if (pool->header->kind == POOL_BDADDR)
+	{
+		if (sscanf(value, "%02X:%02X:%02X:%02X:%02X:%02X", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+			return -1;
+		for (v = 0, kk = 0; kk < 6; kk++)
+			v = (v << 8) | (b[kk] & 0xFF);
+	}
+	else
+	{
+		if (strncmp(value, pool->header->prefix, len) != 0)
+			return -1;
+		v = strtoul(value + len, &endptr, 10);
+		if (endptr == value + len || *endptr != 0)
+			return -1;
+	}
+
+	if (v < pool->header->first || v - pool->header->first >= pool->header->count)
+		return -1;
+
+	// the same text, e.g. the same number of digits
+	pool_format(pool, (uint32_t) (v - pool->header->first), text);
+	if (strcmp(text, value) != 0)
+		return -1;
+
+	return (long) (v - pool->header->first);
+}
+
+static bool pool_owner_alive(DWORD pid)
+{
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	bool alive;
+
+	// a process of another user may not be opened, but it runs
+	if (process == NULL)
+		return GetLastError() != ERROR_INVALID_PARAMETER;
+
+	alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+
+	return alive;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Create a pool file with all its values free.
+ *
+ *  @param[in] path    Pool file; must not exist.
+ *  @param[in] kind    POOL_TEXT or POOL_BDADDR.
+ *  @param[in] prefix  POOL_TEXT: text before the number.
+ *  @param[in] first   First number, or BD address as a 48 bit number.
+ *  @param[in] count   Number of values.
+ *  @param[in] digits  POOL_TEXT: the number is zero-padded to this many digits.
+ *
+ * @return false if the file exists, cannot be written, or the values would not fit.
+ ****************************************************************************************
+*/
+bool pool_create(const char *path, int kind, const char *prefix, uint64_t first, uint32_t count, uint32_t digits)
+{
+	pool_header_t header;
+	LONGLONG slot = POOL_SLOT(POOL_FREE, 0);
+	char last[64];
+	FILE *fp;
+	uint32_t kk;
+
+	if (count == 0 || count > POOL_MAX_COUNT || strlen(prefix) > POOL_MAX_PREFIX_LEN)
+		return false;
+
+	if (kind == POOL_BDADDR && first + count - 1 > 0xFFFFFFFFFFFFULL)
+		return false;
+
+	if (kind == POOL_TEXT)
+	{
+		if (first + count - 1 > 0xFFFFFFFFUL || digits > 10)
+			return false;
+		sprintf(last, "%s%0*lu", prefix, (int) digits, (unsigned long) (first + count - 1));
+		if (strlen(last) > POOL_MAX_VALUE_LEN)
+			return false;
+	}
+
+	fp = fopen(path, "rb");
+	if (fp != NULL)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		return false;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, POOL_FILE_MAGIC, 4);
+	header.kind = kind;
+	header.count = count;
+	header.digits = digits;
+	header.first = first;
+	strcpy(header.prefix, prefix);
+
+	fwrite(&header, sizeof(header), 1, fp);
+	for (kk = 0; kk < count; kk++)
+		fwrite(&slot, sizeof(slot), 1, fp);
+
+	return fclose(fp) == 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Claim a free value of a pool for this process.
+ *
+ *  @param[in]  path   Pool file.
+ *  @param[in]  kind   Kind the pool must be of.
+ *  @param[out] claim  The value; to be finished with pool_finish().
+ *
+ * @return false if the pool cannot be opened, is of another kind or has no free value.
+ ****************************************************************************************
+*/
+bool pool_claim(const char *path, int kind, pool_claim_t *claim)
+{
+	pool_t *pool = &claim->pool;
+	LONGLONG mine = POOL_SLOT(POOL_CLAIMED, GetCurrentProcessId());
+	uint32_t start, index, kk;
+
+	memset(claim, 0, sizeof(pool_claim_t));
+
+	if (!pool_open(path, pool))
+		return false;
+
+	if ((int) pool->header->kind != kind)
+	{
+		pool_close(pool);
+		return false;
+	}
+
+	start = (uint32_t) InterlockedIncrement(&pool->header->next) - 1;
+
+	for (kk = 0; kk < pool->header->count; kk++)
+	{
+		index = (start + kk) % pool->header->count;
+
+		if (POOL_SLOT_STATE(pool->slots[index]) != POOL_FREE)
+			continue;
+
+		if (InterlockedCompareExchange64(&pool->slots[index], mine, POOL_SLOT(POOL_FREE, 0)) == POOL_SLOT(POOL_FREE, 0))
+		{
+			// on disk before the value can be burned
+			FlushViewOfFile((const void *) &pool->slots[index], sizeof(LONGLONG));
+			FlushFileBuffers(pool->file);
+			claim->index = index;
+			claim->claimed = mine;
+			pool_format(pool, index, claim->value);
+			return true;
+		}
+	}
+
+	pool_close(pool);
+
+	return false;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Finish a claim: commit the value if it was written to the DUT, free it if it
+ *        was not; if that is not known, it stays claimed.
+ *
+ *  @param[in] claim    From pool_claim(); nothing is done if nothing was claimed.
+ *  @param[in] outcome  POOL_WRITTEN, POOL_NOT_WRITTEN or POOL_MAYBE_WRITTEN.
+ ****************************************************************************************
+*/
+void pool_finish(pool_claim_t *claim, int outcome)
+{
+	pool_t *pool = &claim->pool;
+	LONGLONG next;
+
+	if (claim->claimed == 0)
+		return;
+
+	if (outcome == POOL_MAYBE_WRITTEN)
+	{
+		fprintf(stderr, "pool: %s stays claimed, the DUT may hold it\n", claim->value);
+		claim->claimed = 0;
+		pool_close(pool);
+		return;
+	}
+
+	next = outcome == POOL_WRITTEN ? POOL_SLOT(POOL_COMMITTED, POOL_SLOT_PID(claim->claimed)) : POOL_SLOT(POOL_FREE, 0);
+
+	if (InterlockedCompareExchange64(&pool->slots[claim->index], next, claim->claimed) != claim->claimed)
+		fprintf(stderr, "pool: claim of %s was taken away\n", claim->value);
+
+	FlushViewOfFile((const void *) &pool->slots[claim->index], sizeof(LONGLONG));
+	FlushFileBuffers(pool->file);
+
+	claim->claimed = 0;
+	pool_close(pool);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Print how many values of a pool are free, claimed and committed, and the
+ *        claims of processes that no longer run.
+ *
+ * @return number of such orphaned claims, -1 if the pool cannot be opened.
+ ****************************************************************************************
+*/
+int pool_status(const char *path)
+{
+	pool_t pool;
+	uint32_t counts[3] = {0, 0, 0};
+	char value[POOL_MAX_VALUE_LEN + 1];
+	LONGLONG slot;
+	uint32_t kk;
+	int orphans = 0;
+
+	if (!pool_open(path, &pool))
+		return -1;
+
+	for (kk = 0; kk < pool.header->count; kk++)
+	{
+		slot = pool.slots[kk];
+		if (POOL_SLOT_STATE(slot) <= POOL_COMMITTED)
+			counts[POOL_SLOT_STATE(slot)]++;
+
+		if (POOL_SLOT_STATE(slot) == POOL_CLAIMED && !pool_owner_alive(POOL_SLOT_PID(slot)))
+		{
+			pool_format(&pool, kk, value);
+			printf("orphaned claim: %s (process %lu)\n", value, (unsigned long) POOL_SLOT_PID(slot));
+			orphans++;
+		}
+	}
+
+	pool_format(&pool, 0, value);
+	printf("first     = %s\n", value);
+	pool_format(&pool, pool.header->count - 1, value);
+	printf("last      = %s\n", value);
+	printf("free      = %u\n", counts[POOL_FREE]);
+	printf("claimed   = %u\n", counts[POOL_CLAIMED]);
+	printf("committed = %u\n", counts[POOL_COMMITTED]);
+
+	pool_close(&pool);
+
+	return orphans;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Free the claim of a process that no longer runs.
+ *
+ * @return 0 on success, 1 if the value is not one of the pool, not claimed or its
+ *         process still runs, -1 if the pool cannot be opened.
+ ****************************************************************************************
+*/
+int pool_release(const char *path, const char *value)
+{
+	pool_t pool;
+	LONGLONG slot;
+	long index;
+	int rc = 1;
+
+	if (!pool_open(path, &pool))
+		return -1;
+
+	index = pool_index_of(&pool, value);
+	if (index < 0)
+	{
+		pool_close(&pool);
+		return 1;
+	}
+
+	slot = pool.slots[index];
+	if (POOL_SLOT_STATE(slot) == POOL_CLAIMED && !pool_owner_alive(POOL_SLOT_PID(slot))
+		&& InterlockedCompareExchange64(&pool.slots[index], POOL_SLOT(POOL_FREE, 0), slot) == slot)
+	{
+		FlushViewOfFile((const void *) &pool.slots[index], sizeof(LONGLONG));
+		rc = 0;
+	}
+
+	pool_close(&pool);
+
+	return rc;
+}
@@ -0,0 +1,98 @@
+/**
+****************************************************************************************
+*
+* @file pool.h
+*
+* @brief Pools of serial numbers and BD addresses, shared by the prodtest instances
+*        of a station.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "stdbool.h"
+
+/*
+ * A pool file holds a range of values and the state of each: free, claimed by
+ * a process, or committed (written to a DUT). Every prodtest instance maps the
+ * file and changes a state with one interlocked compare-exchange, so parallel
+ * runners never wait for each other and never get the same value.
+ *
+ * write_SN, write_PSN and otp wr_bdaddr take "@<pool file>" in place of the
+ * value: the value is claimed, committed once the DUT has confirmed the write
+ * and released if the write failed. A value that may have reached the DUT, e.g.
+ * when its reply was lost, stays claimed.
+ */
+
+#define POOL_FILE_MAGIC  "PTP1"
+
+/* pool kinds */
+#define POOL_TEXT    0    // <prefix><number>, the number zero-padded to <digits>
+#define POOL_BDADDR  1    // BD addresses, first .. first + count - 1
+
+/* slot states */
+#define POOL_FREE       0
+#define POOL_CLAIMED    1
+#define POOL_COMMITTED  2
+
+/* pool_finish() outcome */
+#define POOL_NOT_WRITTEN    0
+#define POOL_WRITTEN        1
+#define POOL_MAYBE_WRITTEN  2
+
+/* a slot: state in the upper 32 bits, process id of the claim in the lower ones */
+#define POOL_SLOT(state, pid)  (((LONGLONG) (state) << 32) | (uint32_t) (pid))
+#define POOL_SLOT_STATE(slot)  ((int) ((slot) >> 32))
+#define POOL_SLOT_PID(slot)    ((DWORD) ((slot) & 0xFFFFFFFF))
+
+#define POOL_MAX_PREFIX_LEN  24
+#define POOL_MAX_VALUE_LEN   31
+#define POOL_MAX_COUNT       0x1000000
+
+typedef struct {
+	char          magic[4];
+	uint32_t      kind;
+	uint32_t      count;
+	uint32_t      digits;
+	uint64_t      first;
+	volatile LONG next;            // where the next claim starts to look
+	uint32_t      reserved;
+	char          prefix[32];
+} pool_header_t;
+
+typedef struct {
+	HANDLE            file;
+	HANDLE            mapping;
+	pool_header_t    *header;
+	volatile LONGLONG *slots;      // count, after the header
+} pool_t;
+
+/* a value claimed for one write */
+typedef struct {
+	pool_t    pool;
+	uint32_t  index;
+	LONGLONG  claimed;             // slot as claimed; 0: nothing claimed
+	char      value[POOL_MAX_VALUE_LEN + 1];
+} pool_claim_t;
+
+bool pool_create(const char *path, int kind, const char *prefix, uint64_t first, uint32_t count, uint32_t digits);
+
+bool pool_claim(const char *path, int kind, pool_claim_t *claim);
+void pool_finish(pool_claim_t *claim, int outcome);
+
+int pool_status(const char *path);
+int pool_release(const char *path, const char *value);
+
+#endif /* _POOL_H_ */
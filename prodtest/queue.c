@@ -19,6 +19,8 @@
 #include "queue.h"
 //////////#include "console.h"
 #include "uart.h"
+#include "fe_msg.h"
+#include "evt_buf.h"
 
 // Used to stop the tasks.
 BOOL StopRxTask;
@@ -33,16 +35,25 @@ HANDLE QueueHasAvailableData;
 
 void InitTasks(void)
 {
+   // already running, e.g. after a firmware download before the command
+   if (Rx232Id != NULL)
+      return;
+
    StopRxTask = FALSE;
 
+   // the queues must exist before the reception thread can deliver anything
+   UARTRxQueueSem = CreateMutex( NULL, FALSE, NULL );
+
+   QueueHasAvailableData = CreateEvent(0, TRUE, FALSE, NULL);
+   UARTRxQueue.HasData = QueueHasAvailableData;
+
+   evt_buf_init();
+   fe_init();
+
    Rx232Id   = (HANDLE) _beginthread(UARTProc, 10000, NULL);
 
    // Set thread priorities
    SetThreadPriority(Rx232Id, THREAD_PRIORITY_TIME_CRITICAL);
-
-   UARTRxQueueSem = CreateMutex( NULL, FALSE, NULL );
-
-   QueueHasAvailableData = CreateEvent(0, TRUE, FALSE, NULL);
 }
 
 void EnQueue(QueueRecord *rec,void *vdata)
@@ -58,7 +69,7 @@ void EnQueue(QueueRecord *rec,void *vdata)
     rec->Last->Next=tmp;
     rec->Last=tmp;
   }
-  SetEvent(QueueHasAvailableData);
+  SetEvent(rec->HasData);
 }
 
 void *DeQueue(QueueRecord *rec)
@@ -67,7 +78,7 @@ void *DeQueue(QueueRecord *rec)
   struct QueueStorage *tmpqe;
   if(rec->First==NULL)
   {
-	  ResetEvent(QueueHasAvailableData);
+	  ResetEvent(rec->HasData);
     return NULL;
   }
   tmpqe=rec->First;
@@ -75,6 +86,6 @@ void *DeQueue(QueueRecord *rec)
   tmp=tmpqe->Data;
   free(tmpqe);
   if(rec->First==NULL) 
-	  ResetEvent(QueueHasAvailableData);
+	  ResetEvent(rec->HasData);
   return tmp;
 }
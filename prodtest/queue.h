@@ -36,16 +36,10 @@ struct QueueStorage {
 
 typedef struct {
   struct QueueStorage *First,*Last;
+  HANDLE HasData; // manual reset event, set while the queue is not empty
 } QueueRecord;
 
 
-typedef struct {
-  unsigned char payload_type;
-  unsigned short payload_size;
-  unsigned char *payload;
-} QueueElement;
-
-
 // Used to stop the tasks.
 extern BOOL StopRxTask;
 
@@ -0,0 +1,116 @@
+/**
+****************************************************************************************
+*
+* @file result.c
+*
+* @brief Return values of the command last run, by name.
+*
+* Handlers print their return values for the operator and also put them here,
+* so that a plan can check and reuse them without parsing the printout.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "result.h"
+
+static result_field_t result_fields[RESULT_MAX_FIELDS];
+static int result_fields_count;
+
+void result_clear(void)
+{
+	result_fields_count = 0;
+}
+
+// field of that name, a new one if there is none; NULL when full
+static result_field_t *result_put(const char *name, int type)
+{
+	result_field_t *field = (result_field_t *) result_find(name);
+
+	if (field == NULL)
+	{
+		if (result_fields_count == RESULT_MAX_FIELDS)
+			return NULL;
+		field = &result_fields[result_fields_count++];
+		strncpy(field->name, name, RESULT_MAX_NAME_LEN - 1);
+		field->name[RESULT_MAX_NAME_LEN - 1] = 0;
+	}
+
+	field->type = type;
+	field->number = 0;
+
+	return field;
+}
+
+void result_put_int(const char *name, long value)
+{
+	result_field_t *field = result_put(name, RESULT_INT);
+
+	if (field == NULL)
+		return;
+	field->number = value;
+	sprintf(field->text, "%ld", value);
+}
+
+void result_put_hex(const char *name, unsigned long value, int digits)
+{
+	result_field_t *field = result_put(name, RESULT_HEX);
+
+	if (field == NULL)
+		return;
+	field->number = value;
+	sprintf(field->text, "%0*lX", digits, value);
+}
+
+void result_put_double(const char *name, double value)
+{
+	result_field_t *field = result_put(name, RESULT_DOUBLE);
+
+	if (field == NULL)
+		return;
+	field->number = value;
+	sprintf(field->text, "%.2f", value);
+}
+
+void result_put_str(const char *name, const char *value)
+{
+	result_field_t *field = result_put(name, RESULT_STR);
+
+	if (field == NULL)
+		return;
+	strncpy(field->text, value, RESULT_MAX_TEXT_LEN - 1);
+	field->text[RESULT_MAX_TEXT_LEN - 1] = 0;
+}
+
+int result_count(void)
+{
+	return result_fields_count;
+}
+
+const result_field_t *result_field(int index)
+{
+	if (index < 0 || index >= result_fields_count)
+		return NULL;
+
+	return &result_fields[index];
+}
+
+const result_field_t *result_find(const char *name)
+{
+	int kk;
+
+	for (kk = 0; kk < result_fields_count; kk++)
+		if (strcmp(result_fields[kk].name, name) == 0)
+			return &result_fields[kk];
+
+	return NULL;
+}
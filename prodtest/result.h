@@ -0,0 +1,51 @@
+/**
+****************************************************************************************
+*
+* @file result.h
+*
+* @brief Return values of the command last run, by name.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _RESULT_H_
+#define _RESULT_H_
+
+#include "stdbool.h"
+
+#define RESULT_MAX_FIELDS    136  // pkt_rx_all returns 4 per port of up to 32, and 4 more
+#define RESULT_MAX_NAME_LEN  32
+#define RESULT_MAX_TEXT_LEN  64
+
+/* field types */
+#define RESULT_INT     0
+#define RESULT_HEX     1   // a number, written in hex
+#define RESULT_DOUBLE  2
+#define RESULT_STR     3
+
+typedef struct {
+	char   name[RESULT_MAX_NAME_LEN];
+	int    type;
+	double number;                    // value of the numeric types
+	char   text[RESULT_MAX_TEXT_LEN]; // value as printed by the handler
+} result_field_t;
+
+void result_clear(void);
+
+void result_put_int(const char *name, long value);
+void result_put_hex(const char *name, unsigned long value, int digits);
+void result_put_double(const char *name, double value);
+void result_put_str(const char *name, const char *value);
+
+int result_count(void);
+const result_field_t *result_field(int index);
+const result_field_t *result_find(const char *name);
+
+#endif /* _RESULT_H_ */
@@ -0,0 +1,324 @@
+/**
+****************************************************************************************
+*
+* @file rx_all.c
+*
+* @brief One-to-many RX test: one TX burst of the golden unit, received by all DUTs
+*        of the fixture at once.
+*
+* The first port of -p stays on the HCI stack, whose reception thread may
+* already read it; the other DUTs and the golden unit are read by the thread
+* that talks to them, through a framer of their own.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <process.h>
+#include <windows.h>
+
+#include "rx_all.h"
+#include "host_hci.h"
+#include "commands.h"
+#include "latency.h"
+
+void rx_all_link_init(rx_all_link_t *link, uart_port_t *port)
+{
+	link->port = port;
+	link->rx_pos = 0;
+	link->rx_len = 0;
+	hci_framer_init(&link->framer, HCI_FRAMER_INTER_BYTE_TIMEOUT_MILLIS);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Encode an HCI command as it goes on the wire, packet indicator included.
+ *
+ *  @param[out] packet  RX_ALL_MAX_CMD_SIZE bytes.
+ *
+ * @return number of bytes.
+ ****************************************************************************************
+*/
+unsigned int rx_all_encode(uint8_t *packet, uint16_t opcode, const uint8_t *params, uint8_t length)
+{
+	packet[0] = 0x01;
+	packet[1] = opcode & 0xFF;
+	packet[2] = opcode >> 8;
+	packet[3] = length;
+	memcpy(&packet[4], params, length);
+
+	return 4 + length;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Send an encoded command on the link.
+ ****************************************************************************************
+*/
+void rx_all_link_write(rx_all_link_t *link, const uint8_t *packet, unsigned int size)
+{
+	// through the HCI stack, which taps it for the capture file
+	if (link->port == NULL)
+		UARTSend(packet[0], (unsigned short) (size - 1), (unsigned char *) &packet[1]);
+	else
+		UARTPortWrite(link->port, packet, size);
+}
+
+static void rx_all_send(rx_all_link_t *link, uint16_t opcode, const uint8_t *params, uint8_t length)
+{
+	uint8_t packet[RX_ALL_MAX_CMD_SIZE];
+	hci_cmd_t *cmd;
+
+	if (link->port == NULL)
+	{
+		cmd = (hci_cmd_t *) alloc_hci_command(opcode, length);
+		memcpy(cmd->parameters, params, length);
+		send_hci_command(cmd);
+		return;
+	}
+
+	rx_all_link_write(link, packet, rx_all_encode(packet, opcode, params, length));
+}
+
+// Command Complete (0x0E) and Command Status (0x0F) of this firmware both carry the
+// opcode in parameters 1 and 2
+static bool rx_all_match(const uint8_t *evt, unsigned int length, uint8_t event, uint16_t opcode)
+{
+	return length >= 5 && evt[0] == event && evt[3] == (opcode & 0xFF) && evt[4] == (opcode >> 8);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Wait for an event of the link, skipping the others.
+ *
+ *  @param[out] evt     Event code, length and parameters, RX_ALL_MAX_EVT_SIZE bytes at most.
+ *
+ * @return true if the event came in time.
+ ****************************************************************************************
+*/
+bool rx_all_link_wait(rx_all_link_t *link, uint8_t event, uint16_t opcode, uint8_t *evt, unsigned int millis)
+{
+	DWORD deadline = GetTickCount() + millis;
+	DWORD now;
+	hci_evt_t *e;
+	hci_frame_t frame;
+	unsigned int size;
+
+	for (;;)
+	{
+		now = GetTickCount();
+
+		if (link->port == NULL)
+		{
+			if ((LONG) (deadline - now) <= 0)
+				return false;
+
+			// no reset on a timeout: the DUTs on their own ports get none either
+			e = hci_recv_event_try(deadline - now);
+			if (e == NULL)
+				return false;
+
+			size = 2 + e->length;
+			if (size > RX_ALL_MAX_EVT_SIZE)
+				size = RX_ALL_MAX_EVT_SIZE;
+			memcpy(evt, e, size);
+			hci_free_event(e);
+
+			if (rx_all_match(evt, size, event, opcode))
+				return true;
+			continue;
+		}
+
+		link->rx_pos += hci_framer_push(&link->framer, &link->rx[link->rx_pos], link->rx_len - link->rx_pos, now);
+
+		if (hci_framer_pull(&link->framer, &frame))
+		{
+			if (frame.payload_type == HCI_FRAMER_HCI_EVT && rx_all_match(frame.data, frame.length, event, opcode))
+			{
+				size = frame.length < RX_ALL_MAX_EVT_SIZE ? frame.length : RX_ALL_MAX_EVT_SIZE;
+				memcpy(evt, frame.data, size);
+				return true;
+			}
+			continue;
+		}
+
+		if ((LONG) (deadline - now) <= 0)
+			return false;
+
+		link->rx_len = UARTPortRead(link->port, link->rx, sizeof(link->rx), deadline - now);
+		link->rx_pos = 0;
+	}
+}
+
+static void rx_all_proc(PVOID arg)
+{
+	rx_all_slot_t *slot = (rx_all_slot_t *) arg;
+	uint8_t evt[RX_ALL_MAX_EVT_SIZE];
+
+	// into RX with readback values, as start_pkt_rx_stats
+	rx_all_send(&slot->link, HCI_START_PROD_RX_TEST_CMD_OPCODE, &slot->frequency, 1);
+
+	if (!rx_all_link_wait(&slot->link, 0x0E, HCI_START_PROD_RX_TEST_CMD_OPCODE, evt,
+			latency_timeout(LATENCY_KEY(HCI_START_PROD_RX_TEST_CMD_OPCODE, 0), RX_TIMEOUT_MILLIS)))
+		slot->status = SC_RX_TIMEOUT;
+	else if (evt[1] != 3)
+		slot->status = SC_UNEXPECTED_EVENT;
+	else
+		slot->listening = true;
+
+	SetEvent(slot->ready);
+
+	if (!slot->listening)
+	{
+		SetEvent(slot->done);
+		return;
+	}
+
+	WaitForSingleObject(slot->stop, INFINITE);
+
+	// the counts, as stop_pkt_rx_stats
+	rx_all_send(&slot->link, HCI_LE_END_PROD_RX_TEST_CMD_OPCODE, NULL, 0);
+
+	if (!rx_all_link_wait(&slot->link, 0x0E, HCI_LE_END_PROD_RX_TEST_CMD_OPCODE, evt,
+			latency_timeout(LATENCY_KEY(HCI_LE_END_PROD_RX_TEST_CMD_OPCODE, 0), RX_TIMEOUT_MILLIS)))
+		slot->status = SC_RX_TIMEOUT;
+	else if (evt[1] != 11)
+		slot->status = SC_UNEXPECTED_EVENT;
+	else
+	{
+		slot->nb_packets_received_correctly   = evt[5] + 256 * evt[6];
+		slot->nb_packets_with_syncerror       = evt[7] + 256 * evt[8];
+		slot->nb_packets_received_with_crcerr = evt[9] + 256 * evt[10];
+		slot->rssi                            = evt[11] + 256 * evt[12];
+	}
+
+	SetEvent(slot->done);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Put the DUTs into RX, one thread each, and wait until all of them are
+ *        listening or have failed. The threads wait for rx_all_stop().
+ *
+ *  @param[in,out] slots      One per DUT; link, com and idle must be set, the port open.
+ *  @param[in]     count      Number of slots.
+ *  @param[in]     frequency  Channel of the burst.
+ *
+ * @return number of DUTs listening.
+ ****************************************************************************************
+*/
+int rx_all_start(rx_all_slot_t *slots, int count, uint8_t frequency)
+{
+	HANDLE ready[UART_MAX_PORTS];
+	HANDLE stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+	int waiting = 0;
+	int listening = 0;
+	int kk;
+
+	for (kk = 0; kk < count; kk++)
+	{
+		slots[kk].stop = stop;
+		if (slots[kk].idle)
+			continue;
+
+		slots[kk].status = 0;
+		slots[kk].listening = false;
+		slots[kk].nb_packets_received_correctly = 0;
+		slots[kk].nb_packets_with_syncerror = 0;
+		slots[kk].nb_packets_received_with_crcerr = 0;
+		slots[kk].rssi = 0;
+		slots[kk].frequency = frequency;
+		slots[kk].ready = CreateEvent(NULL, TRUE, FALSE, NULL);
+		slots[kk].done = CreateEvent(NULL, TRUE, FALSE, NULL);
+		ready[waiting++] = slots[kk].ready;
+
+		_beginthread(rx_all_proc, 10000, &slots[kk]);
+	}
+
+	// each thread gives up on its own after its reply timeout
+	if (waiting > 0)
+		WaitForMultipleObjects(waiting, ready, TRUE, INFINITE);
+
+	for (kk = 0; kk < count; kk++)
+		if (!slots[kk].idle && slots[kk].listening)
+			listening++;
+
+	return listening;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Send the burst from the golden unit, as pkt_tx, and wait until it is over.
+ *
+ * @return SC_...
+ ****************************************************************************************
+*/
+int rx_all_burst(rx_all_link_t *golden, uint8_t frequency, uint8_t length, uint8_t payload, uint16_t number_of_packets)
+{
+	uint8_t params[5];
+	uint8_t evt[RX_ALL_MAX_EVT_SIZE];
+	unsigned int timeout, air_millis;
+
+	params[0] = frequency;
+	params[1] = length;
+	params[2] = payload;
+	params[3] = number_of_packets & 0xFF;
+	params[4] = number_of_packets >> 8;
+
+	rx_all_send(golden, 0x201E, params, sizeof(params));
+
+	if (!rx_all_link_wait(golden, 0x0F, 0x201E, evt, latency_timeout(LATENCY_KEY(0x201E, 0), RX_TIMEOUT_MILLIS)))
+		return SC_RX_TIMEOUT;
+
+	// one packet every ceil((L + 249) / 625) * 625 us with L = (10 + length) * 8 us
+	timeout = latency_timeout(LATENCY_KEY(0x4040, 0), 60000);
+	air_millis = (unsigned int) (((unsigned long) number_of_packets * ((((10 + length) * 8 + 249) + 624) / 625) * 625) / 1000);
+	if (timeout < 2 * air_millis + 1000)
+		timeout = 2 * air_millis + 1000;
+
+	if (!rx_all_link_wait(golden, 0x0E, 0x4040, evt, timeout))
+		return SC_RX_TIMEOUT;
+
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Let the DUT threads collect the counts, and wait for all of them.
+ ****************************************************************************************
+*/
+void rx_all_stop(rx_all_slot_t *slots, int count)
+{
+	HANDLE done[UART_MAX_PORTS];
+	int waiting = 0;
+	int kk;
+
+	if (count == 0)
+		return;
+
+	SetEvent(slots[0].stop);
+
+	for (kk = 0; kk < count; kk++)
+		if (!slots[kk].idle)
+			done[waiting++] = slots[kk].done;
+
+	if (waiting > 0)
+		WaitForMultipleObjects(waiting, done, TRUE, INFINITE);
+
+	CloseHandle(slots[0].stop);
+	for (kk = 0; kk < count; kk++)
+	{
+		if (slots[kk].idle)
+			continue;
+		CloseHandle(slots[kk].ready);
+		CloseHandle(slots[kk].done);
+	}
+}
@@ -0,0 +1,82 @@
+/**
+****************************************************************************************
+*
+* @file rx_all.h
+*
+* @brief One-to-many RX test: one TX burst of the golden unit, received by all DUTs
+*        of the fixture at once (pkt_rx_all).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _RX_ALL_H_
+#define _RX_ALL_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "stdbool.h"
+#include "uart.h"
+#include "hci_framer.h"
+
+/*
+ * Every DUT of -p is put into RX with readback values (start_pkt_rx_stats) on
+ * the same channel, the golden unit sends one burst (pkt_tx), then all DUTs are
+ * asked for their counts (stop_pkt_rx_stats), one thread per DUT: the RX test
+ * of N DUTs takes the air time of one.
+ *
+ * The golden unit is on the COM port "golden.port" of the configuration; in a
+ * plan, mark the step "| golden" so that the fixtures sharing the unit take
+ * turns.
+ */
+#define RX_ALL_CONFIG_GOLDEN_PORT  "golden.port"
+
+/* largest event kept of a reply: the readback values take 11 bytes of parameters */
+#define RX_ALL_MAX_EVT_SIZE  32
+
+/* largest command sent: indicator, opcode, length and the 5 parameters of pkt_tx */
+#define RX_ALL_MAX_CMD_SIZE  (4 + 8)
+
+/* HCI on one port, without the reception thread of the HCI stack */
+typedef struct {
+	uart_port_t  *port;          // NULL: the port of the HCI stack
+	hci_framer_t  framer;
+	uint8_t       rx[256];        // bytes read but not yet framed
+	unsigned long rx_pos;
+	unsigned long rx_len;
+} rx_all_link_t;
+
+/* one DUT */
+typedef struct {
+	rx_all_link_t link;
+	int      com;                 // COM port number, for the report
+	bool     idle;                // left out, e.g. decided by an earlier sub-burst of pkt_rx_per
+	int      status;              // SC_...
+	bool     listening;           // in RX when the burst was sent
+	uint16_t nb_packets_received_correctly;
+	uint16_t nb_packets_with_syncerror;
+	uint16_t nb_packets_received_with_crcerr;
+	uint16_t rssi;                // raw, dBm = 0.474 * rssi - 112.4
+	uint8_t  frequency;
+	HANDLE   ready;               // set once in RX, or failed
+	HANDLE   stop;                // shared by all slots: the burst is over
+	HANDLE   done;                // set when the counts are in, or failed
+} rx_all_slot_t;
+
+void rx_all_link_init(rx_all_link_t *link, uart_port_t *port);
+unsigned int rx_all_encode(uint8_t *packet, uint16_t opcode, const uint8_t *params, uint8_t length);
+void rx_all_link_write(rx_all_link_t *link, const uint8_t *packet, unsigned int size);
+bool rx_all_link_wait(rx_all_link_t *link, uint8_t event, uint16_t opcode, uint8_t *evt, unsigned int millis);
+
+int  rx_all_start(rx_all_slot_t *slots, int count, uint8_t frequency);
+int  rx_all_burst(rx_all_link_t *golden, uint8_t frequency, uint8_t length, uint8_t payload, uint16_t number_of_packets);
+void rx_all_stop(rx_all_slot_t *slots, int count);
+
+#endif /* _RX_ALL_H_ */
@@ -0,0 +1,259 @@
+/**
+****************************************************************************************
+*
+* @file tx_rotate.c
+*
+* @brief Continuous TX taken in turns by the DUTs of -p, on a schedule of the
+*        performance counter.
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <process.h>
+#include <windows.h>
+
+#include "tx_rotate.h"
+#include "host_hci.h"
+#include "commands.h"
+#include "latency.h"
+
+static double tx_rotate_us(const tx_rotate_t *rotation, LONGLONG at)
+{
+	return (double) (at - rotation->t0.QuadPart) * 1000000.0 / (double) rotation->freq;
+}
+
+static double tx_rotate_now_us(const tx_rotate_t *rotation)
+{
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+
+	return tx_rotate_us(rotation, now.QuadPart);
+}
+
+// sleep most of the way, spin the rest; false if the rotation was aborted meanwhile
+static bool tx_rotate_wait_until(const tx_rotate_t *rotation, LONGLONG at)
+{
+	LARGE_INTEGER now;
+	LONGLONG left;
+	DWORD millis;
+
+	for (;;)
+	{
+		QueryPerformanceCounter(&now);
+		left = at - now.QuadPart;
+		if (left <= 0)
+			return WaitForSingleObject(rotation->abort, 0) != WAIT_OBJECT_0;
+
+		millis = 0;
+		if (left > rotation->freq * TX_ROTATE_SPIN_MILLIS / 1000)
+			millis = (DWORD) (left * 1000 / rotation->freq) - TX_ROTATE_SPIN_MILLIS;
+
+		if (WaitForSingleObject(rotation->abort, millis) == WAIT_OBJECT_0)
+			return false;
+	}
+}
+
+// wait until the stop of a turn is answered; false if the rotation was aborted
+static bool tx_rotate_wait_settled(const tx_rotate_t *rotation, LONGLONG turn)
+{
+	if (turn >= 0)
+		while (rotation->settled[turn % rotation->count] <= turn / rotation->count)
+			if (WaitForSingleObject(rotation->abort, 1) == WAIT_OBJECT_0)
+				return false;
+
+	return WaitForSingleObject(rotation->abort, 0) != WAIT_OBJECT_0;
+}
+
+// write a command and wait for its Command Complete
+static int tx_rotate_send(tx_rotate_slot_t *slot, const uint8_t *packet, unsigned int size, uint16_t opcode,
+		double *written, double *event)
+{
+	uint8_t evt[RX_ALL_MAX_EVT_SIZE];
+
+	rx_all_link_write(&slot->link, packet, size);
+	*written = tx_rotate_now_us(slot->rotation);
+
+	if (!rx_all_link_wait(&slot->link, 0x0E, opcode, evt, latency_timeout(LATENCY_KEY(opcode, 0), RX_TIMEOUT_MILLIS)))
+		return SC_RX_TIMEOUT;
+
+	*event = tx_rotate_now_us(slot->rotation);
+
+	return 0;
+}
+
+static void tx_rotate_proc(PVOID arg)
+{
+	tx_rotate_slot_t *slot = (tx_rotate_slot_t *) arg;
+	tx_rotate_t *rotation = slot->rotation;
+	tx_rotate_window_t *window;
+	tx_rotate_window_t unused;
+	LONGLONG due;
+	bool go_on = true;
+	int round;
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+	for (round = 0; round < rotation->rounds && slot->status == 0 && go_on; round++)
+	{
+		window = &slot->windows[round];
+		due = rotation->t0.QuadPart + ((LONGLONG) round * rotation->count + slot->index) * rotation->dwell;
+		window->due = tx_rotate_us(rotation, due);
+
+		// the stop of the turn before this one goes out at the same moment as the start;
+		// that of the turn before it must be answered
+		if (tx_rotate_wait_until(rotation, due)
+			&& tx_rotate_wait_settled(rotation, (LONGLONG) round * rotation->count + slot->index - 2))
+		{
+			slot->status = tx_rotate_send(slot, slot->start, slot->start_size, HCI_TX_CONTINUE_TEST_CMD_OPCODE,
+				&window->start_written, &window->on_air);
+
+			// a DUT that did not answer the start may still transmit: stop it all the same
+			go_on = tx_rotate_wait_until(rotation, due + rotation->dwell);
+			slot->rounds_done = round + 1;
+		}
+		else
+		{
+			// aborted before the turn: stop the DUT all the same, the turn stays empty
+			go_on = false;
+			window = &unused;
+		}
+
+		if (tx_rotate_send(slot, slot->stop, slot->stop_size, HCI_TX_END_CONTINUE_TEST_CMD_OPCODE,
+				&window->stop_written, &window->off_air) != 0)
+		{
+			if (slot->status == 0)
+				slot->status = SC_RX_TIMEOUT;
+
+			// it may still transmit: no other DUT may start
+			slot->on_air = true;
+			SetEvent(rotation->abort);
+		}
+
+		InterlockedExchange(&rotation->settled[slot->index], round + 1);
+	}
+
+	// no turns left to wait for
+	InterlockedExchange(&rotation->settled[slot->index], rotation->rounds);
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+	SetEvent(slot->done);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Run the rotation: each slot transmits for one dwell in its turn, for the given
+ *        number of rounds. A DUT that fails leaves its turns empty; one that does not
+ *        answer its stop ends the rotation for all.
+ *
+ *  @param[out]    rotation      Schedule, for tx_rotate_log().
+ *  @param[in,out] slots         One per DUT, in turn order; link, com, the encoded
+ *                               commands and windows (rounds entries) must be set.
+ ****************************************************************************************
+*/
+void tx_rotate_run(tx_rotate_t *rotation, tx_rotate_slot_t *slots, int count, int rounds, unsigned int dwell_millis)
+{
+	HANDLE done[UART_MAX_PORTS];
+	LARGE_INTEGER freq;
+	FILETIME ft;
+	int kk;
+
+	QueryPerformanceFrequency(&freq);
+	rotation->freq = freq.QuadPart;
+	rotation->count = count;
+	rotation->rounds = rounds;
+	rotation->dwell = freq.QuadPart * dwell_millis / 1000;
+	rotation->abort = CreateEvent(NULL, TRUE, FALSE, NULL);
+	for (kk = 0; kk < count; kk++)
+		rotation->settled[kk] = 0;
+
+	// the wall clock of t0, for the log
+	QueryPerformanceCounter(&rotation->t0);
+	GetSystemTimeAsFileTime(&ft);
+	rotation->t0.QuadPart += freq.QuadPart * TX_ROTATE_LEAD_MILLIS / 1000;
+	rotation->t0_unix_us = ((((unsigned long long) ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10
+	                     - TX_ROTATE_FILETIME_EPOCH_DELTA_US + TX_ROTATE_LEAD_MILLIS * 1000;
+
+	for (kk = 0; kk < count; kk++)
+	{
+		slots[kk].index = kk;
+		slots[kk].status = 0;
+		slots[kk].rounds_done = 0;
+		slots[kk].on_air = false;
+		slots[kk].rotation = rotation;
+		slots[kk].done = done[kk] = CreateEvent(NULL, TRUE, FALSE, NULL);
+		memset(slots[kk].windows, 0, rounds * sizeof(tx_rotate_window_t));
+
+		// a slot without its thread leaves its turns empty
+		if (_beginthread(tx_rotate_proc, 10000, &slots[kk]) == (uintptr_t) -1)
+		{
+			slots[kk].status = SC_OUT_OF_MEMORY;
+			rotation->settled[kk] = rounds;
+			SetEvent(slots[kk].done);
+		}
+	}
+
+	WaitForMultipleObjects(count, done, TRUE, INFINITE);
+
+	for (kk = 0; kk < count; kk++)
+		CloseHandle(done[kk]);
+	CloseHandle(rotation->abort);
+}
+
+// a time of the log; empty for an event that did not come
+static void tx_rotate_put(FILE *fp, unsigned long long t0, double us)
+{
+	if (us > 0)
+		fprintf(fp, ",%llu", t0 + (unsigned long long) us);
+	else
+		fprintf(fp, ",");
+}
+
+/*
+ ****************************************************************************************
+ * @brief Write the on-air windows, in schedule order, as csv (see tx_rotate.h).
+ ****************************************************************************************
+*/
+bool tx_rotate_log(const tx_rotate_t *rotation, const tx_rotate_slot_t *slots, const char *path)
+{
+	const tx_rotate_window_t *w;
+	unsigned long long t0 = rotation->t0_unix_us;
+	FILE *fp;
+	int round, kk;
+	bool ok;
+
+	fp = fopen(path, "w");
+	if (fp == NULL)
+		return false;
+
+	fprintf(fp, "round,port,due,start_written,on_air,stop_written,off_air\n");
+	for (round = 0; round < rotation->rounds; round++)
+		for (kk = 0; kk < rotation->count; kk++)
+		{
+			if (round >= slots[kk].rounds_done)
+				continue;
+
+			w = &slots[kk].windows[round];
+			fprintf(fp, "%d,%d,%llu", round, slots[kk].com, t0 + (unsigned long long) w->due);
+			tx_rotate_put(fp, t0, w->start_written);
+			tx_rotate_put(fp, t0, w->on_air);
+			tx_rotate_put(fp, t0, w->stop_written);
+			tx_rotate_put(fp, t0, w->off_air);
+			fprintf(fp, "\n");
+		}
+
+	ok = !ferror(fp);
+	if (fclose(fp) != 0)
+		ok = false;
+
+	return ok;
+}
@@ -0,0 +1,100 @@
+/**
+****************************************************************************************
+*
+* @file tx_rotate.h
+*
+* @brief Continuous TX taken in turns by the DUTs of -p, e.g. in a shared shielded
+*        box (cont_tx_rotate).
+*
+* Copyright (C) 2015. Dialog Semiconductor Ltd, unpublished work. This computer
+* program includes Confidential, Proprietary Information and is a Trade Secret of
+* Dialog Semiconductor Ltd.  All use, disclosure, and/or reproduction is prohibited
+* unless authorized in writing. All Rights Reserved.
+*
+* <bluetooth.support@diasemi.com> and contributors.
+*
+****************************************************************************************
+*/
+
+#ifndef _TX_ROTATE_H_
+#define _TX_ROTATE_H_
+
+#include <stdint.h>
+#include <windows.h>
+
+#include "stdbool.h"
+#include "rx_all.h"
+
+/*
+ * Each DUT transmits for one dwell, in the order of -p, round after round.
+ * Slot k of the schedule starts at t0 + k * dwell on the performance counter;
+ * each DUT has a thread of its own that sends start_cont_tx (0x4050) when its
+ * slot starts and stop_cont_tx (0x4060) when it ends, so the stop of one DUT
+ * and the start of the next go out at the same moment instead of one round
+ * trip after the other.
+ *
+ * The on-air windows can be logged to a csv file, times in microseconds since
+ * 1970-01-01 UTC, for correlation with the capture of a spectrum analyzer:
+ *
+ *   round,port,due,start_written,on_air,stop_written,off_air
+ *
+ * on_air is the Command Complete of the start, off_air that of the stop.
+ *
+ * Only one DUT may transmit at a time: when a stop is not answered, that DUT
+ * may still be on air, so the rotation is aborted. The other DUTs send a stop
+ * too and end, and the DUT is reported as possibly on air. A turn starts only
+ * once the stop of the turn before the last one is answered, so that a stop
+ * whose reply is late holds the rotation up until it is settled.
+ */
+
+/* the threads are started this long before t0 */
+#define TX_ROTATE_LEAD_MILLIS   100
+
+/* the last part of a wait is spun on the performance counter, for Sleep() is coarse */
+#define TX_ROTATE_SPIN_MILLIS   20
+
+#define TX_ROTATE_MAX_ROUNDS    10000
+
+#define TX_ROTATE_FILETIME_EPOCH_DELTA_US  11644473600000000ULL
+
+/* one turn of a DUT, in us from t0 */
+typedef struct {
+	double due;
+	double start_written;
+	double on_air;
+	double stop_written;
+	double off_air;
+} tx_rotate_window_t;
+
+typedef struct {
+	int      count;                           // DUTs
+	int      rounds;
+	LONGLONG dwell;                           // performance counter ticks
+	LONGLONG freq;
+	LARGE_INTEGER t0;
+	unsigned long long t0_unix_us;            // t0 in us since 1970-01-01 UTC
+	HANDLE   abort;                           // set when a DUT did not answer its stop
+	volatile LONG settled[UART_MAX_PORTS];    // per DUT: rounds whose stop is answered
+} tx_rotate_t;
+
+/* one DUT */
+typedef struct {
+	rx_all_link_t link;
+	int      com;                             // COM port number, for the report
+	int      index;                           // turn in a round
+	int      status;                          // SC_...
+	uint8_t  start[RX_ALL_MAX_CMD_SIZE];      // start_cont_tx, encoded
+	unsigned int start_size;
+	uint8_t  stop[RX_ALL_MAX_CMD_SIZE];       // stop_cont_tx, encoded
+	unsigned int stop_size;
+	tx_rotate_window_t *windows;              // one per round
+	int      rounds_done;
+	bool     on_air;                          // its stop was not answered: may still transmit
+	tx_rotate_t *rotation;
+	HANDLE   done;
+} tx_rotate_slot_t;
+
+void tx_rotate_run(tx_rotate_t *rotation, tx_rotate_slot_t *slots, int count, int rounds, unsigned int dwell_millis);
+bool tx_rotate_log(const tx_rotate_t *rotation, const tx_rotate_slot_t *slots, const char *path);
+
+#endif /* _TX_ROTATE_H_ */
@@ -26,11 +26,199 @@
 
 #include "queue.h"
 #include "uart.h"
+#include "fe_msg.h"
+#include "dut_sim.h"
+#include "evt_buf.h"
+#include "linectl.h"
 
 //#define COMM_DEBUG
 
-HANDLE hComPortHandle = NULL;
-OVERLAPPED ovlRd,ovlWr;
+#define UART_RX_CHUNK_SIZE 512
+
+static hci_framer_t UARTFramer; // only touched by the reception thread
+
+// the port of the HCI commands and of the reception thread
+static uart_port_t UARTPort = { -1 };
+
+/*
+ ****************************************************************************************
+ * @brief Write raw bytes to a port.
+ *
+ *  @param[in] port  Port.
+ *  @param[in] data  Bytes.
+ *  @param[in] len   Number of bytes.
+ *
+ * @return void.
+ ****************************************************************************************
+*/
+void UARTPortWrite(uart_port_t *port, const uint8_t *data, unsigned long len)
+{
+	unsigned long dwWritten;
+
+	if (port->sim != NULL)
+	{
+		dut_sim_write(port->sim, data, len);
+		return;
+	}
+
+	port->ovl_wr.Offset     = 0;
+	port->ovl_wr.OffsetHigh = 0;
+	ResetEvent(port->ovl_wr.hEvent);
+
+	// the caller's buffer may be on the stack and ovl_wr is reused by the next
+	// call: wait until the driver is done with both
+	if (!WriteFile(port->handle, data, len, &dwWritten, &port->ovl_wr)
+		&& GetLastError() == ERROR_IO_PENDING)
+	{
+		GetOverlappedResult(port->handle, &port->ovl_wr, &dwWritten, TRUE);
+	}
+}
+
+/*
+ ****************************************************************************************
+ * @brief Read raw bytes from a port. Not for the port of the reception thread
+ *        once InitTasks() has started it.
+ *
+ *  @param[in]  port    Port.
+ *  @param[out] buf     Receives the bytes.
+ *  @param[in]  size    Size of buf.
+ *  @param[in]  millis  Max. time to wait for a byte.
+ *
+ * @return number of bytes read, 0 on timeout.
+ ****************************************************************************************
+*/
+unsigned long UARTPortRead(uart_port_t *port, uint8_t *buf, unsigned long size, uint32_t millis)
+{
+	unsigned long dwRead = 0;
+	DWORD start = GetTickCount();
+	DWORD elapsed = 0;
+
+	if (port->sim != NULL)
+		return dut_sim_read(port->sim, buf, size, millis);
+
+	while (elapsed < millis)
+	{
+		port->ovl_rd.Offset     = 0;
+		port->ovl_rd.OffsetHigh = 0;
+		ResetEvent(port->ovl_rd.hEvent);
+
+		if (!ReadFile(port->handle, buf, size, &dwRead, &port->ovl_rd)
+			&& GetLastError() != ERROR_IO_PENDING)
+		{
+			return 0;
+		}
+
+		if (WaitForSingleObject(port->ovl_rd.hEvent, millis - elapsed) == WAIT_TIMEOUT)
+		{
+			CancelIo(port->handle);
+			GetOverlappedResult(port->handle, &port->ovl_rd, &dwRead, TRUE);
+			return dwRead;
+		}
+
+		GetOverlappedResult(port->handle, &port->ovl_rd, &dwRead, TRUE);
+		if (dwRead > 0)
+			return dwRead;
+
+		// the comm timeouts ended an idle read; reissue it
+		elapsed = GetTickCount() - start;
+	}
+
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Change the baud rate of an open port.
+ *
+ * @return 0 on success / -1 on failure.
+ ****************************************************************************************
+*/
+uint8_t UARTPortSetBaudRate(uart_port_t *port, int BaudRate)
+{
+	DCB dcb;
+
+	if (port->sim != NULL || BaudRate == port->baud_rate)
+	{
+		port->baud_rate = BaudRate;
+		return 0;
+	}
+
+	memset(&dcb, 0x0, sizeof(DCB));
+	if (!GetCommState(port->handle, &dcb))
+		return -1;
+
+	dcb.BaudRate = BaudRate;
+	if (!SetCommState(port->handle, &dcb))
+		return -1;
+
+	port->baud_rate = BaudRate;
+	return 0;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Assert or deassert a control line of a port.
+ *
+ *  @param[in] port  Port.
+ *  @param[in] line  UART_LINE_DTR or UART_LINE_RTS.
+ *  @param[in] on    TRUE to assert.
+ *
+ * @return 0 on success / -1 on failure.
+ ****************************************************************************************
+*/
+uint8_t UARTPortSetLine(uart_port_t *port, int line, bool on)
+{
+	DWORD func;
+
+	if (port->sim != NULL)
+	{
+		dut_sim_set_line(port->sim, line, on);
+		return 0;
+	}
+
+	if (line == UART_LINE_DTR)
+		func = on ? SETDTR : CLRDTR;
+	else
+		func = on ? SETRTS : CLRRTS;
+
+	return EscapeCommFunction(port->handle, func) ? 0 : -1;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Reset the DUT on a port into its boot ROM, with the LINE_SEQ_BOOT
+ *        sequence, if the fixture is wired for that (see line_auto()).
+ *
+ * @return TRUE if the DUT was reset, FALSE if the operator has to do it.
+ ****************************************************************************************
+*/
+BOOL UARTPortResetDUT(uart_port_t *port)
+{
+	if (!line_auto(port))
+		return FALSE;
+
+	return line_run(port, line_sequence(LINE_SEQ_BOOT));
+}
+
+void UARTWrite(const uint8_t *data, unsigned long len)
+{
+	UARTPortWrite(&UARTPort, data, len);
+}
+
+unsigned long UARTRead(uint8_t *buf, unsigned long size, uint32_t millis)
+{
+	return UARTPortRead(&UARTPort, buf, size, millis);
+}
+
+uint8_t UARTSetBaudRate(int BaudRate)
+{
+	return UARTPortSetBaudRate(&UARTPort, BaudRate);
+}
+
+BOOL UARTResetDUT(void)
+{
+	return UARTPortResetDUT(&UARTPort);
+}
 
 /*
  ****************************************************************************************
@@ -46,18 +234,21 @@ void UARTSend(unsigned char payload_type, unsigned short payload_size, unsigned
 {
 	unsigned char bTransmit232ElementArr[500];
 	unsigned short bSenderSize;
-	unsigned long dwWritten;
 
 	bTransmit232ElementArr[0] = payload_type; // message header
 	memcpy(&bTransmit232ElementArr[1], payload, payload_size);
 
 	bSenderSize = payload_size + 1;
 
-	ovlWr.Offset     = 0;
-    ovlWr.OffsetHigh = 0;
-    ResetEvent(ovlWr.hEvent);
+	if (evt_tapped())
+	{
+		evt_buf_t *buf = evt_buf_alloc(EVT_BUF_TX, payload_type, payload, payload_size);
+
+		evt_buf_publish(buf);
+		evt_buf_release(buf);
+	}
 
-	WriteFile(hComPortHandle, bTransmit232ElementArr, bSenderSize, &dwWritten, &ovlWr);
+	UARTWrite(bTransmit232ElementArr, bSenderSize);
 }
 
 /*
@@ -70,29 +261,61 @@ void UARTSend(unsigned char payload_type, unsigned short payload_size, unsigned
  * @return void.
  ****************************************************************************************
 */
-void SendToMain(unsigned char payload_type, unsigned short length, uint8_t *bInputDataPtr)
+void SendToMain(unsigned char payload_type, unsigned short length, const uint8_t *bInputDataPtr)
 {
-	QueueElement * qe; 
-	unsigned char *bDataPtr; 
+	evt_buf_t *buf;
 
-	// filter out FE API messages
+	// one copy per frame; the queue and the taps share it
+	buf = evt_buf_alloc(EVT_BUF_RX, payload_type, bInputDataPtr, length);
+	evt_buf_publish(buf);
+
+	// FE API messages go to their own channels
 	if (payload_type == 0x05)
 	{
-		return;
+		fe_deliver(buf->data, buf->length);
 	}
+	else
+	{
+		evt_buf_ref(buf); // released by hci_free_event()
+
+		WaitForSingleObject(UARTRxQueueSem, INFINITE);
+		EnQueue(&UARTRxQueue, buf);
+		ReleaseMutex(UARTRxQueueSem);
+	}
+
+	evt_buf_release(buf);
+}
+
+/*
+ ****************************************************************************************
+ * @brief Run received bytes through the framer and pass complete frames on.
+ *
+ *  @param[in] data     Received bytes (may be NULL when len is 0).
+ *  @param[in] len      Number of received bytes.
+ *
+ * @return void.
+ ****************************************************************************************
+*/
+static void UARTRxBytes(const uint8_t *data, unsigned long len)
+{
+	unsigned int used;
+	hci_frame_t frame;
+
+	for (;;)
+	{
+		used = hci_framer_push(&UARTFramer, data, len, GetTickCount());
+		data += used;
+		len -= used;
+
+		if (!hci_framer_pull(&UARTFramer, &frame))
+			break;
+
+		#ifdef COMM_DEBUG
+			printf("\nSIZE: %d ", frame.length);
+		#endif
 
-	qe = (QueueElement *) malloc(sizeof(QueueElement));
-	bDataPtr = (unsigned char *) malloc(length);
-	
-	memcpy(bDataPtr, bInputDataPtr, length);
-	
-	qe->payload_type = payload_type;
-	qe->payload_size = length;
-	qe->payload = bDataPtr;
-	
-	WaitForSingleObject(UARTRxQueueSem, INFINITE);
-	EnQueue(&UARTRxQueue, qe);
-	ReleaseMutex(UARTRxQueueSem);
+		SendToMain(frame.payload_type, frame.length, frame.data);
+	}
 }
 
 /*
@@ -105,188 +328,67 @@ void SendToMain(unsigned char payload_type, unsigned short length, uint8_t *bInp
 void UARTProc(PVOID unused)
 {
    unsigned long dwBytesRead;
-   unsigned char tmp;
-   unsigned short wReceive232Pos=0;
-   unsigned short wDataLength;
-   unsigned char bReceive232ElementArr[1000];
-   unsigned char bReceiveState = 0;
-   unsigned char bCkeckSum = 0;
-   unsigned char bHdrBytesRead = 0;
+   unsigned char bReceiveBuf[UART_RX_CHUNK_SIZE];
+   BOOL bReadPending = FALSE;
+   DWORD dwWait;
+
+   hci_framer_init(&UARTFramer, HCI_FRAMER_INTER_BYTE_TIMEOUT_MILLIS);
 
    while(StopRxTask == FALSE)
    {
+      if (UARTPort.sim != NULL)
+      {
+         dwWait = hci_framer_wait_millis(&UARTFramer, GetTickCount());
+         dwBytesRead = dut_sim_read(UARTPort.sim, bReceiveBuf, sizeof(bReceiveBuf), dwWait < 1000 ? dwWait : 1000);
+         UARTRxBytes(bReceiveBuf, dwBytesRead);
+         continue;
+      }
+
+      if (!bReadPending)
+      {
+         UARTPort.ovl_rd.Offset     = 0;
+         UARTPort.ovl_rd.OffsetHigh = 0;
+         ResetEvent(UARTPort.ovl_rd.hEvent);
 
-      ovlRd.Offset     = 0;
-      ovlRd.OffsetHigh = 0;
-      ResetEvent(ovlRd.hEvent);
+         // use overlapped read, not because of async read, but, due to
+         // multi thread read/write. The comm timeouts make it complete as soon
+         // as anything has arrived, with all bytes available at that point.
+         ReadFile( UARTPort.handle, bReceiveBuf, sizeof(bReceiveBuf), &dwBytesRead, &UARTPort.ovl_rd );
+         bReadPending = TRUE;
+      }
 
-      // use overlapped read, not because of async read, but, due to
-      // multi thread read/write
-      ReadFile( hComPortHandle, &tmp, 1, &dwBytesRead, &ovlRd );
+      // while a frame is incomplete, wake up when its inter-byte deadline expires
+      dwWait = WaitForSingleObject(UARTPort.ovl_rd.hEvent, hci_framer_wait_millis(&UARTFramer, GetTickCount()));
+
+      if (dwWait == WAIT_TIMEOUT)
+      {
+         UARTRxBytes(NULL, 0);
+         continue;
+      }
 
-      GetOverlappedResult( hComPortHandle,
-                           &ovlRd,
+      GetOverlappedResult( UARTPort.handle,
+                           &UARTPort.ovl_rd,
                            &dwBytesRead,
                            TRUE );
+      bReadPending = FALSE;
 
-      switch(bReceiveState)
+      if (dwBytesRead == 0)
+         continue;
+
+      #ifdef COMM_DEBUG
       {
-         case 0:   // Receive FE_MSG
-            if(tmp == 0x05)
-            {
-               bReceiveState = 1; 
-			   wDataLength = 0;
-               wReceive232Pos = 0;
-			   bHdrBytesRead = 0;
-
-			   bReceive232ElementArr[wReceive232Pos]=tmp;
-			   wReceive232Pos++;
-
-				#ifdef COMM_DEBUG
-					printf("\nI: ");
-					printf("%02X ", tmp);
-				#endif   
-            }
-			else if (tmp == 0x04) // HCI event	
-			{
-					bReceiveState = 11; 
-					wDataLength = 0;
-					wReceive232Pos = 0;
-					bHdrBytesRead = 0;
-
-					bReceive232ElementArr[wReceive232Pos]=tmp;
-					wReceive232Pos++; 	
-			} 
-            else
-            {
-                  #ifdef COMM_DEBUG
-                     printf("%02X ", tmp);
-                  #endif
-            }
-            break;
-
-		 case 1:   // Receive Header size = 6
-               #ifdef COMM_DEBUG
-                  printf("%02X ", tmp);
-               #endif
-			 bHdrBytesRead++;
-			 bReceive232ElementArr[wReceive232Pos] = tmp;
-			 wReceive232Pos++;
-
-			 if (bHdrBytesRead == 6)
-				 bReceiveState = 2;
-				
-			 break;
-		 case 2:   // Receive LSB of the length
-			#ifdef COMM_DEBUG
-				printf("%02X ", tmp);
-			#endif
-			wDataLength += tmp;
-            if(wDataLength > MAX_PACKET_LENGTH)
-            {
-                 bReceiveState = 0;
-            }
-            else
-			{
-				bReceive232ElementArr[wReceive232Pos] = tmp;
-				wReceive232Pos++;
-                bReceiveState = 3;
-			}
-          break;
-         case 3:   // Receive MSB of the length
-               #ifdef COMM_DEBUG
-                  printf("%02X ", tmp);
-               #endif
-            wDataLength += (unsigned short) (tmp*256);
-            if(wDataLength > MAX_PACKET_LENGTH)
-            {
-
-				#ifdef COMM_DEBUG
-					printf("\nSIZE: %d ", wDataLength);
-				#endif
-                bReceiveState = 0;
-            }
-			else if(wDataLength == 0)
-			{
-				#ifdef COMM_DEBUG
-					printf("\nSIZE: %d ", wDataLength);
-				#endif
-				SendToMain(0x05, (unsigned short) (wReceive232Pos-1), &bReceive232ElementArr[1]); // an FE msg
-                bReceiveState = 0;
-			}
-            else
-			{
-			   bReceive232ElementArr[wReceive232Pos] = tmp;
-			   wReceive232Pos++;
-               bReceiveState = 4;
-			}
-            break;
-         case 4:   // Receive Data
-			#ifdef COMM_DEBUG
-				printf("%02X ", tmp);
-            #endif
-            bReceive232ElementArr[wReceive232Pos] = tmp;
-            wReceive232Pos++;
-			
-            if(wReceive232Pos == wDataLength + 9 ) // 1 ( first byte - 0x05) + 2 (Type) + 2 (dstid) + 2 (srcid) + 2 (lengths size)
-            {
-               // Sendmail program
-               SendToMain(0x05, (unsigned short) (wReceive232Pos-1), &bReceive232ElementArr[1]); ///FE msg
-			   bReceiveState = 0;
-				#ifdef COMM_DEBUG
-					printf("\nSIZE: %d ", wDataLength);
-				#endif
-            }
-           break;
-
-			
-		 case 11:   // Receive HCI event type byte
-				bReceive232ElementArr[wReceive232Pos] = tmp;
-				wReceive232Pos++;
-
-				bReceiveState = 12;
-				break;
-	
-		 case 12:   // Receive HCI event length byte
-				wDataLength = tmp;
-				
-				if(wDataLength == 0)
-				{
-					bReceive232ElementArr[wReceive232Pos] = tmp;
-					wReceive232Pos++;
-
-					SendToMain(0x04, (unsigned short) (wReceive232Pos-1), &bReceive232ElementArr[1]);
-					bReceiveState = 0;
-				}
-				else
-				{
-					bReceive232ElementArr[wReceive232Pos] = tmp;
-					wReceive232Pos++;
-					bReceiveState = 13;
-				}
-				break;
-	
-		 case 13:   // Receive HCI event data
-				bReceive232ElementArr[wReceive232Pos] = tmp;
-				wReceive232Pos++;
-			
-				if(wReceive232Pos == wDataLength + 3 ) // 1 ( first byte - 0x01) + 1 (event) + 1 (length)
-				{
-					SendToMain(0x04, (unsigned short) (wReceive232Pos-1), &bReceive232ElementArr[1]);
-					bReceiveState = 0;
-				}
-				break;
-	}
-      
+         unsigned long kk;
+         for (kk = 0; kk < dwBytesRead; kk++)
+            printf("%02X ", bReceiveBuf[kk]);
+      }
+      #endif
+
+      UARTRxBytes(bReceiveBuf, dwBytesRead);
    }
 
    StopRxTask = TRUE;   // To indicate that the task has stopped
 
-   PurgeComm(hComPortHandle, PURGE_TXABORT | PURGE_RXABORT | PURGE_TXCLEAR | PURGE_RXCLEAR);
-
-   Sleep(100);
-
-   CloseHandle(hComPortHandle);
+   UARTPortClose(&UARTPort);
 
    ExitThread(0);
 }
@@ -295,15 +397,16 @@ void UARTProc(PVOID unused)
 
 /*
  ****************************************************************************************
- * @brief Init UART iface.
+ * @brief Open a port.
  *
- *  @param[in] Port			COM prot number.
+ *  @param[in] port			Port context.
+ *  @param[in] Port			COM prot number, UART_SIM_PORT for a simulated DUT.
  *  @param[in] BaudRate		Baud rate.
  *
  * @return -1 on failure / 0 on success.
  ****************************************************************************************
 */
-uint8_t InitUART(int Port, int BaudRate)
+uint8_t UARTPortOpen(uart_port_t *port, int Port, int BaudRate)
 {
    DCB dcb;
    DWORD dwErrorCode;
@@ -314,16 +417,29 @@ uint8_t InitUART(int Port, int BaudRate)
    char CPName[500];
    //DWORD dwEvtMask;
 
+   memset(port, 0, sizeof(uart_port_t));
+   port->port = -1;
+
+   if (Port == UART_SIM_PORT)
+   {
+      port->sim = dut_sim_open();
+      if (port->sim == NULL)
+         return -1;
+      port->port = Port;
+      port->baud_rate = BaudRate;
+      return 0;
+   }
+
    sprintf(CPName, "\\\\.\\COM%d", Port);
 
 #ifdef DEVELOPMENT_MESSAGES
    fprintf(stderr, "[info] Connecting to %s\n", &CPName[4]);
 #endif //DEVELOPMENT_MESSAGES
 
-   ovlRd.hEvent = CreateEvent( NULL,FALSE,FALSE,NULL );
-   ovlWr.hEvent = CreateEvent( NULL,FALSE,FALSE,NULL );
+   port->ovl_rd.hEvent = CreateEvent( NULL,FALSE,FALSE,NULL );
+   port->ovl_wr.hEvent = CreateEvent( NULL,FALSE,FALSE,NULL );
 
-   hComPortHandle = CreateFile(CPName,
+   port->handle = CreateFile(CPName,
                                GENERIC_WRITE | GENERIC_READ,
                                0, //FILE_SHARE_WRITE | FILE_SHARE_READ,
                                NULL,
@@ -331,7 +447,7 @@ uint8_t InitUART(int Port, int BaudRate)
                                FILE_FLAG_OVERLAPPED,
                                NULL );
 
-   if(hComPortHandle == INVALID_HANDLE_VALUE)
+   if(port->handle == INVALID_HANDLE_VALUE)
    {
       dwErrorCode = GetLastError();
       #ifdef RSX
@@ -340,10 +456,10 @@ uint8_t InitUART(int Port, int BaudRate)
       return -1;
    }
 
-   ClearCommError( hComPortHandle, &error, &stat );
+   ClearCommError( port->handle, &error, &stat );
    
    memset(&dcb, 0x0, sizeof(DCB) );
-   fSuccess = GetCommState(hComPortHandle, &dcb);
+   fSuccess = GetCommState(port->handle, &dcb);
    if(!fSuccess)
    {
       #ifdef RSX
@@ -361,6 +477,7 @@ uint8_t InitUART(int Port, int BaudRate)
    // disable all kind of flow control and error handling
    dcb.fOutxCtsFlow = 0;
    dcb.fOutxDsrFlow = 0;
+   // DTR and RTS start deasserted; linectl.c drives them to reset the DUT
    dcb.fRtsControl  = RTS_CONTROL_DISABLE;
    dcb.fDtrControl  = DTR_CONTROL_DISABLE;
    dcb.fInX         = 0;
@@ -369,7 +486,7 @@ uint8_t InitUART(int Port, int BaudRate)
    dcb.fNull        = 0;
    dcb.fAbortOnError = 0;
 
-   fSuccess = SetCommState(hComPortHandle, &dcb);
+   fSuccess = SetCommState(port->handle, &dcb);
    if(!fSuccess)
    {
 #ifdef DEVELOPMENT_MESSAGES
@@ -377,18 +494,76 @@ uint8_t InitUART(int Port, int BaudRate)
 #endif DEVELOPMENT_MESSAGES
 	   return -1;
    }
-  commtimeouts.ReadIntervalTimeout = 1000; 
-  commtimeouts.ReadTotalTimeoutMultiplier = 0; 
-  commtimeouts.ReadTotalTimeoutConstant = 0; 
+  // return from a read as soon as at least one byte is available, with everything
+  // received so far; an idle read gives up after a second and is simply reissued
+  commtimeouts.ReadIntervalTimeout = MAXDWORD; 
+  commtimeouts.ReadTotalTimeoutMultiplier = MAXDWORD; 
+  commtimeouts.ReadTotalTimeoutConstant = 1000; 
   commtimeouts.WriteTotalTimeoutMultiplier = 0; 
   commtimeouts.WriteTotalTimeoutConstant = 0;
 
-  fSuccess = SetCommTimeouts( hComPortHandle,
+  fSuccess = SetCommTimeouts( port->handle,
                               &commtimeouts );
  
 #ifdef DEVELOPMENT_MESSAGES
   fprintf(stderr, "[info] %s succesfully opened, baud rate %d\n", &CPName[4], BaudRate);
 #endif //DEVELOPMENT_MESSAGES
 
+   port->port = Port;
+   port->baud_rate = BaudRate;
+
    return 0;
 }
+
+/*
+ ****************************************************************************************
+ * @brief Close a port opened with UARTPortOpen().
+ ****************************************************************************************
+*/
+void UARTPortClose(uart_port_t *port)
+{
+   if (port->port < 0)
+      return;
+
+   if (port->sim != NULL)
+   {
+      dut_sim_close(port->sim);
+      port->sim = NULL;
+   }
+   else
+   {
+      PurgeComm(port->handle, PURGE_TXABORT | PURGE_RXABORT | PURGE_TXCLEAR | PURGE_RXCLEAR);
+
+      Sleep(100);
+
+      CloseHandle(port->handle);
+      CloseHandle(port->ovl_rd.hEvent);
+      CloseHandle(port->ovl_wr.hEvent);
+   }
+
+   port->port = -1;
+}
+
+/*
+ ****************************************************************************************
+ * @brief Init UART iface: open the port of the HCI commands.
+ *
+ *  @param[in] Port			COM prot number.
+ *  @param[in] BaudRate		Baud rate.
+ *
+ * @return -1 on failure / 0 on success.
+ ****************************************************************************************
+*/
+uint8_t InitUART(int Port, int BaudRate)
+{
+   // already open, e.g. by a firmware download before the command
+   if (Port == UARTPort.port)
+      return UARTPortSetBaudRate(&UARTPort, BaudRate);
+
+   return UARTPortOpen(&UARTPort, Port, BaudRate);
+}
+
+uart_port_t *UARTGetPort(void)
+{
+   return &UARTPort;
+}
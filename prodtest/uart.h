@@ -21,15 +21,51 @@
 #include <stdint.h>
 #include <windows.h>
 
-#define MAX_PACKET_LENGTH 350
-#define MIN_PACKET_LENGTH 9
+#include "stdbool.h"
+#include "hci_framer.h"
+#include "dut_sim.h"
 
+/* -p 0 selects the simulated DUT of dut_sim.c */
+#define UART_SIM_PORT 0
+
+/* control lines, see linectl.h */
+#define UART_LINE_DTR 0
+#define UART_LINE_RTS 1
+
+/* max. number of ports in a -p list, e.g. one per board of a fixture */
+#define UART_MAX_PORTS 32
+
+/* an open COM port, or a simulated DUT */
+typedef struct {
+	int        port;          // COM port number, -1 when closed
+	HANDLE     handle;
+	OVERLAPPED ovl_rd;
+	OVERLAPPED ovl_wr;
+	int        baud_rate;
+	dut_sim_t *sim;           // UART_SIM_PORT only
+} uart_port_t;
+
+uint8_t UARTPortOpen(uart_port_t *port, int Port, int BaudRate);
+void UARTPortClose(uart_port_t *port);
+void UARTPortWrite(uart_port_t *port, const uint8_t *data, unsigned long len);
+unsigned long UARTPortRead(uart_port_t *port, uint8_t *buf, unsigned long size, uint32_t millis);
+uint8_t UARTPortSetBaudRate(uart_port_t *port, int BaudRate);
+uint8_t UARTPortSetLine(uart_port_t *port, int line, bool on);
+BOOL UARTPortResetDUT(uart_port_t *port);
+
+/* the port of the HCI commands */
 uint8_t InitUART(int Port, int BaudRate);
+uart_port_t *UARTGetPort(void);
 
 VOID UARTProc(PVOID unused);
 
 void UARTSend(unsigned char payload_type, unsigned short payload_size, unsigned char *payload);
 
+void UARTWrite(const uint8_t *data, unsigned long len);
+unsigned long UARTRead(uint8_t *buf, unsigned long size, uint32_t millis);
+uint8_t UARTSetBaudRate(int BaudRate);
+BOOL UARTResetDUT(void);
+
 
 
 #endif /* _UART_H_ */